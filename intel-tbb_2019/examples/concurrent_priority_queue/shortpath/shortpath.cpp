@@ -27,6 +27,7 @@
 #include "tbb/task_scheduler_init.h"
 #include "tbb/task_group.h"
 #include "tbb/concurrent_priority_queue.h"
+#include "tbb/concurrent_relaxed_priority_queue.h"
 #include "tbb/spin_mutex.h"
 #include "tbb/parallel_for.h"
 #include "tbb/blocked_range.h"
@@ -80,6 +81,7 @@ typedef vector<vector<vertex_id> > edge_set;
 
 bool verbose = false;          // prints bin details and other diagnostics to screen
 bool silent = false;           // suppress all output except for time
+bool relaxed_queue = false;    // use the relaxed priority queue for the open set
 size_t N = 1000;               // number of vertices
 size_t src = 0;                // start of path
 size_t dst = N-1;              // end of path
@@ -87,6 +89,7 @@ double INF=100000.0;           // infinity
 size_t grainsize = 16;         // number of vertices per task on average
 size_t max_spawn;              // max tasks to spawn
 tbb::atomic<size_t> num_spawn;      // number of active tasks
+tbb::atomic<size_t> num_expanded;   // number of vertices taken from the open set and not pruned
 
 point_set vertices;            // vertices
 edge_set edges;                // edges
@@ -105,6 +108,16 @@ public:
 };
 
 concurrent_priority_queue<vertex_rec, compare_f> open_set; // tentative vertices
+concurrent_relaxed_priority_queue<vertex_rec, compare_f> relaxed_open_set; // tentative vertices in relaxed mode
+
+void open_set_push(const vertex_rec& v) {
+    if (relaxed_queue) relaxed_open_set.push(v);
+    else open_set.push(v);
+}
+
+bool open_set_try_pop(vertex_rec& v) {
+    return relaxed_queue ? relaxed_open_set.try_pop(v) : open_set.try_pop(v);
+}
 
 void shortpath_helper();
 
@@ -120,7 +133,7 @@ void shortpath() {
     sp_group = new task_group;
     g_distance[src] = 0.0; // src's distance from src is zero
     f_distance[src] = get_distance(vertices[src], vertices[dst]); // estimate distance from src to dst
-    open_set.push(make_pair(src,f_distance[src])); // push src into open_set
+    open_set_push(make_pair(src,f_distance[src])); // push src into open_set
 #if __TBB_CPP11_LAMBDAS_PRESENT
     sp_group->run([](){ shortpath_helper(); });
 #else
@@ -132,7 +145,7 @@ void shortpath() {
 
 void shortpath_helper() {
     vertex_rec u_rec;
-    while (open_set.try_pop(u_rec)) {
+    while (open_set_try_pop(u_rec)) {
         vertex_id u = u_rec.first;
         if (u==dst) continue;
         double f = u_rec.second;
@@ -142,6 +155,7 @@ void shortpath_helper() {
             if (f > f_distance[u]) continue; // prune search space
             old_g_u = g_distance[u];
         }
+        ++num_expanded;
         for (size_t i=0; i<edges[u].size(); ++i) {
             vertex_id v = edges[u][i];
             double new_g_v = old_g_u + get_distance(vertices[u], vertices[v]);
@@ -158,7 +172,7 @@ void shortpath_helper() {
                 }
             }
             if (push) {
-                open_set.push(make_pair(v,new_f_v));
+                open_set_push(make_pair(v,new_f_v));
                 size_t n_spawn = ++num_spawn;
                 if (n_spawn < max_spawn) {
 #if __TBB_CPP11_LAMBDAS_PRESENT
@@ -324,12 +338,14 @@ int main(int argc, char *argv[]) {
                                      .arg(N,"N","         number of vertices")
                                      .arg(src,"start","      start of path")
                                      .arg(dst,"end","        end of path")
+                                     .arg(relaxed_queue,"relaxed","    use the relaxed priority queue for the open set")
         );
         if (silent) verbose = false;  // make silent override verbose
         else
             printf("shortpath will run with %d vertices to find shortest path between vertices"
-                   " %d and %d using %d:%d threads.\n",
-                   (int)N, (int)src, (int)dst, (int)threads.first, (int)threads.last);
+                   " %d and %d using %d:%d threads%s.\n",
+                   (int)N, (int)src, (int)dst, (int)threads.first, (int)threads.last,
+                   relaxed_queue ? " and the relaxed priority queue" : "");
 
         if (dst >= N) {
             if (verbose)
@@ -343,6 +359,7 @@ int main(int argc, char *argv[]) {
         InitializeGraph();
         for (int n_thr=threads.first; n_thr<=threads.last; n_thr=threads.step(n_thr)) {
             ResetGraph();
+            num_expanded = 0;
             task_scheduler_init init(n_thr);
             t0 = tick_count::now();
             shortpath();
@@ -357,6 +374,8 @@ int main(int argc, char *argv[]) {
                     printf("%d threads: [%6.6f] There is no path from vertex %d to vertex %d\n",
                            (int)n_thr, (t1-t0).seconds(), (int)src, (int)dst);
                 }
+                printf("%d threads: %d vertices expanded using the %s queue\n",
+                       (int)n_thr, (int)num_expanded, relaxed_queue ? "relaxed" : "exact");
             } else
                 utility::report_elapsed_time((t1-t0).seconds());
         }
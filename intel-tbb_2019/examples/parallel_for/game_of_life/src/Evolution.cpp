@@ -237,7 +237,11 @@ void ParallelEvolution::Step()
     //! set matrix pointers
     tbb_parallel_task::set_values(m_matrix, m_dest);
 
+    //! keeps the rows on the threads that computed them in the previous
+    //! generations, also when Run() is called with another number of threads
+    static tbb::affinity_partitioner affinity(tbb::affinity_partitioner::replay_by_fraction);
+
     //! do calculation loop
-    parallel_for (tbb::blocked_range<size_t> (begin, end, GRAIN_SIZE), tbb_parallel_task());
+    parallel_for (tbb::blocked_range<size_t> (begin, end, GRAIN_SIZE), tbb_parallel_task(), affinity);
     UpdateMatrix();
 }
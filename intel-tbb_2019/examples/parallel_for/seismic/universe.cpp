@@ -200,8 +200,10 @@ void Universe::ParallelUpdateUniverse() {
     /** Affinity is an argument to parallel_for to hint that an iteration of a loop
     is best replayed on the same processor for each execution of the loop.
     It is a static object because it must remember where the iterations happened
-    in previous executions. */
-    static tbb::affinity_partitioner affinity;
+    in previous executions. The stress and velocity loops cover different rows,
+    and the console mode runs them with a range of thread numbers, so the affinities
+    are replayed by the fractions of the universe rather than by the tasks. */
+    static tbb::affinity_partitioner affinity(tbb::affinity_partitioner::replay_by_fraction);
     UpdatePulse();
     ParallelUpdateStress(affinity);
     ParallelUpdateVelocity(affinity);
@@ -0,0 +1,623 @@
+/*
+    Copyright (c) 2005-2019 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+#ifndef __TBB_concurrent_flat_hash_map_H
+#define __TBB_concurrent_flat_hash_map_H
+
+#include "tbb_stddef.h"
+#include <utility>      // Need std::pair
+#include <cstring>      // Need std::memset
+#include __TBB_STD_SWAP_HEADER
+
+#include "tbb_allocator.h"
+#include "spin_mutex.h"
+#include "atomic.h"
+#include "aligned_space.h"
+#include "tbb_machine.h"
+#include "internal/_tbb_hash_compare_impl.h"
+#include "internal/_allocator_traits.h"
+#if __TBB_CPP11_TYPE_PROPERTIES_PRESENT
+#include <type_traits>
+#endif
+
+#if __SSE2__ || _M_X64 || _M_AMD64 || (_M_IX86_FP >= 2)
+    #define __TBB_FLAT_HASH_MAP_SSE2 1
+    #include <emmintrin.h>
+#else
+    #define __TBB_FLAT_HASH_MAP_SSE2 0
+#endif
+
+namespace tbb {
+
+namespace interface5 {
+
+    template<typename Key, typename T, typename HashCompare = tbb_hash_compare<Key>, typename A = tbb_allocator<std::pair<Key, T> > >
+    class concurrent_flat_hash_map;
+
+    //! @cond INTERNAL
+    namespace internal {
+    using namespace tbb::internal;
+
+    //! Number of slots in a group, which is probed and validated as a whole
+    static const size_t flat_group_size = 16;
+    //! Control byte of a slot that has never been used
+    static const unsigned char flat_ctrl_empty = 0x80;
+    //! Control byte of a slot whose item was erased
+    static const unsigned char flat_ctrl_deleted = 0xFE;
+
+    //! Returns the mask of the control bytes of a group that are equal to b
+    inline unsigned flat_group_match( const unsigned char* ctrl, unsigned char b ) {
+#if __TBB_FLAT_HASH_MAP_SSE2
+        const __m128i bytes = _mm_loadu_si128( reinterpret_cast<const __m128i*>(ctrl) );
+        return unsigned( _mm_movemask_epi8( _mm_cmpeq_epi8( bytes, _mm_set1_epi8( char(b) ) ) ) );
+#else
+        unsigned mask = 0;
+        for( size_t i = 0; i < flat_group_size; ++i )
+            if( ctrl[i] == b ) mask |= 1u << i;
+        return mask;
+#endif
+    }
+
+    //! Returns the mask of the control bytes of a group that are empty or deleted
+    inline unsigned flat_group_match_free( const unsigned char* ctrl ) {
+#if __TBB_FLAT_HASH_MAP_SSE2
+        // The free control bytes are the only ones with the high bit set
+        return unsigned( _mm_movemask_epi8( _mm_loadu_si128( reinterpret_cast<const __m128i*>(ctrl) ) ) );
+#else
+        unsigned mask = 0;
+        for( size_t i = 0; i < flat_group_size; ++i )
+            if( ctrl[i] & 0x80 ) mask |= 1u << i;
+        return mask;
+#endif
+    }
+
+    //! Returns the index of the lowest bit set in a nonzero mask
+    inline size_t flat_lowest_bit( unsigned mask ) {
+        __TBB_ASSERT( mask, NULL );
+        size_t i = 0;
+        for( ; !(mask & 1); mask >>= 1 ) ++i;
+        return i;
+    }
+
+    //! Group of slots with their control bytes and the sequence lock that guards them.
+    /** The version is odd while a writer holds the group. The moved flag is set when
+        the items of the group are copied to the next table; after that the group never changes. **/
+    template<typename Slot>
+    struct flat_hash_group {
+        static const size_t locked = 1;
+        static const size_t moved = 2;
+        static const size_t version_step = 4;
+        atomic<size_t> version;
+        unsigned char ctrl[flat_group_size];
+        aligned_space<Slot, flat_group_size> slots;
+
+        Slot& slot( size_t i ) const { return slots.begin()[i]; }
+
+        //! Locks the group for writing; returns false if the group was moved.
+        bool lock() {
+            for( atomic_backoff backoff;; backoff.pause() ) {
+                size_t v = version;
+                if( v & moved ) return false;
+                if( !(v & locked) && version.compare_and_swap( v | locked, v ) == v )
+                    return true;
+            }
+        }
+        void unlock() {
+            version = (version & ~locked) + version_step;
+        }
+        void unlock_moved() {
+            version = ((version & ~locked) + version_step) | moved;
+        }
+        //! Waits until no writer holds the group and returns the version read.
+        size_t read_begin() const {
+            size_t v = version;
+            for( atomic_backoff backoff; v & locked; v = version )
+                backoff.pause();
+            return v;
+        }
+        bool read_validate( size_t v ) const {
+            atomic_fence();
+            return version == v;
+        }
+    };
+
+    //! Open-addressing table of the groups; tables of a map are linked while the items move to the larger one.
+    template<typename Group>
+    struct flat_hash_table {
+        Group* groups;
+        //! Number of groups - 1; the number of groups is a power of two
+        size_t mask;
+        //! Number of slots that are not empty, i.e. full or deleted
+        atomic<size_t> used;
+        //! Number of used slots at which the table grows
+        size_t threshold;
+        //! The table the items are moved to, or NULL
+        atomic<flat_hash_table*> next;
+        //! Next group to move
+        atomic<size_t> migrate_cursor;
+        //! Number of groups moved
+        atomic<size_t> migrated;
+        //! The table that was retired before this one
+        flat_hash_table* retired;
+    };
+
+    } // namespace internal
+    //! @endcond
+
+//! Concurrent open-addressing hash map with lock-free lookups.
+/** The items are stored in place in groups of 16 slots, and every slot has a control byte
+    that holds 7 bits of the hash code of its key. A lookup compares the control bytes of a
+    whole group at once (with SSE2 when available), and reads the group under its sequence
+    lock, so it takes no lock and retries only if a writer changed the group meanwhile.
+    Writers of the same key are serialized by a striped lock. The table grows incrementally:
+    a larger table is linked to the current one, and every modifying operation moves a couple
+    of groups to it until the old table is empty; lookups search both tables meanwhile.
+
+    Key and T must be trivially copyable, as a lookup may copy an item being overwritten before
+    it detects the conflict. The methods that are not thread-safe are noted below.
+    There are no iterators; the map is meant for lookup tables with mostly read accesses.
+    The hash code should spread over the high bits too; tbb_hash_compare does it.
+@ingroup containers */
+template<typename Key, typename T, typename HashCompare, typename Allocator>
+class concurrent_flat_hash_map : HashCompare {
+#if __TBB_CPP11_TYPE_PROPERTIES_PRESENT
+    __TBB_STATIC_ASSERT( std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<T>::value,
+                         "concurrent_flat_hash_map requires trivially copyable keys and values" );
+#endif
+public:
+    typedef Key key_type;
+    typedef T mapped_type;
+    typedef std::pair<Key, T> value_type;
+    typedef size_t size_type;
+    typedef HashCompare hasher;
+    typedef Allocator allocator_type;
+
+private:
+    struct slot_type {
+        Key first;
+        T second;
+    };
+    typedef internal::flat_hash_group<slot_type> group_type;
+    typedef internal::flat_hash_table<group_type> table_type;
+    typedef typename tbb::internal::allocator_rebind<Allocator, group_type>::type group_allocator_type;
+    typedef typename tbb::internal::allocator_rebind<Allocator, table_type>::type table_allocator_type;
+    typedef tbb::internal::allocator_traits<group_allocator_type> group_allocator_traits;
+    typedef tbb::internal::allocator_traits<table_allocator_type> table_allocator_traits;
+
+    //! Number of the stripes of the writer lock
+    static const size_t stripe_count = 64;
+    //! Number of groups a modifying operation moves to the next table
+    static const size_t migrate_step = 2;
+
+    typedef tbb::internal::padded<spin_mutex> stripe_type;
+
+    group_allocator_type my_allocator;
+    //! The oldest table that still has items
+    atomic<table_type*> my_table;
+    //! The table the new items are inserted to
+    atomic<table_type*> my_tail;
+    //! Number of items
+    atomic<size_type> my_size;
+    //! Serializes the growth of the map
+    spin_mutex my_grow_mutex;
+    stripe_type my_stripes[stripe_count];
+
+    //! Position of an item found by the writer
+    struct position {
+        table_type* table;
+        size_t group;
+        size_t slot;
+    };
+
+    static unsigned char tag_of( size_t h ) {
+        return (unsigned char)( h >> (sizeof(size_t)*8 - 7) );
+    }
+
+    static size_t groups_for( size_type n ) {
+        // Items fill at most a half of the new table
+        size_t groups = 1;
+        while( groups * internal::flat_group_size < n * 2 )
+            groups <<= 1;
+        return groups;
+    }
+
+    table_type* allocate_table( size_t groups ) {
+        table_allocator_type table_allocator( my_allocator );
+        table_type* t = table_allocator_traits::allocate( table_allocator, 1 );
+        t->groups = group_allocator_traits::allocate( my_allocator, groups );
+        for( size_t i = 0; i < groups; ++i ) {
+            t->groups[i].version = 0;
+            std::memset( t->groups[i].ctrl, internal::flat_ctrl_empty, internal::flat_group_size );
+        }
+        t->mask = groups - 1;
+        t->used = 0;
+        t->threshold = groups * internal::flat_group_size / 8 * 7;
+        t->next = NULL;
+        t->migrate_cursor = 0;
+        t->migrated = 0;
+        t->retired = NULL;
+        return t;
+    }
+
+    void deallocate_table( table_type* t ) {
+        group_allocator_traits::deallocate( my_allocator, t->groups, t->mask + 1 );
+        table_allocator_type table_allocator( my_allocator );
+        table_allocator_traits::deallocate( table_allocator, t, 1 );
+    }
+
+    //! Frees the tail table and all the tables retired before it. Not thread-safe.
+    void delete_tables() {
+        table_type* t = my_tail;
+        while( t ) {
+            table_type* retired = t->retired;
+            deallocate_table( t );
+            t = retired;
+        }
+        my_table = my_tail = NULL;
+    }
+
+    spin_mutex& stripe_of( size_t h ) {
+        // The low bits select the group, so take the stripe from the bits below the tag
+        return my_stripes[(h >> (sizeof(size_t)*8 - 13)) % stripe_count];
+    }
+
+    //! Looks for the key in a table without locking; returns true if found and copies the value.
+    bool find_in_table( table_type* t, const Key& key, size_t h, T& result ) const {
+        const unsigned char tag = tag_of( h );
+        size_t g = h & t->mask;
+        for( size_t step = 0; step <= t->mask; g = (g + ++step) & t->mask ) {
+            const group_type& group = t->groups[g];
+            for(;;) {
+                const size_t v = group.read_begin();
+                unsigned char ctrl[internal::flat_group_size];
+                std::memcpy( ctrl, group.ctrl, internal::flat_group_size );
+                bool found = false;
+                T value;
+                if( !(v & group_type::moved) ) {
+                    for( unsigned m = internal::flat_group_match( ctrl, tag ); m; m &= m - 1 ) {
+                        const slot_type& s = group.slot( internal::flat_lowest_bit( m ) );
+                        const Key k = s.first;
+                        if( this->equal( k, key ) ) {
+                            value = s.second;
+                            found = true;
+                            break;
+                        }
+                    }
+                }
+                // Otherwise the items of the group are in the next table already,
+                // but the group still tells whether the probing goes on
+                if( !group.read_validate( v ) )
+                    continue;
+                if( found ) {
+                    result = value;
+                    return true;
+                }
+                if( internal::flat_group_match( ctrl, internal::flat_ctrl_empty ) )
+                    return false;
+                break;
+            }
+        }
+        return false;
+    }
+
+    //! Looks for the key in all the tables. The caller holds the stripe of the key.
+    bool find_for_write( const Key& key, size_t h, position& pos ) {
+        const unsigned char tag = tag_of( h );
+        for( table_type* t = my_table; t; t = t->next ) {
+            size_t g = h & t->mask;
+            for( size_t step = 0; step <= t->mask; g = (g + ++step) & t->mask ) {
+                group_type& group = t->groups[g];
+                // Writers of this key wait for the stripe, so only the moved flag may change
+                if( !(group.version & group_type::moved) ) {
+                    for( unsigned m = internal::flat_group_match( group.ctrl, tag ); m; m &= m - 1 ) {
+                        const size_t i = internal::flat_lowest_bit( m );
+                        if( this->equal( group.slot( i ).first, key ) ) {
+                            pos.table = t; pos.group = g; pos.slot = i;
+                            return true;
+                        }
+                    }
+                }
+                if( internal::flat_group_match( group.ctrl, internal::flat_ctrl_empty ) )
+                    break;
+            }
+        }
+        return false;
+    }
+
+    //! Locks the group of the item found; returns false if the item was moved or misread.
+    bool lock_item( const position& pos, const Key& key, size_t h ) {
+        group_type& group = pos.table->groups[pos.group];
+        if( !group.lock() )
+            return false;
+        // The search reads the slots other writers may change, so check the item under the lock
+        if( group.ctrl[pos.slot] == tag_of( h ) && this->equal( group.slot( pos.slot ).first, key ) )
+            return true;
+        group.unlock();
+        return false;
+    }
+
+    //! Puts the item to a free slot of the table; returns false if the table was replaced meanwhile.
+    bool insert_to_table( table_type* t, size_t h, const Key& key, const T& value ) {
+        size_t g = h & t->mask;
+        for( size_t step = 0; step <= t->mask; g = (g + ++step) & t->mask ) {
+            group_type& group = t->groups[g];
+            if( !group.lock() )
+                return false;
+            const unsigned free = internal::flat_group_match_free( group.ctrl );
+            if( free ) {
+                const size_t i = internal::flat_lowest_bit( free );
+                if( group.ctrl[i] == internal::flat_ctrl_empty )
+                    ++t->used;
+                slot_type& s = group.slot( i );
+                s.first = key;
+                s.second = value;
+                group.ctrl[i] = tag_of( h );
+                group.unlock();
+                return true;
+            }
+            group.unlock();
+        }
+        __TBB_ASSERT( false, "No free slot in a table" );
+        return false;
+    }
+
+    //! Moves the items of the group to the next table.
+    void migrate_group( table_type* t, size_t g ) {
+        group_type& group = t->groups[g];
+        bool locked = group.lock();
+        __TBB_ASSERT_EX( locked, "The group is moved twice" );
+        table_type* next = t->next;
+        for( unsigned m = ~internal::flat_group_match_free( group.ctrl ) & 0xFFFF; m; m &= m - 1 ) {
+            const slot_type& s = group.slot( internal::flat_lowest_bit( m ) );
+            bool inserted = insert_to_table( next, this->hash( s.first ), s.first, s.second );
+            __TBB_ASSERT_EX( inserted, "The next table is replaced during the migration" );
+        }
+        group.unlock_moved();
+        if( ++t->migrated == t->mask + 1 ) {
+            // The old table is left for the lookups that still read it, until the map is cleared
+            my_table = next;
+        }
+    }
+
+    //! Moves at most n groups of the oldest table to the next one.
+    void help_migrate( size_t n ) {
+        table_type* t = my_table;
+        if( !t->next )
+            return;
+        for( ; n; --n ) {
+            const size_t g = t->migrate_cursor.fetch_and_increment();
+            if( g > t->mask )
+                return;
+            migrate_group( t, g );
+        }
+    }
+
+    //! Completes the migration in progress, if any.
+    void finish_migration() {
+        help_migrate( ~size_t(0) );
+        // Other threads may still be moving their groups
+        for( tbb::internal::atomic_backoff backoff; my_table != my_tail; )
+            backoff.pause();
+    }
+
+    //! Links a larger table, if the tail table is still full.
+    void grow( table_type* full ) {
+        spin_mutex::scoped_lock lock( my_grow_mutex );
+        if( my_tail != full )
+            return;
+        finish_migration();
+        table_type* next = allocate_table( groups_for( my_size + 1 ) );
+        next->retired = full;
+        full->next = next;
+        my_tail = next;
+    }
+
+    //! Inserts the item if the key is absent, or assigns its value if assign is set.
+    bool internal_insert( const Key& key, const T& value, bool assign ) {
+        const size_t h = this->hash( key );
+        spin_mutex::scoped_lock stripe( stripe_of( h ) );
+        for(;;) {
+            help_migrate( migrate_step );
+            position pos;
+            if( find_for_write( key, h, pos ) ) {
+                if( !assign )
+                    return false;
+                if( !lock_item( pos, key, h ) )
+                    continue;
+                group_type& group = pos.table->groups[pos.group];
+                group.slot( pos.slot ).second = value;
+                group.unlock();
+                return false;
+            }
+            table_type* t = my_tail;
+            if( t->used >= t->threshold ) {
+                grow( t );
+                continue;
+            }
+            if( insert_to_table( t, h, key, value ) ) {
+                ++my_size;
+                return true;
+            }
+        }
+    }
+
+    //! Copies the items of the map to a new table that holds n items without growing. Not thread-safe.
+    table_type* copy_items( const concurrent_flat_hash_map& source, size_type n ) {
+        table_type* t = allocate_table( groups_for( n > source.my_size ? n : size_type(source.my_size) ) );
+        for( table_type* s = source.my_table; s; s = s->next )
+            for( size_t g = 0; g <= s->mask; ++g ) {
+                group_type& group = s->groups[g];
+                if( group.version & group_type::moved )
+                    continue;
+                for( unsigned m = ~internal::flat_group_match_free( group.ctrl ) & 0xFFFF; m; m &= m - 1 ) {
+                    const slot_type& item = group.slot( internal::flat_lowest_bit( m ) );
+                    insert_to_table( t, this->hash( item.first ), item.first, item.second );
+                }
+            }
+        return t;
+    }
+
+public:
+    //! Constructs an empty map that holds n items without growing
+    explicit concurrent_flat_hash_map( size_type n = 0, const HashCompare& compare = HashCompare(), const allocator_type& a = allocator_type() )
+        : HashCompare( compare ), my_allocator( a )
+    {
+        my_size = 0;
+        my_table = my_tail = allocate_table( groups_for( n ) );
+    }
+
+    //! Copy constructor. Not thread-safe.
+    concurrent_flat_hash_map( const concurrent_flat_hash_map& source )
+        : HashCompare( source ), my_allocator( source.my_allocator )
+    {
+        my_size = size_type(source.my_size);
+        my_table = my_tail = copy_items( source, 0 );
+    }
+
+    //! Assignment. Not thread-safe.
+    concurrent_flat_hash_map& operator=( const concurrent_flat_hash_map& source ) {
+        if( this != &source ) {
+            table_type* t = copy_items( source, 0 );
+            delete_tables();
+            my_table = my_tail = t;
+            my_size = size_type(source.my_size);
+        }
+        return *this;
+    }
+
+    ~concurrent_flat_hash_map() { delete_tables(); }
+
+    //! Inserts the item if its key is absent; returns true if inserted.
+    bool insert( const value_type& value ) { return internal_insert( value.first, value.second, false ); }
+
+    //! Inserts the item if its key is absent; returns true if inserted.
+    bool insert( const Key& key, const T& value ) { return internal_insert( key, value, false ); }
+
+    //! Inserts the item, or assigns the value of the item with the same key; returns true if inserted.
+    bool insert_or_assign( const Key& key, const T& value ) { return internal_insert( key, value, true ); }
+
+    //! Copies the value of the key to result without locking; returns false if the key is absent.
+    bool find( const Key& key, T& result ) const {
+        const size_t h = this->hash( key );
+        // The tables are searched from the oldest, as an item moves only to a newer one
+        for( table_type* t = my_table; t; t = t->next )
+            if( find_in_table( t, key, h, result ) )
+                return true;
+        return false;
+    }
+
+    //! Returns the number of the items with the key, i.e. 0 or 1, without locking.
+    size_type count( const Key& key ) const {
+        T value;
+        return find( key, value ) ? 1 : 0;
+    }
+
+    //! Calls f(value) for the value of the key while the readers of its group wait; returns false if the key is absent.
+    /** The readers retry while f runs, so it should be short and must not access the map. **/
+    template<typename F>
+    bool update( const Key& key, F f ) {
+        const size_t h = this->hash( key );
+        spin_mutex::scoped_lock stripe( stripe_of( h ) );
+        for(;;) {
+            help_migrate( migrate_step );
+            position pos;
+            if( !find_for_write( key, h, pos ) )
+                return false;
+            if( !lock_item( pos, key, h ) )
+                continue;
+            group_type& group = pos.table->groups[pos.group];
+            f( group.slot( pos.slot ).second );
+            group.unlock();
+            return true;
+        }
+    }
+
+    //! Erases the item with the key; returns true if it was present.
+    bool erase( const Key& key ) {
+        const size_t h = this->hash( key );
+        spin_mutex::scoped_lock stripe( stripe_of( h ) );
+        for(;;) {
+            help_migrate( migrate_step );
+            position pos;
+            if( !find_for_write( key, h, pos ) )
+                return false;
+            if( !lock_item( pos, key, h ) )
+                continue;
+            group_type& group = pos.table->groups[pos.group];
+            group.ctrl[pos.slot] = internal::flat_ctrl_deleted;
+            group.unlock();
+            --my_size;
+            return true;
+        }
+    }
+
+    //! Number of items in the map
+    size_type size() const { return my_size; }
+
+    //! True if the map is empty
+    bool empty() const { return my_size == 0; }
+
+    //! Number of slots of the table the new items are inserted to
+    size_type bucket_count() const { return (my_tail->mask + 1) * internal::flat_group_size; }
+
+    //! Rebuilds the table so that it holds n items without growing, and drops the erased ones. Not thread-safe.
+    void rehash( size_type n = 0 ) {
+        table_type* t = copy_items( *this, n );
+        delete_tables();
+        my_table = my_tail = t;
+    }
+
+    //! Same as rehash(n). Not thread-safe.
+    void reserve( size_type n ) { rehash( n ); }
+
+    //! Erases all the items and frees the retired tables. Not thread-safe.
+    void clear() {
+        delete_tables();
+        my_size = 0;
+        my_table = my_tail = allocate_table( 1 );
+    }
+
+    //! Swaps the contents with the other map. Not thread-safe.
+    void swap( concurrent_flat_hash_map& other ) {
+        using std::swap;
+        swap( my_allocator, other.my_allocator );
+        swap( static_cast<HashCompare&>(*this), static_cast<HashCompare&>(other) );
+        table_type* t = my_table; my_table = other.my_table; other.my_table = t;
+        t = my_tail; my_tail = other.my_tail; other.my_tail = t;
+        size_type s = my_size; my_size = other.my_size; other.my_size = s;
+    }
+
+    //! Returns a copy of the allocator
+    allocator_type get_allocator() const { return allocator_type( my_allocator ); }
+};
+
+} // namespace interface5
+
+using interface5::concurrent_flat_hash_map;
+
+template<typename Key, typename T, typename HashCompare, typename A>
+inline void swap( concurrent_flat_hash_map<Key, T, HashCompare, A>& a, concurrent_flat_hash_map<Key, T, HashCompare, A>& b )
+{    a.swap( b ); }
+
+} // namespace tbb
+
+#undef __TBB_FLAT_HASH_MAP_SSE2
+
+#endif /* __TBB_concurrent_flat_hash_map_H */
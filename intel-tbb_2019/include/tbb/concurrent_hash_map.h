@@ -29,6 +29,7 @@
 
 #include "tbb_allocator.h"
 #include "spin_rw_mutex.h"
+#include "spin_mutex.h"
 #include "atomic.h"
 #include "tbb_exception.h"
 #include "tbb_profiling.h"
@@ -36,6 +37,7 @@
 #include "internal/_tbb_hash_compare_impl.h"
 #include "internal/_template_helpers.h"
 #include "internal/_allocator_traits.h"
+#include "internal/_epoch_reclamation.h"
 #if __TBB_INITIALIZER_LISTS_PRESENT
 #include <initializer_list>
 #endif
@@ -45,6 +47,9 @@
 #if __TBB_STATISTICS
 #include <stdio.h>
 #endif
+#if __TBB_CPP11_TYPE_PROPERTIES_PRESENT
+#include <type_traits>
+#endif
 #if __TBB_CPP11_RVALUE_REF_PRESENT && __TBB_CPP11_VARIADIC_TEMPLATES_PRESENT && __TBB_CPP11_TUPLE_PRESENT
 // Definition of __TBB_CPP11_RVALUE_REF_PRESENT includes __TBB_CPP11_TUPLE_PRESENT
 // for most of platforms, tuple present macro was added for logical correctness
@@ -74,11 +79,17 @@ namespace interface5 {
         //! Next node in chain
         hash_map_node_base *next;
         mutex_t mutex;
+        //! Twice the number of writes through accessors; odd while an accessor writes
+        /** The lock-free readers check that it did not change while they copied the item. **/
+        atomic<size_t> version;
+        hash_map_node_base() { version = 0; }
     };
     //! Incompleteness flag value
     static hash_map_node_base *const rehash_req = reinterpret_cast<hash_map_node_base*>(size_t(3));
     //! Rehashed empty bucket flag
     static hash_map_node_base *const empty_rehashed = reinterpret_cast<hash_map_node_base*>(size_t(0));
+    //! Flag of a bucket whose items are moved to its parent by the shrinking of the table
+    static hash_map_node_base *const merged_to_parent = reinterpret_cast<hash_map_node_base*>(size_t(2));
     //! base class of concurrent_hash_map
     class hash_map_base {
     public:
@@ -111,6 +122,10 @@ namespace interface5 {
         typedef bucket *segment_ptr_t;
         //! Segment pointers table type
         typedef segment_ptr_t segments_table_t[pointers_per_table];
+        //! Number of buckets an operation rehashes or merges when it helps to resize the table
+        static size_type const resize_step = 32;
+        //! One of that many insertions and erasures helps to resize the table
+        static size_type const resize_help_period = 8;
         //! Hash mask = sum of allocated segment sizes - 1
         atomic<hashcode_t> my_mask;
         //! Segment pointers table. Also prevents false sharing between my_mask and my_size
@@ -119,6 +134,22 @@ namespace interface5 {
         atomic<size_type> my_size; // It must be in separate cache line from my_mask due to performance effects
         //! Zero segment
         bucket my_embedded_segment[embedded_buckets];
+        //! Number of the bucket rehashings started and finished
+        /** A lock-free reader that misses the key trusts the miss only if no rehashing moved items meanwhile. **/
+        atomic<size_type> my_rehashes_started, my_rehashes_finished;
+        //! Set when the table is first read without locks; the erased items are retired rather than freed since then
+        atomic<bool> my_lock_free_reads;
+        //! Segments above the mask that the shrinking kept for the operations that still use the former mask
+        /** The growth reuses them; the methods that are not concurrency-safe free them. **/
+        segments_table_t my_parked;
+        //! The table does not shrink below this mask, which covers the buckets requested by the constructor or rehash()
+        hashcode_t my_min_mask;
+        //! Serializes the incremental rehashing and shrinking; the operations help only while it is free
+        spin_mutex my_resize_mutex;
+        //! Next bucket of the top segment to merge into its parent while the segment is released, 0 otherwise
+        atomic<hashcode_t> my_shrink_next;
+        //! Next bucket to check for the pending rehashing
+        atomic<hashcode_t> my_rehash_next;
 #if __TBB_STATISTICS
         atomic<unsigned> my_info_resizes; // concurrent ones
         mutable atomic<unsigned> my_info_restarts; // race collisions
@@ -126,12 +157,18 @@ namespace interface5 {
 #endif
         //! Constructor
         hash_map_base() {
-            std::memset( this, 0, pointers_per_table*sizeof(segment_ptr_t) // 32*4=128   or 64*8=512
+            std::memset( static_cast<void*>(this), 0, pointers_per_table*sizeof(segment_ptr_t) // 32*4=128   or 64*8=512
                 + sizeof(my_size) + sizeof(my_mask)  // 4+4 or 8+8
                 + embedded_buckets*sizeof(bucket) ); // n*8 or n*16
             for( size_type i = 0; i < embedded_block; i++ ) // fill the table
                 my_table[i] = my_embedded_segment + segment_base(i);
             my_mask = embedded_buckets - 1;
+            my_rehashes_started = my_rehashes_finished = 0;
+            my_lock_free_reads = false;
+            std::memset( my_parked, 0, sizeof(my_parked) );
+            my_min_mask = (hashcode_t(1)<<first_block) - 1;
+            my_shrink_next = 0;
+            my_rehash_next = embedded_buckets;
             __TBB_ASSERT( embedded_block <= first_block, "The first block number must include embedded blocks");
 #if __TBB_STATISTICS
             my_info_resizes = 0; // concurrent ones
@@ -173,7 +210,8 @@ namespace interface5 {
         static void add_to_bucket( bucket *b, node_base *n ) {
             __TBB_ASSERT(b->node_list != rehash_req, NULL);
             n->next = b->node_list;
-            b->node_list = n; // its under lock and flag is set
+            // its under lock and flag is set; the release publishes the node to the lock-free readers
+            __TBB_store_with_release( b->node_list, n );
         }
 
         //! Exception safety helper
@@ -192,6 +230,10 @@ namespace interface5 {
             typedef tbb::internal::allocator_traits<bucket_allocator_type> bucket_allocator_traits;
             bucket_allocator_type bucket_allocator(allocator);
             __TBB_ASSERT( k, "Zero segment must be embedded" );
+            if( is_valid( my_table[k] ) ) { // kept by the shrinking
+                reuse_segment( k, is_initial );
+                return;
+            }
             enable_segment_failsafe watchdog( my_table, k );
             size_type sz;
             __TBB_ASSERT( !is_valid(my_table[k]), "Wrong concurrent assignment");
@@ -214,6 +256,21 @@ namespace interface5 {
             watchdog.my_segment_ptr = 0;
         }
 
+        //! Enable the claimed segment that the shrinking kept
+        void reuse_segment( segment_index_t k, bool is_initial ) {
+            __TBB_ASSERT( k >= first_block && !my_parked[k], "The segment must be claimed" );
+            // No shrinking starts until the buckets are marked
+            spin_mutex::scoped_lock lock( my_resize_mutex );
+            // The buckets stay merged until the mask is published, so that the operations with the former
+            // mask, which is the same, do not rehash them before the others can see it
+            itt_store_word_with_release( my_mask, (segment_size( k )<<1) - 1 );
+            segment_ptr_t ptr = my_table[k];
+            for( size_type i = 0; i < segment_size( k ); i++ )
+                __TBB_store_with_release( ptr[i].node_list, is_initial ? empty_rehashed : rehash_req );
+            if( my_rehash_next > segment_base( k ) )
+                my_rehash_next = segment_base( k );
+        }
+
         template<typename Allocator>
         void delete_segment(segment_index_t s, const Allocator& allocator) {
             typedef typename tbb::internal::allocator_rebind<Allocator, bucket>::type bucket_allocator_type;
@@ -254,8 +311,10 @@ namespace interface5 {
         inline bool check_mask_race( const hashcode_t h, hashcode_t &m ) const {
             hashcode_t m_now, m_old = m;
             m_now = (hashcode_t) itt_load_word_with_acquire( my_mask );
-            if( m_old != m_now )
+            if( m_old < m_now )
                 return check_rehashing_collision( h, m_old, m = m_now );
+            // The table has shrunk: the items are merged into the bucket that was locked, see bucket_accessor
+            m = m_now;
             return false;
         }
 
@@ -270,7 +329,8 @@ namespace interface5 {
                 m_old = (m_old<<1) - 1; // get full mask from a bit
                 __TBB_ASSERT((m_old&(m_old+1))==0 && m_old <= m, NULL);
                 // check whether it is rehashing/ed
-                if( itt_load_word_with_acquire(get_bucket(h & m_old)->node_list) != rehash_req )
+                node_base *n = itt_load_word_with_acquire( get_bucket(h & m_old)->node_list );
+                if( n != rehash_req && n != merged_to_parent )
                 {
 #if __TBB_STATISTICS
                     my_info_restarts++; // race collisions
@@ -281,22 +341,47 @@ namespace interface5 {
             return false;
         }
 
+        //! Reserve the segment for enabling. @return false if another thread enables it or the shrinking stops the growth.
+        bool claim_segment( segment_index_t k ) {
+            static const segment_ptr_t is_allocating = (segment_ptr_t)2;
+            segment_ptr_t seg = itt_hide_load_word( my_table[k] );
+            if( !seg )
+                return as_atomic(my_table[k]).compare_and_swap(is_allocating, NULL) == NULL;
+            return is_valid(seg) && as_atomic(my_parked[k]).compare_and_swap(NULL, seg) == seg;
+        }
+
+        //! Undo claim_segment
+        void release_segment( segment_index_t k ) {
+            segment_ptr_t seg = itt_hide_load_word( my_table[k] );
+            if( is_valid(seg) ) as_atomic(my_parked[k]) = seg;
+            else itt_hide_store_word( my_table[k], segment_ptr_t(NULL) );
+        }
+
         //! Insert a node and check for load factor. @return segment index to enable.
-        segment_index_t insert_new_node( bucket *b, node_base *n, hashcode_t mask ) {
+        segment_index_t insert_new_node( bucket *b, node_base *n, hashcode_t mask, bool &help_resize ) {
             size_type sz = ++my_size; // prefix form is to enforce allocation after the first item inserted
             add_to_bucket( b, n );
+            help_resize = !(sz % resize_help_period);
             // check load factor
             if( sz >= mask ) { // TODO: add custom load_factor
                 segment_index_t new_seg = __TBB_Log2( mask+1 ); //optimized segment_index_of
                 __TBB_ASSERT( is_valid(my_table[new_seg-1]), "new allocations must not publish new mask until segment has allocated");
-                static const segment_ptr_t is_allocating = (segment_ptr_t)2;
-                if( !itt_hide_load_word(my_table[new_seg])
-                  && as_atomic(my_table[new_seg]).compare_and_swap(is_allocating, NULL) == NULL )
-                    return new_seg; // The value must be processed
+                if( claim_segment( new_seg ) ) {
+                    if( my_mask == mask )
+                        return new_seg; // The value must be processed
+                    release_segment( new_seg ); // the mask is stale, the table has shrunk meanwhile
+                }
             }
             return 0;
         }
 
+        //! Keep at least the number of buckets when shrinking
+        void set_min_buckets( size_type buckets ) {
+            hashcode_t m = (hashcode_t(1)<<first_block) - 1;
+            while( buckets > m+1 ) m = m<<1 | 1;
+            my_min_mask = m;
+        }
+
         //! Prepare enough segments for number of buckets
         template<typename Allocator>
         void reserve(size_type buckets, const Allocator& allocator) {
@@ -310,10 +395,15 @@ namespace interface5 {
             using std::swap;
             swap(this->my_mask, table.my_mask);
             swap(this->my_size, table.my_size);
+            swap(this->my_min_mask, table.my_min_mask);
+            swap(this->my_shrink_next, table.my_shrink_next);
+            swap(this->my_rehash_next, table.my_rehash_next);
             for(size_type i = 0; i < embedded_buckets; i++)
                 swap(this->my_embedded_segment[i].node_list, table.my_embedded_segment[i].node_list);
-            for(size_type i = embedded_block; i < pointers_per_table; i++)
+            for(size_type i = embedded_block; i < pointers_per_table; i++) {
                 swap(this->my_table[i], table.my_table[i]);
+                swap(this->my_parked[i], table.my_parked[i]);
+            }
         }
     };
 
@@ -599,6 +689,19 @@ protected:
         node_allocator_traits::deallocate(my_allocator, static_cast<node*>(n), 1);
     }
 
+    static void delete_retired_node( void* n, void* table ) {
+        static_cast<concurrent_hash_map*>(table)->delete_node( static_cast<node_base*>(n) );
+    }
+
+    //! Frees the node excluded from the table, or defers it while lock-free readers may see it
+    void free_node( node_base *n ) {
+        atomic_fence(); // the exclusion precedes the check, see start_lock_free_read()
+        if( my_lock_free_reads )
+            tbb::internal::epoch_retire( n, &delete_retired_node, this );
+        else
+            delete_node( n );
+    }
+
     struct node_scoped_guard : tbb::internal::no_copy {
         node* my_node;
         node_allocator_type& my_alloc;
@@ -667,21 +770,151 @@ protected:
         return n;
     }
 
+#if __TBB_CPP11_TYPE_PROPERTIES_PRESENT
+    //! True if an item can be copied while an accessor modifies it, and the copy checked afterwards
+    static const bool optimistic_item_reads = std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<T>::value;
+#else
+    static const bool optimistic_item_reads = false;
+#endif
+
+    //! Makes the erasures retire the items rather than free them
+    void start_lock_free_read() const {
+        if( !my_lock_free_reads ) {
+            const_cast<atomic<bool>&>( my_lock_free_reads ) = true;
+            // An erasure that does not see the flag has excluded its item before, see free_node()
+            atomic_fence();
+        }
+    }
+
+    //! Search for the item without locks; the caller is in an epoch.
+    /** Return false if a concurrent rehashing could hide the item, so that the search is to be repeated. */
+    bool lock_free_search( const Key &key, const hashcode_t h, node *&result ) const {
+        const size_type finished = my_rehashes_finished;
+        const size_type started = my_rehashes_started;
+        hashcode_t m = (hashcode_t) itt_load_word_with_acquire( my_mask );
+    restart:
+        hashcode_t i = h & m;
+        bucket *b = get_bucket( i );
+        node_base *n = itt_load_word_with_acquire( b->node_list );
+        while( n == internal::merged_to_parent ) { // the items are moved to the parent by the shrinking
+            i &= ( hashcode_t(1)<<__TBB_Log2( i ) ) - 1;
+            b = get_bucket( i );
+            n = itt_load_word_with_acquire( b->node_list );
+        }
+        if( n == internal::rehash_req ) {
+            bucket::scoped_t lock;
+            if( lock.try_acquire( b->mutex, /*write=*/true ) ) {
+                if( b->node_list == internal::rehash_req )
+                    const_cast<concurrent_hash_map*>(this)->rehash_bucket( b, i );
+                return false;
+            }
+            // Another thread rehashes the bucket; the items not moved yet are in the parent bucket
+            while( (n = itt_load_word_with_acquire( b->node_list )) == internal::rehash_req || n == internal::merged_to_parent ) {
+                i &= ( hashcode_t(1)<<__TBB_Log2( i ) ) - 1; // get parent mask from the topmost bit
+                b = get_bucket( i );
+            }
+        }
+        for( ; is_valid(n); n = __TBB_load_with_acquire( n->next ) )
+            if( my_hash_compare.equal( key, static_cast<node*>(n)->value().first ) ) {
+                result = static_cast<node*>(n);
+                return true;
+            }
+        result = NULL;
+        atomic_fence();
+        if( started != finished || my_rehashes_started != started )
+            return false;
+        if( check_mask_race( h, m ) )
+            goto restart;
+        return true;
+    }
+
+    //! Calls f for the item with the key, found without locking the table. @return false if there is no such item.
+    template<typename F>
+    bool lock_free_read( const Key &key, F &f, bool read_item ) const {
+        const hashcode_t h = my_hash_compare.hash( key );
+        start_lock_free_read();
+        {
+            tbb::internal::epoch_guard guard;
+            node *n;
+            for( tbb::internal::atomic_backoff backoff; !lock_free_search( key, h, n ); )
+                if( !backoff.bounded_pause() )
+                    goto locked_search; // the rehashing goes on for too long
+            if( !n )
+                return false;
+            if( !read_item )
+                return true;
+            if( optimistic_item_reads ) {
+                for( tbb::internal::atomic_backoff backoff; ; ) {
+                    const size_t v = n->version;
+                    if( !(v & 1) ) {
+                        tbb::aligned_space<value_type> copy;
+                        new( copy.begin() ) value_type( n->value() );
+                        atomic_fence();
+                        if( n->version == v ) {
+                            f( const_cast<const value_type&>( *copy.begin() ) );
+                            return true;
+                        }
+                    }
+                    if( !backoff.bounded_pause() )
+                        break; // the accessor is held for long, wait for it on the lock
+                }
+            }
+            typename node::scoped_t item_lock( n->mutex, /*write=*/false );
+            f( const_cast<const value_type&>( n->value() ) );
+            return true;
+        }
+    locked_search:
+        const_accessor result;
+        if( !find( result, key ) )
+            return false;
+        if( read_item )
+            f( *result );
+        return true;
+    }
+
+    struct item_ignorer {
+        void operator()( const value_type& ) const {}
+    };
+
+    struct value_copier {
+        T &my_result;
+        value_copier( T &result ) : my_result(result) {}
+        void operator()( const value_type &item ) const { my_result = item.second; }
+    };
+
     //! bucket accessor is to find, rehash, acquire a lock, and access a bucket
     class bucket_accessor : public bucket::scoped_t {
         bucket *my_b;
     public:
         bucket_accessor( concurrent_hash_map *base, const hashcode_t h, bool writer = false ) { acquire( base, h, writer ); }
         //! find a bucket by masked hashcode, optionally rehash, and acquire the lock
+        /** The bucket merged by the shrinking is replaced with its parent. The parent holds the items
+            only while the child it was reached from stays merged, which is checked under the lock. */
         inline void acquire( concurrent_hash_map *base, const hashcode_t h, bool writer = false ) {
-            my_b = base->get_bucket( h );
-            // TODO: actually, notification is unnecessary here, just hiding double-check
-            if( itt_load_word_with_acquire(my_b->node_list) == internal::rehash_req
-                && try_acquire( my_b->mutex, /*write=*/true ) )
-            {
-                if( my_b->node_list == internal::rehash_req ) base->rehash_bucket( my_b, h ); //recursive rehashing
+            hashcode_t i = h;
+            bucket *child = NULL;
+            for(;;) {
+                my_b = base->get_bucket( i );
+                // TODO: actually, notification is unnecessary here, just hiding double-check
+                node_base *n = itt_load_word_with_acquire(my_b->node_list);
+                if( n == internal::merged_to_parent ) {
+                    child = my_b;
+                    i &= ( hashcode_t(1)<<__TBB_Log2( i ) ) - 1; // get parent mask from the topmost bit
+                    continue;
+                }
+                if( n == internal::rehash_req && try_acquire( my_b->mutex, /*write=*/true ) )
+                {
+                    if( my_b->node_list == internal::rehash_req ) base->rehash_bucket( my_b, i ); //recursive rehashing
+                }
+                else bucket::scoped_t::acquire( my_b->mutex, writer );
+                n = my_b->node_list;
+                // The bucket merged while the lock was awaited may be reused by the growth meanwhile
+                if( n != internal::merged_to_parent && n != internal::rehash_req
+                    && ( !child || itt_load_word_with_acquire(child->node_list) == internal::merged_to_parent ) )
+                    break;
+                release(); // the table is resized meanwhile
+                i = h; child = NULL;
             }
-            else bucket::scoped_t::acquire( my_b->mutex, writer );
             __TBB_ASSERT( my_b->node_list != internal::rehash_req, NULL);
         }
         //! check whether bucket is locked for write
@@ -694,6 +927,7 @@ protected:
     void rehash_bucket( bucket *b_new, const hashcode_t h ) {
         __TBB_ASSERT( *(intptr_t*)(&b_new->mutex), "b_new must be locked (for write)");
         __TBB_ASSERT( h > 1, "The lowermost buckets can't be rehashed" );
+        my_rehashes_started.fetch_and_increment(); // before any item leaves the sight of the lock-free readers
         __TBB_store_with_release(b_new->node_list, internal::empty_rehashed); // mark rehashed
         hashcode_t mask = ( 1u<<__TBB_Log2( h ) ) - 1; // get parent mask from the topmost bit
 #if __TBB_STATISTICS
@@ -721,6 +955,111 @@ protected:
                 add_to_bucket( b_new, n );
             } else p = &n->next; // iterate to next item
         }
+        b_old.release();
+        ++my_rehashes_finished;
+    }
+
+    //! Do a bounded part of the pending rehashing or shrinking, unless another thread does it now
+    void help_resize() {
+        const hashcode_t m = my_mask;
+        if( !my_shrink_next && my_rehash_next > m && !is_sparse( m ) )
+            return;
+        spin_mutex::scoped_lock lock;
+        if( !lock.try_acquire( my_resize_mutex ) )
+            return;
+        if( my_shrink_next || start_shrinking() )
+            shrink_step();
+        else
+            rehash_step();
+    }
+
+    //! True if the table with the mask is to shrink
+    bool is_sparse( hashcode_t m ) const {
+        // The table grows when it is full and shrinks when a quarter is filled, so that they do not alternate;
+        // the erasures that help then merge buckets faster than the next shrinking becomes due
+        return m > my_min_mask && my_size <= m>>2;
+    }
+
+    //! Start releasing the top segment. The caller holds the resize mutex.
+    bool start_shrinking() {
+        const hashcode_t m = my_mask;
+        if( !is_sparse( m ) )
+            return false;
+        const segment_index_t s = segment_index_of( m );
+        // Claim the next segment to stop the growth until the shrinking ends
+        if( !claim_segment( s+1 ) )
+            return false;
+        __TBB_ASSERT( my_mask == m, "The mask is changed by the growth that has not claimed the segment" );
+        my_shrink_next = segment_base( s );
+        return true;
+    }
+
+    //! Merge the next buckets of the top segment into their parents. The caller holds the resize mutex.
+    void shrink_step() {
+        const hashcode_t m = my_mask, top = (m>>1) + 1;
+        hashcode_t i = my_shrink_next;
+        __TBB_ASSERT( top <= i && i <= m, NULL );
+        for( size_type k = 0; k < resize_step && i <= m; ++k, ++i )
+            merge_bucket( i, i - top );
+        if( i <= m ) {
+            my_shrink_next = i;
+            return;
+        }
+        // The items are in the lower segments now; the operations that still use the former mask
+        // find the buckets merged and go to the parents, so the segment is kept for them
+        const segment_index_t s = segment_index_of( m );
+        itt_store_word_with_release( my_mask, top - 1 );
+        if( my_rehash_next > top )
+            my_rehash_next = top;
+        my_shrink_next = 0;
+        release_segment( s+1 );
+        as_atomic( my_parked[s] ) = my_table[s];
+    }
+
+    //! Move the items of the bucket to its parent and mark the bucket merged
+    void merge_bucket( hashcode_t h, hashcode_t parent ) {
+        bucket *b = get_bucket( h );
+        typename bucket::scoped_t lock( b->mutex, /*write=*/true );
+        node_base *n = b->node_list;
+        __TBB_ASSERT( n != internal::merged_to_parent, "The bucket is merged twice" );
+        if( is_valid( n ) ) {
+            bucket_accessor b_parent( this, parent, /*writer=*/true );
+            node_base *last = n;
+            while( is_valid( last->next ) )
+                last = last->next;
+            // The list is moved as a whole, so that a lock-free reader walking it sees all the items
+            last->next = b_parent()->node_list;
+            __TBB_store_with_release( b_parent()->node_list, n );
+        }
+        // The items of a bucket that requires rehashing are in the parents already
+        __TBB_store_with_release( b->node_list, internal::merged_to_parent );
+    }
+
+    //! Rehash the next buckets that the growth left. The caller holds the resize mutex.
+    void rehash_step() {
+        const hashcode_t m = my_mask;
+        hashcode_t i = my_rehash_next;
+        for( size_type k = 0; k < resize_step && i <= m; ++k, ++i ) {
+            bucket *b = get_bucket( i );
+            if( itt_load_word_with_acquire( b->node_list ) == internal::rehash_req ) {
+                // A busy bucket is rehashed by the operation that accesses it
+                typename bucket::scoped_t lock;
+                if( lock.try_acquire( b->mutex, /*write=*/true ) && b->node_list == internal::rehash_req )
+                    rehash_bucket( b, i );
+            }
+        }
+        my_rehash_next = i;
+    }
+
+    //! Shrink the table as far as its size allows and free the segments kept by the shrinking. Not concurrency-safe.
+    void complete_shrinking() {
+        while( my_shrink_next || start_shrinking() )
+            shrink_step();
+        for( segment_index_t k = segment_index_of( my_mask ) + 1; k < pointers_per_table && is_valid( my_table[k] ); ++k ) {
+            __TBB_ASSERT( my_parked[k] == my_table[k], "Concurrent grow" );
+            my_parked[k] = NULL;
+            delete_segment( k, my_allocator );
+        }
     }
 
     struct call_clear_on_leave {
@@ -750,6 +1089,7 @@ public:
         //! Set to null
         void release() {
             if( my_node ) {
+                end_write();
                 node::scoped_t::release();
                 my_node = 0;
             }
@@ -771,10 +1111,15 @@ public:
 
         //! Destroy result after releasing the underlying reference.
         ~const_accessor() {
+            if( my_node ) end_write();
             my_node = NULL; // scoped lock's release() is called in its destructor
         }
     protected:
         bool is_writer() { return node::scoped_t::is_writer; }
+        //! Makes the version of the item even again after the writes, before the lock is released
+        void end_write() {
+            if( is_writer() ) ++my_node->version;
+        }
         node *my_node;
         hashcode_t my_hash;
     };
@@ -811,12 +1156,14 @@ public:
         : internal::hash_map_base(), my_allocator(a)
     {
         reserve( n, my_allocator );
+        set_min_buckets( n );
     }
 
     concurrent_hash_map( size_type n, const HashCompare& compare, const allocator_type& a = allocator_type() )
         : internal::hash_map_base(), my_allocator(a), my_hash_compare(compare)
     {
         reserve( n, my_allocator );
+        set_min_buckets( n );
     }
 
     //! Copy constructor
@@ -929,7 +1276,9 @@ public:
 
     //! Rehashes and optionally resizes the whole table.
     /** Useful to optimize performance before or after concurrent operations.
-        Also enables using of find() and count() concurrent methods in serial context. */
+        Also enables using of find() and count() concurrent methods in serial context.
+        Shrinks the table filled by less than a quarter and frees the buckets that the concurrent
+        shrinking keeps; non-zero n is the number of buckets the table keeps at least. */
     void rehash(size_type n = 0);
 
     //! Clear table
@@ -985,6 +1334,35 @@ public:
         return const_cast<concurrent_hash_map*>(this)->lookup(/*insert*/false, key, NULL, NULL, /*write=*/false, &do_not_allocate_node );
     }
 
+    //------------------------------------------------------------------------
+    // lock-free reads
+    //------------------------------------------------------------------------
+
+    //! Return true if there is an item with the key. Takes no lock.
+    /** The table is searched without locks, and the erased items are freed only when
+        no such search can see them anymore. */
+    bool contains( const Key &key ) const {
+        item_ignorer ignorer;
+        return lock_free_read( key, ignorer, /*read_item=*/false );
+    }
+
+    //! Copy the value of the item with the key to result. Return false if there is no such item.
+    /** Takes no lock if Key and T are trivially copyable: the value is copied again if an accessor
+        modified it meanwhile. Otherwise only the table is searched without locks, and the value
+        is copied under the read lock of the item. */
+    bool find_value( const Key &key, T &result ) const {
+        value_copier copier( result );
+        return lock_free_read( key, copier, /*read_item=*/true );
+    }
+
+    //! Call f(item) for the item with the key. Return false if there is no such item.
+    /** Locks as find_value does; if Key and T are trivially copyable, f gets a consistent copy of the item.
+        The item is not freed while f runs, so f should be short; it must not modify the table. */
+    template<typename F>
+    bool visit( const Key &key, F f ) const {
+        return lock_free_read( key, f, /*read_item=*/true );
+    }
+
     //! Find item and acquire a read lock on the item.
     /** Return true if item is found, false otherwise. */
     bool find( const_accessor &result, const Key &key ) const {
@@ -1157,14 +1535,19 @@ protected:
         node *n;
     restart:
         __TBB_ASSERT((m&(m+1))==0, "data structure is invalid");
-        bucket *b = get_bucket( h & m );
+        hashcode_t i = h & m;
+        bucket *b = get_bucket( i );
+        while( itt_load_word_with_acquire(b->node_list) == internal::merged_to_parent ) {
+            i &= ( hashcode_t(1)<<__TBB_Log2( i ) ) - 1; // get parent mask from the topmost bit
+            b = get_bucket( i );
+        }
         // TODO: actually, notification is unnecessary here, just hiding double-check
         if( itt_load_word_with_acquire(b->node_list) == internal::rehash_req )
         {
             bucket::scoped_t lock;
             if( lock.try_acquire( b->mutex, /*write=*/true ) ) {
                 if( b->node_list == internal::rehash_req)
-                    const_cast<concurrent_hash_map*>(this)->rehash_bucket( b, h & m ); //recursive rehashing
+                    const_cast<concurrent_hash_map*>(this)->rehash_bucket( b, i ); //recursive rehashing
             }
             else lock.acquire( b->mutex, /*write=*/false );
             __TBB_ASSERT(b->node_list!=internal::rehash_req,NULL);
@@ -1212,6 +1595,7 @@ bool concurrent_hash_map<Key,T,HashCompare,A>::lookup( bool op_insert, const Key
     hashcode_t const h = my_hash_compare.hash( key );
     hashcode_t m = (hashcode_t) itt_load_word_with_acquire( my_mask );
     segment_index_t grow_segment = 0;
+    bool help = false;
     node *n;
     restart:
     {//lock scope
@@ -1239,7 +1623,7 @@ bool concurrent_hash_map<Key,T,HashCompare,A>::lookup( bool op_insert, const Key
                 if( check_mask_race(h, m) )
                     goto restart; // b.release() is done in ~b().
                 // insert and set flag to grow the container
-                grow_segment = insert_new_node( b(), n = tmp_n, m );
+                grow_segment = insert_new_node( b(), n = tmp_n, m, help );
                 tmp_n = 0;
                 return_value = true;
             }
@@ -1269,6 +1653,7 @@ bool concurrent_hash_map<Key,T,HashCompare,A>::lookup( bool op_insert, const Key
             }
         }
     }//lock scope
+    if( write ) ++n->version; // the lock-free readers retry until the accessor is released
     result->my_node = n;
     result->my_hash = h;
 check_growth:
@@ -1279,6 +1664,8 @@ check_growth:
 #endif
         enable_segment( grow_segment, my_allocator );
     }
+    if( help )
+        help_resize();
     if( tmp_n ) // if op_insert only
         delete_node( tmp_n );
     return return_value;
@@ -1292,7 +1679,7 @@ std::pair<I, I> concurrent_hash_map<Key,T,HashCompare,A>::internal_equal_range(
     __TBB_ASSERT((m&(m+1))==0, "data structure is invalid");
     h &= m;
     bucket *b = get_bucket( h );
-    while( b->node_list == internal::rehash_req ) {
+    while( b->node_list == internal::rehash_req || b->node_list == internal::merged_to_parent ) {
         m = ( 1u<<__TBB_Log2( h ) ) - 1; // get parent mask from the topmost bit
         b = get_bucket( h &= m );
     }
@@ -1309,6 +1696,7 @@ bool concurrent_hash_map<Key,T,HashCompare,A>::exclude( const_accessor &item_acc
     node_base *const n = item_accessor.my_node;
     hashcode_t const h = item_accessor.my_hash;
     hashcode_t m = (hashcode_t) itt_load_word_with_acquire( my_mask );
+    size_type sz;
     do {
         // get bucket
         bucket_accessor b( this, h & m, /*writer=*/true );
@@ -1323,19 +1711,24 @@ bool concurrent_hash_map<Key,T,HashCompare,A>::exclude( const_accessor &item_acc
         }
         __TBB_ASSERT( *p == n, NULL );
         *p = n->next; // remove from container
-        my_size--;
+        sz = --my_size;
         break;
     } while(true);
-    if( !item_accessor.is_writer() ) // need to get exclusive lock
+    if( !item_accessor.is_writer() ) { // need to get exclusive lock
         item_accessor.upgrade_to_writer(); // return value means nothing here
+        ++n->version; // as release() ends the write
+    }
     item_accessor.release();
-    delete_node( n ); // Only one thread can delete it
+    free_node( n ); // Only one thread can delete it
+    if( !(sz % resize_help_period) )
+        help_resize();
     return true;
 }
 
 template<typename Key, typename T, typename HashCompare, typename A>
 bool concurrent_hash_map<Key,T,HashCompare,A>::erase( const Key &key ) {
     node_base *n;
+    size_type sz;
     hashcode_t const h = my_hash_compare.hash( key );
     hashcode_t m = (hashcode_t) itt_load_word_with_acquire( my_mask );
 restart:
@@ -1360,13 +1753,15 @@ restart:
             goto search;
         }
         *p = n->next;
-        my_size--;
+        sz = --my_size;
     }
     {
         typename node::scoped_t item_locker( n->mutex, /*write=*/true );
     }
     // note: there should be no threads pretending to acquire this mutex again, do not try to upgrade const_accessor!
-    delete_node( n ); // Only one thread can delete it due to write lock on the bucket
+    free_node( n ); // Only one thread can delete it due to write lock on the bucket
+    if( !(sz % resize_help_period) )
+        help_resize();
     return true;
 }
 
@@ -1374,6 +1769,9 @@ template<typename Key, typename T, typename HashCompare, typename A>
 void concurrent_hash_map<Key,T,HashCompare,A>::swap(concurrent_hash_map<Key,T,HashCompare,A> &table) {
     //TODO: respect C++11 allocator_traits<A>::propogate_on_constainer_swap
     using std::swap;
+    // The retired nodes are freed with the allocator that is about to be swapped
+    if( my_lock_free_reads ) tbb::internal::epoch_purge( this );
+    if( table.my_lock_free_reads ) tbb::internal::epoch_purge( &table );
     swap(this->my_allocator, table.my_allocator);
     swap(this->my_hash_compare, table.my_hash_compare);
     internal_swap(table);
@@ -1381,7 +1779,10 @@ void concurrent_hash_map<Key,T,HashCompare,A>::swap(concurrent_hash_map<Key,T,Ha
 
 template<typename Key, typename T, typename HashCompare, typename A>
 void concurrent_hash_map<Key,T,HashCompare,A>::rehash(size_type sz) {
-    reserve( sz, my_allocator ); // TODO: add reduction of number of buckets as well
+    complete_shrinking();
+    if( sz )
+        set_min_buckets( sz );
+    reserve( sz, my_allocator );
     hashcode_t mask = my_mask;
     hashcode_t b = (mask+1)>>1; // size or first index of the last segment
     __TBB_ASSERT((b&(b-1))==0, NULL); // zero or power of 2
@@ -1454,6 +1855,10 @@ template<typename Key, typename T, typename HashCompare, typename A>
 void concurrent_hash_map<Key,T,HashCompare,A>::clear() {
     hashcode_t m = my_mask;
     __TBB_ASSERT((m&(m+1))==0, "data structure is invalid");
+    if( my_shrink_next ) { // the items are freed wherever the unfinished shrinking left them
+        release_segment( segment_index_of( m ) + 1 );
+        my_shrink_next = 0;
+    }
 #if TBB_USE_ASSERT || TBB_USE_PERFORMANCE_WARNINGS || __TBB_STATISTICS
 #if TBB_USE_PERFORMANCE_WARNINGS || __TBB_STATISTICS
     int current_size = int(my_size), buckets = int(m)+1, empty_buckets = 0, overpopulated_buckets = 0; // usage statistics
@@ -1465,18 +1870,18 @@ void concurrent_hash_map<Key,T,HashCompare,A>::clear() {
         if( b & (b-2) ) ++bp; // not the beginning of a segment
         else bp = get_bucket( b );
         node_base *n = bp->node_list;
-        __TBB_ASSERT( is_valid(n) || n == internal::empty_rehashed || n == internal::rehash_req, "Broken internal structure" );
+        __TBB_ASSERT( is_valid(n) || n == internal::empty_rehashed || n == internal::rehash_req || n == internal::merged_to_parent, "Broken internal structure" );
         __TBB_ASSERT( *reinterpret_cast<intptr_t*>(&bp->mutex) == 0, "concurrent or unexpectedly terminated operation during clear() execution" );
 #if TBB_USE_PERFORMANCE_WARNINGS || __TBB_STATISTICS
         if( n == internal::empty_rehashed ) empty_buckets++;
-        else if( n == internal::rehash_req ) buckets--;
+        else if( n == internal::rehash_req || n == internal::merged_to_parent ) buckets--;
         else if( n->next ) overpopulated_buckets++;
 #endif
 #if __TBB_EXTRA_DEBUG
         for(; is_valid(n); n = n->next ) {
             hashcode_t h = my_hash_compare.hash( static_cast<node*>(n)->value().first );
             h &= m;
-            __TBB_ASSERT( h == b || get_bucket(h)->node_list == internal::rehash_req, "hash() function changed for key in table or internal error" );
+            __TBB_ASSERT( h == b || get_bucket(h)->node_list == internal::rehash_req || get_bucket(h)->node_list == internal::merged_to_parent, "hash() function changed for key in table or internal error" );
         }
 #endif
     }
@@ -1507,6 +1912,11 @@ void concurrent_hash_map<Key,T,HashCompare,A>::clear() {
 #endif // TBB_USE_ASSERT || TBB_USE_PERFORMANCE_WARNINGS || __TBB_STATISTICS
     my_size = 0;
     segment_index_t s = segment_index_of( m );
+    // The segments kept by the shrinking follow the used ones
+    while( s+1 < pointers_per_table && is_valid( my_table[s+1] ) ) {
+        __TBB_ASSERT( my_parked[s+1] == my_table[s+1], "wrong mask or concurrent grow" );
+        my_parked[++s] = NULL;
+    }
     __TBB_ASSERT( s+1 == pointers_per_table || !my_table[s+1], "wrong mask or concurrent grow" );
     do {
         __TBB_ASSERT( is_valid( my_table[s] ), "wrong mask or concurrent grow" );
@@ -1520,6 +1930,11 @@ void concurrent_hash_map<Key,T,HashCompare,A>::clear() {
         delete_segment(s, my_allocator);
     } while(s-- > 0);
     my_mask = embedded_buckets - 1;
+    my_rehash_next = embedded_buckets;
+    if( my_lock_free_reads ) {
+        tbb::internal::epoch_purge( this );
+        my_lock_free_reads = false;
+    }
 }
 
 template<typename Key, typename T, typename HashCompare, typename A>
@@ -1534,7 +1949,7 @@ void concurrent_hash_map<Key,T,HashCompare,A>::internal_copy( const concurrent_h
             else { dst = get_bucket( k ); src = source.get_bucket( k ); }
             __TBB_ASSERT( dst->node_list != internal::rehash_req, "Invalid bucket in destination table");
             node *n = static_cast<node*>( src->node_list );
-            if( n == internal::rehash_req ) { // source is not rehashed, items are in previous buckets
+            if( n == internal::rehash_req || n == internal::merged_to_parent ) { // source is not rehashed, items are in previous buckets
                 rehash_required = true;
                 dst->node_list = internal::rehash_req;
             } else for(; n; n = static_cast<node*>( n->next ) ) {
@@ -30,12 +30,18 @@
 #include <map>
 #include <list>
 #include <algorithm> // std::find
+#include <new>
 #if __TBB_CPP11_RVALUE_REF_PRESENT
 #include <utility> // std::move
 #endif
 
 #include "atomic.h"
+#include "spin_mutex.h"
+#include "tick_count.h"
+#include "cache_aligned_allocator.h"
+#include "task_scheduler_init.h"
 #include "internal/_aggregator_impl.h"
+#include "internal/_tbb_hash_compare_impl.h"
 
 namespace tbb{
 namespace interface6 {
@@ -279,9 +285,355 @@ private:
         }
     }
 };
+
+//! Weight of an item in concurrent_sharded_lru_cache that bounds the number of items
+struct lru_unit_weight {
+    template <typename key_type, typename value_type>
+    std::size_t operator()(key_type const&, value_type const&) const { return 1; }
+};
+
+//! A cache that splits the items into shards by the hash of the key, each with its own lock.
+/** A hit locks only its shard and marks the item referenced; the unused items are evicted by the
+    CLOCK algorithm, which passes over the referenced ones once, so no list is changed on a hit.
+    The capacity bounds the total weight of the items; the weight_functor_type object gives the weight
+    of an item, e.g. its size in bytes. A miss evicts from its shard first, and from the others that
+    are not locked if its shard has nothing to evict. The items in use are not evicted, so the
+    capacity may be exceeded for a while. An item older than the non-zero time to live is created
+    anew on the next access. **/
+template <typename key_type, typename value_type, typename value_functor_type = value_type (*)(key_type),
+          typename weight_functor_type = lru_unit_weight, typename hash_compare_type = tbb::tbb_hash_compare<key_type> >
+class concurrent_sharded_lru_cache : internal::no_copy {
+private:
+    typedef value_functor_type value_function_type;
+    typedef std::size_t ref_counter_type;
+    class handle_object;
+
+    struct record : internal::no_copy {
+        key_type my_key;
+        value_type my_value;
+        //! The shard holds one reference while the item is resident; the last one frees the record
+        tbb::atomic<ref_counter_type> my_ref_counter;
+        std::size_t my_hash;
+        std::size_t my_weight;
+        tick_count my_birth;
+        record* my_next_in_bucket;
+        //! Neighbours in the CLOCK ring of the shard
+        record* my_prev;
+        record* my_next;
+        bool my_referenced;
+        bool my_is_ready;
+        record(key_type const& k, std::size_t h) : my_key(k), my_value(), my_hash(h), my_weight(0),
+            my_next_in_bucket(NULL), my_prev(NULL), my_next(NULL), my_referenced(false), my_is_ready(false)
+        {
+            my_ref_counter = 0;
+        }
+    };
+
+    struct shard : internal::no_copy {
+        spin_mutex my_mutex;
+        record** my_buckets;
+        std::size_t my_bucket_count;
+        std::size_t my_size;
+        //! The next item that the CLOCK examines; the oldest one unless the hand has moved
+        record* my_hand;
+    };
+    typedef internal::padded<shard> padded_shard;
+
+    static const std::size_t initial_bucket_count = 8;
+    //! The default number of the shards does not exceed the capacity divided by this
+    static const std::size_t min_default_shard_capacity = 8;
+
+private:
+    value_function_type my_value_function;
+    weight_functor_type my_weight_function;
+    hash_compare_type my_hash_compare;
+    double my_time_to_live;
+    std::size_t const my_capacity;
+    //! The total weight of the items, including the ones in use
+    tbb::atomic<std::size_t> my_weight;
+    std::size_t my_shard_shift;
+    std::size_t my_number_of_shards;
+    padded_shard* my_shards;
+
+public:
+    typedef handle_object handle;
+
+public:
+    //! Construct the cache
+    /** By default there are up to four shards per hardware thread. A zero time to live means none. **/
+    concurrent_sharded_lru_cache(value_function_type f, std::size_t capacity, weight_functor_type weight_function = weight_functor_type(),
+                                 std::size_t number_of_shards = 0, tick_count::interval_t time_to_live = tick_count::interval_t())
+        : my_value_function(f), my_weight_function(weight_function), my_time_to_live(time_to_live.seconds()), my_capacity(capacity)
+    {
+        my_weight = 0;
+        std::size_t n = 1, log2n = 0;
+        if (!number_of_shards) {
+            number_of_shards = 4 * std::size_t(task_scheduler_init::default_num_threads());
+            if (number_of_shards > capacity / min_default_shard_capacity)
+                number_of_shards = capacity / min_default_shard_capacity;
+        }
+        while (n * 2 <= number_of_shards) { n *= 2; ++log2n; }
+        my_number_of_shards = n;
+        // The high bits select the shard; the low ones, which the shard uses for its buckets, stay uncorrelated
+        my_shard_shift = sizeof(std::size_t) * 8 - log2n;
+        my_shards = cache_aligned_allocator<padded_shard>().allocate(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            shard& s = *new (&my_shards[i]) padded_shard;
+            s.my_bucket_count = initial_bucket_count;
+            s.my_buckets = new record*[initial_bucket_count]();
+            s.my_size = 0;
+            s.my_hand = NULL;
+        }
+    }
+
+    ~concurrent_sharded_lru_cache() {
+        for (std::size_t i = 0; i < my_number_of_shards; ++i) {
+            shard& s = my_shards[i];
+            while (record* r = s.my_hand) {
+                __TBB_ASSERT(r->my_ref_counter == 1, "the cache is destroyed while its items are in use");
+                unlink(s, r);
+                delete r;
+            }
+            delete[] s.my_buckets;
+            my_shards[i].~padded_shard();
+        }
+        cache_aligned_allocator<padded_shard>().deallocate(my_shards, my_number_of_shards);
+    }
+
+    handle_object operator[](key_type k) {
+        std::size_t const h = my_hash_compare.hash(k);
+        std::size_t const index = shard_index(h);
+        shard& s = my_shards[index];
+        record* r;
+        bool is_new_value_needed = false;
+        {
+            spin_mutex::scoped_lock lock(s.my_mutex);
+            r = find(s, k, h);
+            if (r && r->my_is_ready && is_expired(*r)) {
+                // The users of the expired item keep it until they release it
+                unlink(s, r);
+                my_weight -= r->my_weight;
+                if (r->my_ref_counter.fetch_and_decrement() == 1)
+                    delete r;
+                r = NULL;
+            }
+            if (r) {
+                ++r->my_ref_counter;
+                r->my_referenced = true;
+            } else {
+                r = new record(k, h);
+                r->my_ref_counter = 2;
+                if (my_time_to_live > 0)
+                    r->my_birth = tick_count::now();
+                link(s, r);
+                is_new_value_needed = true;
+            }
+        }
+        if (is_new_value_needed) {
+            r->my_value = my_value_function(k);
+            r->my_weight = my_weight_function(r->my_key, r->my_value);
+            my_weight += r->my_weight;
+            {
+                spin_mutex::scoped_lock lock(s.my_mutex);
+                evict(s);
+            }
+            // The busy shards are skipped; the next misses make up for them
+            for (std::size_t i = 1; i < my_number_of_shards && my_weight > my_capacity; ++i) {
+                spin_mutex::scoped_lock lock;
+                shard& other = my_shards[(index + i) & (my_number_of_shards - 1)];
+                if (lock.try_acquire(other.my_mutex))
+                    evict(other);
+            }
+            __TBB_store_with_release(r->my_is_ready, true);
+        } else {
+            tbb::internal::spin_wait_while_eq(r->my_is_ready, false);
+        }
+        return handle_object(r);
+    }
+
+    //! The number of items in the cache, including the ones in use
+    std::size_t size() {
+        std::size_t result = 0;
+        for (std::size_t i = 0; i < my_number_of_shards; ++i) {
+            spin_mutex::scoped_lock lock(my_shards[i].my_mutex);
+            result += my_shards[i].my_size;
+        }
+        return result;
+    }
+
+    //! The total weight of the items in the cache, including the ones in use
+    std::size_t weight() const { return my_weight; }
+
+    std::size_t number_of_shards() const { return my_number_of_shards; }
+
+private:
+    std::size_t shard_index(std::size_t h) const {
+        return my_number_of_shards > 1 ? h >> my_shard_shift : 0;
+    }
+
+    bool is_expired(record const& r) const {
+        return my_time_to_live > 0 && (tick_count::now() - r.my_birth).seconds() > my_time_to_live;
+    }
+
+    record* find(shard& s, key_type const& k, std::size_t h) const {
+        for (record* r = s.my_buckets[h & (s.my_bucket_count - 1)]; r; r = r->my_next_in_bucket)
+            if (r->my_hash == h && my_hash_compare.equal(r->my_key, k))
+                return r;
+        return NULL;
+    }
+
+    //! Add the record to the buckets and to the CLOCK ring just behind the hand. The caller holds the lock.
+    static void link(shard& s, record* r) {
+        if (s.my_size >= s.my_bucket_count) {
+            std::size_t const count = s.my_bucket_count * 2;
+            record** buckets = new record*[count]();
+            for (std::size_t i = 0; i < s.my_bucket_count; ++i)
+                while (record* q = s.my_buckets[i]) {
+                    s.my_buckets[i] = q->my_next_in_bucket;
+                    q->my_next_in_bucket = buckets[q->my_hash & (count - 1)];
+                    buckets[q->my_hash & (count - 1)] = q;
+                }
+            delete[] s.my_buckets;
+            s.my_buckets = buckets;
+            s.my_bucket_count = count;
+        }
+        record*& head = s.my_buckets[r->my_hash & (s.my_bucket_count - 1)];
+        r->my_next_in_bucket = head;
+        head = r;
+        if (record* hand = s.my_hand) {
+            r->my_next = hand;
+            r->my_prev = hand->my_prev;
+            hand->my_prev->my_next = r;
+            hand->my_prev = r;
+        } else {
+            r->my_next = r->my_prev = s.my_hand = r;
+        }
+        ++s.my_size;
+    }
+
+    //! Remove the record from the buckets and from the CLOCK ring. The caller holds the lock.
+    static void unlink(shard& s, record* r) {
+        record** p = &s.my_buckets[r->my_hash & (s.my_bucket_count - 1)];
+        while (*p != r)
+            p = &(*p)->my_next_in_bucket;
+        *p = r->my_next_in_bucket;
+        if (r->my_next == r) {
+            s.my_hand = NULL;
+        } else {
+            if (s.my_hand == r)
+                s.my_hand = r->my_next;
+            r->my_prev->my_next = r->my_next;
+            r->my_next->my_prev = r->my_prev;
+        }
+        --s.my_size;
+    }
+
+    //! Evict the unused items of the shard until the cache fits its capacity. The caller holds the lock.
+    void evict(shard& s) {
+        // Two rounds suffice: the first one clears the referenced marks
+        for (std::size_t n = 2 * s.my_size; n && my_weight > my_capacity; --n) {
+            record* r = s.my_hand;
+            s.my_hand = r->my_next;
+            if (r->my_ref_counter != 1)
+                continue; // in use
+            if (r->my_referenced && !is_expired(*r)) {
+                r->my_referenced = false;
+                continue;
+            }
+            // A hit takes the lock to add a reference, and a release cannot drop the shard's one
+            r->my_ref_counter = 0;
+            unlink(s, r);
+            my_weight -= r->my_weight;
+            delete r;
+        }
+    }
+
+    static void signal_end_of_usage(record* r) {
+        // The record is freed here only if the shard has dropped it while it was in use
+        if (r->my_ref_counter.fetch_and_decrement() == 1)
+            delete r;
+    }
+
+private:
+#if !__TBB_CPP11_RVALUE_REF_PRESENT
+    struct handle_move_t:internal::no_assign{
+        record* my_record_ptr;
+        handle_move_t(record* record_ptr):my_record_ptr(record_ptr) {};
+    };
+#endif
+    class handle_object {
+        record* my_record_ptr;
+    public:
+        handle_object() : my_record_ptr() {}
+        explicit handle_object(record* record_ptr) : my_record_ptr(record_ptr) {}
+        operator bool() const {
+            return my_record_ptr != NULL;
+        }
+#if __TBB_CPP11_RVALUE_REF_PRESENT
+        handle_object(handle_object&& src) : my_record_ptr(src.my_record_ptr) {
+            src.my_record_ptr = NULL;
+        }
+        handle_object& operator=(handle_object&& src) {
+            if (my_record_ptr) {
+                signal_end_of_usage(my_record_ptr);
+            }
+            my_record_ptr = src.my_record_ptr;
+            src.my_record_ptr = NULL;
+            return *this;
+        }
+#else
+        handle_object(handle_move_t m) : my_record_ptr(m.my_record_ptr) {}
+        handle_object& operator=(handle_move_t m) {
+            if (my_record_ptr) {
+                signal_end_of_usage(my_record_ptr);
+            }
+            my_record_ptr = m.my_record_ptr;
+            return *this;
+        }
+        operator handle_move_t(){
+            return move(*this);
+        }
+#endif // __TBB_CPP11_RVALUE_REF_PRESENT
+        value_type& value(){
+            __TBB_ASSERT(my_record_ptr,"get value from an invalid or already moved object?");
+            return my_record_ptr->my_value;
+        }
+        ~handle_object(){
+            if (my_record_ptr){
+                signal_end_of_usage(my_record_ptr);
+            }
+        }
+    private:
+#if __TBB_CPP11_RVALUE_REF_PRESENT
+        // For source compatibility with C++03
+        friend handle_object&& move(handle_object& h){
+            return std::move(h);
+        }
+#else
+        friend handle_move_t move(handle_object& h){
+            return handle_object::move(h);
+        }
+        static handle_move_t move(handle_object& h){
+            record* record_ptr = h.my_record_ptr;
+            h.my_record_ptr = NULL;
+            return handle_move_t(record_ptr);
+        }
+#endif // __TBB_CPP11_RVALUE_REF_PRESENT
+    private:
+        void operator=(handle_object&);
+#if __SUNPRO_CC
+    // Presumably due to a compiler error, private copy constructor
+    // breaks expressions like handle h = cache[key];
+    public:
+#endif
+        handle_object(handle_object &);
+    };
+};
 } // namespace interface6
 
 using interface6::concurrent_lru_cache;
+using interface6::concurrent_sharded_lru_cache;
+using interface6::lru_unit_weight;
 
 } // namespace tbb
 #endif //__TBB_concurrent_lru_cache_H
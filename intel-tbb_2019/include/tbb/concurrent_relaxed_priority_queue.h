@@ -0,0 +1,274 @@
+/*
+    Copyright (c) 2005-2019 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+#ifndef __TBB_concurrent_relaxed_priority_queue_H
+#define __TBB_concurrent_relaxed_priority_queue_H
+
+#include "atomic.h"
+#include "spin_mutex.h"
+#include "cache_aligned_allocator.h"
+#include "enumerable_thread_specific.h"
+#include "task_scheduler_init.h"
+#include "tbb_stddef.h"
+#include "internal/_tbb_hash_compare_impl.h"
+#include "internal/_template_helpers.h"
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <new>
+#if __TBB_CPP11_RVALUE_REF_PRESENT
+#include <utility> // std::move, std::forward
+#endif
+
+namespace tbb {
+namespace interface5 {
+
+//! Concurrent priority queue that trades the order of the elements for scalability
+/** The elements are kept in several binary heaps, each with its own lock. A push goes to a random
+    heap; a pop takes the higher priority of the tops of two random heaps. The popped element is
+    thus not always the highest one, but with n heaps it is among the O(n) highest ones on average.
+    More heaps make the contention lower and the order more relaxed; one heap gives the exact order. */
+template <typename T, typename Compare=std::less<T>, typename A=cache_aligned_allocator<T> >
+class concurrent_relaxed_priority_queue : tbb::internal::no_copy {
+public:
+    //! Element type in the queue.
+    typedef T value_type;
+
+    //! Reference type
+    typedef T& reference;
+
+    //! Const reference type
+    typedef const T& const_reference;
+
+    //! Integral type for representing size of the queue.
+    typedef size_t size_type;
+
+    //! Difference type for iterator
+    typedef ptrdiff_t difference_type;
+
+    //! Allocator type
+    typedef A allocator_type;
+
+    //! The number of heaps per hardware thread by default
+    static const size_type default_queues_per_thread = 2;
+
+    //! Constructs an empty queue with the default number of heaps
+    explicit concurrent_relaxed_priority_queue(const allocator_type& a = allocator_type()) : my_compare()
+    {
+        initialize(0, a);
+    }
+
+    //! Constructs an empty queue with the default number of heaps
+    explicit concurrent_relaxed_priority_queue(const Compare& c, const allocator_type& a = allocator_type()) : my_compare(c)
+    {
+        initialize(0, a);
+    }
+
+    //! Constructs an empty queue with number_of_queues heaps, or the default number if it is zero
+    explicit concurrent_relaxed_priority_queue(size_type number_of_queues, const Compare& c = Compare(), const allocator_type& a = allocator_type()) :
+        my_compare(c)
+    {
+        initialize(number_of_queues, a);
+    }
+
+    ~concurrent_relaxed_priority_queue() {
+        for (size_type i = 0; i < my_number_of_queues; ++i)
+            my_queues[i].~padded_queue();
+        cache_aligned_allocator<padded_queue>().deallocate(my_queues, my_number_of_queues);
+    }
+
+    //! Returns true if empty, false otherwise
+    /** Returned value may not reflect results of pending operations. */
+    bool empty() const { return size()==0; }
+
+    //! Returns the current number of elements contained in the queue
+    /** Returned value may not reflect results of pending operations. */
+    size_type size() const {
+        size_type result = 0;
+        for (size_type i = 0; i < my_number_of_queues; ++i)
+            result += my_queues[i].my_size;
+        return result;
+    }
+
+    //! Returns the number of heaps, which bounds the relaxation of the order
+    size_type number_of_queues() const { return my_number_of_queues; }
+
+    //! Pushes elem onto the queue
+    /** This operation can be safely used concurrently with other push, try_pop or emplace operations. */
+    void push(const_reference elem) {
+        spin_mutex::scoped_lock lock;
+        queue& q = lock_random_queue(lock);
+        q.my_data.push_back(elem);
+        push_heap(q);
+    }
+
+#if __TBB_CPP11_RVALUE_REF_PRESENT
+    //! Pushes elem onto the queue
+    /** This operation can be safely used concurrently with other push, try_pop or emplace operations. */
+    void push(value_type &&elem) {
+        spin_mutex::scoped_lock lock;
+        queue& q = lock_random_queue(lock);
+        q.my_data.push_back(std::move(elem));
+        push_heap(q);
+    }
+
+#if __TBB_CPP11_VARIADIC_TEMPLATES_PRESENT
+    //! Constructs a new element using args as the arguments for its construction and pushes it onto the queue */
+    /** This operation can be safely used concurrently with other push, try_pop or emplace operations. */
+    template<typename... Args>
+    void emplace(Args&&... args) {
+        push(value_type(std::forward<Args>(args)...));
+    }
+#endif /* __TBB_CPP11_VARIADIC_TEMPLATES_PRESENT */
+#endif /* __TBB_CPP11_RVALUE_REF_PRESENT */
+
+    //! Removes one of the highest priority elements
+    /** If an element was found, sets elem and returns true, otherwise returns false.
+        The element is the higher of the tops of two random heaps; false is returned only if
+        all the heaps were found empty. This operation can be safely used concurrently with
+        other push, try_pop or emplace operations. */
+    bool try_pop(reference elem) {
+        random_state& r = my_random.local();
+        for (size_type attempt = 0; attempt < 2*my_number_of_queues; ++attempt) {
+            queue* a = &my_queues[r.get() % my_number_of_queues];
+            queue* b = &my_queues[r.get() % my_number_of_queues];
+            if (!a->my_size)
+                std::swap(a, b);
+            if (!a->my_size)
+                continue;
+            spin_mutex::scoped_lock lock_a, lock_b;
+            // Both locks are only tried, so that a pop never waits and two pops never deadlock
+            if (!lock_a.try_acquire(a->my_mutex))
+                continue;
+            if (a->my_data.empty())
+                continue;
+            queue* chosen = a;
+            if (b != a && b->my_size && lock_b.try_acquire(b->my_mutex)
+                && !b->my_data.empty() && my_compare(a->my_data.front(), b->my_data.front()))
+                chosen = b;
+            pop_heap(*chosen, elem);
+            return true;
+        }
+        // The heaps seen were empty or busy; look through all of them before reporting the queue empty
+        const size_t start = r.get();
+        for (size_type i = 0; i < my_number_of_queues; ++i) {
+            queue& q = my_queues[(start + i) % my_number_of_queues];
+            if (!q.my_size)
+                continue;
+            spin_mutex::scoped_lock lock(q.my_mutex);
+            if (!q.my_data.empty()) {
+                pop_heap(q, elem);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    //! Clear the queue; not thread-safe
+    /** This operation is unsafe if there are pending concurrent operations on the queue. */
+    void clear() {
+        for (size_type i = 0; i < my_number_of_queues; ++i) {
+            my_queues[i].my_data.clear();
+            my_queues[i].my_size = 0;
+        }
+    }
+
+    //! Return allocator object
+    allocator_type get_allocator() const { return my_queues[0].my_data.get_allocator(); }
+
+private:
+    typedef std::vector<value_type, allocator_type> vector_t;
+
+    struct queue : tbb::internal::no_copy {
+        spin_mutex my_mutex;
+        //! The size of the heap, read without the lock to skip the empty heaps
+        atomic<size_type> my_size;
+        //! The binary heap with the highest priority element in front
+        vector_t my_data;
+    };
+    typedef tbb::internal::padded<queue> padded_queue;
+
+    //! Per-thread state of the random choices
+    class random_state {
+        size_t my_x;
+    public:
+        random_state() : my_x(tbb::tbb_hasher(this) * internal::hash_multiplier | 1) {}
+        //! Returns the next number of the xorshift sequence, upper bits first
+        size_t get() {
+            my_x ^= my_x << 13;
+            my_x ^= my_x >> 7;
+            my_x ^= my_x << 17;
+            return my_x >> 16;
+        }
+    };
+
+    Compare my_compare;
+    size_type my_number_of_queues;
+    padded_queue* my_queues;
+    enumerable_thread_specific<random_state> my_random;
+
+    void initialize(size_type number_of_queues, const allocator_type& a) {
+        if (!number_of_queues)
+            number_of_queues = default_queues_per_thread * size_type(task_scheduler_init::default_num_threads());
+        my_number_of_queues = number_of_queues;
+        my_queues = cache_aligned_allocator<padded_queue>().allocate(number_of_queues);
+        for (size_type i = 0; i < number_of_queues; ++i) {
+            queue& q = *new (&my_queues[i]) padded_queue;
+            vector_t(a).swap(q.my_data);
+            q.my_size = 0;
+        }
+    }
+
+    //! Locks a random heap, trying others while it is busy
+    /** After a few busy heaps waits for the last one tried, so that pushers do not spin at full
+        speed when there are few heaps. */
+    queue& lock_random_queue(spin_mutex::scoped_lock& lock) {
+        random_state& r = my_random.local();
+        queue* q;
+        tbb::internal::atomic_backoff backoff;
+        do {
+            q = &my_queues[r.get() % my_number_of_queues];
+            if (lock.try_acquire(q->my_mutex))
+                return *q;
+        } while (backoff.bounded_pause());
+        lock.acquire(q->my_mutex);
+        return *q;
+    }
+
+    void push_heap(queue& q) {
+        std::push_heap(q.my_data.begin(), q.my_data.end(), my_compare);
+        q.my_size = q.my_data.size();
+    }
+
+    void pop_heap(queue& q, reference elem) {
+        std::pop_heap(q.my_data.begin(), q.my_data.end(), my_compare);
+        elem = tbb::internal::move(q.my_data.back());
+        q.my_data.pop_back();
+        q.my_size = q.my_data.size();
+    }
+};
+
+} // namespace interface5
+
+using interface5::concurrent_relaxed_priority_queue;
+
+} // namespace tbb
+
+#endif /* __TBB_concurrent_relaxed_priority_queue_H */
@@ -31,6 +31,7 @@ public:
     enum parameter {
         max_allowed_parallelism,
         thread_stack_size,
+        max_spin_time,  // microseconds an idle worker may spin before leaving the arena
         parameter_max // insert new parameters above this point
     };
 
@@ -0,0 +1,58 @@
+/*
+    Copyright (c) 2005-2019 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+#ifndef __TBB__epoch_reclamation_H
+#define __TBB__epoch_reclamation_H
+
+#include "../tbb_stddef.h"
+
+namespace tbb {
+namespace internal {
+
+//! Frees an object retired by epoch_retire; gets the context given to epoch_retire.
+typedef void (*epoch_deleter_t)( void* object, void* context );
+
+//! Announces that the calling thread reads shared objects without locks.
+/** The objects the thread can reach are not freed until it calls epoch_leave.
+    The calls nest; only the outermost pair matters. **/
+void __TBB_EXPORTED_FUNC epoch_enter();
+
+//! Ends the reading started by the matching epoch_enter.
+void __TBB_EXPORTED_FUNC epoch_leave();
+
+//! Frees the object, which is already unlinked from the shared structure, when no reader can see it.
+/** The deleter runs on a thread that retires objects later; it must not retire objects itself. **/
+void __TBB_EXPORTED_FUNC epoch_retire( void* object, epoch_deleter_t deleter, void* context );
+
+//! Frees at once all the objects retired with the context.
+/** The caller guarantees that no thread reads them anymore, e.g. as the container is destroyed. **/
+void __TBB_EXPORTED_FUNC epoch_purge( void* context );
+
+//! Reads shared objects in the scope of its lifetime.
+class epoch_guard : no_copy {
+public:
+    epoch_guard() { epoch_enter(); }
+    ~epoch_guard() { epoch_leave(); }
+};
+
+} // namespace internal
+} // namespace tbb
+
+#endif /* __TBB__epoch_reclamation_H */
@@ -215,6 +215,82 @@ public:
     ~fixed_pool() { destroy(); }
 };
 
+//! Monotonic (bump pointer) arena for short-lived allocations
+/** Objects have no headers and are never released one by one: free() does
+    nothing, and recycle() makes all the memory available again in O(1) time.
+    Chunks are taken first from the buffer given to constructor (if any),
+    then from the upstream pool (if any), then from scalable_malloc.
+    The arena is not thread-safe; use one per thread or per request.
+    memory_pool_allocator<T, monotonic_arena> makes it a C++ allocator.
+    @ingroup memory_allocation */
+class monotonic_arena : tbb::internal::no_copy {
+public:
+    static const size_t default_alignment = 16;
+    static const size_t default_chunk_size = 64*1024;
+
+    //! construct arena with chunks obtained from scalable_malloc
+    inline explicit monotonic_arena(size_t chunk_size = default_chunk_size);
+    //! construct arena that starts from the buffer, e.g. on stack, and then falls back to scalable_malloc
+    inline monotonic_arena(void *buf, size_t size, size_t chunk_size = default_chunk_size);
+    //! construct arena with chunks obtained from the pool, e.g. fixed_pool, and then from scalable_malloc
+    inline explicit monotonic_arena(internal::pool_base &upstream, size_t chunk_size = default_chunk_size);
+    //! release all chunks
+    ~monotonic_arena() { release(); }
+
+    //! allocate size bytes aligned to alignment, that must be a power of 2
+    void *malloc(size_t size, size_t alignment = default_alignment) {
+        __TBBMALLOC_ASSERT(alignment && !(alignment & (alignment-1)), "alignment must be power of 2");
+        if (my_current) {
+            char *p = align_up(my_ptr, alignment);
+            if (p <= my_current->end && size <= size_t(my_current->end - p)) {
+                my_ptr = p + size;
+                return p;
+            }
+        }
+        return malloc_slow(size, alignment);
+    }
+    //! objects are released all at once by recycle() or release()
+    void free(void*) {}
+    //! make all memory available for reuse, chunks are kept by the arena
+    void recycle() {
+        my_current = my_head;
+        my_ptr = my_head? data(my_head) : NULL;
+    }
+    //! return chunks to upstream, except the buffer given to constructor
+    inline void release();
+
+private:
+    enum chunk_source { user_buffer, upstream_pool, scalable_memory };
+    struct chunk {
+        chunk *next;
+        char *end;
+        chunk_source source;
+    };
+    // chunk header is padded, so data of a chunk is aligned as its header
+    static const size_t header_size = (sizeof(chunk)+default_alignment-1) & ~(default_alignment-1);
+    static const size_t max_chunk_size = 4*1024*1024;
+
+    chunk *my_head,
+          *my_current;
+    char *my_ptr;
+    internal::pool_base *my_upstream;
+    size_t my_chunk_size,
+           my_next_chunk_size;
+
+    static char *data(chunk *c) { return reinterpret_cast<char*>(c) + header_size; }
+    static char *align_up(char *p, size_t alignment) {
+        return reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(p)+alignment-1) & ~(alignment-1));
+    }
+    void init(size_t chunk_size) {
+        my_head = my_current = NULL;
+        my_ptr = NULL;
+        my_upstream = NULL;
+        my_chunk_size = my_next_chunk_size = chunk_size<header_size+default_alignment?
+            header_size+default_alignment : chunk_size;
+    }
+    inline void *malloc_slow(size_t size, size_t alignment);
+};
+
 //////////////// Implementation ///////////////
 
 template <typename Alloc>
@@ -269,10 +345,85 @@ inline void *fixed_pool::allocate_request(intptr_t pool_id, size_t & bytes) {
     return self.my_buffer;
 }
 
+inline monotonic_arena::monotonic_arena(size_t chunk_size) {
+    init(chunk_size);
+}
+inline monotonic_arena::monotonic_arena(void *buf, size_t size, size_t chunk_size) {
+    init(chunk_size);
+    char *start = align_up(static_cast<char*>(buf), default_alignment);
+    if (!buf || start + header_size >= static_cast<char*>(buf) + size)
+        tbb::internal::throw_exception(std::invalid_argument("Buffer is too small for arena"));
+    my_head = reinterpret_cast<chunk*>(start);
+    my_head->next = NULL;
+    my_head->end = static_cast<char*>(buf) + size;
+    my_head->source = user_buffer;
+    recycle();
+}
+inline monotonic_arena::monotonic_arena(internal::pool_base &upstream, size_t chunk_size) {
+    init(chunk_size);
+    my_upstream = &upstream;
+}
+inline void *monotonic_arena::malloc_slow(size_t size, size_t alignment) {
+    if (size > ~size_t(0)/2 || alignment > max_chunk_size)
+        return NULL; // do not overflow computation of chunk size
+    chunk *next = my_current? my_current->next : my_head;
+    // chunks kept after recycle() are reused, if big enough
+    if (next && size + alignment <= size_t(next->end - data(next))) {
+        my_current = next;
+        my_ptr = data(next);
+        return malloc(size, alignment);
+    }
+    size_t bytes = my_next_chunk_size;
+    if (bytes < header_size + alignment + size)
+        bytes = header_size + alignment + size; // dedicated chunk for a big object
+    else if (my_next_chunk_size < max_chunk_size)
+        my_next_chunk_size *= 2;
+    chunk *c = NULL;
+    chunk_source source = upstream_pool;
+    if (my_upstream)
+        c = static_cast<chunk*>(my_upstream->malloc(bytes));
+    if (!c) {
+        source = scalable_memory;
+        c = static_cast<chunk*>(scalable_malloc(bytes));
+        if (!c)
+            return NULL;
+    }
+    c->end = reinterpret_cast<char*>(c) + bytes;
+    c->source = source;
+    // insert after the current chunk, so not yet reused chunks are kept
+    c->next = next;
+    if (my_current)
+        my_current->next = c;
+    else
+        my_head = c;
+    my_current = c;
+    my_ptr = data(c);
+    return malloc(size, alignment);
+}
+inline void monotonic_arena::release() {
+    chunk *buffer = NULL;
+    for (chunk *c = my_head; c; ) {
+        chunk *next = c->next;
+        if (c->source == user_buffer)
+            buffer = c;
+        else if (c->source == upstream_pool)
+            my_upstream->free(c);
+        else
+            scalable_free(c);
+        c = next;
+    }
+    if (buffer)
+        buffer->next = NULL;
+    my_head = buffer;
+    my_next_chunk_size = my_chunk_size;
+    recycle();
+}
+
 } //namespace interface6
 using interface6::memory_pool_allocator;
 using interface6::memory_pool;
 using interface6::fixed_pool;
+using interface6::monotonic_arena;
 } //namespace tbb
 
 #undef __TBBMALLOC_ASSERT
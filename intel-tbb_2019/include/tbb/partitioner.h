@@ -53,6 +53,7 @@
 #include "task_arena.h"
 #include "aligned_space.h"
 #include "atomic.h"
+#include "cache_aligned_allocator.h"
 #include "internal/_template_helpers.h"
 
 #if defined(_MSC_VER) && !defined(__INTEL_COMPILER)
@@ -86,13 +87,29 @@ class affinity_partitioner_base_v3: no_copy {
     affinity_id* my_array;
     //! Number of elements in my_array.
     size_t my_size;
+    //! True if my_array maps fractions of the iteration space to affinity_id.
+    /** The array has then fraction_map_size elements regardless of the number of threads. */
+    bool my_replay_by_fraction;
+    //! Number of elements in my_array when it maps fractions of the iteration space.
+    static const size_t fraction_map_size = 1024;
     //! Zeros the fields.
-    affinity_partitioner_base_v3() : my_array(NULL), my_size(0) {}
+    affinity_partitioner_base_v3() : my_array(NULL), my_size(0), my_replay_by_fraction(false) {}
     //! Deallocates my_array.
     ~affinity_partitioner_base_v3() {resize(0);}
     //! Resize my_array.
     /** Retains values if resulting size is the same. */
     void __TBB_EXPORTED_METHOD resize( unsigned factor );
+    //! Allocates my_array as the map of fractions unless it is already allocated.
+    /** Retains values, so the affinities survive the changes of the range and of the number of threads. */
+    void allocate_fraction_map() {
+        if( my_size!=fraction_map_size ) {
+            resize(0);
+            my_array = static_cast<affinity_id*>(NFS_Allocate(fraction_map_size, sizeof(affinity_id), NULL));
+            for( size_t i = 0; i < fraction_map_size; ++i )
+                my_array[i] = 0;
+            my_size = fraction_map_size;
+        }
+    }
 };
 
 //! Provides backward-compatible methods for partition objects without affinity.
@@ -526,35 +543,59 @@ public:
 class affinity_partition_type : public dynamic_grainsize_mode<linear_affinity_mode<affinity_partition_type> > {
     static const unsigned factor_power = 4; // TODO: get a unified formula based on number of computing units
     tbb::internal::affinity_id* my_array;
+    //! Head of the root task; nonzero my_by_fraction means that my_array maps fractions.
+    size_t my_base;
+    bool my_by_fraction;
+    //! Index in the map of fractions of the given offset from my_base.
+    size_t fraction_index( size_t offset ) const {
+        return offset * affinity_partitioner_base_v3::fraction_map_size / my_max_affinity;
+    }
+    size_t fraction_offset() const {
+        return (my_head + my_max_affinity - my_base) % my_max_affinity;
+    }
 public:
     static const unsigned factor = 1 << factor_power; // number of slots in affinity array per task
     typedef proportional_split split_type;
     affinity_partition_type( tbb::internal::affinity_partitioner_base_v3& ap )
         : dynamic_grainsize_mode<linear_affinity_mode<affinity_partition_type> >() {
         __TBB_ASSERT( (factor&(factor-1))==0, "factor must be power of two" );
-        ap.resize(factor);
+        my_by_fraction = ap.my_replay_by_fraction;
+        if( my_by_fraction )
+            ap.allocate_fraction_map();
+        else
+            ap.resize(factor);
         my_array = ap.my_array;
+        my_base = my_head;
         my_max_depth = factor_power + 1;
         __TBB_ASSERT( my_max_depth < __TBB_RANGE_POOL_CAPACITY, 0 );
     }
     affinity_partition_type(affinity_partition_type& p, split)
         : dynamic_grainsize_mode<linear_affinity_mode<affinity_partition_type> >(p, split())
-        , my_array(p.my_array) {}
+        , my_array(p.my_array), my_base(p.my_base), my_by_fraction(p.my_by_fraction) {}
     affinity_partition_type(affinity_partition_type& p, const proportional_split& split_obj)
         : dynamic_grainsize_mode<linear_affinity_mode<affinity_partition_type> >(p, split_obj)
-        , my_array(p.my_array) {}
+        , my_array(p.my_array), my_base(p.my_base), my_by_fraction(p.my_by_fraction) {}
     void set_affinity( task &t ) {
         if( my_divisor ) {
-            if( !my_array[my_head] )
+            affinity_id id = my_by_fraction ? my_array[fraction_index(fraction_offset())] : my_array[my_head];
+            // An affinity recorded with more threads than there are now is not replayed
+            if( !id || id > my_max_affinity / factor )
                 // TODO: consider new ideas with my_array for both affinity and static partitioner's, then code reuse
                 t.set_affinity( affinity_id(my_head / factor + 1) );
             else
-                t.set_affinity( my_array[my_head] );
+                t.set_affinity( id );
         }
     }
     void note_affinity( task::affinity_id id ) {
-        if( my_divisor )
-            my_array[my_head] = id;
+        if( my_divisor ) {
+            if( my_by_fraction ) {
+                // The task covers my_divisor positions, i.e. the same fraction of the iteration space
+                size_t offset = fraction_offset();
+                size_t i = fraction_index(offset), end = fraction_index(offset + my_divisor);
+                do my_array[i] = id; while( ++i < end );
+            } else
+                my_array[my_head] = id;
+        }
     }
 };
 
@@ -651,7 +692,15 @@ private:
 //! An affinity partitioner
 class affinity_partitioner: internal::affinity_partitioner_base_v3 {
 public:
+    //! Defines what the affinities recorded by an algorithm are bound to when they are replayed.
+    enum replay_mode {
+        //! The positions of the tasks in the splitting tree; forgotten when the number of threads changes.
+        replay_by_task,
+        //! The fractions of the iteration space; kept when the range or the number of threads changes.
+        replay_by_fraction
+    };
     affinity_partitioner() {}
+    explicit affinity_partitioner( replay_mode mode ) { my_replay_by_fraction = mode==replay_by_fraction; }
 
 private:
     template<typename Range, typename Body, typename Partitioner> friend class serial::interface9::start_for;
@@ -50,6 +50,23 @@ void * __TBB_EXPORTED_FUNC scalable_malloc (size_t size);
     @ingroup memory_allocation */
 void   __TBB_EXPORTED_FUNC scalable_free (void* ptr);
 
+/** Allocate num objects of size bytes each, storing pointers to objects array.
+    Returns the number of allocated objects, it's less than num only if memory is exhausted.
+    @ingroup memory_allocation */
+size_t __TBB_EXPORTED_FUNC scalable_malloc_batch (size_t size, size_t num, void** objects);
+
+/** Discard num pieces of memory previously allocated by scalable_malloc or
+    scalable_malloc_batch. NULL elements of objects array are ignored.
+    @ingroup memory_allocation */
+void   __TBB_EXPORTED_FUNC scalable_free_batch (void** objects, size_t num);
+
+/** Discard a piece of memory allocated by scalable_malloc or scalable_calloc,
+    size must be the one requested on allocation (nobj*size for scalable_calloc).
+    Faster than scalable_free, as kind of the object is known from the size;
+    the size is checked in debug builds of the library only.
+    @ingroup memory_allocation */
+void   __TBB_EXPORTED_FUNC scalable_free_sized (void* ptr, size_t size);
+
 /** The "realloc" analogue complementing scalable_malloc.
     @ingroup memory_allocation */
 void * __TBB_EXPORTED_FUNC scalable_realloc (void* ptr, size_t size);
@@ -90,6 +107,9 @@ typedef enum {
 } ScalableAllocationResult;
 
 /* Setting TBB_MALLOC_USE_HUGE_PAGES environment variable to 1 enables huge pages.
+   Setting TBB_MALLOC_USE_NUMA environment variable to 1 enables NUMA-aware mode.
+   Setting TBB_MALLOC_COLLECT_STATISTICS environment variable to 1 enables statistics.
+   Setting TBB_MALLOC_DECAY_TIME environment variable to N sets decay time to N ms.
    scalable_allocation_mode call has priority over environment variable. */
 typedef enum {
     TBBMALLOC_USE_HUGE_PAGES,  /* value turns using huge pages on and off */
@@ -97,7 +117,34 @@ typedef enum {
     USE_HUGE_PAGES = TBBMALLOC_USE_HUGE_PAGES,
     /* try to limit memory consumption value Bytes, clean internal buffers
        if limit is exceeded, but not prevents from requesting memory from OS */
-    TBBMALLOC_SET_SOFT_HEAP_LIMIT
+    TBBMALLOC_SET_SOFT_HEAP_LIMIT,
+    /* value turns NUMA-aware mode on and off: memory regions and free blocks
+       are kept per NUMA node, and threads prefer memory of their node */
+    TBBMALLOC_USE_NUMA,
+    /* value turns collecting of statistics on and off, see TBBMALLOC_GET_STATISTICS */
+    TBBMALLOC_COLLECT_STATISTICS,
+    /* record stack of an allocation after every value bytes allocated by a thread,
+       0 turns sampling off. Returns TBBMALLOC_NO_EFFECT if not supported. */
+    TBBMALLOC_HEAP_PROFILE_SAMPLING,
+    /* free memory not reused during value milliseconds is returned to OS
+       by a background thread, keeping address space mapped;
+       0 turns it off. Returns TBBMALLOC_NO_EFFECT if not supported. */
+    TBBMALLOC_SET_DECAY_TIME,
+    /* value turns on and off dedicating whole huge pages to slabs of groups
+       of size classes of a thread, to reduce TLB misses. Returns
+       TBBMALLOC_NO_EFFECT if huge pages can't be requested on the platform. */
+    TBBMALLOC_USE_HUGE_PAGE_SLABS,
+    /* objects allocated by other threads are released in batches of up to
+       value objects per thread; 0 turns batching off. Buffered objects are
+       also released when the thread runs out of free objects in its own
+       blocks, by TBBMALLOC_CLEAN_THREAD_BUFFERS and on thread exit. */
+    TBBMALLOC_SET_REMOTE_FREE_BATCH,
+    /* large object cache learns reuse distance for each size and caches
+       repeating bursts of same-size objects from the first object */
+    TBBMALLOC_USE_ADAPTIVE_LOC,
+    /* limit in bytes of total size of large objects cached by each thread,
+       4MB by default; 0 turns the thread-local cache off */
+    TBBMALLOC_SET_LOCAL_LOC_SIZE
 } AllocationModeParam;
 
 /** Set TBB allocator-specific allocation modes.
@@ -111,9 +158,49 @@ typedef enum {
     TBBMALLOC_CLEAN_ALL_BUFFERS,
     /* Clean internal allocator buffer for current thread only.
        Return values same as for TBBMALLOC_CLEAN_ALL_BUFFERS. */
-    TBBMALLOC_CLEAN_THREAD_BUFFERS
+    TBBMALLOC_CLEAN_THREAD_BUFFERS,
+    /* Store NUMA node of current thread, as seen by the allocator,
+       to int pointed by param. Returns TBBMALLOC_NO_EFFECT and stores 0,
+       if only one node is found. */
+    TBBMALLOC_GET_NUMA_NODE,
+    /* Fill ScalableAllocationStatistics pointed by param.
+       Returns TBBMALLOC_NO_EFFECT if collecting of statistics is off,
+       only backend region counters are valid in this case. */
+    TBBMALLOC_GET_STATISTICS,
+    /* Write sampled heap profile in pprof text format to the file
+       with name pointed by param. Returns TBBMALLOC_NO_EFFECT
+       if sampling is off, TBBMALLOC_INVALID_PARAM if file can't be written. */
+    TBBMALLOC_DUMP_HEAP_PROFILE
 } ScalableAllocationCmd;
 
+#define TBBMALLOC_STATISTICS_BINS 32
+
+/* Occupancy of slabs serving objects of one size class. */
+typedef struct {
+    size_t objectSize;
+    size_t slabs;             /* slabs currently assigned to the size class */
+    size_t allocatedObjects;
+    size_t freeObjects;       /* unused space in the slabs, in objects */
+} ScalableBinStatistics;
+
+/* Counters are changed only while collecting is on, so object and slab counts
+   are exact only if collecting was on since process start. */
+typedef struct {
+    size_t binsNum;           /* used elements of bins */
+    ScalableBinStatistics bins[TBBMALLOC_STATISTICS_BINS];
+    size_t largeLocalCacheHits; /* large objects got from thread-local cache */
+    size_t largeCacheHits;
+    size_t largeCacheMisses;
+    size_t largeCacheEvictions; /* large objects released from cache to OS */
+    size_t regions;           /* memory regions got from OS */
+    size_t regionsSize;
+    size_t hugePageRegions;   /* regions backed by huge pages */
+    size_t hugePageRegionsSize;
+    size_t hugePageSlabGroups; /* huge pages dedicated to slabs, see TBBMALLOC_USE_HUGE_PAGE_SLABS */
+    size_t groupedSlabs;      /* slabs taken from dedicated huge pages */
+    size_t ungroupedSlabs;    /* slabs taken from other memory */
+} ScalableAllocationStatistics;
+
 /** Call TBB allocator-specific commands.
     @ingroup memory_allocation */
 int __TBB_EXPORTED_FUNC scalable_allocation_command(int cmd, void *param);
@@ -275,9 +362,17 @@ public:
     }
 
     //! Free previously allocated block of memory
+    /** Define TBB_USE_SCALABLE_FREE_SIZED to release by size, that requires
+        a version of the tbbmalloc library exporting scalable_free_sized. */
+#if TBB_USE_SCALABLE_FREE_SIZED
+    void deallocate( pointer p, size_type n ) {
+        scalable_free_sized( p, n * sizeof(value_type) );
+    }
+#else
     void deallocate( pointer p, size_type ) {
         scalable_free( p );
     }
+#endif
 
     //! Largest value for which method allocate might succeed.
     size_type max_size() const throw() {
@@ -0,0 +1,44 @@
+/*
+    Copyright (c) 2005-2019 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+#ifndef __TBB_scheduler_trace_H
+#define __TBB_scheduler_trace_H
+
+#include "tbb_stddef.h"
+
+namespace tbb {
+
+namespace internal {
+    bool __TBB_EXPORTED_FUNC dump_scheduler_trace( const char* file_name );
+} // namespace internal
+
+//! Writes the scheduler events recorded so far into a file in the Chrome trace event format.
+/** The events are task execution, spawns, steals, mailbox hits, arena joins and leaves,
+    and sleeping of workers, per thread. They are recorded only if the TBB_TRACE environment
+    variable is set to a file name when the scheduler is first initialized; the trace is
+    written to that file at exit, and to it by default when this function is called.
+    Returns false if tracing is disabled or the file cannot be written. **/
+inline bool dump_scheduler_trace( const char* file_name = NULL ) {
+    return internal::dump_scheduler_trace( file_name );
+}
+
+} // namespace tbb
+
+#endif /* __TBB_scheduler_trace_H */
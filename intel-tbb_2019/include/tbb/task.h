@@ -24,6 +24,7 @@
 #include "tbb_stddef.h"
 #include "tbb_machine.h"
 #include "tbb_profiling.h"
+#include "tick_count.h"
 #include <climits>
 
 typedef struct ___itt_caller *__itt_caller;
@@ -298,6 +299,22 @@ enum priority_t {
     priority_high = priority_normal + internal::priority_stride_v4
 };
 
+//! Priority of the given level out of num_levels, spaced evenly from priority_low to priority_high.
+/** With 3 levels these are priority_low, priority_normal and priority_high. The values in between
+    are valid priorities as well; the scheduler maps them onto the nearest of the levels it is
+    built to distinguish, which is set by __TBB_NUM_PRIORITY_LEVELS when building the library. **/
+inline priority_t priority_level( unsigned level, unsigned num_levels ) {
+    __TBB_ASSERT( num_levels > 1 && level < num_levels, "Invalid priority level" );
+    return priority_t( priority_low + int( (long long)(priority_high - priority_low) * level / (num_levels - 1) ) );
+}
+
+namespace internal {
+    //! True for priority_low, priority_high and the priorities in between.
+    inline bool is_valid_priority( intptr_t p ) {
+        return priority_low <= p && p <= priority_high;
+    }
+}
+
 #endif /* __TBB_TASK_PRIORITY */
 
 #if TBB_USE_CAPTURED_EXCEPTION
@@ -597,6 +614,12 @@ class task: __TBB_TASK_BASE_ACCESS interface5::internal::task_base {
     //! Decrement reference count and return its new value.
     internal::reference_count __TBB_EXPORTED_METHOD internal_decrement_ref_count();
 
+    //! Enqueue all tasks of the list at the given priority level and clear the list.
+    static void __TBB_EXPORTED_FUNC internal_enqueue( task_list& list, intptr_t priority );
+
+    //! Enqueue the task to be taken in the order of deadlines at the given priority level.
+    static void __TBB_EXPORTED_FUNC internal_enqueue_with_deadline( task& t, tick_count deadline, intptr_t priority );
+
 protected:
     //! Default constructor.
     task() {prefix().extra_state=1;}
@@ -814,15 +837,50 @@ public:
     //! Enqueue task for starvation-resistant execution on the specified priority level.
     static void enqueue( task& t, priority_t p ) {
 #if __TBB_PREVIEW_CRITICAL_TASKS
-        __TBB_ASSERT(p == priority_low || p == priority_normal || p == priority_high
-                     || p == internal::priority_critical, "Invalid priority level value");
+        __TBB_ASSERT(internal::is_valid_priority(p) || p == internal::priority_critical, "Invalid priority level value");
 #else
-        __TBB_ASSERT(p == priority_low || p == priority_normal || p == priority_high, "Invalid priority level value");
+        __TBB_ASSERT(internal::is_valid_priority(p), "Invalid priority level value");
 #endif
         t.prefix().owner->enqueue( t, (void*)p );
     }
 #endif /* __TBB_TASK_PRIORITY */
 
+    //! Enqueue all tasks of the list for starvation-resistant execution, and clear the list.
+    /** Has the effect of enqueuing the tasks one by one in the list order, but
+        the tasks are put into the arena's queue at once, and workers are notified once. **/
+    static void enqueue( task_list& list ) {
+        internal_enqueue( list, 0 );
+    }
+
+#if __TBB_TASK_PRIORITY
+    //! Enqueue all tasks of the list on the specified priority level, and clear the list.
+    static void enqueue( task_list& list, priority_t p ) {
+#if __TBB_PREVIEW_CRITICAL_TASKS
+        __TBB_ASSERT(internal::is_valid_priority(p) || p == internal::priority_critical, "Invalid priority level value");
+#else
+        __TBB_ASSERT(internal::is_valid_priority(p), "Invalid priority level value");
+#endif
+        internal_enqueue( list, p );
+    }
+#endif /* __TBB_TASK_PRIORITY */
+
+    //! Enqueue task for execution in the order of deadlines.
+    /** Of the tasks enqueued on the same priority level, the one with the earliest deadline is
+        taken first, and the tasks enqueued without a deadline are taken when none with
+        a deadline is left. The deadline only orders the tasks; a task is executed even if
+        its deadline has passed. **/
+    static void enqueue_with_deadline( task& t, tick_count deadline ) {
+        internal_enqueue_with_deadline( t, deadline, 0 );
+    }
+
+#if __TBB_TASK_PRIORITY
+    //! Enqueue task for execution in the order of deadlines on the specified priority level.
+    static void enqueue_with_deadline( task& t, tick_count deadline, priority_t p ) {
+        __TBB_ASSERT(internal::is_valid_priority(p), "Invalid priority level value");
+        internal_enqueue_with_deadline( t, deadline, p );
+    }
+#endif /* __TBB_TASK_PRIORITY */
+
     //! The innermost task being executed or destroyed by the current thread at the moment.
     static task& __TBB_EXPORTED_FUNC self();
 
@@ -31,8 +31,13 @@
 
 namespace tbb {
 
+namespace interface7 {
+    struct task_arena_statistics;
+} // namespace interface7
+
 namespace this_task_arena {
     int max_concurrency();
+    interface7::task_arena_statistics statistics();
 } // namespace this_task_arena
 
 //! @cond INTERNAL
@@ -47,6 +52,36 @@ namespace internal {
 namespace interface7 {
 class task_arena;
 
+//! Counters of the activity in a task arena, accumulated since the arena was initialized.
+/** The counters are collected by every thread in its arena slot, and summed up when requested.
+    The sum is not an atomic snapshot: the counters are read while the threads update them. **/
+struct task_arena_statistics {
+    //! Number of tasks executed in the arena.
+    size_t tasks_executed;
+    //! Number of attempts to steal a task from another thread of the arena.
+    size_t steals_attempted;
+    //! Number of successful steal attempts.
+    size_t steals_succeeded;
+    //! Number of tasks taken from mailboxes, i.e. executed by the thread they have affinity to.
+    size_t mailbox_tasks_taken;
+    //! Number of tasks enqueued into the arena.
+    size_t tasks_enqueued;
+    //! Total time in seconds that threads spent in the outermost wait_for_all() in the arena.
+    double wait_time;
+    //! Total time in seconds that threads spent looking for work after a failed attempt to get a task.
+    double spin_time;
+    //! Total time in seconds that workers spent in the arena less their spin time.
+    double work_time;
+    //! Total time in seconds that workers had slept in the market before they joined the arena.
+    double sleep_time;
+    //! Number of workers the arena currently demands from the market.
+    int workers_requested;
+    //! Number of workers the market currently allots to the arena.
+    int workers_allotted;
+    //! Number of workers currently servicing the arena.
+    int workers_active;
+};
+
 //! @cond INTERNAL
 namespace internal {
 using namespace tbb::internal; //e.g. function_task from task.h
@@ -125,6 +160,7 @@ protected:
         | (task_group_context::default_traits & task_group_context::exact_exception)  // 0 or 1 << 16
         , exact_exception_flag = task_group_context::exact_exception // used to specify flag for context directly
 #endif
+        , nested_flag = 0x0100 << 16 // the arena takes its workers from the quota of the initializing thread's arena
     };
 
     task_arena_base(int max_concurrency, unsigned reserved_for_masters)
@@ -145,6 +181,7 @@ protected:
     void __TBB_EXPORTED_METHOD internal_wait() const;
     static int __TBB_EXPORTED_FUNC internal_current_slot();
     static int __TBB_EXPORTED_FUNC internal_max_concurrency( const task_arena * );
+    static void __TBB_EXPORTED_FUNC internal_statistics( const task_arena *, task_arena_statistics & );
 public:
     //! Typedef for number of threads that is automatic.
     static const int automatic = -1;
@@ -173,6 +210,7 @@ R isolate_impl(F& f) {
 class task_arena : public internal::task_arena_base {
     friend class tbb::internal::task_scheduler_observer_v3;
     friend int tbb::this_task_arena::max_concurrency();
+    friend task_arena_statistics tbb::this_task_arena::statistics();
     bool my_initialized;
     void mark_initialized() {
         __TBB_ASSERT( my_arena, "task_arena initialization is incomplete" );
@@ -229,7 +267,27 @@ public:
     task_arena(const task_arena &s) // copy settings but not the reference or instance
         : task_arena_base(s.my_max_concurrency, s.my_master_slots)
         , my_initialized(false)
-    {}
+    {
+        my_version_and_traits |= s.my_version_and_traits & nested_flag;
+    }
+
+    //! Tag class used to indicate the constructor of a nested arena
+    struct nested {};
+
+    //! Creates task_arena that borrows workers from the arena of the thread that initializes it
+    /** The workers serving the arena count against the number of workers of the parent arena,
+        so together with the parent's own workers, and with those of all the arenas nested into
+        either of them, they never exceed it. A worker is returned to the parent when it leaves
+        the nested arena for lack of work. Master threads are not counted.
+        The automatic concurrency is that of the parent arena.
+        If the initializing thread is not in an arena, the arena takes its workers from the
+        market as usual. **/
+    task_arena(nested, int max_concurrency_ = automatic, unsigned reserved_for_masters = 1)
+        : task_arena_base(max_concurrency_, reserved_for_masters)
+        , my_initialized(false)
+    {
+        my_version_and_traits |= nested_flag;
+    }
 
     //! Tag class used to indicate the "attaching" constructor
     struct attach {};
@@ -314,20 +372,18 @@ public:
 #if __TBB_CPP11_RVALUE_REF_PRESENT
     void enqueue( F&& f, priority_t p ) {
 #if __TBB_PREVIEW_CRITICAL_TASKS
-        __TBB_ASSERT(p == priority_low || p == priority_normal || p == priority_high
-                     || p == internal::priority_critical, "Invalid priority level value");
+        __TBB_ASSERT(tbb::internal::is_valid_priority(p) || p == internal::priority_critical, "Invalid priority level value");
 #else
-        __TBB_ASSERT(p == priority_low || p == priority_normal || p == priority_high, "Invalid priority level value");
+        __TBB_ASSERT(tbb::internal::is_valid_priority(p), "Invalid priority level value");
 #endif
         enqueue_impl(std::forward<F>(f), p);
     }
 #else
     void enqueue( const F& f, priority_t p ) {
 #if __TBB_PREVIEW_CRITICAL_TASKS
-        __TBB_ASSERT(p == priority_low || p == priority_normal || p == priority_high
-                     || p == internal::priority_critical, "Invalid priority level value");
+        __TBB_ASSERT(tbb::internal::is_valid_priority(p) || p == internal::priority_critical, "Invalid priority level value");
 #else
-        __TBB_ASSERT(p == priority_low || p == priority_normal || p == priority_high, "Invalid priority level value");
+        __TBB_ASSERT(tbb::internal::is_valid_priority(p), "Invalid priority level value");
 #endif
         enqueue_impl(f,p);
     }
@@ -373,6 +429,13 @@ public:
         // Handle special cases inside the library
         return (my_max_concurrency>1) ? my_max_concurrency : internal_max_concurrency(this);
     }
+
+    //! Returns the activity counters of the arena; all of them are zero if it is not initialized
+    task_arena_statistics statistics() const {
+        task_arena_statistics s;
+        internal_statistics(this, s);
+        return s;
+    }
 };
 
 #if __TBB_TASK_ISOLATION
@@ -395,6 +458,7 @@ namespace this_task_arena {
 } // namespace interfaceX
 
 using interface7::task_arena;
+using interface7::task_arena_statistics;
 #if __TBB_TASK_ISOLATION
 namespace this_task_arena {
     using namespace interface7::this_task_arena;
@@ -412,6 +476,14 @@ namespace this_task_arena {
     inline int max_concurrency() {
         return tbb::task_arena::internal_max_concurrency(NULL);
     }
+
+    //! Returns the activity counters of the arena the calling thread works in
+    //! All of them are zero if the thread does not work in an arena
+    inline task_arena_statistics statistics() {
+        task_arena_statistics s;
+        tbb::task_arena::internal_statistics(NULL, s);
+        return s;
+    }
 } // namespace this_task_arena
 
 } // namespace tbb
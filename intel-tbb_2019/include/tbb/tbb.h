@@ -72,6 +72,7 @@
 #include "queuing_rw_mutex.h"
 #include "reader_writer_lock.h"
 #include "recursive_mutex.h"
+#include "scheduler_trace.h"
 #include "spin_mutex.h"
 #include "spin_rw_mutex.h"
 #include "task.h"
@@ -56,6 +56,9 @@ public:
         //! Extract the intervals from the tick_counts and subtract them.
         friend interval_t operator-( const tick_count& t1, const tick_count& t0 );
 
+        //! Shift the timestamp by the interval.
+        friend tick_count operator+( const tick_count& t, const interval_t& i );
+
         //! Add two intervals.
         friend interval_t operator+( const interval_t& i, const interval_t& j ) {
             return interval_t(i.value+j.value);
@@ -95,6 +98,9 @@ public:
     //! Subtract two timestamps to get the time interval between
     friend interval_t operator-( const tick_count& t1, const tick_count& t0 );
 
+    //! Add the time interval to the timestamp, e.g. to get a deadline
+    friend tick_count operator+( const tick_count& t, const interval_t& i );
+
     //! Return the resolution of the clock in seconds per tick.
     static double resolution() { return 1.0 / interval_t::ticks_per_second(); }
 
@@ -131,6 +137,12 @@ inline tick_count::interval_t operator-( const tick_count& t1, const tick_count&
     return tick_count::interval_t( t1.my_count-t0.my_count );
 }
 
+inline tick_count operator+( const tick_count& t, const tick_count::interval_t& i ) {
+    tick_count result;
+    result.my_count = t.my_count+i.value;
+    return result;
+}
+
 inline double tick_count::interval_t::seconds() const {
     return value*tick_count::resolution();
 }
@@ -29,11 +29,13 @@
 #include "tbb/blocked_range.h"
 #include "../test/harness.h"
 #include "tbb/concurrent_priority_queue.h"
+#include "tbb/concurrent_relaxed_priority_queue.h"
 
 #pragma warning(disable: 4996)
 
 #define IMPL_STL 0
 #define IMPL_CPQ 1
+#define IMPL_RELAXED 2
 
 using namespace tbb;
 
@@ -47,6 +49,8 @@ const int min_spawn = 0; // min number of events to spawn
 const int max_spawn = 2; // max number of events to spawn
 
 tbb::atomic<unsigned int> operation_count;
+// pops of an event earlier than the latest one popped by the same thread, a measure of the order relaxation
+tbb::atomic<unsigned int> inversion_count;
 tbb::tick_count start;
 bool done;
 
@@ -67,6 +71,7 @@ public:
 spin_mutex *my_mutex;
 std::priority_queue<event, std::vector<event>, timestamp_compare > *stl_cpq;
 concurrent_priority_queue<event, timestamp_compare > *lfc_pq;
+concurrent_relaxed_priority_queue<event, timestamp_compare > *relaxed_pq;
 
 unsigned int one_us_iters = 429; // default value
 
@@ -99,9 +104,12 @@ void do_push(event elem, int nThr, int impl) {
             stl_cpq->push(elem);
         }
     }
-    else {
+    else if (impl == IMPL_CPQ) {
         lfc_pq->push(elem);
     }
+    else {
+        relaxed_pq->push(elem);
+    }
 }
 
 bool do_pop(event& elem, int nThr, int impl) {
@@ -122,11 +130,16 @@ bool do_pop(event& elem, int nThr, int impl) {
             }
         }
     }
-    else {
+    else if (impl == IMPL_CPQ) {
         if (lfc_pq->try_pop(elem)) {
             return true;
         }
     }
+    else {
+        if (relaxed_pq->try_pop(elem)) {
+            return true;
+        }
+    }
     return false;
 }
 
@@ -144,11 +157,15 @@ struct TestPDESloadBody : NoAssign {
         }
         else {
             event e, tmp;
-            unsigned int num_operations = 0;
+            unsigned int num_operations = 0, num_inversions = 0;
+            int last_timestamp = 0;
             for (;;) {
                 // pop an event
                 if (do_pop(e, nThread, implementation)) {
                     num_operations++;
+                    if (e.timestamp < last_timestamp)
+                        num_inversions++;
+                    last_timestamp = e.timestamp;
                     // do the event
                     busy_wait(e.elapse*contention_unit);
                     while (e.spawn > 0) {
@@ -167,6 +184,7 @@ struct TestPDESloadBody : NoAssign {
                 if (done) break;
             }
             operation_count += num_operations;
+            inversion_count += num_inversions;
         }
     }
 };
@@ -193,7 +211,7 @@ void TestPDESload(int nThreads) {
     NativeParallelFor(nThreads+1, my_stl_test);
     delete stl_cpq;
 
-    REPORT(" %10d", operation_count/throughput_window);
+    REPORT(" %10d", int(operation_count/throughput_window));
     
     operation_count = 0;
     done = false;
@@ -204,7 +222,20 @@ void TestPDESload(int nThreads) {
     NativeParallelFor(nThreads+1, my_cpq_test);
     delete lfc_pq;
 
-    REPORT(" %10d\n", operation_count/throughput_window);
+    REPORT(" %10d", int(operation_count/throughput_window));
+
+    operation_count = 0;
+    inversion_count = 0;
+    done = false;
+    relaxed_pq = new concurrent_relaxed_priority_queue<event, timestamp_compare >;
+    preload_queue(nThreads, IMPL_RELAXED);
+    TestPDESloadBody my_relaxed_test(nThreads, IMPL_RELAXED);
+    start = tbb::tick_count::now();
+    NativeParallelFor(nThreads+1, my_relaxed_test);
+    delete relaxed_pq;
+
+    REPORT(" %10d %9.4f%%\n", int(operation_count/throughput_window),
+           operation_count ? 100.0*inversion_count/operation_count : 0.0);
 }
 
 int TestMain() {
@@ -218,10 +249,11 @@ int TestMain() {
     REPORT("#Thr ");
     REPORT("STL        ");
 #ifdef LINEARIZABLE
-    REPORT("CPQ_L\n"); 
+    REPORT("CPQ_L      ");
 #else
-    REPORT("CPQ_N\n"); 
+    REPORT("CPQ_N      ");
 #endif
+    REPORT("RELAXED    inversions\n");
     for (int p = MinThread; p <= MaxThread; ++p) {
         TestPDESload(p);
     }
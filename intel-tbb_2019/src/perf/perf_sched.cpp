@@ -21,6 +21,8 @@
 #include "perf.h"
 
 #include <cmath>
+#include <cstdlib>
+#include <vector>
 
 #include "tbb/blocked_range.h"
 #include "tbb/parallel_for.h"
@@ -429,6 +431,59 @@ public:
     Test_PReduce ( PartitionerType pt = SimplePartitioner ) : Test_Algs(pt) {}
 }; // class Test_PReduce
 
+//! Repeatedly updates an array that does not fit the private caches.
+/** Subranges stolen by a nearby thread find the data in a shared cache, so the
+    test shows the effect of topology-aware stealing enabled by TBB_STEAL_TOPOLOGY
+    (and of worker pinning enabled by TBB_PIN_WORKERS). **/
+class Test_PFor_Touch : public Perf::Test {
+    static const int numWorkloads = 3;
+    static const count_t touchRanges[numWorkloads];
+    static const count_t touchGrain = 4096;
+    static const int numPasses = 8;
+
+    std::vector<count_t> my_data;
+    tbb::simple_partitioner my_partitioner;
+
+    class Body {
+        count_t* my_data;
+    public:
+        Body ( count_t* data ) : my_data(data) {}
+        void operator()( const range_t& r ) const {
+            for( count_t i = r.begin(); i < r.end(); ++i )
+                my_data[i] += i;
+        }
+    }; // class Body
+
+protected:
+    const char* Name () {
+        if ( getenv("TBB_STEAL_TOPOLOGY") )
+            return getenv("TBB_PIN_WORKERS") ? "PFor-Touch-Topology-Pinned" : "PFor-Touch-Topology";
+        return "PFor-Touch";
+    }
+
+    int NumWorkloads () { return numWorkloads; }
+
+    void SetWorkload ( int idx ) {
+        IterRange = touchRanges[idx];
+        my_data.assign( IterRange, 0 );
+        Perf::SetWorkloadName( "%dK", IterRange / 1024 );
+    }
+
+    void Run ( ThreadInfo& ) {
+        for ( int i = 0; i < numPasses; ++i )
+            tbb::parallel_for( range_t(0, IterRange, touchGrain), Body(&my_data[0]), my_partitioner );
+    }
+
+    void RunSerial ( ThreadInfo& ) {
+        Body body(&my_data[0]);
+        for ( int i = 0; i < numPasses; ++i )
+            body( range_t(0, IterRange, touchGrain) );
+    }
+}; // class Test_PFor_Touch
+
+// 1, 8 and 64 MB of data
+const count_t Test_PFor_Touch::touchRanges[] = {256*1024, 2*1024*1024, 16*1024*1024};
+
 int main( int argc, char* argv[] ) {
     Perf::SessionSettings opts (Perf::UseTaskScheduler | Perf::UseSerialBaseline, "perf_sched.txt");   // Perf::UseBaseline, Perf::UseSmallestWorkloadOnly
     Perf::RegisterTest<Test_SPMC>();
@@ -452,5 +507,6 @@ int main( int argc, char* argv[] ) {
     Perf::RegisterTest(pf_sn_ap);
     Perf::RegisterTest(pf_dn_sp);
     Perf::RegisterTest(pf_dn_ap);
+    Perf::RegisterTest<Test_PFor_Touch>();
     return Perf::TestMain(argc, argv, &opts);
 }
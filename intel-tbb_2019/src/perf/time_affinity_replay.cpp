@@ -0,0 +1,206 @@
+/*
+    Copyright (c) 2005-2019 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+// Measures how well affinity_partitioner replays the placement of the iterations
+// when the loops change between the executions. Two kernels are modeled on the
+// examples: the stress and velocity sweeps of parallel_for/seismic over the rows
+// of a grid, and a generation of parallel_for/game_of_life over a blocked_range2d.
+// Every frame the number of rows changes by up to "jitter", and every "period"
+// frames the loops move to an arena with a different number of threads, as the
+// examples do when they run with a range of thread numbers. A partitioner that
+// keeps the iterations on the threads that touched them last time runs faster,
+// because the data stays in their caches; to count the cache misses directly,
+// run this under a hardware counter tool, e.g. "perf stat -e cache-misses", with
+// one "mode" at a time.
+
+#include "../examples/common/utility/utility.h"
+#include "tbb/parallel_for.h"
+#include "tbb/partitioner.h"
+#include "tbb/blocked_range.h"
+#include "tbb/blocked_range2d.h"
+#include "tbb/task_arena.h"
+#include "tbb/task_scheduler_init.h"
+#include "tbb/tick_count.h"
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+struct parameter_pack {
+    int threads_number;
+    int width;
+    int height;
+    int frames;
+    int jitter;
+    int period;
+    std::string mode;
+};
+
+class grid {
+    std::vector<float> my_v, my_s, my_d;
+    std::vector<char> my_cells[2];
+    int my_width;
+public:
+    grid(int width, int height) : my_v(size_t(width)*height, 0.f), my_s(size_t(width)*height, 0.f),
+                                  my_d(size_t(width)*height, 0.5f), my_width(width) {
+        for (int k = 0; k < 2; ++k)
+            my_cells[k].assign(size_t(width)*height, 0);
+        for (size_t i = 0; i < my_cells[0].size(); i += 3)
+            my_cells[0][i] = 1;
+    }
+    int width() const { return my_width; }
+    float* v(int row) { return &my_v[size_t(row)*my_width]; }
+    float* s(int row) { return &my_s[size_t(row)*my_width]; }
+    const float* d(int row) const { return &my_d[size_t(row)*my_width]; }
+    char* cells(int k, int row) { return &my_cells[k][size_t(row)*my_width]; }
+};
+
+//! The stress sweep of seismic
+class stress_body {
+    grid& my_grid;
+public:
+    stress_body(grid& g) : my_grid(g) {}
+    void operator()(const tbb::blocked_range<int>& r) const {
+        for (int i = r.begin(); i != r.end(); ++i) {
+            float* s = my_grid.s(i);
+            const float* v = my_grid.v(i);
+            const float* v1 = my_grid.v(i + 1);
+            for (int j = 1; j < my_grid.width() - 1; ++j)
+                s[j] += (v[j+1] - v[j] + v1[j] - v[j]) * 0.25f;
+        }
+    }
+};
+
+//! The velocity sweep of seismic
+class velocity_body {
+    grid& my_grid;
+public:
+    velocity_body(grid& g) : my_grid(g) {}
+    void operator()(const tbb::blocked_range<int>& r) const {
+        for (int i = r.begin(); i != r.end(); ++i) {
+            float* v = my_grid.v(i);
+            const float* s = my_grid.s(i);
+            const float* s0 = my_grid.s(i - 1);
+            const float* d = my_grid.d(i);
+            for (int j = 1; j < my_grid.width() - 1; ++j)
+                v[j] = (v[j] + (s[j] - s[j-1] + s[j] - s0[j]) * 0.5f) * d[j];
+        }
+    }
+};
+
+//! A generation of game_of_life
+class life_body {
+    grid& my_grid;
+    int my_from;
+public:
+    life_body(grid& g, int from) : my_grid(g), my_from(from) {}
+    void operator()(const tbb::blocked_range2d<int>& r) const {
+        for (int i = r.rows().begin(); i != r.rows().end(); ++i) {
+            const char* up = my_grid.cells(my_from, i - 1);
+            const char* row = my_grid.cells(my_from, i);
+            const char* down = my_grid.cells(my_from, i + 1);
+            char* dest = my_grid.cells(1 - my_from, i);
+            for (int j = r.cols().begin(); j != r.cols().end(); ++j) {
+                int n = up[j-1] + up[j] + up[j+1] + row[j-1] + row[j+1] + down[j-1] + down[j] + down[j+1];
+                dest[j] = char(n == 3 || (n == 2 && row[j]));
+            }
+        }
+    }
+};
+
+template<typename Partitioner>
+class frame_body {
+    grid& my_grid;
+    Partitioner& my_partitioner;
+    int my_rows;
+    int my_generation;
+public:
+    frame_body(grid& g, Partitioner& p, int rows, int generation)
+        : my_grid(g), my_partitioner(p), my_rows(rows), my_generation(generation) {}
+    void operator()() const {
+        tbb::parallel_for(tbb::blocked_range<int>(0, my_rows - 1), stress_body(my_grid), my_partitioner);
+        tbb::parallel_for(tbb::blocked_range<int>(1, my_rows - 1), velocity_body(my_grid), my_partitioner);
+        tbb::parallel_for(tbb::blocked_range2d<int>(1, my_rows - 1, 1, my_grid.width() - 1),
+                          life_body(my_grid, my_generation % 2), my_partitioner);
+    }
+};
+
+template<typename Partitioner>
+static void run(const char* name, const parameter_pack& p, Partitioner& partitioner) {
+    grid g(p.width, p.height + 2);
+    tbb::task_arena arenas[2];
+    arenas[0].initialize(p.threads_number);
+    arenas[1].initialize(p.threads_number > 1 ? p.threads_number - 1 : 1);
+    double elapsed = 0;
+    for (int frame = 0; frame < p.frames; ++frame) {
+        // Deterministic jitter of the number of rows, the same for all the modes
+        const int rows = p.height - int((unsigned(frame) * 2654435761u >> 16) % unsigned(p.jitter + 1));
+        tbb::task_arena& arena = arenas[frame / p.period % 2];
+        const tbb::tick_count t0 = tbb::tick_count::now();
+        arena.execute(frame_body<Partitioner>(g, partitioner, rows, frame));
+        // The first frames only warm the caches up
+        if (frame >= p.period)
+            elapsed += (tbb::tick_count::now() - t0).seconds();
+    }
+    std::cout << std::setw(20) << name << std::setw(16) << std::fixed << std::setprecision(1)
+              << elapsed / (p.frames - p.period) * 1e6 << std::endl;
+}
+
+int main(int argc, const char** args) {
+    parameter_pack p;
+    p.threads_number = tbb::task_scheduler_init::default_num_threads();
+    p.width = 1024;
+    p.height = 1024;
+    p.frames = 400;
+    p.jitter = 8;
+    p.period = 20;
+    p.mode = "all";
+
+    utility::parse_cli_arguments(argc,args,utility::cli_argument_pack()
+            .arg(p.threads_number,"n-of-threads","number of threads in the larger of the two arenas")
+            .arg(p.width,"width","number of columns of the grid")
+            .arg(p.height,"height","maximal number of rows of the grid")
+            .arg(p.frames,"frames","number of frames to compute")
+            .arg(p.jitter,"jitter","maximal change of the number of rows between the frames")
+            .arg(p.period,"period","number of frames between the changes of the number of threads")
+            .arg(p.mode,"mode","auto, task, fraction or all")
+            );
+    if (p.threads_number < 1 || p.width < 3 || p.period < 1 || p.frames <= p.period
+        || p.jitter < 0 || p.height - p.jitter < 3) {
+        std::cerr << "invalid parameters" << std::endl;
+        return 1;
+    }
+
+    std::cout << std::setw(20) << "partitioner" << std::setw(16) << "us per frame" << std::endl;
+    if (p.mode == "all" || p.mode == "auto") {
+        tbb::auto_partitioner ap;
+        run("auto", p, ap);
+    }
+    if (p.mode == "all" || p.mode == "task") {
+        tbb::affinity_partitioner ap;
+        run("affinity by task", p, ap);
+    }
+    if (p.mode == "all" || p.mode == "fraction") {
+        tbb::affinity_partitioner ap(tbb::affinity_partitioner::replay_by_fraction);
+        run("affinity by fraction", p, ap);
+    }
+    return 0;
+}
@@ -0,0 +1,111 @@
+/*
+    Copyright (c) 2005-2019 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+// Compares the per-task cost of submitting a batch of tasks one by one
+// with submitting it as a single task_list. For spawn the list is placed
+// into the task pool growing it at most once, for enqueue it is pushed into
+// a single task_stream lane under one lock with one wake-up of workers.
+// Reported is the time per task of the submission and of the whole batch
+// including the execution of the (empty) tasks.
+
+#include "../examples/common/utility/utility.h"
+#include "tbb/task.h"
+#include "tbb/task_scheduler_init.h"
+#include "tbb/tick_count.h"
+
+#include <iostream>
+#include <iomanip>
+
+struct parameter_pack {
+    int threads_number;
+    int batch_size;
+    int batches;
+};
+
+enum submission_mode {
+    spawn_one_by_one,
+    spawn_list,
+    enqueue_one_by_one,
+    enqueue_list
+};
+
+static const char* mode_names[] = {
+    "spawn", "spawn(list)", "enqueue", "enqueue(list)"
+};
+
+static void submit(submission_mode mode, tbb::task &root, int n) {
+    tbb::task_list list;
+    for (int i = 0; i < n; ++i) {
+        tbb::task &t = *new(root.allocate_child()) tbb::empty_task;
+        switch (mode) {
+        case spawn_one_by_one:   tbb::task::spawn(t); break;
+        case enqueue_one_by_one: tbb::task::enqueue(t); break;
+        default:                 list.push_back(t);
+        }
+    }
+    if (mode == spawn_list)
+        tbb::task::spawn(list);
+    else if (mode == enqueue_list)
+        tbb::task::enqueue(list);
+}
+
+static void run(const parameter_pack &p, submission_mode mode) {
+    double submit_time = 0, total_time = 0;
+    tbb::task &root = *new(tbb::task::allocate_root()) tbb::empty_task;
+    for (int i = 0; i < p.batches; ++i) {
+        root.set_ref_count(p.batch_size + 1);
+        const tbb::tick_count t0 = tbb::tick_count::now();
+        submit(mode, root, p.batch_size);
+        const tbb::tick_count t1 = tbb::tick_count::now();
+        root.wait_for_all();
+        const tbb::tick_count t2 = tbb::tick_count::now();
+        submit_time += (t1 - t0).seconds();
+        total_time += (t2 - t0).seconds();
+    }
+    tbb::task::destroy(root);
+    const double n = double(p.batches) * p.batch_size;
+    std::cout << std::setw(16) << mode_names[mode]
+              << std::setw(14) << std::fixed << std::setprecision(1) << submit_time / n * 1e9
+              << std::setw(14) << total_time / n * 1e9 << std::endl;
+}
+
+int main(int argc, const char** args) {
+    parameter_pack p;
+    p.threads_number = tbb::task_scheduler_init::default_num_threads();
+    p.batch_size = 1000;
+    p.batches = 2000;
+
+    utility::parse_cli_arguments(argc,args,utility::cli_argument_pack()
+            .arg(p.threads_number,"n-of-threads","number of threads including the submitting one")
+            .arg(p.batch_size,"batch-size","number of tasks submitted at once")
+            .arg(p.batches,"batches","number of batches per submission mode")
+            );
+    if (p.threads_number < 1 || p.batch_size < 1 || p.batches < 1) {
+        std::cerr << "all parameters must be positive" << std::endl;
+        return 1;
+    }
+
+    tbb::task_scheduler_init init(p.threads_number);
+    std::cout << std::setw(16) << "mode" << std::setw(14) << "submit, ns"
+              << std::setw(14) << "total, ns" << std::endl;
+    for (int mode = spawn_one_by_one; mode <= enqueue_list; ++mode)
+        run(p, submission_mode(mode));
+    return 0;
+}
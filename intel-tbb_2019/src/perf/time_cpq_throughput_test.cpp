@@ -24,12 +24,15 @@
 #include <cstdlib>
 #include <cmath>
 #include <queue>
+#include <vector>
+#include <algorithm>
 #include "tbb/tbb_stddef.h"
 #include "tbb/spin_mutex.h"
 #include "tbb/task_scheduler_init.h"
 #include "tbb/tick_count.h"
 #include "tbb/cache_aligned_allocator.h"
 #include "tbb/concurrent_priority_queue.h"
+#include "tbb/concurrent_relaxed_priority_queue.h"
 #include "../test/harness.h"
 #include "../examples/common/utility/utility.h"
 #if _MSC_VER
@@ -39,6 +42,7 @@
 #define IMPL_SERIAL 0
 #define IMPL_STL 1
 #define IMPL_CPQ 2
+#define IMPL_RELAXED 3
 
 using namespace tbb;
 
@@ -48,6 +52,8 @@ int contention = 1; // busywork between operations in us
 int preload = 0; // # elements to pre-load queue with
 double throughput_window = 30.0; // in seconds
 int ops_per_iteration = 20; // minimum: 2 (1 push, 1 pop)
+int number_of_queues = 0; // heaps in the relaxed queue, 0 for the default
+int quality_size = 100000; // # distinct elements popped to measure the rank error
 const int sample_operations = 1000; // for timing checks
 
 // global data & types
@@ -100,6 +106,9 @@ std::priority_queue<my_data_type, std::vector<my_data_type>, my_less > *stl_cpq;
 // TBB concurrent_priority_queue
 concurrent_priority_queue<my_data_type, my_less > *agg_cpq;
 
+// TBB concurrent_relaxed_priority_queue
+concurrent_relaxed_priority_queue<my_data_type, my_less > *relaxed_cpq;
+
 // Busy work and calibration helpers
 unsigned int one_us_iters = 345; // default value
 
@@ -134,6 +143,9 @@ void do_push(my_data_type elem, int nThr, int impl) {
     else if (impl == IMPL_CPQ) {
         agg_cpq->push(elem);
     }
+    else if (impl == IMPL_RELAXED) {
+        relaxed_cpq->push(elem);
+    }
 }
 
 // Pop from priority queue, depending on implementation
@@ -159,6 +171,11 @@ my_data_type do_pop(int nThr, int impl) {
             return elem;
         }
     }
+    else if (impl == IMPL_RELAXED) {
+        if (relaxed_cpq->try_pop(elem)) {
+            return elem;
+        }
+    }
     return elem;
 }
 
@@ -241,6 +258,87 @@ void TestThroughputCpqOnNThreads(int nThreads) {
         
         printf("CPQ  %3d %10d\n", nThreads, int(operation_count/(now-start).seconds()));
     }
+    else if (impl == IMPL_RELAXED) {
+        relaxed_cpq = new concurrent_relaxed_priority_queue<my_data_type, my_less >(number_of_queues);
+        for (int i=0; i<preload; ++i) do_push(input_data[i], nThreads, IMPL_RELAXED);
+
+        TestThroughputBody my_relaxed_test(nThreads, IMPL_RELAXED);
+        start = tbb::tick_count::now();
+        NativeParallelFor(nThreads, my_relaxed_test);
+        now = tbb::tick_count::now();
+        printf("RLX  %3d %10d  (%d heaps)\n", nThreads, int(operation_count/(now-start).seconds()),
+               int(relaxed_cpq->number_of_queues()));
+        delete relaxed_cpq;
+    }
+}
+
+// Quality of the order: the queue is loaded with quality_size distinct priorities and then
+// emptied by nThreads threads. The rank error of a pop is the number of elements of higher
+// priority still in the queue; for an exact queue it is zero up to the races between the
+// threads. The pops are ordered by a shared counter taken right after each pop.
+int *popped_priorities;
+tbb::atomic<int> pop_sequence;
+
+struct TestQualityBody : NoAssign {
+    int nThread;
+    int implementation;
+
+    TestQualityBody(int nThread_, int implementation_) :
+        nThread(nThread_), implementation(implementation_) {}
+
+    void operator()(const int) const {
+        for (;;) {
+            // do_pop returns the default element with zero priority when the queue is empty
+            my_data_type elem = do_pop(nThread, implementation);
+            if (elem.priority == 0) break;
+            popped_priorities[pop_sequence++] = elem.priority;
+        }
+    }
+};
+
+void TestQualityOnNThreads(int nThreads) {
+    if (impl == IMPL_STL)
+        stl_cpq = new std::priority_queue<my_data_type, std::vector<my_data_type>, my_less >;
+    else if (impl == IMPL_CPQ)
+        agg_cpq = new concurrent_priority_queue<my_data_type, my_less >;
+    else if (impl == IMPL_RELAXED)
+        relaxed_cpq = new concurrent_relaxed_priority_queue<my_data_type, my_less >(number_of_queues);
+    popped_priorities = new int[quality_size];
+    for (int i=0; i<quality_size; ++i) popped_priorities[i] = i+1;
+    std::random_shuffle(popped_priorities, popped_priorities+quality_size);
+    my_data_type elem;
+    for (int i=0; i<quality_size; ++i) {
+        elem.priority = popped_priorities[i];
+        do_push(elem, nThreads, impl);
+    }
+    pop_sequence = 0;
+    NativeParallelFor(nThreads, TestQualityBody(nThreads, impl));
+    if (impl == IMPL_STL) delete stl_cpq;
+    else if (impl == IMPL_CPQ) delete agg_cpq;
+    else if (impl == IMPL_RELAXED) delete relaxed_cpq;
+
+    // Fenwick tree over the priorities still in the queue
+    std::vector<int> tree(quality_size+1, 0);
+    for (int i=1; i<=quality_size; ++i) {
+        ++tree[i];
+        int parent = i + (i & -i);
+        if (parent <= quality_size) tree[parent] += tree[i];
+    }
+    double rank_sum = 0;
+    int rank_max = 0;
+    for (int n=0; n<int(pop_sequence); ++n) {
+        // the number of remaining priorities not greater than the popped one
+        int not_greater = 0;
+        for (int i=popped_priorities[n]; i>0; i -= i & -i) not_greater += tree[i];
+        const int rank = quality_size - n - not_greater;
+        rank_sum += rank;
+        if (rank > rank_max) rank_max = rank;
+        for (int i=popped_priorities[n]; i<=quality_size; i += i & -i) --tree[i];
+    }
+    delete[] popped_priorities;
+    if (pop_sequence != quality_size)
+        printf("%d elements of %d are popped\n", int(pop_sequence), quality_size);
+    printf("rank error %3d: mean %10.2f max %8d\n", nThreads, rank_sum/quality_size, rank_max);
 }
 
 
@@ -248,16 +346,18 @@ int main(int argc, char *argv[]) {
     utility::thread_number_range threads(tbb::task_scheduler_init::default_num_threads);
     struct select_impl{
         static bool validate(const int & impl){
-            return  ((impl == IMPL_SERIAL) || (impl == IMPL_STL) || (impl == IMPL_CPQ));
+            return  ((impl == IMPL_SERIAL) || (impl == IMPL_STL) || (impl == IMPL_CPQ) || (impl == IMPL_RELAXED));
         }
     };
     utility::parse_cli_arguments(argc,argv,utility::cli_argument_pack()
             .positional_arg(threads,"n-of-threads",utility::thread_number_range_desc)
             .positional_arg(contention,"contention"," busywork between operations, in us")
-            .positional_arg(impl,"queue_type", "which implementation to test. One of 0(SERIAL), 1(STL), 2(CPQ) ", select_impl::validate)
+            .positional_arg(impl,"queue_type", "which implementation to test. One of 0(SERIAL), 1(STL), 2(CPQ), 3(RELAXED) ", select_impl::validate)
             .positional_arg(preload,"preload","number of elements to pre-load queue with")
             .positional_arg(ops_per_iteration, "batch size" ,"minimum: 2 (1 push, 1 pop)")
             .positional_arg(throughput_window, "duration", "in seconds")
+            .arg(number_of_queues, "queues", "number of heaps in the relaxed queue, 0 for the default")
+            .arg(quality_size, "quality-size", "number of elements to measure the rank error with, 0 to skip")
             );
 
     std::cout<< "Priority queue performance test "<<impl<<" will run with "<<contention<<"us contention "
@@ -288,6 +388,9 @@ int main(int argc, char *argv[]) {
     else {
         for( int p=threads.first; p<=threads.last; p = threads.step(p) ) {
             TestThroughputCpqOnNThreads(p);
+            operation_count = 0;
+            if (quality_size > 0)
+                TestQualityOnNThreads(p);
         }
     }
     return Harness::Done;
@@ -32,6 +32,9 @@
 #define TESTTABLE 0
 #define TESTTABLEHEADER "tbb/concurrent_unordered_map.h"
 
+//! enable/disable concurrent_flat_hash_map tests
+#define FLATTABLE 1
+
 //! avoid erase()
 #define TEST_ERASE 1
 
@@ -77,6 +80,11 @@ namespace version_current {
 }
 typedef version_current::tbb::concurrent_hash_map<int,int> IntTable;
 
+#if FLATTABLE
+#include "tbb/concurrent_flat_hash_map.h"
+typedef tbb::concurrent_flat_hash_map<int,int> FlatTable;
+#endif
+
 #if OLDTABLE
 #undef __TBB_concurrent_hash_map_H
 namespace version_base {
@@ -101,7 +109,7 @@ typedef version_new::tbb::concurrent_unordered_map<int,int> TestTable;
 ///////////////////////////////////////
 
 static const char *map_testnames[] = {
-    "1.insert", "2.count1st", "3.count2nd", "4.insert-exists", "5.erase "
+    "1.insert", "2.count1st", "3.count2nd", "4.insert-exists", "5.read90%", "6.erase "
 };
 
 template<typename TableType>
@@ -109,7 +117,7 @@ struct TestTBBMap : TesterBase {
     TableType Table;
     int n_items;
 
-    TestTBBMap() : TesterBase(4+TEST_ERASE), Table(MaxThread*4) {}
+    TestTBBMap() : TesterBase(5+TEST_ERASE), Table(MaxThread*4) {}
     void init() { n_items = value/threads_count; }
 
     std::string get_name(int testn) {
@@ -140,8 +148,16 @@ struct TestTBBMap : TesterBase {
                 Table.insert( std::make_pair(i,i) );
             }
             break;
+          case 4: // work4: a lookup table, one new key per 9 lookups
+            for(int i = t*n_items, e = (t+1)*n_items; i < e; i++) {
+                if( i % 10 )
+                    Table.count( i );
+                else
+                    Table.insert( std::make_pair(int(value)+i,i) );
+            }
+            break;
 #if TEST_ERASE
-          case 4: // clean
+          case 5: // clean
             for(int i = t*n_items, e = (t+1)*n_items; i < e; i++) {
                 ASSERT( Table.erase( i ), NULL);
             }
@@ -157,7 +173,7 @@ struct TestSTLMap : TesterBase {
     M mutex;
 
     int n_items;
-    TestSTLMap() : TesterBase(4+TEST_ERASE) {}
+    TestSTLMap() : TesterBase(5+TEST_ERASE) {}
     void init() { n_items = value/threads_count; }
 
     std::string get_name(int testn) {
@@ -192,7 +208,16 @@ struct TestSTLMap : TesterBase {
                 Table.insert(std::make_pair(i,i));
             }
             break;
-          case 4: // clean
+          case 4: // work4
+            for(int i = t*n_items, e = (t+1)*n_items; i < e; i++) {
+                typename M::scoped_lock with(mutex);
+                if( i % 10 )
+                    Table.count(i);
+                else
+                    Table.insert(std::make_pair(int(value)+i,i));
+            }
+            break;
+          case 5: // clean
             for(int i = t*n_items, e = (t+1)*n_items; i < e; i++) {
                 typename M::scoped_lock with(mutex);
                 Table.erase(i);
@@ -229,6 +254,9 @@ public:
             run("old::hmap", new NanosecPerValue<TestTBBMap<OldTable> >() ),
 #endif
             run("tbb::hmap", new NanosecPerValue<TestTBBMap<IntTable> >() ),
+#if FLATTABLE
+            run("flat::hmap", new NanosecPerValue<TestTBBMap<FlatTable> >() ),
+#endif
 #if TESTTABLE
             run("new::hmap", new NanosecPerValue<TestTBBMap<TestTable> >() ),
 #endif
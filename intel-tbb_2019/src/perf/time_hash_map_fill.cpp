@@ -43,6 +43,11 @@ int MAX_TABLE_SIZE = 2000000;
 #define BOX3TEST ValuePerSecond<Uniques<tbb::concurrent_hash_map<int,int> >, SECONDS_RATIO>
 #define BOX3HEADER "tbb/concurrent_hash_map-5468.h"
 
+// enable/disable tests for:
+#define BOX4 "CFHMap"
+#define BOX4TEST ValuePerSecond<Uniques<tbb::concurrent_flat_hash_map<int,int> >, SECONDS_RATIO>
+#define BOX4HEADER "tbb/concurrent_flat_hash_map.h"
+
 #define TBB_USE_THREADING_TOOLS 0
 //////////////////////////////////////////////////////////////////////////////////
 
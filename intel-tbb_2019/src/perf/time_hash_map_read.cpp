@@ -0,0 +1,147 @@
+/*
+    Copyright (c) 2005-2019 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+// Measures the scalability of the read-mostly use of concurrent_hash_map. The
+// table holds "size" keys; every operation looks a random key up, and one of
+// "write-ratio" operations instead erases a key and inserts it again. The
+// lookups are done in three ways:
+//   accessor - find(const_accessor&), which locks the bucket and the item;
+//   value    - find_value, which copies the value without locks;
+//   contains - contains, which reads nothing but the key.
+// Reported are millions of operations per second for 1 to "n-of-threads" threads.
+
+#include "../examples/common/utility/utility.h"
+#include "tbb/concurrent_hash_map.h"
+#include "tbb/task_arena.h"
+#include "tbb/task_scheduler_init.h"
+#include "tbb/parallel_for.h"
+#include "tbb/blocked_range.h"
+#include "tbb/atomic.h"
+#include "tbb/tick_count.h"
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+
+typedef tbb::concurrent_hash_map<long, long> table_type;
+
+struct parameter_pack {
+    int threads_number;
+    int size;
+    int operations;
+    int write_ratio;
+    std::string mode;
+};
+
+static tbb::atomic<long> g_found;
+
+class read_body {
+    table_type& my_table;
+    const parameter_pack& my_p;
+    int my_mode;
+public:
+    read_body(table_type& table, const parameter_pack& p, int mode) : my_table(table), my_p(p), my_mode(mode) {}
+    void operator()(const tbb::blocked_range<int>& r) const {
+        unsigned long x = 2654435761ul * (r.begin() + 1);
+        long found = 0;
+        for (int i = r.begin(); i != r.end(); ++i) {
+            x = x * 6364136223846793005ul + 1442695040888963407ul;
+            const long key = long((x >> 33) % my_p.size);
+            if (my_p.write_ratio && i % my_p.write_ratio == 0) {
+                my_table.erase(key);
+                my_table.insert(std::make_pair(key, key));
+            } else if (my_mode == 0) {
+                table_type::const_accessor a;
+                if (my_table.find(a, key))
+                    found += a->second == key;
+            } else if (my_mode == 1) {
+                long value;
+                if (my_table.find_value(key, value))
+                    found += value == key;
+            } else {
+                found += my_table.contains(key);
+            }
+        }
+        g_found += found;
+    }
+};
+
+class read_loop {
+    table_type& my_table;
+    const parameter_pack& my_p;
+    int my_mode;
+public:
+    read_loop(table_type& table, const parameter_pack& p, int mode) : my_table(table), my_p(p), my_mode(mode) {}
+    void operator()() const {
+        tbb::parallel_for(tbb::blocked_range<int>(0, my_p.operations, 1000), read_body(my_table, my_p, my_mode));
+    }
+};
+
+static void run(table_type& table, int mode, int threads, const parameter_pack& p) {
+    tbb::task_arena arena(threads);
+    // Warm up the arena and the workers
+    arena.execute(read_loop(table, p, mode));
+    g_found = 0;
+    const tbb::tick_count t0 = tbb::tick_count::now();
+    arena.execute(read_loop(table, p, mode));
+    const double elapsed = (tbb::tick_count::now() - t0).seconds();
+    std::cout << std::setw(14) << std::fixed << std::setprecision(1) << p.operations / elapsed / 1e6;
+}
+
+int main(int argc, const char** args) {
+    parameter_pack p;
+    p.threads_number = tbb::task_scheduler_init::default_num_threads();
+    p.size = 100000;
+    p.operations = 10000000;
+    p.write_ratio = 100;
+    p.mode = "all";
+
+    utility::parse_cli_arguments(argc,args,utility::cli_argument_pack()
+            .arg(p.threads_number,"n-of-threads","largest number of threads")
+            .arg(p.size,"size","number of keys in the table")
+            .arg(p.operations,"operations","number of operations in a run")
+            .arg(p.write_ratio,"write-ratio","one of that many operations modifies the table, 0 for none")
+            .arg(p.mode,"mode","accessor, value, contains or all")
+            );
+    if (p.threads_number < 1 || p.size < 1 || p.operations < 1 || p.write_ratio < 0) {
+        std::cerr << "parameters must be positive" << std::endl;
+        return 1;
+    }
+
+    tbb::task_scheduler_init init(p.threads_number);
+    table_type table;
+    for (long key = 0; key < p.size; ++key)
+        table.insert(std::make_pair(key, key));
+
+    const char* names[] = { "accessor", "value", "contains" };
+    std::cout << std::setw(8) << "threads";
+    for (int mode = 0; mode < 3; ++mode)
+        if (p.mode == "all" || p.mode == names[mode])
+            std::cout << std::setw(14) << names[mode];
+    std::cout << "    (Mops/s)" << std::endl;
+    for (int threads = 1; threads <= p.threads_number; threads = threads < p.threads_number && threads * 2 > p.threads_number ? p.threads_number : threads * 2) {
+        std::cout << std::setw(8) << threads;
+        for (int mode = 0; mode < 3; ++mode)
+            if (p.mode == "all" || p.mode == names[mode])
+                run(table, mode, threads, p);
+        std::cout << std::endl;
+    }
+    return 0;
+}
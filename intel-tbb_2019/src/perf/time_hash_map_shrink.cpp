@@ -0,0 +1,170 @@
+/*
+    Copyright (c) 2005-2019 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+// Measures the memory and the iteration time of concurrent_hash_map after a mass
+// erasure. The table is filled with "size" keys, then all but "kept" of them are
+// erased in parallel, and then rehash() is called. After each stage reported are
+// the bytes allocated by the table, the number of buckets, and the time of the
+// serial and the parallel (over range()) traversals, in milliseconds.
+
+#include "../examples/common/utility/utility.h"
+#include "tbb/concurrent_hash_map.h"
+#include "tbb/task_scheduler_init.h"
+#include "tbb/parallel_for.h"
+#include "tbb/blocked_range.h"
+#include "tbb/atomic.h"
+#include "tbb/tick_count.h"
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstdlib>
+#include <new>
+
+static tbb::atomic<long> g_bytes;
+
+//! Counts the bytes that the table holds
+template<typename T>
+class counting_allocator {
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+    template<typename U> struct rebind { typedef counting_allocator<U> other; };
+
+    counting_allocator() {}
+    template<typename U> counting_allocator(const counting_allocator<U>&) {}
+
+    pointer address(reference x) const { return &x; }
+    const_pointer address(const_reference x) const { return &x; }
+    pointer allocate(size_type n, const void* = 0) {
+        g_bytes += long(n * sizeof(T));
+        void* p = std::malloc(n * sizeof(T));
+        if (!p) throw std::bad_alloc();
+        return static_cast<pointer>(p);
+    }
+    void deallocate(pointer p, size_type n) {
+        g_bytes -= long(n * sizeof(T));
+        std::free(p);
+    }
+    size_type max_size() const { return size_type(-1) / sizeof(T); }
+    void construct(pointer p, const T& value) { new(static_cast<void*>(p)) T(value); }
+    void destroy(pointer p) { p->~T(); }
+};
+
+template<typename T, typename U>
+bool operator==(const counting_allocator<T>&, const counting_allocator<U>&) { return true; }
+template<typename T, typename U>
+bool operator!=(const counting_allocator<T>&, const counting_allocator<U>&) { return false; }
+
+typedef tbb::concurrent_hash_map<long, long, tbb::tbb_hash_compare<long>, counting_allocator<std::pair<const long, long> > > table_type;
+
+struct parameter_pack {
+    int threads_number;
+    int size;
+    int kept;
+    int repeats;
+};
+
+static tbb::atomic<long> g_sum;
+
+class range_sum {
+public:
+    void operator()(const table_type::const_range_type& r) const {
+        long sum = 0;
+        for (table_type::const_iterator i = r.begin(); i != r.end(); ++i)
+            sum += i->second;
+        g_sum += sum;
+    }
+};
+
+class erase_body {
+    table_type& my_table;
+public:
+    erase_body(table_type& table) : my_table(table) {}
+    void operator()(const tbb::blocked_range<long>& r) const {
+        for (long key = r.begin(); key != r.end(); ++key)
+            my_table.erase(key);
+    }
+};
+
+static void report(const char* stage, const table_type& table, const parameter_pack& p) {
+    tbb::tick_count t0 = tbb::tick_count::now();
+    long sum = 0;
+    for (int rep = 0; rep < p.repeats; ++rep)
+        for (table_type::const_iterator i = table.begin(); i != table.end(); ++i)
+            sum += i->second;
+    const double serial = (tbb::tick_count::now() - t0).seconds() * 1e3 / p.repeats;
+    g_sum = 0;
+    t0 = tbb::tick_count::now();
+    for (int rep = 0; rep < p.repeats; ++rep)
+        tbb::parallel_for(table.range(), range_sum());
+    const double parallel = (tbb::tick_count::now() - t0).seconds() * 1e3 / p.repeats;
+    if (g_sum != sum)
+        std::cerr << "traversals disagree" << std::endl;
+    std::cout << std::setw(14) << stage << std::setw(10) << table.size() << std::setw(12) << table.bucket_count()
+              << std::setw(14) << g_bytes << std::setw(12) << std::fixed << std::setprecision(3) << serial
+              << std::setw(12) << parallel << std::endl;
+}
+
+int main(int argc, const char** args) {
+    parameter_pack p;
+    p.threads_number = tbb::task_scheduler_init::default_num_threads();
+    p.size = 4000000;
+    p.kept = 1000;
+    p.repeats = 10;
+
+    utility::parse_cli_arguments(argc,args,utility::cli_argument_pack()
+            .arg(p.threads_number,"n-of-threads","number of threads")
+            .arg(p.size,"size","number of keys in the filled table")
+            .arg(p.kept,"kept","number of keys left after the erasure")
+            .arg(p.repeats,"repeats","number of traversals to average")
+            );
+    if (p.threads_number < 1 || p.size < 1 || p.kept < 0 || p.kept > p.size || p.repeats < 1) {
+        std::cerr << "invalid parameters" << std::endl;
+        return 1;
+    }
+
+    tbb::task_scheduler_init init(p.threads_number);
+    {
+        table_type table;
+        for (long key = 0; key < p.size; ++key)
+            table.insert(std::make_pair(key, key));
+
+        std::cout << std::setw(14) << "stage" << std::setw(10) << "items" << std::setw(12) << "buckets"
+                  << std::setw(14) << "bytes" << std::setw(12) << "serial,ms" << std::setw(12) << "parallel,ms" << std::endl;
+        report("filled", table, p);
+        const tbb::tick_count t0 = tbb::tick_count::now();
+        tbb::parallel_for(tbb::blocked_range<long>(p.kept, p.size), erase_body(table));
+        const double erase_time = (tbb::tick_count::now() - t0).seconds();
+        report("erased", table, p);
+        table.rehash();
+        report("rehashed", table, p);
+        std::cout << "erasure of " << p.size - p.kept << " keys: " << std::setprecision(1)
+                  << (p.size - p.kept) / erase_time / 1e6 << " Mops/s" << std::endl;
+    }
+    if (g_bytes)
+        std::cerr << g_bytes << " bytes are not freed" << std::endl;
+    return 0;
+}
@@ -189,6 +189,8 @@ int main(int argc,const char** args ){
     size_t weight_of_initiation_call_usec =1000;
     bool use_serial_initiation_function = false;
     bool use_coarse_grained_locked_cache = false;
+    bool use_sharded_cache = false;
+    bool compare = false;
 
     parameter_pack p(time_window_sec, time_check_granularity_ops, cache_lru_history_size,time_of_item_use_usec,cache_miss_percent,threads_number,weight_of_initiation_call_usec,use_serial_initiation_function);
 
@@ -201,13 +203,25 @@ int main(int argc,const char** args ){
             .arg(p.weight_of_initiation_call_usec,"initiation-call-weight","time occupied by a single call to initiation function, in microseconds")
             .arg(p.use_serial_initiation_function,"use-serial-initiation-function","limit lock-based serial initiation function")
             .arg(use_coarse_grained_locked_cache,"use-locked-version","use stl coarse grained lock based version")
+            .arg(use_sharded_cache,"use-sharded-version","use the sharded version with CLOCK eviction")
+            .arg(compare,"compare","run all the versions and report the operations per second of each")
             );
 
     typedef tbb::concurrent_lru_cache<size_t,size_t,return_size_t> tbb_cache;
+    typedef tbb::concurrent_sharded_lru_cache<size_t,size_t,return_size_t> sharded_cache;
     typedef coarse_grained_raii_lru_cache<size_t,size_t,return_size_t> coarse_grained_locked_cache;
 
+    if (compare){
+        std::cout<<"threads: "<<p.threads_number<<std::endl;
+        std::cout<<"aggregator: "<<throughput<tbb_cache>(p)() / p.time_window_sec<<" ops/s"<<std::endl;
+        std::cout<<"sharded:    "<<throughput<sharded_cache>(p)() / p.time_window_sec<<" ops/s"<<std::endl;
+        std::cout<<"locked:     "<<throughput<coarse_grained_locked_cache>(p)() / p.time_window_sec<<" ops/s"<<std::endl;
+        return 0;
+    }
     size_t operations =0;
-    if (!use_coarse_grained_locked_cache){
+    if (use_sharded_cache){
+        operations = throughput<sharded_cache>(p)();
+    }else if (!use_coarse_grained_locked_cache){
         operations = throughput<tbb_cache>(p)();
     }else{
         operations = throughput<coarse_grained_locked_cache>(p)();
@@ -0,0 +1,142 @@
+/*
+    Copyright (c) 2005-2019 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+// Per-request scratch allocation: every request builds a map and a vector
+// and allocates a number of small buffers of random sizes, then drops them
+// all. Requests per second are reported for scalable_allocator and for
+// monotonic_arena, recycled after each request.
+
+#define TBB_PREVIEW_MEMORY_POOL 1
+
+#include "../examples/common/utility/utility.h"
+#include "tbb/tick_count.h"
+#include "tbb/scalable_allocator.h"
+#include "tbb/memory_pool.h"
+
+#include <vector>
+#include <map>
+#include <functional>
+#include <iostream>
+
+struct parameter_pack {
+    size_t requests;
+    size_t objects;
+    size_t max_object_size;
+    size_t chunk_size;
+    bool stack_buffer;
+};
+
+// simple LCG, to not depend on quality of rand() across platforms
+class Random {
+    unsigned long long x;
+public:
+    Random(unsigned long long seed) : x(seed) {}
+    size_t operator()(size_t n) {
+        x = x*6364136223846793005ULL + 1442695040888963407ULL;
+        return (size_t)(x>>33) % n;
+    }
+};
+
+static size_t checksum;
+
+template<typename Alloc, typename Malloc>
+void handle_request(const parameter_pack &p, const Alloc &a, Malloc &m, Random &rnd) {
+    typedef typename Alloc::template rebind<int>::other int_alloc_t;
+    typedef typename Alloc::template rebind<std::pair<const int, int> >::other pair_alloc_t;
+    std::vector<int, int_alloc_t> v((int_alloc_t(a)));
+    std::map<int, int, std::less<int>, pair_alloc_t> index(std::less<int>(), (pair_alloc_t(a)));
+    std::vector<char*, typename Alloc::template rebind<char*>::other> bufs(a);
+    for (size_t i=0; i<p.objects; i++) {
+        size_t sz = 1+rnd(p.max_object_size);
+        char *buf = (char*)m.malloc(sz);
+        buf[0] = char(i);
+        bufs.push_back(buf);
+        v.push_back(int(sz));
+        index[int(i*7 % p.objects)] = int(sz);
+    }
+    checksum += v.size() + index.size();
+    for (size_t i=0; i<bufs.size(); i++)
+        m.free(bufs[i]);
+}
+
+struct scalable_source {
+    void *malloc(size_t size) { return scalable_malloc(size); }
+    void free(void *p) { scalable_free(p); }
+};
+
+double run_scalable(const parameter_pack &p) {
+    Random rnd(42);
+    scalable_source m;
+    tbb::scalable_allocator<char> a;
+    tbb::tick_count t0 = tbb::tick_count::now();
+    for (size_t r=0; r<p.requests; r++)
+        handle_request(p, a, m, rnd);
+    return (tbb::tick_count::now()-t0).seconds();
+}
+
+double run_arena(const parameter_pack &p) {
+    Random rnd(42);
+    std::vector<char> buf(p.stack_buffer? p.chunk_size : 0);
+    tbb::monotonic_arena *arena = p.stack_buffer?
+        new tbb::monotonic_arena(&buf[0], buf.size(), p.chunk_size)
+        : new tbb::monotonic_arena(p.chunk_size);
+    tbb::memory_pool_allocator<char, tbb::monotonic_arena> a(*arena);
+    tbb::tick_count t0 = tbb::tick_count::now();
+    for (size_t r=0; r<p.requests; r++) {
+        handle_request(p, a, *arena, rnd);
+        arena->recycle();
+    }
+    double secs = (tbb::tick_count::now()-t0).seconds();
+    delete arena;
+    return secs;
+}
+
+int main(int argc, const char** args) {
+    parameter_pack p;
+    p.requests = 20000;
+    p.objects = 200;
+    p.max_object_size = 256;
+    p.chunk_size = tbb::monotonic_arena::default_chunk_size;
+    p.stack_buffer = false;
+
+    utility::parse_cli_arguments(argc,args,utility::cli_argument_pack()
+            .arg(p.requests,"requests","number of requests to handle")
+            .arg(p.objects,"objects","number of buffers and container elements per request")
+            .arg(p.max_object_size,"max-object-size","maximal size of a buffer")
+            .arg(p.chunk_size,"chunk-size","initial size of arena chunk")
+            .arg(p.stack_buffer,"buffer","start arena from a preallocated buffer of chunk-size")
+            );
+    if (!p.requests || !p.objects || !p.max_object_size || !p.chunk_size) {
+        std::cerr << "requests, objects, max-object-size and chunk-size must be positive" << std::endl;
+        return 1;
+    }
+    // warm up
+    parameter_pack warm = p;
+    warm.requests = p.requests/10+1;
+    run_scalable(warm);
+    run_arena(warm);
+
+    double scalable = run_scalable(p),
+        arena = run_arena(p);
+    std::cout << "scalable_allocator: " << p.requests/scalable/1e3 << " K requests/s" << std::endl;
+    std::cout << "monotonic_arena:    " << p.requests/arena/1e3 << " K requests/s" << std::endl;
+    std::cout << "speedup " << scalable/arena << " (checksum " << checksum << ")" << std::endl;
+    return 0;
+}
@@ -0,0 +1,161 @@
+/*
+    Copyright (c) 2005-2019 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+// Measures alloc/touch/free bandwidth of tbbmalloc when memory is released by
+// a thread other than the one that allocated it, with and without NUMA mode.
+// Each round every thread allocates a batch of objects and writes them, then
+// the batches are rotated, so the next thread frees them and memory can migrate
+// between nodes. An object is counted as remote when its tail still carries
+// the mark of a thread from another node.
+// On a single-node box, use fake-nodes=N to emulate a topology.
+
+#include "../examples/common/utility/utility.h"
+#include "tbb/tick_count.h"
+#include "tbb/atomic.h"
+#include "tbb/scalable_allocator.h"
+#include "tbb/task_scheduler_init.h" //for number of threads
+
+#define HARNESS_CUSTOM_MAIN 1
+#define HARNESS_NO_PARSE_COMMAND_LINE 1
+
+#include "../src/test/harness.h"
+#include "../src/test/harness_barrier.h"
+
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+struct parameter_pack {
+    int threads_number;
+    size_t rounds;
+    size_t batch_size;
+    size_t large_object_percent;
+};
+
+class numa_bandwidth {
+    parameter_pack p;
+    // batches[i] is filled by thread i and freed by thread (i+1)%n
+    std::vector< std::vector<void*> > batches;
+    std::vector<size_t> sizes;
+    Harness::SpinBarrier barrier;
+    tbb::atomic<size_t> bytes_touched;
+    tbb::atomic<size_t> objects_total;
+    tbb::atomic<size_t> objects_remote;
+
+    static unsigned char mark(int node) { return (unsigned char)(node+1); }
+    struct body {
+        numa_bandwidth *self;
+        void operator()(int tid) const { self->work(tid); }
+    };
+public:
+    numa_bandwidth(const parameter_pack &a_p) : p(a_p), batches(a_p.threads_number),
+        sizes(a_p.batch_size) {
+        for (size_t i=0; i<sizes.size(); i++)
+            sizes[i] = std::rand()%100 < (int)p.large_object_percent?
+                64*1024 + std::rand()%(192*1024) : 16 + std::rand()%(8*1024);
+    }
+
+    void work(int tid) {
+        int node = 0;
+        scalable_allocation_command(TBBMALLOC_GET_NUMA_NODE, &node);
+        std::vector<void*> &mine = batches[tid];
+        std::vector<void*> &foreign = batches[(tid+p.threads_number-1)%p.threads_number];
+        size_t touched = 0, total = 0, remote = 0;
+
+        for (size_t r=0; r<p.rounds; r++) {
+            mine.resize(p.batch_size);
+            for (size_t i=0; i<p.batch_size; i++) {
+                unsigned char *obj = (unsigned char*)scalable_malloc(sizes[i]);
+                unsigned char tail = obj[sizes[i]-1];
+                if (tail && tail != mark(node))
+                    remote++;
+                memset(obj, mark(node), sizes[i]);
+                mine[i] = obj;
+                touched += sizes[i];
+            }
+            total += p.batch_size;
+            barrier.wait();
+            for (size_t i=0; i<foreign.size(); i++)
+                scalable_free(foreign[i]);
+            foreign.clear();
+            barrier.wait();
+        }
+        bytes_touched += touched;
+        objects_total += total;
+        objects_remote += remote;
+    }
+
+    void run(const char *title) {
+        bytes_touched = objects_total = objects_remote = 0;
+        barrier.initialize(p.threads_number);
+        tbb::tick_count t0 = tbb::tick_count::now();
+        body b = {this};
+        NativeParallelFor(p.threads_number, b);
+        double secs = (tbb::tick_count::now()-t0).seconds();
+        scalable_allocation_command(TBBMALLOC_CLEAN_ALL_BUFFERS, NULL);
+
+        std::cout << title << ": " << bytes_touched/secs/(1024*1024) << " MB/s, "
+                  << objects_remote*100.0/objects_total << "% remote objects ("
+                  << secs << " s)" << std::endl;
+    }
+};
+
+int main(int argc, const char** args) {
+    parameter_pack p;
+    p.threads_number = tbb::task_scheduler_init::default_num_threads();
+    p.rounds = 200;
+    p.batch_size = 2000;
+    p.large_object_percent = 5;
+    int fake_nodes = 0;
+    bool compare = true;
+
+    utility::parse_cli_arguments(argc,args,utility::cli_argument_pack()
+            .arg(p.threads_number,"n-of-threads","number of threads to run on")
+            .arg(p.rounds,"rounds","number of alloc/free rounds per thread")
+            .arg(p.batch_size,"batch-size","number of objects allocated by a thread per round")
+            .arg(p.large_object_percent,"large-percent","percent of objects above 64KB")
+            .arg(fake_nodes,"fake-nodes","emulate the given number of NUMA nodes, 0 for the real topology")
+            .arg(compare,"compare","run with NUMA mode off as well")
+            );
+    if (p.threads_number < 1 || !p.batch_size) {
+        std::cerr << "n-of-threads and batch-size must be positive" << std::endl;
+        return 1;
+    }
+    // must be set before the first allocation, as the topology is read once
+    if (fake_nodes) {
+        char buf[16];
+        sprintf(buf, "%d", fake_nodes);
+        setenv("TBB_MALLOC_NUMA_FAKE_NODES", buf, 1);
+    }
+
+    numa_bandwidth test(p);
+    if (compare) {
+        scalable_allocation_mode(TBBMALLOC_USE_NUMA, 0);
+        test.run("NUMA mode off");
+    }
+    if (scalable_allocation_mode(TBBMALLOC_USE_NUMA, 1) != TBBMALLOC_OK)
+        std::cout << "NUMA mode is not supported on this platform" << std::endl;
+    int node;
+    if (scalable_allocation_command(TBBMALLOC_GET_NUMA_NODE, &node) != TBBMALLOC_OK)
+        std::cout << "Single NUMA node detected, try fake-nodes=2" << std::endl;
+    test.run("NUMA mode on ");
+    return 0;
+}
@@ -0,0 +1,130 @@
+/*
+    Copyright (c) 2005-2019 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+// Measures throughput of releasing objects allocated by other threads.
+// Each round every thread allocates a batch of objects, then all threads
+// release objects of all batches, interleaved, so every slab gets frees from
+// many threads at once. Runs with TBBMALLOC_SET_REMOTE_FREE_BATCH off and
+// set to the given batch size.
+
+#include "../examples/common/utility/utility.h"
+#include "tbb/tick_count.h"
+#include "tbb/scalable_allocator.h"
+#include "tbb/task_scheduler_init.h" //for number of threads
+
+#define HARNESS_CUSTOM_MAIN 1
+#define HARNESS_NO_PARSE_COMMAND_LINE 1
+
+#include "../src/test/harness.h"
+#include "../src/test/harness_barrier.h"
+
+#include <vector>
+#include <iostream>
+
+struct parameter_pack {
+    int threads_number;
+    size_t rounds;
+    size_t objects;
+    size_t object_size;
+    size_t remote_batch;
+};
+
+class remote_free {
+    parameter_pack p;
+    std::vector< std::vector<void*> > batches;
+    Harness::SpinBarrier barrier;
+    std::vector<double> free_time;
+
+    struct body {
+        remote_free *self;
+        void operator()(int tid) const { self->work(tid); }
+    };
+public:
+    remote_free(const parameter_pack &a_p) : p(a_p), batches(a_p.threads_number),
+        free_time(a_p.threads_number) {}
+
+    void work(int tid) {
+        const int n = p.threads_number;
+        double secs = 0;
+
+        for (size_t r=0; r<p.rounds; r++) {
+            std::vector<void*> &mine = batches[tid];
+            mine.resize(p.objects);
+            for (size_t i=0; i<p.objects; i++)
+                mine[i] = scalable_malloc(p.object_size);
+            barrier.wait();
+            // objects adjacent in a batch are released by different threads
+            tbb::tick_count t0 = tbb::tick_count::now();
+            for (int b=0; b<n; b++) {
+                std::vector<void*> &batch = batches[(tid+b)%n];
+                for (size_t i=tid; i<batch.size(); i+=n)
+                    scalable_free(batch[i]);
+            }
+            // thread becomes idle, so buffered objects must be released
+            scalable_allocation_command(TBBMALLOC_CLEAN_THREAD_BUFFERS, NULL);
+            secs += (tbb::tick_count::now()-t0).seconds();
+            barrier.wait();
+        }
+        free_time[tid] = secs;
+    }
+
+    void run(const char *title) {
+        barrier.initialize(p.threads_number);
+        body b = {this};
+        NativeParallelFor(p.threads_number, b);
+        double secs = 0;
+        for (int i=0; i<p.threads_number; i++)
+            secs += free_time[i];
+        secs /= p.threads_number;
+        scalable_allocation_command(TBBMALLOC_CLEAN_ALL_BUFFERS, NULL);
+
+        const double frees = double(p.rounds)*p.objects*p.threads_number;
+        std::cout << title << ": " << frees/secs/1e6 << " M frees/s ("
+                  << secs << " s in free per thread)" << std::endl;
+    }
+};
+
+int main(int argc, const char** args) {
+    parameter_pack p;
+    p.threads_number = tbb::task_scheduler_init::default_num_threads();
+    p.rounds = 200;
+    p.objects = 10000;
+    p.object_size = 64;
+    p.remote_batch = 64;
+
+    utility::parse_cli_arguments(argc,args,utility::cli_argument_pack()
+            .arg(p.threads_number,"n-of-threads","number of threads to run on")
+            .arg(p.rounds,"rounds","number of alloc/free rounds per thread")
+            .arg(p.objects,"objects","number of objects allocated by a thread per round")
+            .arg(p.object_size,"object-size","size of objects")
+            .arg(p.remote_batch,"remote-batch","objects buffered by a thread before releasing")
+            );
+    if (p.threads_number < 1 || !p.objects || !p.remote_batch) {
+        std::cerr << "n-of-threads, objects and remote-batch must be positive" << std::endl;
+        return 1;
+    }
+
+    remote_free test(p);
+    scalable_allocation_mode(TBBMALLOC_SET_REMOTE_FREE_BATCH, 0);
+    test.run("remote free batching off");
+    scalable_allocation_mode(TBBMALLOC_SET_REMOTE_FREE_BATCH, p.remote_batch);
+    test.run("remote free batching on ");
+    return 0;
+}
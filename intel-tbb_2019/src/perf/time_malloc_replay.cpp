@@ -0,0 +1,504 @@
+/*
+    Copyright (c) 2005-2019 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+// Replays a trace of allocation calls to compare allocators and large object
+// cache policies offline. The trace has the binary format of
+// src/tbbmalloc/proxy_trace.h and is recorded by the proxy library (run an
+// application with LD_PRELOAD=libtbbmalloc_proxy.so and TBB_MALLOC_TRACE=<name>,
+// the trace is written to <name>.<pid>). Without trace file a trace with bursts
+// of 64KB-4MB buffers among small objects is generated; it can be saved
+// with save=<file> and used later.
+// Calls of each recorded thread are replayed by thread number "thread mod
+// n-of-threads" in the recorded order. An object released or reallocated by
+// other thread than the allocating one is waited for, so cross-thread
+// frees stay cross-thread.
+// For the system allocator and for each policy of tbbmalloc reported are
+// throughput, latency percentiles of sampled calls, growth of resident set
+// size during the replay and counters of large object caches.
+
+#include "../examples/common/utility/utility.h"
+#include "tbb/tick_count.h"
+#include "tbb/atomic.h"
+#include "tbb/scalable_allocator.h"
+#include "tbb/task_scheduler_init.h" //for number of threads
+#include "../tbbmalloc/proxy_trace.h"
+
+#define HARNESS_CUSTOM_MAIN 1
+#define HARNESS_NO_PARSE_COMMAND_LINE 1
+
+#include "../src/test/harness.h"
+#include "../src/test/harness_barrier.h"
+
+#include <vector>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/resource.h>
+
+struct parameter_pack {
+    std::string trace;
+    std::string save;
+    std::string allocator;
+    int threads_number;
+    size_t sample;
+    size_t bursts;
+    size_t burst_size;
+    size_t gap;
+    size_t local_cache_size;
+    size_t repeat;
+};
+
+static const size_t no_object = ~(size_t)0;
+
+struct Operation {
+    uint32_t type;   // MallocTraceOp
+    uint32_t thread; // replay thread
+    size_t id;       // allocated or released object
+    size_t prev;     // reallocated object or no_object
+    size_t size;
+    size_t alignment;
+};
+
+struct TraceStatistics {
+    size_t records;
+    size_t implicit_frees;  // address allocated again while live
+    size_t unknown_frees;   // releases of objects allocated before recording
+};
+
+// simple LCG, to not depend on quality of rand() across platforms
+class Random {
+    unsigned long long x;
+public:
+    Random(unsigned long long seed) : x(seed) {}
+    size_t operator()(size_t n) {
+        x = x*6364136223846793005ULL + 1442695040888963407ULL;
+        return (size_t)(x>>33) % n;
+    }
+};
+
+static bool load_trace(const std::string &name, std::vector<MallocTraceRecord> &records) {
+    FILE *f = fopen(name.c_str(), "rb");
+    if (!f)
+        return false;
+    MallocTraceHeader header;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1 && header.magic == MALLOC_TRACE_MAGIC
+        && header.version == MALLOC_TRACE_VERSION && header.recordSize == sizeof(MallocTraceRecord);
+    MallocTraceRecord buf[1024];
+    size_t n;
+    while (ok && (n = fread(buf, sizeof(MallocTraceRecord), 1024, f)) > 0)
+        records.insert(records.end(), buf, buf+n);
+    fclose(f);
+    return ok;
+}
+
+static bool save_trace(const std::string &name, const std::vector<MallocTraceRecord> &records) {
+    FILE *f = fopen(name.c_str(), "wb");
+    if (!f)
+        return false;
+    MallocTraceHeader header = {MALLOC_TRACE_MAGIC, MALLOC_TRACE_VERSION, sizeof(MallocTraceRecord)};
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1
+        && (records.empty()
+            || fwrite(&records[0], sizeof(MallocTraceRecord), records.size(), f) == records.size());
+    return fclose(f) == 0 && ok;
+}
+
+static void add_record(std::vector<MallocTraceRecord> &records, uint32_t op, size_t id, size_t size) {
+    MallocTraceRecord r = {records.size(), id+1, 0, size, op, 0};
+    records.push_back(r);
+}
+
+// Bursts of buffers of a few sizes, allocated and released together,
+// separated by phases of small object allocations of random length.
+// All calls are done by one thread; object number+1 is used as its address.
+static void generate_trace(const parameter_pack &p, std::vector<MallocTraceRecord> &records) {
+    const size_t sizes[] = {64*1024, 96*1024, 256*1024, 600*1024, 1024*1024, 3*1024*1024, 4*1024*1024};
+    const size_t sizes_num = sizeof(sizes)/sizeof(sizes[0]);
+    Random rnd(42);
+    size_t next_id = 0;
+    std::vector<size_t> small;
+    for (size_t b=0; b<p.bursts; b++) {
+        // burst uses two sizes, so bins are reused after varying distances
+        const size_t s1 = sizes[rnd(sizes_num)], s2 = sizes[rnd(sizes_num)];
+        const size_t first = next_id;
+        for (size_t i=0; i<p.burst_size; i++)
+            add_record(records, MALLOC_TRACE_MALLOC, next_id++, i%2? s1 : s2);
+        for (size_t i=0, n=rnd(p.gap); i<n; i++) {
+            if (small.size() > 100 && rnd(2)) {
+                size_t k = rnd(small.size());
+                add_record(records, MALLOC_TRACE_FREE, small[k], 0);
+                small[k] = small.back();
+                small.pop_back();
+            } else {
+                small.push_back(next_id);
+                add_record(records, MALLOC_TRACE_MALLOC, next_id++, 16+rnd(2000));
+            }
+        }
+        for (size_t i=first; i<first+p.burst_size; i++)
+            add_record(records, MALLOC_TRACE_FREE, i, 0);
+    }
+    for (size_t i=0; i<small.size(); i++)
+        add_record(records, MALLOC_TRACE_FREE, small[i], 0);
+}
+
+static bool earlier(const MallocTraceRecord &a, const MallocTraceRecord &b) {
+    return a.time < b.time;
+}
+
+// Translates addresses to object numbers, so objects can be looked up
+// in a vector during the replay. A trace with records of different threads
+// being interleaved only by time can be not quite consistent, e.g. when
+// an object was released and its address reused by other thread within
+// the clock resolution; such records are fixed up and counted.
+static size_t build_operations(std::vector<MallocTraceRecord> &records, int threads,
+                               std::vector<Operation> &ops, TraceStatistics &stat) {
+    std::stable_sort(records.begin(), records.end(), earlier);
+    std::map<uint64_t, size_t> live;
+    size_t objects = 0;
+    stat.records = records.size();
+    stat.implicit_frees = stat.unknown_frees = 0;
+
+    for (size_t i=0; i<records.size(); i++) {
+        const MallocTraceRecord &r = records[i];
+        Operation op = {r.op, r.thread % threads, no_object, no_object, (size_t)r.size, 0};
+        std::map<uint64_t, size_t>::iterator it;
+
+        if (r.op == MALLOC_TRACE_FREE) {
+            it = live.find(r.ptr);
+            if (it == live.end()) {
+                stat.unknown_frees++;
+                continue;
+            }
+            op.id = it->second;
+            live.erase(it);
+            ops.push_back(op);
+            continue;
+        }
+        if (r.op == MALLOC_TRACE_REALLOC) {
+            it = r.arg? live.find(r.arg) : live.end();
+            if (it != live.end()) {
+                op.prev = it->second;
+                live.erase(it);
+            } else {
+                if (r.arg)
+                    stat.unknown_frees++;
+                op.type = MALLOC_TRACE_MALLOC;
+            }
+        } else if (r.op == MALLOC_TRACE_ALIGNED)
+            op.alignment = (size_t)r.arg;
+        else if (r.op != MALLOC_TRACE_MALLOC && r.op != MALLOC_TRACE_CALLOC)
+            continue;
+
+        it = live.find(r.ptr);
+        if (it != live.end()) {
+            Operation free_op = {MALLOC_TRACE_FREE, op.thread, it->second, no_object, 0, 0};
+            ops.push_back(free_op);
+            live.erase(it);
+            stat.implicit_frees++;
+        }
+        op.id = objects++;
+        live[r.ptr] = op.id;
+        ops.push_back(op);
+    }
+    return objects;
+}
+
+// Resident set size, in bytes
+static size_t current_rss() {
+    size_t size = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f) {
+        if (fscanf(f, "%zu %zu", &size, &resident) != 2)
+            resident = 0;
+        fclose(f);
+    }
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+class trace_replay {
+    const parameter_pack &p;
+    const std::vector<Operation> &ops;
+    std::vector< tbb::atomic<void*> > objects;
+    std::vector< std::vector<double> > latencies;
+    std::vector<size_t> counts;
+    Harness::SpinBarrier barrier;
+    tbb::atomic<int> running;
+    size_t peak_rss;
+    bool use_tbbmalloc;
+
+    struct body {
+        trace_replay *self;
+        void operator()(int tid) const {
+            if (tid < self->p.threads_number)
+                self->work(tid);
+            else
+                self->sample_rss();
+        }
+    };
+
+    void *wait_for(size_t id) {
+        void *ptr;
+        while (!(ptr = objects[id]))
+            __TBB_Yield();
+        objects[id] = NULL;
+        return ptr;
+    }
+
+    void *allocate(const Operation &op, void *prev) {
+        void *ptr = NULL;
+        switch (op.type) {
+        case MALLOC_TRACE_MALLOC:
+            ptr = use_tbbmalloc? scalable_malloc(op.size) : malloc(op.size);
+            break;
+        case MALLOC_TRACE_CALLOC:
+            ptr = use_tbbmalloc? scalable_calloc(1, op.size) : calloc(1, op.size);
+            break;
+        case MALLOC_TRACE_REALLOC:
+            ptr = use_tbbmalloc? scalable_realloc(prev, op.size) : realloc(prev, op.size);
+            break;
+        case MALLOC_TRACE_ALIGNED:
+            if (use_tbbmalloc)
+                scalable_posix_memalign(&ptr, op.alignment, op.size);
+            else if (posix_memalign(&ptr, op.alignment, op.size))
+                ptr = NULL;
+            break;
+        }
+        return ptr;
+    }
+
+    void work(int tid) {
+        std::vector<double> &lat = latencies[tid];
+        size_t count = 0;
+        barrier.wait();
+        for (size_t i=0; i<ops.size(); i++) {
+            const Operation &op = ops[i];
+            if (op.thread != (uint32_t)tid)
+                continue;
+            void *prev = op.prev != no_object? wait_for(op.prev) : NULL;
+            void *obj = op.type == MALLOC_TRACE_FREE? wait_for(op.id) : NULL;
+            const bool sampled = ++count % p.sample == 0;
+            tbb::tick_count t0;
+            if (sampled)
+                t0 = tbb::tick_count::now();
+            if (op.type == MALLOC_TRACE_FREE) {
+                if (use_tbbmalloc)
+                    scalable_free(obj);
+                else
+                    free(obj);
+            } else {
+                obj = allocate(op, prev);
+                // touch the memory, as a user of the object would do
+                if (obj && op.size)
+                    *(char*)obj = 0;
+            }
+            if (sampled)
+                lat.push_back((tbb::tick_count::now()-t0).seconds());
+            if (op.type != MALLOC_TRACE_FREE) {
+                if (!obj) {
+                    REPORT("Allocation of %zu bytes failed.\n", op.size);
+                    exit(1);
+                }
+                objects[op.id] = obj;
+            }
+        }
+        counts[tid] += count;
+        running--;
+    }
+
+    void sample_rss() {
+        const size_t base = current_rss();
+        size_t peak = base;
+        barrier.wait();
+        while (running) {
+            size_t rss = current_rss();
+            if (rss > peak)
+                peak = rss;
+            usleep(1000);
+        }
+        if (peak - base > peak_rss)
+            peak_rss = peak - base;
+    }
+
+    double replay_once() {
+        for (size_t i=0; i<objects.size(); i++)
+            objects[i] = NULL;
+        running = p.threads_number;
+        // threads and the RSS sampler start together
+        barrier.initialize(p.threads_number+1);
+
+        tbb::tick_count t0 = tbb::tick_count::now();
+        body b = {this};
+        NativeParallelFor(p.threads_number+1, b);
+        const double secs = (tbb::tick_count::now()-t0).seconds();
+
+        // objects that were not released in the trace
+        for (size_t i=0; i<objects.size(); i++)
+            if (objects[i]) {
+                if (use_tbbmalloc)
+                    scalable_free(objects[i]);
+                else
+                    free(objects[i]);
+            }
+        return secs;
+    }
+
+public:
+    trace_replay(const parameter_pack &a_p, const std::vector<Operation> &a_ops, size_t a_objects)
+        : p(a_p), ops(a_ops), objects(a_objects), latencies(a_p.threads_number),
+          counts(a_p.threads_number) {}
+
+    static void print_header() {
+        std::cout << std::setw(22) << "allocator" << std::setw(9) << "time, s"
+                  << std::setw(9) << "M ops/s" << std::setw(9) << "p50, ns"
+                  << std::setw(9) << "p90" << std::setw(9) << "p99"
+                  << std::setw(9) << "p99.9" << std::setw(9) << "max"
+                  << std::setw(13) << "peak RSS, KB" << std::setw(11) << "local hits"
+                  << std::setw(9) << "hits" << std::setw(9) << "misses"
+                  << std::setw(10) << "evictions" << std::endl;
+    }
+
+    void run(const char *title, bool tbbmalloc, bool adaptive = false, size_t local_cache_size = 0) {
+        use_tbbmalloc = tbbmalloc;
+        ScalableAllocationStatistics before, after;
+        if (use_tbbmalloc) {
+            scalable_allocation_mode(TBBMALLOC_USE_ADAPTIVE_LOC, adaptive);
+            scalable_allocation_mode(TBBMALLOC_SET_LOCAL_LOC_SIZE, local_cache_size);
+            // start from empty caches, so policies get the same conditions
+            scalable_allocation_command(TBBMALLOC_CLEAN_ALL_BUFFERS, NULL);
+            scalable_allocation_command(TBBMALLOC_GET_STATISTICS, &before);
+        }
+        for (int i=0; i<p.threads_number; i++) {
+            latencies[i].clear();
+            counts[i] = 0;
+        }
+        peak_rss = 0;
+        double secs = 0;
+        for (size_t r=0; r<p.repeat; r++)
+            secs += replay_once();
+        if (use_tbbmalloc) {
+            scalable_allocation_command(TBBMALLOC_GET_STATISTICS, &after);
+            scalable_allocation_command(TBBMALLOC_CLEAN_ALL_BUFFERS, NULL);
+        }
+
+        std::vector<double> lat;
+        size_t total = 0;
+        for (int i=0; i<p.threads_number; i++) {
+            lat.insert(lat.end(), latencies[i].begin(), latencies[i].end());
+            total += counts[i];
+        }
+        std::sort(lat.begin(), lat.end());
+        const double percentiles[] = {0.5, 0.9, 0.99, 0.999, 1.0};
+        std::cout << std::setw(22) << title << std::setw(9) << std::setprecision(3) << secs
+                  << std::setw(9) << total/secs/1e6;
+        for (size_t i=0; i<sizeof(percentiles)/sizeof(percentiles[0]); i++) {
+            double v = 0;
+            if (!lat.empty()) {
+                size_t k = (size_t)(percentiles[i]*(lat.size()-1));
+                v = lat[k];
+            }
+            std::cout << std::setw(9) << (size_t)(v*1e9);
+        }
+        std::cout << std::setw(13) << peak_rss/1024;
+        if (use_tbbmalloc)
+            std::cout << std::setw(11) << after.largeLocalCacheHits - before.largeLocalCacheHits
+                      << std::setw(9) << after.largeCacheHits - before.largeCacheHits
+                      << std::setw(9) << after.largeCacheMisses - before.largeCacheMisses
+                      << std::setw(10) << after.largeCacheEvictions - before.largeCacheEvictions;
+        std::cout << std::endl;
+    }
+};
+
+int main(int argc, const char** args) {
+    parameter_pack p;
+    p.allocator = "both";
+    p.threads_number = tbb::task_scheduler_init::default_num_threads();
+    p.sample = 16;
+    p.bursts = 2000;
+    p.burst_size = 8;
+    p.gap = 200;
+    p.local_cache_size = 64*1024*1024;
+    p.repeat = 3;
+
+    utility::parse_cli_arguments(argc,args,utility::cli_argument_pack()
+            .arg(p.trace,"trace","file with trace written by the proxy library; generated if not set")
+            .arg(p.save,"save","file to save generated trace to")
+            .arg(p.allocator,"allocator","tbbmalloc, system or both")
+            .arg(p.threads_number,"n-of-threads","number of threads to replay the trace on")
+            .arg(p.sample,"sample","latency of every sample-th call of a thread is measured")
+            .arg(p.bursts,"bursts","number of bursts in generated trace")
+            .arg(p.burst_size,"burst-size","number of buffers in a burst of generated trace")
+            .arg(p.gap,"gap","maximal number of small object operations inside a burst")
+            .arg(p.local_cache_size,"local-cache-size","thread-local large object cache size for the last policy")
+            .arg(p.repeat,"repeat","number of times the trace is replayed")
+            );
+    if (p.threads_number < 1 || !p.sample || !p.repeat
+        || (p.allocator != "tbbmalloc" && p.allocator != "system" && p.allocator != "both")) {
+        std::cerr << "n-of-threads, sample and repeat must be positive, "
+            "allocator must be tbbmalloc, system or both" << std::endl;
+        return 1;
+    }
+
+    std::vector<MallocTraceRecord> records;
+    if (!p.trace.empty()) {
+        if (!load_trace(p.trace, records)) {
+            std::cerr << "Can't read trace from " << p.trace << std::endl;
+            return 1;
+        }
+    } else {
+        if (!p.gap) {
+            std::cerr << "gap must be positive" << std::endl;
+            return 1;
+        }
+        generate_trace(p, records);
+        if (!p.save.empty() && !save_trace(p.save, records)) {
+            std::cerr << "Can't save trace to " << p.save << std::endl;
+            return 1;
+        }
+    }
+    std::vector<Operation> ops;
+    TraceStatistics stat;
+    const size_t objects = build_operations(records, p.threads_number, ops, stat);
+    std::vector<MallocTraceRecord>().swap(records);
+    std::cout << stat.records << " records, " << ops.size() << " operations on "
+              << objects << " objects, " << stat.implicit_frees << " implicit frees, "
+              << stat.unknown_frees << " frees of unknown objects" << std::endl;
+
+    if (p.allocator != "system" && scalable_allocation_mode(TBBMALLOC_COLLECT_STATISTICS, 1) != TBBMALLOC_OK)
+        std::cout << "Cache counters are not available." << std::endl;
+    trace_replay replay(p, ops, objects);
+    trace_replay::print_header();
+    if (p.allocator != "tbbmalloc")
+        replay.run("system", false);
+    if (p.allocator != "system") {
+        const size_t default_local_size = 4*1024*1024;
+        replay.run("default", true, false, default_local_size);
+        replay.run("adaptive", true, true, default_local_size);
+        replay.run("adaptive, large local", true, true, p.local_cache_size);
+    }
+
+    struct rusage usage;
+    if (!getrusage(RUSAGE_SELF, &usage))
+        std::cout << "max RSS of the process: " << usage.ru_maxrss << " KB" << std::endl;
+    return 0;
+}
@@ -0,0 +1,106 @@
+/*
+    Copyright (c) 2005-2019 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+// Measures the cost of scalable_malloc/scalable_free pair for different sizes,
+// and of the same pair when the object is released with scalable_free_sized.
+// The cost is reported in time stamp counter ticks per pair where the counter
+// is available, and in nanoseconds otherwise.
+// Only public API is used, so the driver can be built against an older
+// tbbmalloc (with -DNO_SIZED_FREE) to get the numbers before a change.
+
+#include "../examples/common/utility/utility.h"
+#include "tbb/tick_count.h"
+#include "tbb/tbb_machine.h"
+#include "tbb/scalable_allocator.h"
+
+#include <vector>
+#include <iostream>
+#include <iomanip>
+
+#if defined(__TBB_time_stamp)
+typedef tbb::internal::machine_tsc_t timestamp_t;
+static const char *units = "ticks";
+static inline timestamp_t now() { return __TBB_time_stamp(); }
+static inline double elapsed(timestamp_t t0) { return double(now()-t0); }
+#else
+typedef tbb::tick_count timestamp_t;
+static const char *units = "ns";
+static inline timestamp_t now() { return tbb::tick_count::now(); }
+static inline double elapsed(timestamp_t t0) { return (now()-t0).seconds()*1e9; }
+#endif
+
+struct parameter_pack {
+    size_t iterations;
+    size_t batch_size;
+};
+
+// objects are allocated in batches, so released objects are not
+// the same one reused over and over
+template<bool sized>
+double measure(const parameter_pack &p, size_t size, std::vector<void*> &objs)
+{
+    timestamp_t t0 = now();
+    for (size_t it=0; it<p.iterations; it++) {
+        for (size_t i=0; i<p.batch_size; i++)
+            objs[i] = scalable_malloc(size);
+        for (size_t i=0; i<p.batch_size; i++)
+#if !NO_SIZED_FREE
+            if (sized)
+                scalable_free_sized(objs[i], size);
+            else
+#endif
+                scalable_free(objs[i]);
+    }
+    return elapsed(t0)/(p.iterations*p.batch_size);
+}
+
+int main(int argc, const char** args) {
+    parameter_pack p;
+    p.iterations = 20000;
+    p.batch_size = 64;
+
+    utility::parse_cli_arguments(argc,args,utility::cli_argument_pack()
+            .arg(p.iterations,"iterations","number of batches per size")
+            .arg(p.batch_size,"batch-size","number of objects allocated before releasing")
+            );
+    if (!p.iterations || !p.batch_size) {
+        std::cerr << "iterations and batch-size must be positive" << std::endl;
+        return 1;
+    }
+    const size_t sizes[] = {8, 24, 64, 100, 256, 1000, 2000, 4000, 8000, 64*1024, 1024*1024};
+    std::vector<void*> objs(p.batch_size);
+
+    std::cout << "size  free(" << units << "/pair)";
+#if !NO_SIZED_FREE
+    std::cout << "  free_sized(" << units << "/pair)";
+#endif
+    std::cout << std::endl;
+    for (size_t s=0; s<sizeof(sizes)/sizeof(sizes[0]); s++) {
+        // warm up caches and thread-local bins
+        measure<false>(p, sizes[s], objs);
+        std::cout << std::setw(7) << sizes[s] << "  " << std::setw(10)
+                  << measure<false>(p, sizes[s], objs);
+#if !NO_SIZED_FREE
+        std::cout << "  " << std::setw(10) << measure<true>(p, sizes[s], objs);
+#endif
+        std::cout << std::endl;
+    }
+    return 0;
+}
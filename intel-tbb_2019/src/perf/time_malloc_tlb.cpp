@@ -0,0 +1,133 @@
+/*
+    Copyright (c) 2005-2019 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+// TLB stress: random pointer chasing over many small objects allocated
+// with scalable_malloc, interleaved with allocations of another size class.
+// Latency of an access is reported with TBBMALLOC_USE_HUGE_PAGE_SLABS off
+// and on, together with placement counters of the allocator.
+
+#include "../examples/common/utility/utility.h"
+#include "tbb/tick_count.h"
+#include "tbb/scalable_allocator.h"
+
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+struct parameter_pack {
+    size_t objects;
+    size_t object_size;
+    size_t other_size;
+    size_t accesses;
+};
+
+struct Node {
+    Node *next;
+};
+
+// simple LCG, to not depend on quality of rand() across platforms
+class Random {
+    unsigned long long x;
+public:
+    Random(unsigned long long seed) : x(seed) {}
+    size_t operator()(size_t n) {
+        x = x*6364136223846793005ULL + 1442695040888963407ULL;
+        return (size_t)(x>>33) % n;
+    }
+};
+
+static double measure(const parameter_pack &p, bool hugePageSlabs)
+{
+    int res = scalable_allocation_mode(TBBMALLOC_USE_HUGE_PAGE_SLABS, hugePageSlabs);
+    if (hugePageSlabs && res != TBBMALLOC_OK)
+        std::cout << "Huge page slabs are not supported, placement is not changed." << std::endl;
+    // slabs cached by the thread must not be reused
+    scalable_allocation_command(TBBMALLOC_CLEAN_THREAD_BUFFERS, NULL);
+
+    std::vector<Node*> nodes(p.objects);
+    std::vector<void*> others(p.objects);
+    for (size_t i=0; i<p.objects; i++) {
+        nodes[i] = (Node*)scalable_malloc(p.object_size);
+        others[i] = scalable_malloc(p.other_size);
+    }
+    // link the objects in random cyclic order
+    Random rnd(42);
+    std::vector<Node*> order(nodes);
+    for (size_t i=order.size()-1; i>0; i--)
+        std::swap(order[i], order[rnd(i+1)]);
+    for (size_t i=0; i<order.size(); i++)
+        order[i]->next = order[(i+1) % order.size()];
+
+    Node *curr = order[0];
+    for (size_t i=0; i<p.objects; i++) // warm up
+        curr = curr->next;
+    tbb::tick_count t0 = tbb::tick_count::now();
+    for (size_t i=0; i<p.accesses; i++)
+        curr = curr->next;
+    double ns = (tbb::tick_count::now()-t0).seconds()*1e9/p.accesses;
+    if (!curr)
+        std::cout << "unreachable" << std::endl; // keep the chase alive
+
+    ScalableAllocationStatistics stat;
+    scalable_allocation_command(TBBMALLOC_GET_STATISTICS, &stat);
+    std::cout << std::setw(18) << (hugePageSlabs? "huge page slabs" : "default")
+              << std::setw(12) << std::setprecision(3) << ns
+              << std::setw(14) << stat.hugePageSlabGroups
+              << std::setw(14) << stat.groupedSlabs
+              << std::setw(14) << stat.ungroupedSlabs << std::endl;
+
+    for (size_t i=0; i<p.objects; i++) {
+        scalable_free(nodes[i]);
+        scalable_free(others[i]);
+    }
+    scalable_allocation_mode(TBBMALLOC_USE_HUGE_PAGE_SLABS, 0);
+    return ns;
+}
+
+int main(int argc, const char** args) {
+    parameter_pack p;
+    p.objects = 1024*1024;
+    p.object_size = 32;
+    p.other_size = 200;
+    p.accesses = 20*1024*1024;
+
+    utility::parse_cli_arguments(argc,args,utility::cli_argument_pack()
+            .arg(p.objects,"objects","number of objects in the chased list")
+            .arg(p.object_size,"object-size","size of chased objects")
+            .arg(p.other_size,"other-size","size of objects allocated between chased ones")
+            .arg(p.accesses,"accesses","number of dependent accesses to measure")
+            );
+    if (!p.objects || !p.accesses || p.object_size < sizeof(Node)) {
+        std::cerr << "objects and accesses must be positive, object-size not less than "
+                  << sizeof(Node) << std::endl;
+        return 1;
+    }
+    if (scalable_allocation_mode(TBBMALLOC_COLLECT_STATISTICS, 1) != TBBMALLOC_OK)
+        std::cout << "Placement counters are not available." << std::endl;
+
+    std::cout << std::setw(18) << "mode" << std::setw(12) << "ns/access"
+              << std::setw(14) << "huge pages" << std::setw(14) << "grouped slabs"
+              << std::setw(14) << "other slabs" << std::endl;
+    double base = measure(p, false),
+        grouped = measure(p, true);
+    std::cout << "speedup " << std::setprecision(3) << base/grouped << std::endl;
+    return 0;
+}
@@ -0,0 +1,175 @@
+/*
+    Copyright (c) 2005-2019 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+// Measures the throughput of nested parallelism, where every iteration of an
+// outer parallel_for runs an inner parallel_for in a task_arena of its own, as
+// a library does when it isolates its parallel code from its callers. The outer
+// loop runs in an arena of "outer-threads" threads, while the market has
+// "n-of-threads" workers. The inner arenas are created in three ways:
+//   none   - no inner arena, the inner loop runs in the outer arena;
+//   plain  - task_arena, which takes its workers from the market;
+//   nested - task_arena(task_arena::nested), which borrows them from the outer arena.
+// Reported are the inner iterations per second and the largest number of
+// threads that worked for the outer arena at once; plain inner arenas exceed
+// "outer-threads", the nested ones do not.
+
+#include "../examples/common/utility/utility.h"
+#include "tbb/task_arena.h"
+#include "tbb/task_scheduler_init.h"
+#include "tbb/parallel_for.h"
+#include "tbb/blocked_range.h"
+#include "tbb/enumerable_thread_specific.h"
+#include "tbb/atomic.h"
+#include "tbb/tick_count.h"
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+
+struct parameter_pack {
+    int threads_number;
+    int outer_threads;
+    int outer_size;
+    int inner_size;
+    int work;
+    std::string mode;
+};
+
+static tbb::atomic<int> g_active;
+static tbb::atomic<int> g_peak;
+static tbb::enumerable_thread_specific<int> g_depth;
+
+//! Counts the thread as working for the outer arena while any body runs on it.
+class activity_scope {
+public:
+    activity_scope() {
+        if (!g_depth.local()++) {
+            int active = ++g_active;
+            for (int peak = g_peak; active > peak; peak = g_peak)
+                g_peak.compare_and_swap(active, peak);
+        }
+    }
+    ~activity_scope() {
+        if (!--g_depth.local())
+            --g_active;
+    }
+};
+
+class inner_body {
+    int my_work;
+public:
+    inner_body(int work) : my_work(work) {}
+    void operator()(const tbb::blocked_range<int>& r) const {
+        activity_scope scope;
+        for (int i = r.begin(); i != r.end(); ++i) {
+            volatile double x = i;
+            for (int k = 0; k < my_work; ++k)
+                x = x * 1.0000001 + 1e-7;
+        }
+    }
+};
+
+class inner_loop {
+    const parameter_pack& my_p;
+public:
+    inner_loop(const parameter_pack& p) : my_p(p) {}
+    void operator()() const {
+        tbb::parallel_for(tbb::blocked_range<int>(0, my_p.inner_size), inner_body(my_p.work));
+    }
+};
+
+class outer_body {
+    const parameter_pack& my_p;
+    int my_mode;
+public:
+    outer_body(const parameter_pack& p, int mode) : my_p(p), my_mode(mode) {}
+    void operator()(const tbb::blocked_range<int>& r) const {
+        activity_scope scope;
+        const inner_loop loop(my_p);
+        for (int i = r.begin(); i != r.end(); ++i) {
+            if (my_mode == 0) {
+                loop();
+            } else if (my_mode == 1) {
+                tbb::task_arena inner;
+                inner.execute(loop);
+            } else {
+                tbb::task_arena inner(tbb::task_arena::nested(), tbb::task_arena::automatic);
+                inner.execute(loop);
+            }
+        }
+    }
+};
+
+class outer_loop {
+    const parameter_pack& my_p;
+    int my_mode;
+public:
+    outer_loop(const parameter_pack& p, int mode) : my_p(p), my_mode(mode) {}
+    void operator()() const {
+        tbb::parallel_for(tbb::blocked_range<int>(0, my_p.outer_size), outer_body(my_p, my_mode));
+    }
+};
+
+static void run(const char* name, int mode, const parameter_pack& p) {
+    tbb::task_arena outer(p.outer_threads);
+    // Warm up the arena and the workers
+    outer.execute(outer_loop(p, mode));
+    g_peak = 0;
+    const tbb::tick_count t0 = tbb::tick_count::now();
+    outer.execute(outer_loop(p, mode));
+    const double elapsed = (tbb::tick_count::now() - t0).seconds();
+    std::cout << std::setw(10) << name
+              << std::setw(20) << std::fixed << std::setprecision(0) << double(p.outer_size) * p.inner_size / elapsed
+              << std::setw(14) << g_peak << std::endl;
+}
+
+int main(int argc, const char** args) {
+    parameter_pack p;
+    p.threads_number = tbb::task_scheduler_init::default_num_threads();
+    p.outer_threads = p.threads_number > 1 ? p.threads_number / 2 : 1;
+    p.outer_size = 64;
+    p.inner_size = 1000;
+    p.work = 1000;
+    p.mode = "all";
+
+    utility::parse_cli_arguments(argc,args,utility::cli_argument_pack()
+            .arg(p.threads_number,"n-of-threads","number of threads in the market")
+            .arg(p.outer_threads,"outer-threads","concurrency of the arena of the outer loop")
+            .arg(p.outer_size,"outer-size","number of iterations of the outer loop")
+            .arg(p.inner_size,"inner-size","number of iterations of every inner loop")
+            .arg(p.work,"work","number of operations in an inner iteration")
+            .arg(p.mode,"mode","none, plain, nested or all")
+            );
+    if (p.threads_number < 1 || p.outer_threads < 1 || p.outer_size < 1 || p.inner_size < 1 || p.work < 0) {
+        std::cerr << "parameters must be positive" << std::endl;
+        return 1;
+    }
+
+    tbb::task_scheduler_init init(p.threads_number);
+    std::cout << std::setw(10) << "inner" << std::setw(20) << "iterations per s"
+              << std::setw(14) << "peak threads" << std::endl;
+    if (p.mode == "all" || p.mode == "none")
+        run("none", 0, p);
+    if (p.mode == "all" || p.mode == "plain")
+        run("plain", 1, p);
+    if (p.mode == "all" || p.mode == "nested")
+        run("nested", 2, p);
+    return 0;
+}
@@ -0,0 +1,176 @@
+/*
+    Copyright (c) 2005-2019 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+// Measures the delay between enqueuing an urgent task and the start of its
+// execution while the workers are saturated with batch tasks. The batch tasks
+// busy-wait for a while and re-enqueue themselves at priority_low, so the
+// queue of batch tasks never drains. The urgent tasks are enqueued
+// - at priority_low as well, behind the queued batch tasks;
+// - at priority_low with a deadline, which puts them ahead of the batch tasks;
+// - at priority_high, which makes the workers leave the lower levels;
+// - at a level in between, given as a level of the levels option.
+// Reported are latency percentiles. Run with the library built with
+// -D__TBB_NUM_PRIORITY_LEVELS=N to see how the levels in between are served.
+
+#include "../examples/common/utility/utility.h"
+#include "tbb/task.h"
+#include "tbb/task_scheduler_init.h"
+#include "tbb/global_control.h"
+#include "tbb/tick_count.h"
+#include "tbb/tbb_thread.h"
+#include "tbb/atomic.h"
+
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+struct parameter_pack {
+    int threads_number;
+    int queue_depth;
+    int batch_time;
+    int probes;
+    int gap;
+    int levels;
+    int level;
+};
+
+static tbb::atomic<bool> stop;
+static tbb::atomic<int> batch_tasks;
+
+static void busy_wait(double seconds) {
+    const tbb::tick_count t0 = tbb::tick_count::now();
+    while ((tbb::tick_count::now() - t0).seconds() < seconds)
+        continue;
+}
+
+class BatchTask : public tbb::task {
+    double my_duration;
+
+    tbb::task* execute() __TBB_override {
+        busy_wait(my_duration);
+        if (stop)
+            --batch_tasks;
+        else
+            tbb::task::enqueue(*new(tbb::task::allocate_root()) BatchTask(my_duration), tbb::priority_low);
+        return NULL;
+    }
+public:
+    BatchTask(double duration) : my_duration(duration) {}
+};
+
+class UrgentTask : public tbb::task {
+    tbb::tick_count my_enqueue_time;
+    double *my_latency;
+    tbb::atomic<int> *my_done;
+
+    tbb::task* execute() __TBB_override {
+        *my_latency = (tbb::tick_count::now() - my_enqueue_time).seconds();
+        ++*my_done;
+        return NULL;
+    }
+public:
+    UrgentTask(tbb::tick_count t, double *latency, tbb::atomic<int> *done)
+        : my_enqueue_time(t), my_latency(latency), my_done(done) {}
+};
+
+enum urgency_mode {
+    fifo_low,
+    deadline_low,
+    fifo_high,
+    fifo_level
+};
+
+static const char* mode_names[] = {
+    "low", "low+deadline", "high", "level"
+};
+
+static void run(const parameter_pack &p, urgency_mode mode) {
+    stop = false;
+    batch_tasks = p.queue_depth;
+    for (int i = 0; i < p.queue_depth; ++i)
+        tbb::task::enqueue(*new(tbb::task::allocate_root()) BatchTask(p.batch_time * 1e-6), tbb::priority_low);
+    std::vector<double> latency(p.probes);
+    tbb::atomic<int> done;
+    done = 0;
+    for (int i = 0; i < p.probes; ++i) {
+        const tbb::tick_count t = tbb::tick_count::now();
+        tbb::task &u = *new(tbb::task::allocate_root()) UrgentTask(t, &latency[i], &done);
+        switch (mode) {
+        case fifo_low:     tbb::task::enqueue(u, tbb::priority_low); break;
+        case deadline_low: tbb::task::enqueue_with_deadline(u, t, tbb::priority_low); break;
+        case fifo_high:    tbb::task::enqueue(u, tbb::priority_high); break;
+        case fifo_level:   tbb::task::enqueue(u, tbb::priority_level(p.level, p.levels)); break;
+        }
+        while (done < i + 1)
+            tbb::this_tbb_thread::yield();
+        if (p.gap > 0)
+            tbb::this_tbb_thread::sleep(tbb::tick_count::interval_t(p.gap * 1e-6));
+    }
+    stop = true;
+    while (batch_tasks)
+        tbb::this_tbb_thread::yield();
+    std::sort(latency.begin(), latency.end());
+    const size_t n = latency.size();
+    std::cout << std::setw(14) << mode_names[mode]
+              << std::setw(10) << size_t(latency[n / 2] * 1e6)
+              << std::setw(10) << size_t(latency[n * 99 / 100] * 1e6)
+              << std::setw(10) << size_t(latency[n * 999 / 1000] * 1e6)
+              << std::setw(10) << size_t(latency[n - 1] * 1e6) << std::endl;
+}
+
+int main(int argc, const char** args) {
+    parameter_pack p;
+    p.threads_number = std::max(2, tbb::task_scheduler_init::default_num_threads());
+    p.queue_depth = 0;
+    p.batch_time = 100;
+    p.probes = 1000;
+    p.gap = 200;
+    p.levels = 5;
+    p.level = 3;
+
+    utility::parse_cli_arguments(argc,args,utility::cli_argument_pack()
+            .arg(p.threads_number,"n-of-threads","number of threads including the enqueuing one")
+            .arg(p.queue_depth,"queue-depth","batch tasks kept enqueued, 4 per worker by default")
+            .arg(p.batch_time,"batch-time","duration of a batch task in microseconds")
+            .arg(p.probes,"probes","number of urgent tasks per mode")
+            .arg(p.gap,"gap","pause between the urgent tasks in microseconds")
+            .arg(p.levels,"levels","number of priority levels for the level mode")
+            .arg(p.level,"level","priority level of the urgent tasks in the level mode")
+            );
+    if (p.threads_number < 2 || p.queue_depth < 0 || p.batch_time < 0 || p.probes < 1
+        || p.levels < 2 || p.level < 0 || p.level >= p.levels) {
+        std::cerr << "n-of-threads must be at least 2, probes positive, and level less than levels" << std::endl;
+        return 1;
+    }
+    if (!p.queue_depth)
+        p.queue_depth = 4 * (p.threads_number - 1);
+
+    // The enqueuing thread does not execute tasks, so the workers have to be allowed
+    tbb::global_control parallelism(tbb::global_control::max_allowed_parallelism, p.threads_number);
+    tbb::task_scheduler_init init(p.threads_number);
+
+    std::cout << std::setw(14) << "urgent tasks" << std::setw(10) << "p50, us"
+              << std::setw(10) << "p99" << std::setw(10) << "p99.9"
+              << std::setw(10) << "max" << std::endl;
+    for (int mode = fifo_low; mode <= fifo_level; ++mode)
+        run(p, urgency_mode(mode));
+    return 0;
+}
@@ -0,0 +1,169 @@
+/*
+    Copyright (c) 2005-2019 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+// Measures the task pool on steal-heavy workloads: the recursive Fibonacci of
+// fibonacci_impl_tbb.cpp with a small cutoff, and the sum of a binary tree as in
+// the tree_sum example. Every spawned task is a candidate for stealing, so the
+// time is dominated by the owner's pushes and pops racing with the thieves.
+// Run it with the library built with and without -D__TBB_CHASE_LEV_TASK_POOL=1
+// to compare the lock-based task pool with the Chase-Lev one. Reported is the
+// time per spawned task, and the share of the steal attempts that succeeded.
+
+#include "../examples/common/utility/utility.h"
+#include "tbb/task.h"
+#include "tbb/task_arena.h"
+#include "tbb/task_scheduler_init.h"
+#include "tbb/tick_count.h"
+#include "fibonacci_impl_tbb.cpp"
+
+#include <iostream>
+#include <iomanip>
+
+long CutOff = 2;
+
+struct parameter_pack {
+    int threads_number;
+    int fib_n;
+    int tree_depth;
+    int repetitions;
+};
+
+struct tree_node {
+    tree_node* left;
+    tree_node* right;
+    long value;
+};
+
+static tree_node* make_tree(int depth, long& count) {
+    tree_node* n = new tree_node;
+    n->value = ++count;
+    n->left = depth ? make_tree(depth - 1, count) : NULL;
+    n->right = depth ? make_tree(depth - 1, count) : NULL;
+    return n;
+}
+
+static void destroy_tree(tree_node* n) {
+    if (n) {
+        destroy_tree(n->left);
+        destroy_tree(n->right);
+        delete n;
+    }
+}
+
+class tree_sum_task: public tbb::task {
+    tree_node* my_root;
+    long* my_sum;
+public:
+    tree_sum_task(tree_node* root, long* sum) : my_root(root), my_sum(sum) {}
+    tbb::task* execute() __TBB_override {
+        long x = 0, y = 0;
+        int count = 1;
+        tbb::task_list list;
+        if (my_root->left) {
+            ++count;
+            list.push_back(*new(allocate_child()) tree_sum_task(my_root->left, &x));
+        }
+        if (my_root->right) {
+            ++count;
+            list.push_back(*new(allocate_child()) tree_sum_task(my_root->right, &y));
+        }
+        set_ref_count(count);
+        if (count > 1)
+            spawn_and_wait_for_all(list);
+        else
+            wait_for_all();
+        *my_sum = my_root->value + x + y;
+        return NULL;
+    }
+};
+
+static long parallel_tree_sum(tree_node* root) {
+    long sum = 0;
+    tbb::task::spawn_root_and_wait(*new(tbb::task::allocate_root()) tree_sum_task(root, &sum));
+    return sum;
+}
+
+static long fib_task_count(long n) {
+    return n < CutOff ? 1 : 1 + fib_task_count(n - 1) + fib_task_count(n - 2);
+}
+
+template<typename Body>
+static void run(const char* name, long tasks, int repetitions, Body body) {
+    const tbb::task_arena_statistics s0 = tbb::this_task_arena::statistics();
+    const tbb::tick_count t0 = tbb::tick_count::now();
+    long result = 0;
+    for (int i = 0; i < repetitions; ++i)
+        result += body();
+    const double elapsed = (tbb::tick_count::now() - t0).seconds();
+    const tbb::task_arena_statistics s1 = tbb::this_task_arena::statistics();
+    const size_t attempted = s1.steals_attempted - s0.steals_attempted;
+    const size_t succeeded = s1.steals_succeeded - s0.steals_succeeded;
+    std::cout << std::setw(10) << name
+              << std::setw(14) << std::fixed << std::setprecision(1) << elapsed / (double(tasks) * repetitions) * 1e9
+              << std::setw(12) << succeeded
+              << std::setw(12) << std::setprecision(3) << (attempted ? double(succeeded) / attempted : 0.)
+              << std::setw(16) << result << std::endl;
+}
+
+struct fib_body {
+    long n;
+    long operator()() const { return ParallelFib(n); }
+};
+
+struct tree_sum_body {
+    tree_node* root;
+    long operator()() const { return parallel_tree_sum(root); }
+};
+
+int main(int argc, const char** args) {
+    parameter_pack p;
+    p.threads_number = tbb::task_scheduler_init::default_num_threads();
+    p.fib_n = 30;
+    p.tree_depth = 20;
+    p.repetitions = 10;
+
+    utility::parse_cli_arguments(argc,args,utility::cli_argument_pack()
+            .arg(p.threads_number,"n-of-threads","number of threads")
+            .arg(p.fib_n,"fib-n","Fibonacci number to compute")
+            .arg(CutOff,"cutoff","Fibonacci numbers below it are computed serially")
+            .arg(p.tree_depth,"tree-depth","depth of the binary tree to sum")
+            .arg(p.repetitions,"repetitions","number of runs of each workload")
+            );
+    if (p.threads_number < 1 || p.fib_n < 1 || CutOff < 1 || p.tree_depth < 0 || p.repetitions < 1) {
+        std::cerr << "parameters must be positive" << std::endl;
+        return 1;
+    }
+
+    tbb::task_scheduler_init init(p.threads_number);
+    long node_count = 0;
+    tree_node* root = make_tree(p.tree_depth, node_count);
+    // Warm up the workers and the task pools
+    ParallelFib(p.fib_n);
+
+    std::cout << std::setw(10) << "workload" << std::setw(14) << "ns per task"
+              << std::setw(12) << "steals" << std::setw(12) << "success"
+              << std::setw(16) << "result" << std::endl;
+    fib_body fib = { p.fib_n };
+    run("fibonacci", fib_task_count(p.fib_n), p.repetitions, fib);
+    tree_sum_body tree_sum = { root };
+    run("tree_sum", node_count, p.repetitions, tree_sum);
+    destroy_tree(root);
+    return 0;
+}
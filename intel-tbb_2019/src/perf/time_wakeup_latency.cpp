@@ -0,0 +1,132 @@
+/*
+    Copyright (c) 2005-2019 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+// Measures the delay between enqueuing a task and the start of its execution
+// by a worker when tasks come in bursts separated by idle gaps. Short gaps are
+// bridged by spinning workers, while after long ones the workers have to be
+// woken up. Reported are latency percentiles and the CPU time the process
+// consumed per burst, that grows with the time workers spend spinning.
+// The spinning can be limited via global_control::max_spin_time.
+
+#include "../examples/common/utility/utility.h"
+#include "tbb/task.h"
+#include "tbb/task_scheduler_init.h"
+#include "tbb/global_control.h"
+#include "tbb/tick_count.h"
+#include "tbb/tbb_thread.h"
+#include "tbb/atomic.h"
+
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <sys/resource.h>
+
+struct parameter_pack {
+    int threads_number;
+    int bursts;
+    int burst_size;
+    long spin_time;
+};
+
+class LatencyTask : public tbb::task {
+    tbb::tick_count my_enqueue_time;
+    double *my_latency;
+    tbb::atomic<int> *my_done;
+
+    tbb::task* execute() __TBB_override {
+        *my_latency = (tbb::tick_count::now() - my_enqueue_time).seconds();
+        ++*my_done;
+        return NULL;
+    }
+public:
+    LatencyTask(tbb::tick_count t, double *latency, tbb::atomic<int> *done)
+        : my_enqueue_time(t), my_latency(latency), my_done(done) {}
+};
+
+static double cpu_time() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+        + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+}
+
+static void run(const parameter_pack &p, double gap) {
+    std::vector<double> latency(p.bursts * p.burst_size);
+    tbb::atomic<int> done;
+    done = 0;
+    const double cpu_start = cpu_time();
+    for (int i = 0; i < p.bursts; ++i) {
+        const tbb::tick_count t = tbb::tick_count::now();
+        for (int j = 0; j < p.burst_size; ++j)
+            tbb::task::enqueue(*new(tbb::task::allocate_root())
+                               LatencyTask(t, &latency[i * p.burst_size + j], &done));
+        while (done < (i + 1) * p.burst_size)
+            __TBB_Yield();
+        if (gap > 0)
+            tbb::this_tbb_thread::sleep(tbb::tick_count::interval_t(gap));
+    }
+    const double cpu = cpu_time() - cpu_start;
+    std::sort(latency.begin(), latency.end());
+    const size_t n = latency.size();
+    std::cout << std::setw(10) << gap * 1e6
+              << std::setw(10) << size_t(latency[n / 2] * 1e6)
+              << std::setw(10) << size_t(latency[n * 9 / 10] * 1e6)
+              << std::setw(10) << size_t(latency[n * 99 / 100] * 1e6)
+              << std::setw(10) << size_t(latency[n - 1] * 1e6)
+              << std::setw(14) << size_t(cpu / p.bursts * 1e6) << std::endl;
+}
+
+int main(int argc, const char** args) {
+    parameter_pack p;
+    p.threads_number = std::max(2, tbb::task_scheduler_init::default_num_threads());
+    p.bursts = 200;
+    p.burst_size = 0;
+    p.spin_time = -1;
+
+    utility::parse_cli_arguments(argc,args,utility::cli_argument_pack()
+            .arg(p.threads_number,"n-of-threads","number of threads including the enqueuing one")
+            .arg(p.bursts,"bursts","number of bursts per gap length")
+            .arg(p.burst_size,"burst-size","tasks per burst, number of workers by default")
+            .arg(p.spin_time,"spin-time","global_control::max_spin_time in microseconds, not set by default")
+            );
+    if (p.threads_number < 2 || p.bursts < 1 || p.burst_size < 0) {
+        std::cerr << "n-of-threads must be at least 2, bursts must be positive" << std::endl;
+        return 1;
+    }
+    if (!p.burst_size)
+        p.burst_size = p.threads_number - 1;
+
+    tbb::task_scheduler_init init(p.threads_number);
+    std::vector<tbb::global_control*> control;
+    if (p.spin_time >= 0)
+        control.push_back(new tbb::global_control(tbb::global_control::max_spin_time, p.spin_time));
+
+    std::cout << std::setw(10) << "gap, us" << std::setw(10) << "p50, us"
+              << std::setw(10) << "p90" << std::setw(10) << "p99"
+              << std::setw(10) << "max" << std::setw(14) << "CPU/burst, us" << std::endl;
+    const double gaps[] = {0, 20e-6, 200e-6, 2e-3, 20e-3};
+    for (size_t i = 0; i < sizeof(gaps) / sizeof(gaps[0]); ++i)
+        run(p, gaps[i]);
+
+    for (size_t i = 0; i < control.size(); ++i)
+        delete control[i];
+    return 0;
+}
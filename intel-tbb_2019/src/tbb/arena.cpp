@@ -43,6 +43,8 @@ void generic_scheduler::attach_arena( arena* a, size_t index, bool is_master ) {
     my_arena_index = index;
     my_arena_slot = a->my_slots + index;
     attach_mailbox( affinity_id(index+1) );
+    if ( governor::topology().num_cpus() )
+        __TBB_store_relaxed( my_arena_slot->my_cpu, current_cpu() );
     if ( is_master && my_inbox.is_idle_state( true ) ) {
         // Master enters an arena with its own task to be executed. It means that master is not
         // going to enter stealing loop and take affinity tasks.
@@ -110,6 +112,8 @@ void arena::process( generic_scheduler& s ) {
     __TBB_ASSERT( s.worker_outermost_level(), NULL );
 
     __TBB_ASSERT( my_num_slots > 1, NULL );
+    const tick_count entry_time = tick_count::now();
+    tick_count::interval_t entry_spin_time, work_time;
 
     size_t index = occupy_free_slot</*as_worker*/true>( s );
     if ( index == out_of_arena )
@@ -117,6 +121,11 @@ void arena::process( generic_scheduler& s ) {
 
     __TBB_ASSERT( index >= my_num_reserved_slots, "Workers cannot occupy reserved slots" );
     s.attach_arena( this, index, /*is_master*/false );
+    // The sleep that preceded the visit is accounted to the arena that woke the worker up
+    s.my_arena_slot->sleep_time += s.my_sleep_time;
+    s.my_sleep_time = tick_count::interval_t();
+    entry_spin_time = s.my_arena_slot->spin_time;
+    TRACE_EVENT( s.my_trace, te_arena_join, this, int(index) );
 
 #if !__TBB_FP_CONTEXT
     my_cpu_ctl_env.set_env();
@@ -168,11 +177,15 @@ void arena::process( generic_scheduler& s ) {
     if ( s.my_offloaded_tasks )
         orphan_offloaded_tasks( s );
 #endif /* __TBB_TASK_PRIORITY */
+    work_time = (tick_count::now() - entry_time) - (s.my_arena_slot->spin_time - entry_spin_time);
+    s.my_arena_slot->work_time += work_time;
 #if __TBB_STATISTICS
     ++s.my_counters.arena_roundtrips;
+    s.my_counters.work_time += time_counter( work_time );
     *my_slots[index].my_counters += s.my_counters;
     s.my_counters.reset();
 #endif /* __TBB_STATISTICS */
+    TRACE_EVENT( s.my_trace, te_arena_leave, this, int(index) );
     __TBB_store_with_release( my_slots[index].my_scheduler, (generic_scheduler*)NULL );
     s.my_arena_slot = 0; // detached from slot
     s.my_inbox.detach();
@@ -181,6 +194,7 @@ void arena::process( generic_scheduler& s ) {
     __TBB_ASSERT( s.worker_outermost_level(), NULL );
     __TBB_ASSERT( is_alive(my_guard), NULL );
 quit:
+    leave_quota();
     // In contrast to earlier versions of TBB (before 3.0 U5) now it is possible
     // that arena may be temporarily left unpopulated by threads. See comments in
     // arena::on_thread_leaving() for more details.
@@ -200,6 +214,7 @@ arena::arena ( market& m, unsigned num_slots, unsigned num_reserved_slots ) {
     my_num_slots = num_arena_slots(num_slots);
     my_num_reserved_slots = num_reserved_slots;
     my_max_num_workers = num_slots-num_reserved_slots;
+    my_spin_rounds = default_spin_rounds;
     my_references = ref_external; // accounts for the master
 #if __TBB_TASK_PRIORITY
     my_bottom_priority = my_top_priority = normalized_normal_priority;
@@ -227,6 +242,8 @@ arena::arena ( market& m, unsigned num_slots, unsigned num_reserved_slots ) {
     }
     my_task_stream.initialize(my_num_slots);
     ITT_SYNC_CREATE(&my_task_stream, SyncType_Scheduler, SyncObj_TaskStream);
+    my_deadline_task_stream.initialize(my_num_slots);
+    ITT_SYNC_CREATE(&my_deadline_task_stream, SyncType_Scheduler, SyncObj_TaskStream);
 #if __TBB_PREVIEW_CRITICAL_TASKS
     my_critical_task_stream.initialize(my_num_slots);
     ITT_SYNC_CREATE(&my_critical_task_stream, SyncType_Scheduler, SyncObj_CriticalTaskStream);
@@ -239,6 +256,15 @@ arena::arena ( market& m, unsigned num_slots, unsigned num_reserved_slots ) {
 #endif
 }
 
+void arena::set_quota_parent( arena& parent ) {
+    __TBB_ASSERT( !my_quota_parent && !my_num_workers_requested, "The quota must be set before the arena requests workers" );
+    parent.my_references += ref_external;
+    my_quota_parent = &parent;
+    // The arena can never get more workers than its parent may have
+    if( my_max_num_workers > parent.my_max_num_workers )
+        my_max_num_workers = parent.my_max_num_workers;
+}
+
 arena& arena::allocate_arena( market& m, unsigned num_slots, unsigned num_reserved_slots ) {
     __TBB_ASSERT( sizeof(base_type) + sizeof(arena_slot) == sizeof(arena), "All arena data fields must go to arena_base" );
     __TBB_ASSERT( sizeof(base_type) % NFS_GetLineSize() == 0, "arena slots area misaligned: wrong padding" );
@@ -275,12 +301,16 @@ void arena::free_arena () {
         drained += mailbox(i+1).drain();
     }
     __TBB_ASSERT( my_task_stream.drain()==0, "Not all enqueued tasks were executed");
+    __TBB_ASSERT( my_deadline_task_stream.drain()==0, "Not all tasks enqueued with deadlines were executed");
 #if __TBB_PREVIEW_CRITICAL_TASKS
     __TBB_ASSERT( my_critical_task_stream.drain()==0, "Not all critical tasks were executed");
 #endif
 #if __TBB_COUNT_TASK_NODES
     my_market->update_task_node_count( -drained );
 #endif /* __TBB_COUNT_TASK_NODES */
+    __TBB_ASSERT( !my_quota_workers, "Workers are counted in the quota of a dying arena" );
+    if( my_quota_parent )
+        my_quota_parent->on_thread_leaving<ref_external>();
     // remove an internal reference
     my_market->release( /*is_public=*/false, /*blocking_terminate=*/false );
 #if __TBB_TASK_GROUP_CONTEXT
@@ -379,7 +409,7 @@ void arena::orphan_offloaded_tasks(generic_scheduler& s) {
 bool arena::has_enqueued_tasks() {
     // Look for enqueued tasks at all priority levels
     for ( int p = 0; p < num_priority_levels; ++p )
-        if ( !my_task_stream.empty(p) )
+        if ( has_enqueued_tasks(p) )
             return true;
     return false;
 }
@@ -396,7 +426,7 @@ void arena::restore_priority_if_need() {
         // update_arena_priority() expects non-zero arena::my_num_workers_requested,
         // so must be called after advertise_new_work<work_enqueued>()
         for ( int p = 0; p < num_priority_levels; ++p )
-            if ( !my_task_stream.empty(p) ) {
+            if ( has_enqueued_tasks(p) ) {
                 if ( p < my_bottom_priority || p > my_top_priority )
                     my_market->update_arena_priority(*this, p);
             }
@@ -489,18 +519,18 @@ bool arena::is_out_of_work() {
                     // Test and test-and-set.
                     if( my_pool_state==busy ) {
 #if __TBB_TASK_PRIORITY
-                        bool no_fifo_tasks = my_task_stream.empty(top_priority);
+                        bool no_fifo_tasks = !has_enqueued_tasks(top_priority);
                         work_absent = work_absent && (!dequeuing_possible || no_fifo_tasks)
                                       && top_priority == my_top_priority && reload_epoch == my_reload_epoch;
 #else
-                        bool no_fifo_tasks = my_task_stream.empty(0);
+                        bool no_fifo_tasks = !has_enqueued_tasks(0);
                         work_absent = work_absent && no_fifo_tasks;
 #endif /* __TBB_TASK_PRIORITY */
                         if( work_absent ) {
 #if __TBB_TASK_PRIORITY
                             if ( top_priority > my_bottom_priority ) {
                                 if ( my_market->lower_arena_priority(*this, top_priority - 1, reload_epoch)
-                                     && !my_task_stream.empty(top_priority) )
+                                     && has_enqueued_tasks(top_priority) )
                                 {
                                     atomic_update( my_skipped_fifo_priority, top_priority, std::less<intptr_t>());
                                 }
@@ -555,7 +585,8 @@ intptr_t arena::workers_task_node_count() {
 }
 #endif /* __TBB_COUNT_TASK_NODES */
 
-void arena::enqueue_task( task& t, intptr_t prio, FastRandom &random )
+//! Marks the task as enqueued and checks that it can be enqueued.
+static void prepare_for_enqueuing( task& t )
 {
 #if __TBB_RECYCLE_TO_ENQUEUE
     __TBB_ASSERT( t.state()==task::allocated || t.state()==task::to_enqueue, "attempt to enqueue task with inappropriate state" );
@@ -574,6 +605,20 @@ void arena::enqueue_task( task& t, intptr_t prio, FastRandom &random )
     }
     __TBB_ASSERT(t.prefix().affinity==affinity_id(0), "affinity is ignored for enqueued tasks");
 #endif /* TBB_USE_ASSERT */
+}
+
+void arena::count_enqueued_tasks( size_t n ) {
+    generic_scheduler* s = governor::local_scheduler_if_initialized();
+    if( s && s->my_arena == this && s->my_arena_slot )
+        s->my_arena_slot->tasks_enqueued += n;
+    else
+        my_tasks_enqueued_from_outside += n;
+}
+
+void arena::enqueue_task( task& t, intptr_t prio, FastRandom &random )
+{
+    prepare_for_enqueuing( t );
+    count_enqueued_tasks( 1 );
 #if __TBB_PREVIEW_CRITICAL_TASKS
     if( prio == internal::priority_critical || internal::is_critical( t ) ) {
         // TODO: consider using of 'scheduler::handled_as_critical'
@@ -607,8 +652,6 @@ void arena::enqueue_task( task& t, intptr_t prio, FastRandom &random )
 #else
     my_task_stream.push( &t, p, random );
 #endif
-    if ( p != my_top_priority )
-        my_market->update_arena_priority( *this, p );
 #else /* !__TBB_TASK_PRIORITY */
     __TBB_ASSERT_EX(prio == 0, "the library is not configured to respect the task priority");
 #if __TBB_PREVIEW_CRITICAL_TASKS && __TBB_CPF_BUILD
@@ -619,8 +662,82 @@ void arena::enqueue_task( task& t, intptr_t prio, FastRandom &random )
 #endif /* !__TBB_TASK_PRIORITY */
     advertise_new_work<work_enqueued>();
 #if __TBB_TASK_PRIORITY
-    if ( p != my_top_priority )
-        my_market->update_arena_priority( *this, p );
+    update_priority_for_enqueued( p );
+#endif /* __TBB_TASK_PRIORITY */
+}
+
+void arena::enqueue_task_list( task* first, task*& next, intptr_t prio, FastRandom &random )
+{
+    const size_t buffer_size = 256;
+    task* buffer[buffer_size];
+    size_t n = 1;
+    for( task* t = first; &t->prefix().next != &next; t = t->prefix().next )
+        ++n;
+    task** tasks = n <= buffer_size ? buffer : (task**)NFS_Allocate( n, sizeof(task*), NULL );
+    size_t num_tasks = 0;
+    task* t_next = NULL;
+    for( task* t = first; ; t = t_next ) {
+        // A critical task may be executed and destroyed as soon as it is enqueued.
+        bool end = &t->prefix().next == &next;
+        t_next = t->prefix().next;
+#if __TBB_PREVIEW_CRITICAL_TASKS
+        if( prio == internal::priority_critical || internal::is_critical( *t ) )
+            enqueue_task( *t, prio, random );
+        else
+#endif /* __TBB_PREVIEW_CRITICAL_TASKS */
+        {
+            prepare_for_enqueuing( *t );
+            tasks[num_tasks++] = t;
+        }
+        if( end )
+            break;
+    }
+    if( num_tasks ) {
+        count_enqueued_tasks( num_tasks );
+        ITT_NOTIFY(sync_releasing, &my_task_stream);
+#if __TBB_TASK_PRIORITY
+        intptr_t p = prio ? normalize_priority(priority_t(prio)) : normalized_normal_priority;
+        assert_priority_valid(p);
+#else /* !__TBB_TASK_PRIORITY */
+        __TBB_ASSERT_EX(prio == 0, "the library is not configured to respect the task priority");
+        const intptr_t p = 0;
+#endif /* !__TBB_TASK_PRIORITY */
+#if __TBB_PREVIEW_CRITICAL_TASKS && __TBB_CPF_BUILD
+        my_task_stream.push( tasks, num_tasks, p, internal::random_lane_selector(random) );
+#else
+        my_task_stream.push( tasks, num_tasks, p, random );
+#endif
+        advertise_new_work<work_enqueued>();
+#if __TBB_TASK_PRIORITY
+        update_priority_for_enqueued( p );
+#endif /* __TBB_TASK_PRIORITY */
+    }
+    if( tasks != buffer )
+        NFS_Free( tasks );
+}
+
+void arena::enqueue_task_with_deadline( task& t, tick_count deadline, intptr_t prio, FastRandom &random )
+{
+#if __TBB_PREVIEW_CRITICAL_TASKS
+    if( internal::is_critical( t ) ) {
+        enqueue_task( t, prio, random );
+        return;
+    }
+#endif /* __TBB_PREVIEW_CRITICAL_TASKS */
+    prepare_for_enqueuing( t );
+    count_enqueued_tasks( 1 );
+    ITT_NOTIFY(sync_releasing, &my_deadline_task_stream);
+#if __TBB_TASK_PRIORITY
+    intptr_t p = prio ? normalize_priority(priority_t(prio)) : normalized_normal_priority;
+    assert_priority_valid(p);
+#else /* !__TBB_TASK_PRIORITY */
+    __TBB_ASSERT_EX(prio == 0, "the library is not configured to respect the task priority");
+    const intptr_t p = 0;
+#endif /* !__TBB_TASK_PRIORITY */
+    my_deadline_task_stream.push( &t, deadline, p, random );
+    advertise_new_work<work_enqueued>();
+#if __TBB_TASK_PRIORITY
+    update_priority_for_enqueued( p );
 #endif /* __TBB_TASK_PRIORITY */
 }
 
@@ -688,6 +805,7 @@ void generic_scheduler::nested_arena_entry(arena* a, size_t slot_index) {
 #endif /* __TBB_TASK_PRIORITY */
     attach_arena( a, slot_index, /*is_master*/true );
     __TBB_ASSERT( my_arena == a, NULL );
+    TRACE_EVENT( my_trace, te_arena_join, a, int(slot_index) );
     governor::assume_scheduler( this );
     // TODO? ITT_NOTIFY(sync_acquired, a->my_slots + index);
     // TODO: it requires market to have P workers (not P-1)
@@ -701,6 +819,7 @@ void generic_scheduler::nested_arena_entry(arena* a, size_t slot_index) {
 }
 
 void generic_scheduler::nested_arena_exit() {
+    TRACE_EVENT( my_trace, te_arena_leave, my_arena, int(my_arena_index) );
 #if __TBB_ARENA_OBSERVER
     my_arena->my_observers.notify_exit_observers( my_last_local_observer, /*worker=*/false );
 #endif /* __TBB_ARENA_OBSERVER */
@@ -735,12 +854,22 @@ namespace internal {
 
 void task_arena_base::internal_initialize( ) {
     governor::one_time_init();
+    arena* parent = NULL;
+    if( my_version_and_traits & nested_flag ) {
+        // The parent is the arena of the initializing thread; without one, the workers come from the market
+        generic_scheduler* s = governor::local_scheduler_if_initialized();
+        if( s )
+            parent = s->my_arena;
+    }
     if( my_max_concurrency < 1 )
-        my_max_concurrency = (int)governor::default_num_threads();
+        my_max_concurrency = parent ? int(parent->my_num_reserved_slots + parent->my_max_num_workers)
+                                    : (int)governor::default_num_threads();
     __TBB_ASSERT( my_master_slots <= (unsigned)my_max_concurrency, "Number of slots reserved for master should not exceed arena concurrency");
     arena* new_arena = market::create_arena( my_max_concurrency, my_master_slots, 0 );
     // add an internal market reference; a public reference was added in create_arena
     market &m = market::global_market( /*is_public=*/false );
+    if( parent )
+        new_arena->set_quota_parent( *parent );
     // allocate default context for task_arena
 #if __TBB_TASK_GROUP_CONTEXT
     new_arena->my_default_ctx = new ( NFS_Allocate(1, sizeof(task_group_context), NULL) )
@@ -1058,6 +1187,39 @@ int task_arena_base::internal_max_concurrency(const task_arena *ta) {
         return int(governor::default_num_threads());
     }
 }
+
+void task_arena_base::internal_statistics( const task_arena *ta, task_arena_statistics& stats ) {
+    memset( &stats, 0, sizeof(stats) );
+    arena* a = NULL;
+    if( ta )
+        a = ta->my_arena;
+    else if( generic_scheduler* s = governor::local_scheduler_if_initialized() )
+        a = s->my_arena; // the current arena if any
+    if( !a )
+        return;
+    // The counters are read while their slots' owners update them
+    tick_count::interval_t wait_time, spin_time, work_time, sleep_time;
+    for( unsigned i = 0; i < a->my_num_slots; ++i ) {
+        const arena_slot& slot = a->my_slots[i];
+        stats.tasks_executed += __TBB_load_relaxed( slot.tasks_executed );
+        stats.steals_attempted += __TBB_load_relaxed( slot.steals_attempted );
+        stats.steals_succeeded += __TBB_load_relaxed( slot.steals_succeeded );
+        stats.mailbox_tasks_taken += __TBB_load_relaxed( slot.mailbox_tasks_taken );
+        stats.tasks_enqueued += __TBB_load_relaxed( slot.tasks_enqueued );
+        wait_time += slot.wait_time;
+        spin_time += slot.spin_time;
+        work_time += slot.work_time;
+        sleep_time += slot.sleep_time;
+    }
+    stats.tasks_enqueued += a->my_tasks_enqueued_from_outside;
+    stats.wait_time = wait_time.seconds();
+    stats.spin_time = spin_time.seconds();
+    stats.work_time = work_time.seconds();
+    stats.sleep_time = sleep_time.seconds();
+    stats.workers_requested = __TBB_load_relaxed( a->my_num_workers_requested );
+    stats.workers_allotted = int(__TBB_load_relaxed( a->my_num_workers_allotted ));
+    stats.workers_active = int(a->num_workers_active());
+}
 } // tbb::interfaceX::internal
 } // tbb::interfaceX
 } // tbb
@@ -33,6 +33,7 @@
 #else
 #include "task_stream.h"
 #endif
+#include "deadline_task_stream.h"
 #include "../rml/include/rml_tbb.h"
 #include "mailbox.h"
 #include "observer_proxy.h"
@@ -80,6 +81,11 @@ struct arena_base : padded<intrusive_list_node> {
     task_stream<num_priority_levels> my_task_stream; // heavy use in stealing loop
 #endif
 
+    //! Task pool for the tasks scheduled via task::enqueue_with_deadline() method.
+    /** The tasks are taken in the order of their deadlines, ahead of the ones in my_task_stream
+        on the same priority level. **/
+    deadline_task_stream<num_priority_levels> my_deadline_task_stream;
+
 #if __TBB_PREVIEW_CRITICAL_TASKS
     //! Task pool for the tasks with critical property set.
     /** Critical tasks are scheduled for execution ahead of other sources (including local task pool
@@ -102,6 +108,15 @@ struct arena_base : padded<intrusive_list_node> {
         my_pool_state to be unsigned. */
     tbb::atomic<uintptr_t> my_pool_state;
 
+    //! The number of tasks enqueued by threads that do not occupy a slot in the arena.
+    /** The other threads count enqueued tasks in their slots. **/
+    tbb::atomic<size_t> my_tasks_enqueued_from_outside;
+
+    //! The number of yield rounds an idle worker spends looking for work before leaving the arena.
+    /** Adapted by the workers to the recent outcomes of spinning, see arena::on_spin_end().
+        Updated without synchronization, as a lost update only makes the estimate less accurate. **/
+    int my_spin_rounds;
+
 #if __TBB_ARENA_OBSERVER
     //! The list of local observers attached to this arena.
     observer_list my_observers;
@@ -137,6 +152,16 @@ struct arena_base : padded<intrusive_list_node> {
     //! ABA prevention marker.
     uintptr_t my_aba_epoch;
 
+    //! The arena whose workers this arena borrows, or NULL if it takes them from the market.
+    /** Set for the arenas created as task_arena(task_arena::nested). The arena holds an external
+        reference to its parent, so the whole chain of the parents outlives it. **/
+    arena* my_quota_parent;
+
+    //! The number of workers servicing this arena and the arenas nested into it with quotas.
+    /** A worker is admitted only while the counter is below my_max_num_workers in the arena
+        and in each of its parents. **/
+    atomic<unsigned> my_quota_workers;
+
 #if !__TBB_FP_CONTEXT
     //! FPU control settings of arena's master thread captured at the moment of arena instantiation.
     cpu_ctl_env my_cpu_ctl_env;
@@ -238,6 +263,16 @@ public:
         return my_references >> ref_external_bits;
     }
 
+    //! Makes the arena take its workers from the quota of the given one.
+    void set_quota_parent( arena& parent );
+
+    //! Counts a joining worker in the quotas of the arena and of its parents.
+    /** Returns false and counts nothing if any of the quotas is exhausted. **/
+    bool try_join_quota();
+
+    //! Returns the quotas taken by a worker leaving the arena to its parents.
+    void leave_quota();
+
     //! If necessary, raise a flag that there is new job in arena.
     template<arena::new_work_type work_type> void advertise_new_work();
 
@@ -245,9 +280,49 @@ public:
     /** Return true if no job or if arena is being cleaned up. */
     bool is_out_of_work();
 
+    //! Bounds and initial value of my_spin_rounds
+    static const int min_spin_rounds = 4;
+    static const int max_spin_rounds = 1600;
+    static const int default_spin_rounds = 100;
+
+    //! Number of yield rounds between the checks of the spin time limit set via global_control
+    static const int spin_time_check_period = 4;
+
+    //! The number of yield rounds an idle worker should spend before leaving the arena.
+    int spin_rounds() const { return __TBB_load_relaxed(my_spin_rounds); }
+
+    //! Adapts spin_rounds() to the outcome of spinning of an idle worker.
+    /** If work was found after more than a half of the allowed rounds, spinning is
+        allowed to last twice longer; if the worker gave up, the rounds are reduced
+        by a quarter. So the limit follows the typical delay between bursts of work
+        and shrinks when the arena stays idle. **/
+    void on_spin_end( int rounds, bool found_work ) {
+        int limit = spin_rounds();
+        if ( found_work ) {
+            if ( 2*rounds <= limit || limit == max_spin_rounds )
+                return;
+            limit = min( 2*limit, int(max_spin_rounds) );
+        } else {
+            if ( limit == min_spin_rounds )
+                return;
+            limit = max( limit - limit/4, int(min_spin_rounds) );
+        }
+        __TBB_store_relaxed( my_spin_rounds, limit );
+    }
+
     //! enqueue a task into starvation-resistance queue
     void enqueue_task( task&, intptr_t, FastRandom & );
 
+    //! enqueue a list of tasks into starvation-resistance queue at once
+    /** The list starts with first and ends with the task whose prefix().next is next. **/
+    void enqueue_task_list( task* first, task*& next, intptr_t, FastRandom & );
+
+    //! enqueue a task to be taken in the order of deadlines
+    void enqueue_task_with_deadline( task&, tick_count, intptr_t, FastRandom & );
+
+    //! Adds the number of enqueued tasks to the activity counters of the arena
+    void count_enqueued_tasks( size_t n );
+
     //! Registers the worker with the arena and enters TBB scheduler dispatch loop
     void process( generic_scheduler& );
 
@@ -267,6 +342,14 @@ public:
 
     //! Puts offloaded tasks into global list of orphaned tasks
     void orphan_offloaded_tasks ( generic_scheduler& s );
+
+    //! Lets the market know the priority level of just enqueued tasks.
+    /** The market is only locked if the level is out of the arena's range of levels,
+        as otherwise market::update_arena_priority() would not change anything. **/
+    void update_priority_for_enqueued ( intptr_t p ) {
+        if ( p > my_top_priority || p < my_bottom_priority )
+            my_market->update_arena_priority( *this, p );
+    }
 #endif /* __TBB_TASK_PRIORITY */
 
 #if __TBB_COUNT_TASK_NODES
@@ -277,6 +360,11 @@ public:
     //! Check for the presence of enqueued tasks at all priority levels
     bool has_enqueued_tasks();
 
+    //! Check for the presence of enqueued tasks, with or without deadlines, at the priority level
+    bool has_enqueued_tasks( intptr_t p ) {
+        return !my_task_stream.empty(p) || !my_deadline_task_stream.empty(p);
+    }
+
 #if __TBB_ENQUEUE_ENFORCED_CONCURRENCY
     //! Recall worker if global mandatory is enabled, but not for this arena
     bool recall_by_mandatory_request() const {
@@ -390,6 +478,25 @@ inline void arena::on_thread_leaving ( ) {
         m->try_destroy_arena( this, aba_epoch );
 }
 
+inline bool arena::try_join_quota() {
+    for( arena* a = this; a; a = a->my_quota_parent ) {
+        if( a->my_quota_workers.fetch_and_increment() >= a->my_max_num_workers ) {
+            // Roll back the counts taken so far, including the one just taken
+            for( arena* b = this; b != a->my_quota_parent; b = b->my_quota_parent )
+                --b->my_quota_workers;
+            return false;
+        }
+    }
+    return true;
+}
+
+inline void arena::leave_quota() {
+    for( arena* a = this; a; a = a->my_quota_parent ) {
+        __TBB_ASSERT( a->my_quota_workers, "Worker quota underflowed" );
+        --a->my_quota_workers;
+    }
+}
+
 template<arena::new_work_type work_type> void arena::advertise_new_work() {
     if( work_type == work_enqueued ) {
 #if __TBB_ENQUEUE_ENFORCED_CONCURRENCY
@@ -24,10 +24,40 @@
 #include "scheduler.h"
 #include "observer_proxy.h"
 #include "itt_notify.h"
+#include "tbb/tick_count.h"
 
 namespace tbb {
 namespace internal {
 
+//! Adds the time since the first call to start() to the spin time of the arena slot when destroyed.
+class spin_time_recorder : no_copy {
+    arena_slot& my_slot;
+#if __TBB_STATISTICS
+    statistics_counters& my_counters;
+#endif
+    tick_count my_start;
+    bool my_started;
+public:
+    spin_time_recorder( generic_scheduler& s ) : my_slot(*s.my_arena_slot),
+#if __TBB_STATISTICS
+        my_counters(s.my_counters),
+#endif
+        my_started(false) {}
+    ~spin_time_recorder() {
+        if ( my_started ) {
+            const tick_count::interval_t spin_time = tick_count::now() - my_start;
+            my_slot.spin_time += spin_time;
+            GATHER_STATISTIC( my_counters.spin_time += time_counter(spin_time) );
+        }
+    }
+    void start() {
+        if ( !my_started ) {
+            my_started = true;
+            my_start = tick_count::now();
+        }
+    }
+};
+
 //------------------------------------------------------------------------
 //! Traits classes for scheduler
 //------------------------------------------------------------------------
@@ -166,6 +196,10 @@ task* custom_scheduler<SchedulerTraits>::receive_or_steal_task( __TBB_ISOLATION_
     // The number of slots potentially used in the arena. Updated once in a while, as my_limit changes rarely.
     size_t n = my_arena->my_limit-1;
     int yield_count = 0;
+    // Time limit of spinning set via global_control; read when yielding starts.
+    size_t max_spin_time = market::unlimited_spin_time;
+    tick_count spin_start;
+    spin_time_recorder spin_timer( *this );
     // The state "failure_count==-1" is used only when itt_possible is true,
     // and denotes that a sync_prepare has not yet been issued.
     for( int failure_count = -static_cast<int>(SchedulerTraits::itt_possible);; ++failure_count) {
@@ -220,6 +254,16 @@ task* custom_scheduler<SchedulerTraits>::receive_or_steal_task( __TBB_ISOLATION_
         }
         if ( t ) {
             GATHER_STATISTIC( ++my_counters.mails_received );
+            ++my_arena_slot->mailbox_tasks_taken;
+            TRACE_EVENT( my_trace, te_mailbox_hit, NULL, 0 );
+        }
+        // Check if there are tasks enqueued with deadlines; they go ahead of the other enqueued tasks.
+        // Only allowed at the outermost dispatch level without isolation.
+        else if (__TBB_ISOLATION_EXPR(isolation == no_isolation &&) outermost_dispatch_level &&
+                 !my_arena->my_deadline_task_stream.empty(p) &&
+                 (t = my_arena->my_deadline_task_stream.pop( p )) ) {
+            ITT_NOTIFY(sync_acquired, &my_arena->my_deadline_task_stream);
+            // just proceed with the obtained task
         }
         // Check if there are tasks in starvation-resistant stream.
         // Only allowed at the outermost dispatch level without isolation.
@@ -266,9 +310,12 @@ task* custom_scheduler<SchedulerTraits>::receive_or_steal_task( __TBB_ISOLATION_
             // Notify Intel(R) Thread Profiler that thread has stopped spinning.
             ITT_NOTIFY(sync_acquired, this);
         }
+        if ( yield_count && outermost_worker_level )
+            my_arena->on_spin_end( yield_count, /*found_work=*/true );
         break; // exit stealing loop and return
 fail:
         GATHER_STATISTIC( ++my_counters.steals_failed );
+        spin_timer.start();
         if( SchedulerTraits::itt_possible && failure_count==-1 ) {
             // The first attempt to steal work failed, so notify Intel(R) Thread Profiler that
             // the thread has started spinning.  Ideally, we would do this notification
@@ -314,8 +361,16 @@ fail:
                 }
             }
 #endif /* __TBB_TASK_PRIORITY */
-            const int yield_threshold = 100;
-            if( yield_count++ >= yield_threshold ) {
+            if ( !yield_count ) {
+                max_spin_time = market::max_spin_time();
+                if ( max_spin_time != market::unlimited_spin_time )
+                    spin_start = tick_count::now();
+            }
+            // The number of rounds is adapted by the arena to the recent outcomes of spinning.
+            // The time limit is checked once in a few rounds, as reading the clock is not free.
+            if( yield_count++ >= my_arena->spin_rounds() || ( max_spin_time != market::unlimited_spin_time
+                    && yield_count % arena::spin_time_check_period == 0
+                    && (tick_count::now() - spin_start).seconds()*1e6 >= double(max_spin_time) ) ) {
                 // When a worker thread has nothing to do, return it to RML.
                 // For purposes of affinity support, the thread is considered idle while in RML.
 #if __TBB_TASK_PRIORITY
@@ -326,6 +381,7 @@ fail:
 #endif /* !__TBB_TASK_PRIORITY */
                         if( SchedulerTraits::itt_possible )
                             ITT_NOTIFY(sync_cancel, this);
+                        my_arena->on_spin_end( yield_count, /*found_work=*/false );
                         return NULL;
                     }
 #if __TBB_TASK_PRIORITY
@@ -391,6 +447,8 @@ void custom_scheduler<SchedulerTraits>::local_wait_for_all( task& parent, task*
     // Remove outermost property to indicate nested level.
     __TBB_ASSERT( my_properties.outermost || my_innermost_running_task!=my_dummy_task, "The outermost property should be set out of a dispatch loop" );
     my_properties.outermost &= my_innermost_running_task==my_dummy_task;
+    // The time that application threads wait for the work to complete is reported by task_arena::statistics().
+    wait_time_guard wait_guard( master_outermost_level() ? my_arena_slot : NULL );
 #if __TBB_TASK_ISOLATION
     isolation_tag isolation = my_innermost_running_task->prefix().isolation;
 #endif /* __TBB_TASK_ISOLATION */
@@ -507,6 +565,7 @@ void custom_scheduler<SchedulerTraits>::local_wait_for_all( task& parent, task*
                 if ( !t->prefix().context->my_cancellation_requested )
 #endif
                 {
+                    ++my_arena_slot->tasks_executed;
                     GATHER_STATISTIC( ++my_counters.tasks_executed );
                     GATHER_STATISTIC( my_counters.avg_arena_concurrency += my_arena->num_workers_active() );
                     GATHER_STATISTIC( my_counters.avg_assigned_workers += my_arena->my_num_workers_allotted );
@@ -518,7 +577,9 @@ void custom_scheduler<SchedulerTraits>::local_wait_for_all( task& parent, task*
 #if __TBB_PREVIEW_CRITICAL_TASKS
                     internal::critical_task_count_guard tc_guard(my_properties, *t);
 #endif
+                    TRACE_EVENT( my_trace, te_task_begin, my_trace->task_name(typeid(*t)), 0 );
                     t_next = t->execute();
+                    TRACE_EVENT( my_trace, te_task_end, NULL, 0 );
                     ITT_STACK(SchedulerTraits::itt_possible, callee_leave, t->prefix().context->itt_caller);
                     if (t_next) {
                         __TBB_ASSERT( t_next->state()==task::allocated,
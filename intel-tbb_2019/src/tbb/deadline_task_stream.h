@@ -0,0 +1,171 @@
+/*
+    Copyright (c) 2005-2019 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+#ifndef _TBB_deadline_task_stream_H
+#define _TBB_deadline_task_stream_H
+
+#include "tbb/tbb_stddef.h"
+#include <vector>
+#include <algorithm>
+#include "tbb/spin_mutex.h"
+#include "tbb/tbb_allocator.h"
+#include "tbb/tick_count.h"
+#include "scheduler_common.h"
+#include "tbb_misc.h" // for FastRandom
+#if __TBB_PREVIEW_CRITICAL_TASKS && __TBB_CPF_BUILD
+#include "task_stream_extended.h" // for population_t
+#else
+#include "task_stream.h" // for population_t
+#endif
+
+namespace tbb {
+namespace internal {
+
+//! The container for the tasks enqueued with a deadline.
+/** As in task_stream, there is a set of lanes for each priority level, and a task is pushed
+    into a random lane. A lane is a heap ordered by the deadlines, and a task is popped from
+    the lane with the earliest deadline on top. The lanes are compared without locking them,
+    so the order is approximate while the tasks are being pushed and popped concurrently. **/
+template<int Levels>
+class deadline_task_stream : no_copy {
+    struct entry {
+        //! Seconds since my_base.
+        double deadline;
+        task* t;
+    };
+    struct later {
+        bool operator()( const entry& e1, const entry& e2 ) const { return e1.deadline > e2.deadline; }
+    };
+    struct lane_t {
+        typedef std::vector< entry, tbb_allocator<entry> > heap_t;
+        heap_t my_heap;
+        spin_mutex my_mutex;
+        //! Deadline of the top entry; read without the lock to choose the lane to pop from.
+        double my_earliest;
+        lane_t () : my_heap(), my_mutex(), my_earliest() {}
+    };
+    population_t population[Levels];
+    padded<lane_t>* lanes[Levels];
+    unsigned N;
+    //! Moment the deadlines are counted from.
+    tick_count my_base;
+
+public:
+    deadline_task_stream() : N() {
+        for(int level = 0; level < Levels; level++) {
+            population[level] = 0;
+            lanes[level] = NULL;
+        }
+    }
+
+    void initialize( unsigned n_lanes ) {
+        const unsigned max_lanes = sizeof(population_t) * CHAR_BIT;
+
+        N = n_lanes>=max_lanes ? max_lanes : n_lanes>2 ? 1<<(__TBB_Log2(n_lanes-1)+1) : 2;
+        __TBB_ASSERT( N==max_lanes || N>=n_lanes && ((N-1)&N)==0, "number of lanes miscalculated");
+        for(int level = 0; level < Levels; level++) {
+            lanes[level] = new padded<lane_t>[N];
+            __TBB_ASSERT( !population[level], NULL );
+        }
+        my_base = tick_count::now();
+    }
+
+    ~deadline_task_stream() {
+        for(int level = 0; level < Levels; level++)
+            if (lanes[level]) delete[] lanes[level];
+    }
+
+    //! Push a task into a lane.
+    void push( task* source, tick_count deadline, int level, FastRandom& random ) {
+        entry e = { (deadline - my_base).seconds(), source };
+        // Lane selection is random. Each thread should keep a separate seed value.
+        for( ; ; ) {
+            unsigned idx = random.get() & (N-1);
+            lane_t& lane = lanes[level][idx];
+            spin_mutex::scoped_lock lock;
+            if( lock.try_acquire(lane.my_mutex) ) {
+                lane.my_heap.push_back( e );
+                std::push_heap( lane.my_heap.begin(), lane.my_heap.end(), later() );
+                lane.my_earliest = lane.my_heap.front().deadline;
+                if( !is_bit_set( population[level], idx ) )
+                    set_one_bit( population[level], idx );
+                break;
+            }
+        }
+    }
+
+    //! Pop the task with the earliest deadline, if any.
+    task* pop( int level ) {
+        for( population_t p = population[level]; p; p = population[level] ) {
+            unsigned idx = N;
+            double earliest = 0;
+            for( unsigned i = 0; i < N; ++i ) {
+                if( is_bit_set( p, i ) && (idx == N || lanes[level][i].my_earliest < earliest) ) {
+                    idx = i;
+                    earliest = lanes[level][i].my_earliest;
+                }
+            }
+            __TBB_ASSERT( idx < N, NULL );
+            lane_t& lane = lanes[level][idx];
+            spin_mutex::scoped_lock lock(lane.my_mutex);
+            // The lane might have been emptied after the population was read
+            if( !lane.my_heap.empty() ) {
+                std::pop_heap( lane.my_heap.begin(), lane.my_heap.end(), later() );
+                task* result = lane.my_heap.back().t;
+                lane.my_heap.pop_back();
+                if( lane.my_heap.empty() )
+                    clear_one_bit( population[level], idx );
+                else
+                    lane.my_earliest = lane.my_heap.front().deadline;
+                return result;
+            }
+        }
+        return NULL;
+    }
+
+    //! Checks existence of a task.
+    bool empty(int level) {
+        return !population[level];
+    }
+
+    //! Destroys all remaining tasks in every lane. Returns the number of destroyed tasks.
+    intptr_t drain() {
+        intptr_t result = 0;
+        for(int level = 0; level < Levels; level++)
+            for(unsigned i=0; i<N; ++i) {
+                lane_t& lane = lanes[level][i];
+                spin_mutex::scoped_lock lock(lane.my_mutex);
+                for(typename lane_t::heap_t::iterator it=lane.my_heap.begin();
+                    it!=lane.my_heap.end(); ++it, ++result)
+                {
+                    __TBB_ASSERT( is_bit_set( population[level], i ), NULL );
+                    tbb::task::destroy(*it->t);
+                }
+                lane.my_heap.clear();
+                clear_one_bit( population[level], i );
+            }
+        return result;
+    }
+}; // deadline_task_stream
+
+} // namespace internal
+} // namespace tbb
+
+#endif /* _TBB_deadline_task_stream_H */
@@ -0,0 +1,200 @@
+/*
+    Copyright (c) 2005-2019 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+#include "tbb/internal/_epoch_reclamation.h"
+#include "tbb/cache_aligned_allocator.h"
+#include "tbb/spin_mutex.h"
+#include "tbb/atomic.h"
+#include "tls.h"
+#include "tbb_misc.h"
+
+#include <cstring>
+#include <new>
+
+namespace tbb {
+namespace internal {
+
+// The global epoch grows when all the readers have seen its current value. A reader announces
+// the epoch it read at entry; an object retired in epoch e is freed when every reader announces
+// a later epoch, i.e. when the readers that could have seen it before it was unlinked are gone.
+
+struct retired_object {
+    void* object;
+    epoch_deleter_t deleter;
+    void* context;
+    uintptr_t epoch;
+};
+
+//! Per-thread state of the epoch-based reclamation
+struct epoch_record {
+    //! The epoch the thread reads in, shifted left by one, with the lowest bit set while it reads
+    atomic<uintptr_t> state;
+    //! Set while a thread owns the record; the records of the finished threads are reused
+    atomic<bool> in_use;
+    //! Depth of the nested epoch_enter calls
+    unsigned nesting;
+    //! Next record in the registry; the records are never freed
+    epoch_record* next;
+    //! Protects the retired objects against epoch_purge from other threads
+    spin_mutex limbo_mutex;
+    //! Retired objects in the order of their epochs
+    retired_object* limbo;
+    size_t limbo_size;
+    size_t limbo_capacity;
+    //! Number of retired objects at which the next reclamation is attempted
+    size_t reclaim_threshold;
+};
+
+static const size_t min_reclaim_threshold = 64;
+
+static atomic<uintptr_t> the_global_epoch;
+static atomic<epoch_record*> the_epoch_records;
+static atomic<do_once_state> the_epoch_init_state;
+static basic_tls<epoch_record*> the_local_record;
+
+//! Releases the record of a finishing thread; its retired objects wait for the next owner.
+static void release_record( void* p ) {
+    epoch_record* r = static_cast<epoch_record*>(p);
+    __TBB_ASSERT( !r->nesting, "thread finishes inside an epoch" );
+    r->state = 0;
+    r->in_use = false;
+}
+
+static void initialize_epoch_tls() {
+#if USE_PTHREAD
+    the_local_record.create( release_record );
+#else
+    // The records of the finished threads are not reused
+    the_local_record.create();
+#endif
+}
+
+static epoch_record* local_record() {
+    // The key must exist before the first get(), which would read the slot of another key otherwise
+    atomic_do_once( &initialize_epoch_tls, the_epoch_init_state );
+    epoch_record* r = the_local_record.get();
+    if( r )
+        return r;
+    for( r = the_epoch_records; r; r = r->next )
+        if( !r->in_use && r->in_use.compare_and_swap( true, false ) == false )
+            break;
+    if( r ) {
+        // The objects of the former owner, which may have piled up under long readers, are reclaimed soon
+        spin_mutex::scoped_lock lock( r->limbo_mutex );
+        r->reclaim_threshold = min_reclaim_threshold;
+    } else {
+        r = new( NFS_Allocate( 1, sizeof(epoch_record), NULL ) ) epoch_record;
+        r->state = 0;
+        r->in_use = true;
+        r->nesting = 0;
+        r->limbo = NULL;
+        r->limbo_size = r->limbo_capacity = 0;
+        r->reclaim_threshold = min_reclaim_threshold;
+        for( epoch_record* head = the_epoch_records;; head = the_epoch_records ) {
+            r->next = head;
+            if( the_epoch_records.compare_and_swap( r, head ) == head )
+                break;
+        }
+    }
+    the_local_record.set( r );
+    return r;
+}
+
+void epoch_enter() {
+    epoch_record* r = local_record();
+    if( !r->nesting++ ) {
+        // The full fence of the exchange makes the announcement visible before any read of the objects
+        r->state.fetch_and_store( the_global_epoch << 1 | 1 );
+    }
+}
+
+void epoch_leave() {
+    epoch_record* r = the_local_record.get();
+    __TBB_ASSERT( r && r->nesting, "epoch_leave without epoch_enter" );
+    if( !--r->nesting )
+        r->state = 0;
+}
+
+//! Returns the oldest epoch a reader may be in, and advances the global epoch if no reader is behind it.
+static uintptr_t safe_epoch() {
+    const uintptr_t global = the_global_epoch;
+    uintptr_t oldest = global;
+    for( epoch_record* r = the_epoch_records; r; r = r->next ) {
+        const uintptr_t state = r->state;
+        if( (state & 1) && (state >> 1) < oldest )
+            oldest = state >> 1;
+    }
+    if( oldest == global )
+        the_global_epoch.compare_and_swap( global + 1, global );
+    return oldest;
+}
+
+//! Frees the objects of the record that no reader can see. The caller holds the limbo mutex.
+static void reclaim( epoch_record& r ) {
+    const uintptr_t safe = safe_epoch();
+    size_t freed = 0;
+    while( freed < r.limbo_size && r.limbo[freed].epoch < safe ) {
+        retired_object& o = r.limbo[freed++];
+        o.deleter( o.object, o.context );
+    }
+    r.limbo_size -= freed;
+    std::memmove( r.limbo, r.limbo + freed, r.limbo_size * sizeof(retired_object) );
+    // The readers that stay long make the objects pile up; do not rescan the records on every retire then
+    r.reclaim_threshold = r.limbo_size * 2 > min_reclaim_threshold ? r.limbo_size * 2 : min_reclaim_threshold;
+}
+
+void epoch_retire( void* object, epoch_deleter_t deleter, void* context ) {
+    epoch_record* r = local_record();
+    // The object is unlinked before the epoch is read
+    atomic_fence();
+    retired_object o = { object, deleter, context, the_global_epoch };
+    spin_mutex::scoped_lock lock( r->limbo_mutex );
+    if( r->limbo_size == r->limbo_capacity ) {
+        const size_t capacity = r->limbo_capacity ? r->limbo_capacity * 2 : min_reclaim_threshold;
+        retired_object* limbo = static_cast<retired_object*>( NFS_Allocate( capacity, sizeof(retired_object), NULL ) );
+        if( r->limbo ) {
+            std::memcpy( limbo, r->limbo, r->limbo_size * sizeof(retired_object) );
+            NFS_Free( r->limbo );
+        }
+        r->limbo = limbo;
+        r->limbo_capacity = capacity;
+    }
+    r->limbo[r->limbo_size++] = o;
+    if( r->limbo_size >= r->reclaim_threshold )
+        reclaim( *r );
+}
+
+void epoch_purge( void* context ) {
+    for( epoch_record* r = the_epoch_records; r; r = r->next ) {
+        spin_mutex::scoped_lock lock( r->limbo_mutex );
+        size_t kept = 0;
+        for( size_t i = 0; i < r->limbo_size; ++i ) {
+            retired_object& o = r->limbo[i];
+            if( o.context == context )
+                o.deleter( o.object, o.context );
+            else
+                r->limbo[kept++] = o;
+        }
+        r->limbo_size = kept;
+    }
+}
+
+} // namespace internal
+} // namespace tbb
@@ -29,6 +29,7 @@
 #include "tbb/task_scheduler_init.h"
 
 #include "dynamic_link.h"
+#include "tbb_environment.h"
 
 namespace tbb {
 namespace internal {
@@ -78,6 +79,15 @@ void governor::acquire_resources () {
         handle_perror(status, "TBB failed to initialize task scheduler TLS\n");
     is_speculation_enabled = cpu_has_speculation();
     is_rethrow_broken = gcc_rethrow_exception_broken();
+    // Flags are only set here, so a test can plug in a fake topology before initialization
+    bool steal = GetBoolEnvironmentVariable("TBB_STEAL_TOPOLOGY"),
+         pin = GetBoolEnvironmentVariable("TBB_PIN_WORKERS");
+    if( (steal || pin || __TBB_STATISTICS) && !theTopology.num_cpus() )
+        theTopology.read( "/sys/devices/system" );
+    if( theTopology.num_cpus() ) {
+        is_topology_stealing_enabled |= steal;
+        is_worker_pinning_enabled |= pin;
+    }
 }
 
 void governor::release_resources () {
@@ -68,6 +68,11 @@ private:
     static bool is_speculation_enabled;
     static bool is_rethrow_broken;
 
+    //! Topology of the machine; read if topology-aware stealing or pinning of workers is requested.
+    static cpu_topology theTopology;
+    static bool is_topology_stealing_enabled;
+    static bool is_worker_pinning_enabled;
+
     //! Create key for thread-local storage and initialize RML.
     static void acquire_resources ();
 
@@ -155,6 +160,13 @@ public:
     static bool speculation_enabled() { return is_speculation_enabled; }
     static bool rethrow_exception_broken() { return is_rethrow_broken; }
 
+    //! Thieves prefer victims running on SMT siblings, then on CPUs sharing cache, then the same node.
+    /** Enabled by TBB_STEAL_TOPOLOGY=1 environment variable. **/
+    static bool topology_stealing_enabled() { return is_topology_stealing_enabled; }
+    //! Workers are bound to CPUs in topology order; enabled by TBB_PIN_WORKERS=1.
+    static bool worker_pinning_enabled() { return is_worker_pinning_enabled; }
+    static const cpu_topology& topology() { return theTopology; }
+
 }; // class governor
 
 } // namespace internal
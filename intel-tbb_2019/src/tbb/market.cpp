@@ -272,7 +272,7 @@ void market::set_active_num_workers ( unsigned soft_limit ) {
                 arena_list_type &arenas = m->my_arenas;
 #endif /* __TBB_TASK_PRIORITY */
                 for( arena_list_type::iterator it = arenas.begin(); it != arenas.end(); ++it ) {
-                    if( !it->my_task_stream.empty(p) ) {
+                    if( it->has_enqueued_tasks(p) ) {
                         // switch local_mandatory to global_mandatory unconditionally
                         if( m->mandatory_concurrency_enable_impl( &*it ) )
                             need_mandatory = true;
@@ -373,7 +373,7 @@ arena* market::arena_in_need ( arena_list_type &arenas, arena *hint ) {
 #if __TBB_ENQUEUE_ENFORCED_CONCURRENCY
             && !a.recall_by_mandatory_request()
 #endif
-            ) {
+            && a.try_join_quota() ) {
             a.my_references += arena::ref_worker;
             return &a;
         }
@@ -700,6 +700,10 @@ void market::process( job& j ) {
     // s.my_arena can be dead. Don't access it until arena_in_need is called
     arena *a = s.my_arena;
     __TBB_ASSERT( governor::is_set(&s), NULL );
+    // Accounted to the arena the worker joins next, see arena::process()
+    const tick_count::interval_t sleep_time = tick_count::now() - s.my_market_leave_time;
+    s.my_sleep_time += sleep_time;
+    GATHER_STATISTIC( s.my_counters.sleep_time += time_counter(sleep_time) );
 
     for (int i = 0; i < 2; ++i) {
         while ( (a = arena_in_need(a)) ) {
@@ -715,6 +719,7 @@ void market::process( job& j ) {
     }
     
     GATHER_STATISTIC( ++s.my_counters.market_roundtrips );
+    s.my_market_leave_time = tick_count::now();
 }
 
 void market::cleanup( job& j ) {
@@ -741,6 +746,9 @@ void market::acknowledge_close_connection() {
     ITT_THREAD_SET_NAME(_T("TBB Worker Thread"));
     // index serves as a hint decreasing conflicts between workers when they migrate between arenas
     generic_scheduler* s = generic_scheduler::create_worker( *this, index );
+    if ( governor::worker_pinning_enabled() )
+        // Masters usually run on CPUs at the beginning of the order, so start from the next one
+        pin_current_thread( governor::topology().ordered_cpu( index ) );
 #if __TBB_TASK_GROUP_CONTEXT
     __TBB_ASSERT( index <= my_num_workers_hard_limit, NULL );
     __TBB_ASSERT( !my_workers[index - 1], NULL );
@@ -303,6 +303,12 @@ public:
     //! Reports active parallelism level according to user's settings
     static unsigned app_parallelism_limit();
 
+    //! Value of max_spin_time meaning that spinning is limited by the adaptive policy only
+    static const size_t unlimited_spin_time = ~size_t(0);
+
+    //! Reports how long (in microseconds) idle workers may spin according to user's settings
+    static size_t max_spin_time();
+
 #if _WIN32||_WIN64
     //! register master with the resource manager
     void register_master( ::rml::server::execution_resource_t& rsc_handle ) {
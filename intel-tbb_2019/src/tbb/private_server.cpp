@@ -25,6 +25,7 @@
 #include "scheduler_common.h"
 #include "governor.h"
 #include "tbb_misc.h"
+#include "tbb_trace.h"
 
 using rml::internal::thread_monitor;
 
@@ -274,7 +275,9 @@ void private_worker::run() {
             my_thread_monitor.prepare_wait(c);
             // Check/set the invariant for sleeping
             if( my_state!=st_quit && my_server.try_insert_in_asleep_list(*this) ) {
+                trace_current_thread( te_sleep );
                 my_thread_monitor.commit_wait(c);
+                trace_current_thread( te_wake );
                 __TBB_ASSERT( my_state==st_quit || !my_next, "Thread monitor missed a spurious wakeup?" );
                 my_server.propagate_chain_reaction();
             } else {
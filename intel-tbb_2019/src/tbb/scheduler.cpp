@@ -115,6 +115,7 @@ generic_scheduler::generic_scheduler( market& m )
 #endif /* __TBB_TASK_GROUP_CONTEXT */
     ITT_SYNC_CREATE(&my_dummy_task->prefix().ref_count, SyncType_Scheduler, SyncObj_WorkerLifeCycleMgmt);
     ITT_SYNC_CREATE(&my_return_list, SyncType_Scheduler, SyncObj_TaskReturnList);
+    my_market_leave_time = tick_count::now();
 }
 
 #if _MSC_VER && !defined(__INTEL_COMPILER)
@@ -122,6 +123,19 @@ generic_scheduler::generic_scheduler( market& m )
 #endif // warning 4355 is back
 
 #if TBB_USE_ASSERT > 1
+#if __TBB_CHASE_LEV_TASK_POOL
+void generic_scheduler::assert_task_pool_valid() const {
+    if ( !my_arena_slot )
+        return;
+    // Thieves take and execute the tasks concurrently, so only the bounds can be checked.
+    const size_t T = __TBB_load_relaxed(my_arena_slot->tail); // mirror
+    const size_t H = __TBB_load_relaxed(my_arena_slot->head);
+    __TBB_ASSERT( (intptr_t)(T - H) >= 0, NULL );
+    __TBB_ASSERT( T - H <= my_arena_slot->my_task_pool_size, "Task pool corrupted" );
+    __TBB_ASSERT( !my_arena_slot->my_task_pool_size
+        || arena_slot::header_of( my_arena_slot->task_pool_ptr ).mask == my_arena_slot->my_task_pool_size - 1, NULL );
+}
+#else /* !__TBB_CHASE_LEV_TASK_POOL */
 void generic_scheduler::assert_task_pool_valid() const {
     if ( !my_arena_slot )
         return;
@@ -145,6 +159,7 @@ void generic_scheduler::assert_task_pool_valid() const {
         __TBB_ASSERT( tp[i] == poisoned_ptr, "Task pool corrupted" );
     release_task_pool();
 }
+#endif /* !__TBB_CHASE_LEV_TASK_POOL */
 #endif /* TBB_USE_ASSERT > 1 */
 
 void generic_scheduler::init_stack_info () {
@@ -263,6 +278,9 @@ void generic_scheduler::cleanup_local_context_list () {
 
 void generic_scheduler::free_scheduler() {
     __TBB_ASSERT( !my_arena_slot, NULL );
+#if __TBB_TRACE
+    trace_buffer::release( my_trace );
+#endif
 #if __TBB_PREVIEW_CRITICAL_TASKS
     __TBB_ASSERT( !my_properties.has_taken_critical_task, "Critical tasks miscount." );
 #endif
@@ -270,6 +288,7 @@ void generic_scheduler::free_scheduler() {
     cleanup_local_context_list();
 #endif /* __TBB_TASK_GROUP_CONTEXT */
     free_task<small_local_task>( *my_dummy_task );
+    my_victims.free_list();
 
 #if __TBB_HOARD_NONLOCAL_TASKS
     while( task* t = my_nonlocal_free_list ) {
@@ -403,6 +422,38 @@ void generic_scheduler::free_nonlocal_small_task( task& t ) {
     }
 }
 
+#if __TBB_CHASE_LEV_TASK_POOL
+inline void generic_scheduler::put_task( size_t i, task* t ) {
+    my_arena_slot->put_task( i, t, is_proxy( *t ) ? static_cast<task_proxy*>(t)->outbox : NULL );
+}
+
+inline size_t generic_scheduler::prepare_task_pool ( size_t num_tasks ) {
+    size_t T = __TBB_load_relaxed(my_arena_slot->tail); // mirror
+    // Thieves only move the head forward, so the space found free with a stale head is free.
+    size_t H = __TBB_load_relaxed(my_arena_slot->head);
+    if ( T - H + num_tasks <= my_arena_slot->my_task_pool_size )
+        return T;
+    if ( !my_arena_slot->my_task_pool_size ) {
+        __TBB_ASSERT( !is_task_pool_published() && is_quiescent_local_task_pool_reset(), NULL );
+        __TBB_ASSERT( !my_arena_slot->task_pool_ptr, NULL );
+        my_arena_slot->allocate_task_pool( num_tasks < min_task_pool_size ? size_t(min_task_pool_size) : num_tasks );
+        return T;
+    }
+    // The tasks are never moved within the task pool, as a thief may be taking any of them.
+    // Thieves that have read the old task pool go on taking the tasks from it, as it keeps
+    // the same tasks as the new one for the indices up to the tail.
+    my_arena_slot->grow_task_pool( T - H + num_tasks, H, T );
+    if ( is_task_pool_published() )
+        // The release fence makes the copied tasks visible to thieves reading the new task pool.
+        __TBB_store_with_release( my_arena_slot->task_pool, my_arena_slot->task_pool_ptr );
+    assert_task_pool_valid();
+    return T;
+}
+#else /* !__TBB_CHASE_LEV_TASK_POOL */
+inline void generic_scheduler::put_task( size_t i, task* t ) {
+    my_arena_slot->task_at( i ) = t;
+}
+
 inline size_t generic_scheduler::prepare_task_pool ( size_t num_tasks ) {
     size_t T = __TBB_load_relaxed(my_arena_slot->tail); // mirror
     if ( T + num_tasks <= my_arena_slot->my_task_pool_size )
@@ -451,6 +502,7 @@ inline size_t generic_scheduler::prepare_task_pool ( size_t num_tasks ) {
     assert_task_pool_valid();
     return T1;
 }
+#endif /* !__TBB_CHASE_LEV_TASK_POOL */
 
 /** ATTENTION:
     This method is mostly the same as generic_scheduler::lock_task_pool(), with
@@ -636,26 +688,22 @@ void generic_scheduler::local_spawn( task* first, task*& next ) {
 #endif
         {
             size_t T = prepare_task_pool( 1 );
-            my_arena_slot->task_pool_ptr[T] = prepare_for_spawning( first );
+            put_task( T, prepare_for_spawning( first ) );
             commit_spawned_tasks( T + 1 );
+            TRACE_EVENT( my_trace, te_spawn, NULL, 1 );
             if ( !is_task_pool_published() )
                 publish_task_pool();
         }
     }
     else {
-        // Task list is being spawned
-#if __TBB_TODO
-        // TODO: add task_list::front() and implement&document the local execution ordering which is
-        // opposite to the current implementation. The idea is to remove hackish fast_reverse_vector
-        // and use push_back/push_front when accordingly LIFO and FIFO order of local execution is
-        // desired. It also requires refactoring of the reload_tasks method and my_offloaded_tasks list.
-        // Additional benefit may come from adding counter to the task_list so that it can reserve enough
-        // space in the task pool in advance and move all the tasks directly without any intermediate
-        // storages. But it requires dealing with backward compatibility issues and still supporting
-        // counter-less variant (though not necessarily fast implementation).
-#endif
-        task *arr[min_task_pool_size];
-        fast_reverse_vector<task*> tasks(arr, min_task_pool_size);
+        // Task list is being spawned. The tasks are counted first, so that the task pool
+        // grows at most once and the tasks are put into it directly. The first task of
+        // the list goes on top of the pool, i.e. it is the first one to be executed locally.
+        size_t num_tasks = 1;
+        for( task* t = first; &t->prefix().next != &next; t = t->prefix().next )
+            ++num_tasks;
+        size_t T = prepare_task_pool( num_tasks );
+        size_t dst = T + num_tasks;
         task *t_next = NULL;
         for( task* t = first; ; t = t_next ) {
             // If t is affinitized to another thread, it may already be executed
@@ -666,14 +714,21 @@ void generic_scheduler::local_spawn( task* first, task*& next ) {
 #if __TBB_PREVIEW_CRITICAL_TASKS
             if( !handled_as_critical( *t ) )
 #endif
-                tasks.push_back( prepare_for_spawning(t) );
+                put_task( --dst, prepare_for_spawning(t) );
             if( end )
                 break;
         }
-        if( size_t num_tasks = tasks.size() ) {
-            size_t T = prepare_task_pool( num_tasks );
-            tasks.copy_memory( my_arena_slot->task_pool_ptr + T );
+#if __TBB_PREVIEW_CRITICAL_TASKS
+        if( dst != T ) {
+            // Move the tasks down to fill the slots reserved for critical ones
+            num_tasks -= dst - T;
+            for( size_t i = 0; i < num_tasks; ++i )
+                put_task( T + i, my_arena_slot->task_at( dst + i ) );
+        }
+#endif
+        if( num_tasks ) {
             commit_spawned_tasks( T + num_tasks );
+            TRACE_EVENT( my_trace, te_spawn, NULL, int(num_tasks) );
             if ( !is_task_pool_published() )
                 publish_task_pool();
         }
@@ -718,6 +773,51 @@ void tbb::internal::generic_scheduler::enqueue( task& t, void* prio ) {
     s->my_arena->enqueue_task(t, (intptr_t)prio, s->my_random );
 }
 
+#if __TBB_CHASE_LEV_TASK_POOL
+inline task* generic_scheduler::pop_task() {
+    arena_slot& slot = *my_arena_slot;
+    size_t T = __TBB_load_relaxed( slot.tail ) - 1;
+    __TBB_store_relaxed( slot.tail, T );
+    atomic_fence();
+    size_t H = __TBB_load_relaxed( slot.head );
+    if ( (intptr_t)(T - H) > 0 )
+        // Thieves stop at the new tail, so they cannot take the task at T.
+        return slot.task_at( T );
+    task* result = NULL;
+    if ( H == T ) {
+        // The last task; a thief may be taking it as well, and the one moving the head wins.
+        if ( as_atomic( slot.head ).compare_and_swap( H + 1, H ) == H )
+            result = slot.task_at( T );
+        else
+            GATHER_STATISTIC( ++my_counters.thieves_conflicts );
+    }
+    // The task pool is empty now. Keep the head not greater than the tail.
+    __TBB_store_relaxed( slot.tail, T + 1 );
+    return result;
+}
+
+//! Puts tasks into the consecutive cells of the task pool.
+class task_pool_filler {
+    generic_scheduler& my_scheduler;
+    size_t my_index;
+public:
+    task_pool_filler( generic_scheduler& s, size_t index ) : my_scheduler(s), my_index(index) {}
+    void operator()( task* t ) { my_scheduler.put_task( my_index++, t ); }
+};
+
+template<typename Vector>
+void generic_scheduler::push_tasks( const Vector& tasks ) {
+    size_t num_tasks = tasks.size();
+    __TBB_ASSERT( num_tasks, NULL );
+    size_t T = prepare_task_pool( num_tasks );
+    task_pool_filler filler( *this, T );
+    tasks.for_each( filler );
+    commit_spawned_tasks( T + num_tasks );
+    if ( !is_task_pool_published() )
+        publish_task_pool();
+}
+#endif /* __TBB_CHASE_LEV_TASK_POOL */
+
 #if __TBB_TASK_PRIORITY
 class auto_indicator : no_copy {
     volatile bool& my_indicator;
@@ -726,6 +826,7 @@ public:
     ~auto_indicator () { my_indicator = false; }
 };
 
+#if !__TBB_CHASE_LEV_TASK_POOL
 task *generic_scheduler::get_task_and_activate_task_pool( size_t H0, __TBB_ISOLATION_ARG( size_t T0, isolation_tag isolation ) ) {
     __TBB_ASSERT( is_local_task_pool_quiescent(), NULL );
 
@@ -783,6 +884,7 @@ task *generic_scheduler::get_task_and_activate_task_pool( size_t H0, __TBB_ISOLA
     assert_task_pool_valid();
     return t;
 }
+#endif /* !__TBB_CHASE_LEV_TASK_POOL */
 
 task* generic_scheduler::winnow_task_pool( __TBB_ISOLATION_EXPR( isolation_tag isolation ) ) {
     GATHER_STATISTIC( ++my_counters.prio_winnowings );
@@ -796,6 +898,28 @@ task* generic_scheduler::winnow_task_pool( __TBB_ISOLATION_EXPR( isolation_tag i
     // anyway, fences aren't used, so that not to penalize warmer path.
     auto_indicator indicator( my_pool_reshuffling_pending );
 
+#if __TBB_CHASE_LEV_TASK_POOL
+    // Take all the tasks, so that thieves do not get them meanwhile, and put back the ones not offloaded.
+    task *arr[min_task_pool_size];
+    fast_reverse_vector<task*> tasks(arr, min_task_pool_size);
+    while ( task *t = pop_task() ) {
+        // We cannot offload a proxy task (check the priority of it) because it can be already consumed.
+        if ( !is_proxy( *t ) ) {
+            intptr_t p = priority( *t );
+            if ( p<*my_ref_top_priority ) {
+                offload_task( *t, p );
+                continue;
+            }
+        }
+        tasks.push_back( t );
+    }
+    if ( !tasks.size() ) {
+        leave_task_pool();
+        return NULL;
+    }
+    push_tasks( tasks );
+    return get_task( __TBB_ISOLATION_EXPR( isolation ) );
+#else /* !__TBB_CHASE_LEV_TASK_POOL */
     // Locking the task pool unconditionally produces simpler code,
     // scalability of which should not suffer unless priority jitter takes place.
     // TODO: consider the synchronization algorithm here is for the owner thread
@@ -822,11 +946,14 @@ task* generic_scheduler::winnow_task_pool( __TBB_ISOLATION_EXPR( isolation_tag i
     // Choose max(T1, H0) because ranges [0, T1) and [H0, T0) can overlap.
     my_arena_slot->fill_with_canary_pattern( max( T1, H0 ), T0 );
     return get_task_and_activate_task_pool( 0, __TBB_ISOLATION_ARG( T1, isolation ) );
+#endif /* !__TBB_CHASE_LEV_TASK_POOL */
 }
 
 task* generic_scheduler::reload_tasks ( task*& offloaded_tasks, task**& offloaded_task_list_link, __TBB_ISOLATION_ARG( intptr_t top_priority, isolation_tag isolation ) ) {
     GATHER_STATISTIC( ++my_counters.prio_reloads );
-#if __TBB_TASK_ISOLATION
+#if __TBB_CHASE_LEV_TASK_POOL
+    // The reloaded tasks are pushed into the task pool like the spawned ones, without locking.
+#elif __TBB_TASK_ISOLATION
     // In many cases, locking the task pool is no-op here because the task pool is in the empty
     // state. However, isolation allows entering stealing loop with non-empty task pool.
     // In principle, it is possible to process reloaded tasks without locking but it will
@@ -869,17 +996,26 @@ task* generic_scheduler::reload_tasks ( task*& offloaded_tasks, task**& offloade
     __TBB_ASSERT( link, NULL );
     size_t num_tasks = tasks.size();
     if ( !num_tasks ) {
+#if !__TBB_CHASE_LEV_TASK_POOL
         __TBB_ISOLATION_EXPR( release_task_pool() );
+#endif
         return NULL;
     }
 
     // Copy found tasks into the task pool.
     GATHER_STATISTIC( ++my_counters.prio_tasks_reloaded );
+#if __TBB_CHASE_LEV_TASK_POOL
+    push_tasks( tasks );
+
+    // Find a task available for execution.
+    task *t = get_task( __TBB_ISOLATION_EXPR( isolation ) );
+#else
     size_t T = prepare_task_pool( num_tasks );
     tasks.copy_memory( my_arena_slot->task_pool_ptr + T );
 
     // Find a task available for execution.
     task *t = get_task_and_activate_task_pool( __TBB_load_relaxed( my_arena_slot->head ), __TBB_ISOLATION_ARG( T + num_tasks, isolation ) );
+#endif
     if ( t ) --num_tasks;
     if ( num_tasks )
         my_arena->advertise_new_work<arena::work_spawned>();
@@ -975,6 +1111,64 @@ inline task* generic_scheduler::get_task( size_t T )
     return NULL;
 }
 
+#if __TBB_CHASE_LEV_TASK_POOL
+//! Returns the task taken from the task pool, or the one extracted from the proxy, or NULL if the proxy is empty.
+inline task* generic_scheduler::get_task( task* t, bool& proxy_extracted ) {
+    if ( !is_proxy( *t ) )
+        return t;
+    task_proxy& tp = static_cast<task_proxy&>(*t);
+    if ( task* result = tp.extract_task<task_proxy::pool_bit>() ) {
+        GATHER_STATISTIC( ++my_counters.proxies_executed );
+        // Following assertion should be true because TBB 2.0 tasks never specify affinity, and hence are not proxied.
+        __TBB_ASSERT( is_version_3_task( *result ), "backwards compatibility with TBB 2.0 broken" );
+        __TBB_ASSERT( my_innermost_running_task != result, NULL );
+        my_innermost_running_task = result; // prepare for calling note_affinity()
+        proxy_extracted = true;
+        return result;
+    }
+    // Proxy was empty, so it's our responsibility to free it
+    free_task<small_task>( tp );
+    return NULL;
+}
+
+inline task* generic_scheduler::get_task( __TBB_ISOLATION_EXPR( isolation_tag isolation ) ) {
+    __TBB_ASSERT( is_task_pool_published(), NULL );
+    task* result = NULL;
+    bool proxy_extracted = false;
+#if __TBB_TASK_ISOLATION
+    if ( isolation != no_isolation ) {
+        // The tasks that cannot be executed due to isolation are taken out of the task pool
+        // to get to the ones below them, and are put back in the same order. Holes are not
+        // left instead, as the thieves take the task at the head without checking it.
+        task *arr[min_task_pool_size];
+        fast_reverse_vector<task*> tasks_omitted(arr, min_task_pool_size);
+        while ( task* t = pop_task() ) {
+            if ( isolation != t->prefix().isolation )
+                tasks_omitted.push_back( t );
+            else if ( (result = get_task( t, proxy_extracted )) )
+                break;
+        }
+        if ( tasks_omitted.size() ) {
+            push_tasks( tasks_omitted );
+            // Synchronize with snapshot as we published some tasks.
+            my_arena->advertise_new_work<arena::wakeup>();
+        }
+    } else
+#endif /* __TBB_TASK_ISOLATION */
+    while ( task* t = pop_task() )
+        if ( (result = get_task( t, proxy_extracted )) )
+            break;
+    // As with the lock based task pool, the pool is left when it is found empty, not when the last task is taken.
+    if ( !result && __TBB_load_relaxed( my_arena_slot->tail ) == __TBB_load_relaxed( my_arena_slot->head ) )
+        leave_task_pool();
+    // Now it is safe to call note_affinity because the task pool is restored.
+    if ( proxy_extracted ) {
+        assert_task_valid( result );
+        result->note_affinity( my_affinity_id );
+    }
+    return result;
+} // generic_scheduler::get_task
+#else /* !__TBB_CHASE_LEV_TASK_POOL */
 inline task* generic_scheduler::get_task( __TBB_ISOLATION_EXPR( isolation_tag isolation ) ) {
     __TBB_ASSERT( is_task_pool_published(), NULL );
     // The current task position in the task pool.
@@ -1071,18 +1265,90 @@ inline task* generic_scheduler::get_task( __TBB_ISOLATION_EXPR( isolation_tag is
     __TBB_ASSERT( result || __TBB_ISOLATION_EXPR( tasks_omitted || ) is_quiescent_local_task_pool_reset(), NULL );
     return result;
 } // generic_scheduler::get_task
+#endif /* !__TBB_CHASE_LEV_TASK_POOL */
+
+void victim_list::build( arena_slot* slots, size_t limit, size_t self, const cpu_topology& topology, int cpu ) {
+    if ( my_capacity < limit ) {
+        free_list();
+        my_order = (size_t*)NFS_Allocate( limit, sizeof(size_t), NULL );
+        my_capacity = limit;
+    }
+    // Counting sort of slots by distance
+    size_t count[cpu_distance_levels] = {0};
+    for ( size_t i = 0; i < limit; ++i )
+        if ( i != self )
+            ++count[topology.distance( cpu, __TBB_load_relaxed(slots[i].my_cpu) )];
+    size_t end = 0;
+    for ( int level = 0; level < cpu_distance_levels; ++level ) {
+        my_level_end[level] = end;
+        end += count[level];
+    }
+    for ( size_t i = 0; i < limit; ++i )
+        if ( i != self )
+            my_order[my_level_end[topology.distance( cpu, __TBB_load_relaxed(slots[i].my_cpu) )]++] = i;
+    my_arena_slots = slots;
+    my_limit = limit;
+    my_self = self;
+    my_age = 0;
+}
+
+arena_slot* victim_list::select( FastRandom& random, cpu_distance& distance ) const {
+    size_t begin = 0;
+    for ( int level = 0; level < cpu_distance_levels; ++level ) {
+        size_t end = my_level_end[level];
+        if ( begin < end ) {
+            arena_slot* victim = my_arena_slots + my_order[begin + random.get() % (end - begin)];
+            if ( victim->task_pool != EmptyTaskPool ) {
+                distance = cpu_distance(level);
+                return victim;
+            }
+        }
+        begin = end;
+    }
+    return NULL;
+}
+
+void victim_list::free_list() {
+    if ( my_order ) {
+        NFS_Free( my_order );
+        my_order = NULL;
+        my_capacity = 0;
+    }
+    my_arena_slots = NULL;
+}
 
 task* generic_scheduler::steal_task( __TBB_ISOLATION_EXPR(isolation_tag isolation) ) {
-    // Try to steal a task from a random victim.
-    size_t k = my_random.get() % (my_arena->my_limit-1);
-    arena_slot* victim = &my_arena->my_slots[k];
-    // The following condition excludes the master that might have
-    // already taken our previous place in the arena from the list .
-    // of potential victims. But since such a situation can take
-    // place only in case of significant oversubscription, keeping
-    // the checks simple seems to be preferable to complicating the code.
-    if( k >= my_arena_index )
-        ++victim;               // Adjusts random distribution to exclude self
+    arena_slot* victim;
+    cpu_distance distance = cpu_remote;
+    if ( governor::topology_stealing_enabled() ) {
+        // Try nearby victims first.
+        if ( my_victims.is_stale( my_arena->my_slots, my_arena->my_limit, my_arena_index ) ) {
+            // Threads that are not pinned migrate; refresh the CPU for the thieves too.
+            int cpu = current_cpu();
+            if ( my_arena_slot->my_cpu != cpu )
+                __TBB_store_relaxed( my_arena_slot->my_cpu, cpu );
+            my_victims.build( my_arena->my_slots, my_arena->my_limit, my_arena_index, governor::topology(), cpu );
+        }
+        victim = my_victims.select( my_random, distance );
+        if ( !victim )
+            return NULL;
+    } else {
+        // Try to steal a task from a random victim.
+        size_t k = my_random.get() % (my_arena->my_limit-1);
+        victim = &my_arena->my_slots[k];
+        // The following condition excludes the master that might have
+        // already taken our previous place in the arena from the list .
+        // of potential victims. But since such a situation can take
+        // place only in case of significant oversubscription, keeping
+        // the checks simple seems to be preferable to complicating the code.
+        if( k >= my_arena_index )
+            ++victim;               // Adjusts random distribution to exclude self
+#if __TBB_STATISTICS
+        distance = governor::topology().distance( __TBB_load_relaxed(my_arena_slot->my_cpu),
+                                                  __TBB_load_relaxed(victim->my_cpu) );
+#endif
+    }
+    ++my_arena_slot->steals_attempted;
     task **pool = victim->task_pool;
     task *t = NULL;
     if( pool == EmptyTaskPool || !(t = steal_task_from( __TBB_ISOLATION_ARG(*victim, isolation) )) )
@@ -1103,10 +1369,68 @@ task* generic_scheduler::steal_task( __TBB_ISOLATION_EXPR(isolation_tag isolatio
         t->prefix().owner = this;
         t->note_affinity( my_affinity_id );
     }
+    ++my_arena_slot->steals_succeeded;
     GATHER_STATISTIC( ++my_counters.steals_committed );
+    TRACE_EVENT( my_trace, te_steal, my_arena, int(victim - my_arena->my_slots) );
+    // Locality counters follow each other in the order of cpu_distance
+    GATHER_STATISTIC( ++(&my_counters.steals_same_core)[distance] );
+    suppress_unused_warning( distance );
     return t;
 }
 
+#if __TBB_CHASE_LEV_TASK_POOL
+task* generic_scheduler::steal_task_from( __TBB_ISOLATION_ARG( arena_slot& victim_slot, isolation_tag isolation ) ) {
+    task* result;
+    for ( atomic_backoff backoff;; backoff.pause() ) {
+        size_t H = __TBB_load_relaxed( victim_slot.head );
+        atomic_fence();
+        if ( (intptr_t)(__TBB_load_with_acquire( victim_slot.tail ) - H) <= 0 ) {
+            GATHER_STATISTIC( ++my_counters.thief_backoffs );
+            return NULL;
+        }
+        // The task pool is read after the tail, so that it has the tasks up to the tail.
+        task** victim_pool = __TBB_load_with_acquire( victim_slot.task_pool );
+        if ( victim_pool == EmptyTaskPool )
+            return NULL;
+        // A claimed task cannot be returned to the victim, so it is checked before the claim.
+        // Only the head can be claimed, so the thief gives up if the head task does not suit it.
+        // The task may be taken, executed and freed by another thread while it is checked, so
+        // only the hint kept in the task pool is read; it is discarded if the head moves.
+        const arena_slot::steal_hint hint = arena_slot::hint( victim_pool, H );
+        bool skip = false;
+#if __TBB_TASK_ISOLATION
+        if ( isolation != no_isolation && isolation != hint.isolation )
+            skip = true;
+        else
+#endif /* __TBB_TASK_ISOLATION */
+        // If mailed task is likely to be grabbed by its destination thread, skip it.
+        // Whether the proxy is still in the mailbox cannot be checked without reading it; it is
+        // surely not when the mailbox is empty, and then the proxy must not block the task pool.
+        if ( hint.outbox )
+            skip = hint.outbox->recipient_is_idle() && !hint.outbox->empty();
+        if ( skip ) {
+            atomic_fence();
+            if ( __TBB_load_relaxed( victim_slot.head ) != H )
+                continue;
+            GATHER_STATISTIC( hint.outbox ? ++my_counters.proxies_bypassed : 0 );
+            return NULL;
+        }
+        result = arena_slot::cell( victim_pool, H );
+        if ( as_atomic( victim_slot.head ).compare_and_swap( H + 1, H ) == H )
+            break;
+        // Another thief or the owner has taken the task.
+        GATHER_STATISTIC( ++my_counters.thieves_conflicts );
+    }
+    __TBB_ASSERT( result && !is_poisoned( result ), NULL );
+    // emit "task was consumed" signal
+    ITT_NOTIFY( sync_acquired, (void*)((uintptr_t)&victim_slot+sizeof( uintptr_t )) );
+#if __TBB_PREFETCHING
+    __TBB_cl_evict(&victim_slot.head);
+    __TBB_cl_evict(&victim_slot.tail);
+#endif
+    return result;
+}
+#else /* !__TBB_CHASE_LEV_TASK_POOL */
 task* generic_scheduler::steal_task_from( __TBB_ISOLATION_ARG( arena_slot& victim_slot, isolation_tag isolation ) ) {
     task** victim_pool = lock_task_pool( &victim_slot );
     if ( !victim_pool )
@@ -1171,6 +1495,7 @@ unlock:
         my_arena->advertise_new_work<arena::wakeup>();
     return result;
 }
+#endif /* !__TBB_CHASE_LEV_TASK_POOL */
 
 #if __TBB_PREVIEW_CRITICAL_TASKS
 // Retrieves critical task respecting isolation level, if provided. The rule is:
@@ -1227,8 +1552,13 @@ inline void generic_scheduler::leave_task_pool() {
     __TBB_ASSERT( is_task_pool_published(), "Not in arena" );
     // Do not reset my_arena_index. It will be used to (attempt to) re-acquire the slot next time
     __TBB_ASSERT( &my_arena->my_slots[my_arena_index] == my_arena_slot, "arena slot and slot index mismatch" );
+#if __TBB_CHASE_LEV_TASK_POOL
+    __TBB_ASSERT ( __TBB_load_relaxed(my_arena_slot->head) == __TBB_load_relaxed(my_arena_slot->tail),
+                   "Cannot leave arena when the task pool is not empty" );
+#else
     __TBB_ASSERT ( my_arena_slot->task_pool == LockedTaskPool, "Task pool must be locked when leaving arena" );
     __TBB_ASSERT ( is_quiescent_local_task_pool_empty(), "Cannot leave arena when the task pool is not empty" );
+#endif
     ITT_NOTIFY(sync_releasing, &my_arena->my_slots[my_arena_index]);
     // No release fence is necessary here as this assignment precludes external
     // accesses to the local task pool when becomes visible. Thus it is harmless
@@ -1244,6 +1574,9 @@ generic_scheduler* generic_scheduler::create_worker( market& m, size_t index ) {
     s->my_properties.type = scheduler_properties::worker;
     // Do not call init_stack_info before the scheduler is set as master or worker.
     s->init_stack_info();
+#if __TBB_TRACE
+    s->my_trace = trace_buffer::create( /*is_worker=*/true, index );
+#endif
     governor::sign_on(s);
     return s;
 }
@@ -1256,6 +1589,9 @@ generic_scheduler* generic_scheduler::create_master( arena* a ) {
     __TBB_ASSERT( s->my_market, NULL );
     task& t = *s->my_dummy_task;
     s->my_properties.type = scheduler_properties::master;
+#if __TBB_TRACE
+    s->my_trace = trace_buffer::create( /*is_worker=*/false, 0 );
+#endif
     t.prefix().ref_count = 1;
 #if __TBB_TASK_GROUP_CONTEXT
     t.prefix().context = new ( NFS_Allocate(1, sizeof(task_group_context), NULL) )
@@ -1306,16 +1642,23 @@ bool generic_scheduler::cleanup_master( bool blocking_terminate ) {
     market * const m = my_market;
     __TBB_ASSERT( my_market, NULL );
     if( a && is_task_pool_published() ) {
+#if __TBB_CHASE_LEV_TASK_POOL
+        // Thieves only take the tasks, so the task pool found empty stays empty.
+        if ( __TBB_load_relaxed(my_arena_slot->head) == __TBB_load_relaxed(my_arena_slot->tail) )
+#else
         acquire_task_pool();
         if ( my_arena_slot->task_pool == EmptyTaskPool ||
              __TBB_load_relaxed(my_arena_slot->head) >= __TBB_load_relaxed(my_arena_slot->tail) )
+#endif
         {
             // Local task pool is empty
             leave_task_pool();
         }
         else {
             // Master's local task pool may e.g. contain proxies of affinitized tasks.
+#if !__TBB_CHASE_LEV_TASK_POOL
             release_task_pool();
+#endif
             __TBB_ASSERT ( governor::is_set(this), "TLS slot is cleared before the task pool cleanup" );
             local_wait_for_all( *my_dummy_task, NULL );
             __TBB_ASSERT( !is_task_pool_published(), NULL );
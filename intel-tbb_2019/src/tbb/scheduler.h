@@ -22,6 +22,7 @@
 #define _TBB_scheduler_H
 
 #include "scheduler_common.h"
+#include "tbb_trace.h"
 #include "tbb/spin_mutex.h"
 #include "mailbox.h"
 #include "tbb_misc.h" // for FastRandom
@@ -114,6 +115,40 @@ struct scheduler_state {
 #endif /* __TBB_TASK_PRIORITY */
 };
 
+//! Slots of an arena ordered by distance from the thief's CPU to the CPUs of their owners.
+/** Used by topology-aware stealing. The order is rebuilt when the thread enters
+    another arena or the number of used slots changes, and also periodically,
+    as threads migrate between CPUs unless pinned. **/
+class victim_list : no_copy {
+    //! Indices of slots, nearest first. Allocated on demand.
+    size_t* my_order;
+    size_t my_capacity;
+    //! End of each distance level in my_order.
+    size_t my_level_end[cpu_distance_levels];
+    //! Slots of the arena the list was built for.
+    arena_slot* my_arena_slots;
+    size_t my_limit;
+    //! Slot of the thief; it can change when the thread re-enters the arena.
+    size_t my_self;
+    unsigned my_age;
+public:
+    static const unsigned rebuild_period = 1024;
+
+    //! True if the list should be rebuilt before use. Counts the calls.
+    bool is_stale( arena_slot* slots, size_t limit, size_t self ) {
+        return slots != my_arena_slots || limit != my_limit || self != my_self || ++my_age > rebuild_period;
+    }
+
+    //! Orders the first limit slots but self by distance from cpu.
+    void build( arena_slot* slots, size_t limit, size_t self, const cpu_topology& topology, int cpu );
+
+    //! Picks one random candidate at each distance level and returns the nearest one with a task pool.
+    /** Returns NULL if none of the candidates has tasks. **/
+    arena_slot* select( FastRandom& random, cpu_distance& distance ) const;
+
+    void free_list();
+};
+
 //! Work stealing task scheduler.
 /** None of the fields here are ever read or written by threads other than
     the thread that creates the instance.
@@ -161,6 +196,9 @@ public: // almost every class in TBB uses generic_scheduler
     //! Random number generator used for picking a random victim from which to steal.
     FastRandom my_random;
 
+    //! Victims of topology-aware stealing.
+    victim_list my_victims;
+
     //! Free list of small tasks that can be reused.
     task* my_free_list;
 
@@ -260,6 +298,25 @@ public: // almost every class in TBB uses generic_scheduler
 #else
     task* get_task( size_t T );
 #endif /* __TBB_TASK_ISOLATION */
+
+    //! Puts the task into the cell of the local pool for index i.
+    /** Called only by the pool owner, before the tail is moved past i. **/
+    void put_task( size_t i, task* t );
+
+#if __TBB_CHASE_LEV_TASK_POOL
+    //! Takes the task from the tail of the local pool.
+    /** Returns NULL if the pool is empty. Called only by the pool owner. **/
+    task* pop_task();
+
+    //! Returns t taken from the local pool, or the task extracted from the proxy t.
+    /** Returns NULL if the proxy is empty. Sets proxy_extracted if the task is extracted. **/
+    task* get_task( task* t, bool& proxy_extracted );
+
+    //! Puts the tasks from the fast_reverse_vector into the local pool and publishes it.
+    /** The tasks are put in the order of fast_reverse_vector::copy_memory. **/
+    template<typename Vector>
+    void push_tasks( const Vector& tasks );
+#endif /* __TBB_CHASE_LEV_TASK_POOL */
     //! Attempt to get a task from the mailbox.
     /** Gets a task only if it has not been executed by its sender or a thief
         that has stolen it from the sender's task pool. Otherwise returns NULL.
@@ -454,9 +511,11 @@ public:
     /** Returns the next execution candidate task or NULL. **/
     task* winnow_task_pool ( __TBB_ISOLATION_EXPR( isolation_tag isolation ) );
 
+#if !__TBB_CHASE_LEV_TASK_POOL
     //! Get a task from locked or empty pool in range [H0, T0). Releases or unlocks the task pool.
     /** Returns the found task or NULL. **/
     task *get_task_and_activate_task_pool( size_t H0 , __TBB_ISOLATION_ARG( size_t T0, isolation_tag isolation ) );
+#endif
 
     //! Unconditionally moves the task into offload area.
     inline void offload_task ( task& t, intptr_t task_priority );
@@ -528,6 +587,17 @@ public:
 #endif /* TBB_USE_ASSERT */
 #endif /* __TBB_SURVIVE_THREAD_SWITCH */
 
+#if __TBB_TRACE
+    //! Events of this thread; NULL unless tracing is enabled.
+    trace_buffer* my_trace;
+#endif /* __TBB_TRACE */
+
+    //! The moment the worker returned into RML last time; used to track its sleeping time.
+    tick_count my_market_leave_time;
+
+    //! Time the worker slept in RML since it joined an arena last time.
+    tick_count::interval_t my_sleep_time;
+
 #if __TBB_STATISTICS
     //! Set of counters to track internal statistics on per thread basis
     /** Placed at the end of the class definition to minimize the disturbance of
@@ -565,7 +635,12 @@ inline bool generic_scheduler::is_quiescent_local_task_pool_empty () const {
 
 inline bool generic_scheduler::is_quiescent_local_task_pool_reset () const {
     __TBB_ASSERT( is_local_task_pool_quiescent(), "Task pool is not quiescent" );
+#if __TBB_CHASE_LEV_TASK_POOL
+    // The indices are never reset, as a thief may still try to take the task at the head.
+    return is_quiescent_local_task_pool_empty();
+#else
     return __TBB_load_relaxed(my_arena_slot->head) == 0 && __TBB_load_relaxed(my_arena_slot->tail) == 0;
+#endif
 }
 
 inline bool generic_scheduler::outermost_level () const {
@@ -630,7 +705,12 @@ inline void generic_scheduler::reset_task_pool_and_leave () {
 
 //TODO: move to arena_slot
 inline void generic_scheduler::commit_spawned_tasks( size_t new_tail ) {
+#if __TBB_CHASE_LEV_TASK_POOL
+    __TBB_ASSERT ( new_tail - __TBB_load_relaxed(my_arena_slot->head) <= my_arena_slot->my_task_pool_size,
+                   "task deque end was overwritten" );
+#else
     __TBB_ASSERT ( new_tail <= my_arena_slot->my_task_pool_size, "task deque end was overwritten" );
+#endif
     // emit "task was released" signal
     ITT_NOTIFY(sync_releasing, (void*)((uintptr_t)my_arena_slot+sizeof(uintptr_t)));
     // Release fence is necessary to make sure that previously stored task pointers
@@ -733,6 +813,22 @@ private:
 };
 #endif /* __TBB_PREVIEW_CRITICAL_TASKS */
 
+//! Adds the time spent in a dispatch loop to the wait time of the arena slot, if the slot is given
+class wait_time_guard : internal::no_copy {
+public:
+    wait_time_guard( arena_slot* slot ) : my_slot(slot) {
+        if( my_slot )
+            my_start = tick_count::now();
+    }
+    ~wait_time_guard() {
+        if( my_slot )
+            my_slot->wait_time += tick_count::now() - my_start;
+    }
+private:
+    arena_slot* my_slot;
+    tick_count my_start;
+};
+
 #if __TBB_FP_CONTEXT || __TBB_TASK_GROUP_CONTEXT
 //! Helper class for tracking floating point context and task group context switches
 /** Assuming presence of an itt collector, in addition to keeping track of floating
@@ -23,6 +23,7 @@
 
 #include "tbb/tbb_machine.h"
 #include "tbb/cache_aligned_allocator.h"
+#include "tbb/tick_count.h"
 
 #include <string.h>  // for memset, memcpy, memmove
 
@@ -73,6 +74,24 @@
 #endif /* __TBB_TASK_ISOLATION */
 
 
+//! Use the Chase-Lev deque as the task pool instead of the one locked by thieves and the owner.
+/** The owner pushes and pops tasks without locks, and thieves take them by CAS on the head.
+    Selected at library build time, e.g. by adding -D__TBB_CHASE_LEV_TASK_POOL=1 to CXXFLAGS. **/
+#ifndef __TBB_CHASE_LEV_TASK_POOL
+#define __TBB_CHASE_LEV_TASK_POOL 0
+#endif
+
+//! Number of the priority levels distinguished by the scheduler.
+/** priority_low, priority_normal and priority_high are always among them, and the other
+    priorities are mapped onto the nearest level. So the number must be odd and at least 3.
+    Selected at library build time, e.g. by adding -D__TBB_NUM_PRIORITY_LEVELS=7 to CXXFLAGS. **/
+#ifndef __TBB_NUM_PRIORITY_LEVELS
+#define __TBB_NUM_PRIORITY_LEVELS 3
+#endif
+#if __TBB_NUM_PRIORITY_LEVELS < 3 || __TBB_NUM_PRIORITY_LEVELS % 2 == 0
+#error __TBB_NUM_PRIORITY_LEVELS must be odd and at least 3
+#endif
+
 #if DO_TBB_TRACE
 #include <cstdio>
 #define TBB_TRACE(x) ((void)std::printf x)
@@ -111,16 +130,18 @@ class observer_proxy;
 class task_scheduler_observer_v3;
 
 #if __TBB_TASK_PRIORITY
-static const intptr_t num_priority_levels = 3;
+static const intptr_t num_priority_levels = __TBB_NUM_PRIORITY_LEVELS;
 static const intptr_t normalized_normal_priority = (num_priority_levels - 1) / 2;
 
+//! Maps the priority onto the nearest of the levels distinguished by the scheduler.
 inline intptr_t normalize_priority ( priority_t p ) {
-    return intptr_t(p - priority_low) / priority_stride_v4;
+    return intptr_t( ( int64_t(p - priority_low) * (num_priority_levels - 1) + priority_stride_v4 )
+                     / (2 * priority_stride_v4) );
 }
 
-static const priority_t priority_from_normalized_rep[num_priority_levels] = {
-    priority_low, priority_normal, priority_high
-};
+inline priority_t priority_from_normalized_rep ( intptr_t p ) {
+    return priority_level( unsigned(p), unsigned(num_priority_levels) );
+}
 
 inline void assert_priority_valid ( intptr_t p ) {
     __TBB_ASSERT_EX( p >= 0 && p < num_priority_levels, NULL );
@@ -342,8 +363,13 @@ struct arena_slot_line1 {
     task* *__TBB_atomic task_pool;
 
     //! Index of the first ready task in the deque.
-    /** Modified by thieves, and by the owner during compaction/reallocation **/
+    /** Modified by thieves, and by the owner during compaction/reallocation.
+        With __TBB_CHASE_LEV_TASK_POOL, head and tail only grow, and the tasks are
+        kept in the cells given by the indices modulo the task pool size. **/
     __TBB_atomic size_t head;
+
+    //! CPU the owner of the slot ran on when last checked; used by topology-aware stealing.
+    __TBB_atomic int my_cpu;
 };
 
 struct arena_slot_line2 {
@@ -372,7 +398,27 @@ struct arena_slot_line2 {
 #endif /* __TBB_STATISTICS */
 };
 
-struct arena_slot : padded<arena_slot_line1>, padded<arena_slot_line2> {
+//! Activity counters reported by task_arena::statistics().
+/** Unlike statistics_counters, they are always collected. Only the thread occupying the slot
+    updates them, so they are plain variables kept apart from the lines read by thieves. **/
+struct arena_slot_line3 {
+    size_t tasks_executed;
+    size_t steals_attempted;
+    size_t steals_succeeded;
+    size_t mailbox_tasks_taken;
+    //! Tasks enqueued into the arena by the thread occupying the slot.
+    size_t tasks_enqueued;
+    //! Time spent in the outermost dispatch loops of wait_for_all().
+    tick_count::interval_t wait_time;
+    //! Time spent looking for work after a failed attempt to get a task.
+    tick_count::interval_t spin_time;
+    //! Time spent by workers in the arena less their spin time.
+    tick_count::interval_t work_time;
+    //! Time workers had slept in the market before they occupied the slot.
+    tick_count::interval_t sleep_time;
+};
+
+struct arena_slot : padded<arena_slot_line1>, padded<arena_slot_line2>, padded<arena_slot_line3> {
 #if TBB_USE_ASSERT
     void fill_with_canary_pattern ( size_t first, size_t last ) {
         for ( size_t i = first; i < last; ++i )
@@ -382,6 +428,100 @@ struct arena_slot : padded<arena_slot_line1>, padded<arena_slot_line2> {
     void fill_with_canary_pattern ( size_t, size_t ) {}
 #endif /* TBB_USE_ASSERT */
 
+#if __TBB_CHASE_LEV_TASK_POOL
+    //! Precedes the cells of the task pool.
+    /** Thieves find the size of the task pool they have read here, as the owner
+        may have replaced it by a larger one. **/
+    struct task_pool_header {
+        //! Task pool size minus one; the size is a power of two.
+        size_t mask;
+        //! Task pool replaced by this one.
+        /** Thieves may still read it, so it is freed together with the current one. **/
+        task** retired;
+    };
+
+    //! What a thief checks before it claims the task of the cell.
+    /** The task itself is not read before it is claimed, as another thread may have taken,
+        executed and freed it meanwhile. The hints follow the cells of the task pool. **/
+    struct steal_hint {
+#if __TBB_TASK_ISOLATION
+        isolation_tag isolation;
+#endif /* __TBB_TASK_ISOLATION */
+        //! Mailbox the task proxy was sent to, or NULL if the task is not a proxy.
+        /** Mailboxes live as long as the arena, so a stale value can be followed. **/
+        mail_outbox* outbox;
+    };
+
+    static task_pool_header& header_of( task** pool ) {
+        return *((task_pool_header*)pool - 1);
+    }
+
+    //! Cell of the given task pool for the task with index i.
+    static task*& cell( task** pool, size_t i ) {
+        return pool[i & header_of( pool ).mask];
+    }
+
+    //! Hint of the given task pool for the task with index i.
+    static steal_hint& hint( task** pool, size_t i ) {
+        const size_t mask = header_of( pool ).mask;
+        return ((steal_hint*)(pool + mask + 1))[i & mask];
+    }
+
+    //! Cell of the task pool for the task with index i.
+    task*& task_at( size_t i ) {
+        return task_pool_ptr[i & (my_task_pool_size - 1)];
+    }
+
+    //! Puts the task into the cell for index i, with the hint for thieves.
+    void put_task( size_t i, task* t, mail_outbox* outbox ) {
+        steal_hint& h = hint( task_pool_ptr, i );
+#if __TBB_TASK_ISOLATION
+        h.isolation = t->prefix().isolation;
+#endif /* __TBB_TASK_ISOLATION */
+        h.outbox = outbox;
+        task_at( i ) = t;
+    }
+
+    void allocate_task_pool( size_t n ) {
+        size_t size = NFS_MaxLineSize / sizeof(task*);
+        while ( size < n )
+            size *= 2;
+        my_task_pool_size = size;
+        char* p = (char*)NFS_Allocate( 1, NFS_MaxLineSize + size * (sizeof(task*) + sizeof(steal_hint)), NULL );
+        task_pool_ptr = (task**)(p + NFS_MaxLineSize);
+        header_of( task_pool_ptr ).mask = size - 1;
+        header_of( task_pool_ptr ).retired = NULL;
+        // A thief may read the hint of a cell that has not been filled yet; it must not lead anywhere.
+        memset( &hint( task_pool_ptr, 0 ), 0, size * sizeof(steal_hint) );
+        fill_with_canary_pattern( 0, my_task_pool_size );
+    }
+
+    //! Replaces the task pool by at least twice as large one for n tasks.
+    /** The tasks [h, t) are copied to the cells for the same indices. **/
+    void grow_task_pool( size_t n, size_t h, size_t t ) {
+        task** old_pool = task_pool_ptr;
+        allocate_task_pool( n > 2 * my_task_pool_size ? n : 2 * my_task_pool_size );
+        header_of( task_pool_ptr ).retired = old_pool;
+        for ( ; h != t; ++h ) {
+            hint( task_pool_ptr, h ) = hint( old_pool, h );
+            task_at( h ) = cell( old_pool, h );
+        }
+    }
+
+    //! Deallocate task pool that was allocated by means of allocate_task_pool, and the retired ones.
+    void free_task_pool( ) {
+        while ( task** pool = task_pool_ptr ) {
+            task_pool_ptr = header_of( pool ).retired;
+            NFS_Free( (char*)pool - NFS_MaxLineSize );
+        }
+        my_task_pool_size = 0;
+    }
+#else /* !__TBB_CHASE_LEV_TASK_POOL */
+    //! Cell of the task pool for the task with index i.
+    task*& task_at( size_t i ) {
+        return task_pool_ptr[i];
+    }
+
     void allocate_task_pool( size_t n ) {
         size_t byte_size = ((n * sizeof(task*) + NFS_MaxLineSize - 1) / NFS_MaxLineSize) * NFS_MaxLineSize;
         my_task_pool_size = byte_size / sizeof(task*);
@@ -402,6 +542,7 @@ struct arena_slot : padded<arena_slot_line1>, padded<arena_slot_line2> {
            my_task_pool_size = 0;
         }
     }
+#endif /* !__TBB_CHASE_LEV_TASK_POOL */
 };
 
 #if !__TBB_CPU_CTL_ENV_PRESENT
@@ -106,6 +106,20 @@ public:
         }
     }
 
+    //! Applies f to the items in the order in which copy_memory puts them.
+    template<typename F>
+    void for_each ( F& f ) const
+    {
+        for ( size_t j = m_pos; j < m_cur_segment_size; ++j )
+            f( m_cur_segment[j] );
+        size_t sz = m_cur_segment_size / 2;
+        for ( long i = (long)m_num_segments - 2; i >= 0; --i ) {
+            for ( size_t j = 0; j < sz; ++j )
+                f( m_segments[i][j] );
+            sz /= 2;
+        }
+    }
+
 protected:
     //! The current (not completely filled) segment
     T       *m_cur_segment;
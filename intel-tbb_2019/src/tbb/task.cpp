@@ -243,6 +243,21 @@ void task::spawn_and_wait_for_all( task_list& list ) {
     s->local_wait_for_all( *this, t );
 }
 
+void task::internal_enqueue( task_list& list, intptr_t priority ) {
+    if( task* t = list.first ) {
+        generic_scheduler* s = governor::local_scheduler();
+        __TBB_ASSERT( s->my_arena, "thread is not in any arena" );
+        s->my_arena->enqueue_task_list( t, *list.next_ptr, priority, s->my_random );
+        list.clear();
+    }
+}
+
+void task::internal_enqueue_with_deadline( task& t, tick_count deadline, intptr_t priority ) {
+    generic_scheduler* s = governor::local_scheduler();
+    __TBB_ASSERT( s->my_arena, "thread is not in any arena" );
+    s->my_arena->enqueue_task_with_deadline( t, deadline, priority, s->my_random );
+}
+
 /** Defined out of line so that compiler does not replicate task's vtable.
     It's pointless to define it inline anyway, because all call sites to it are virtual calls
     that the compiler is unlikely to optimize. */
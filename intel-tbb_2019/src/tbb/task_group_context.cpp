@@ -463,7 +463,7 @@ void task_group_context::register_pending_exception () {
 
 #if __TBB_TASK_PRIORITY
 void task_group_context::set_priority ( priority_t prio ) {
-    __TBB_ASSERT( prio == priority_low || prio == priority_normal || prio == priority_high, "Invalid priority level value" );
+    __TBB_ASSERT( internal::is_valid_priority(prio), "Invalid priority level value" );
     intptr_t p = normalize_priority(prio);
     if ( my_priority == p && !(my_state & task_group_context::may_have_children))
         return;
@@ -486,7 +486,7 @@ void task_group_context::set_priority ( priority_t prio ) {
 }
 
 priority_t task_group_context::priority () const {
-    return static_cast<priority_t>(priority_from_normalized_rep[my_priority]);
+    return static_cast<priority_t>(priority_from_normalized_rep(my_priority));
 }
 #endif /* __TBB_TASK_PRIORITY */
 
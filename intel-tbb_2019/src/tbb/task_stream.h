@@ -27,9 +27,17 @@
 #include "tbb/atomic.h" // for __TBB_Atomic*
 #include "tbb/spin_mutex.h"
 #include "tbb/tbb_allocator.h"
+#include "tbb/cache_aligned_allocator.h" // for NFS_Allocate
+#include "tbb/internal/_epoch_reclamation.h"
 #include "scheduler_common.h"
 #include "tbb_misc.h" // for FastRandom
 
+//! Use lock-free lanes in task_stream instead of the mutex-protected queues.
+/** Selected at library build time, e.g. by adding -D__TBB_LOCKFREE_TASK_STREAM=1 to CXXFLAGS. **/
+#ifndef __TBB_LOCKFREE_TASK_STREAM
+#define __TBB_LOCKFREE_TASK_STREAM 0
+#endif
+
 namespace tbb {
 namespace internal {
 
@@ -68,10 +76,233 @@ inline bool is_bit_set( population_t val, int pos ) {
     return (val & (one<<pos)) != 0;
 }
 
+#if __TBB_LOCKFREE_TASK_STREAM
+//! A ring of task pointers that producers and consumers access without locks.
+/** The ring is a bounded MPMC queue where each cell holds the position it is ready
+    for: pos when empty, pos+1 when the task for pos is written into it. Positions
+    grow monotonically, so a segment serves any number of tasks while it is not full.
+    A full segment is closed, and the following tasks go into a new one. **/
+class lockfree_segment : no_copy {
+public:
+    static const uintptr_t size = 128;
+    //! The bit of my_enqueue_pos indicating that no more tasks can be pushed into the segment.
+    static const uintptr_t closed = ~(~uintptr_t(0)>>1);
+
+    static lockfree_segment* allocate() {
+        lockfree_segment* s = static_cast<lockfree_segment*>( NFS_Allocate( 1, sizeof(lockfree_segment), NULL ) );
+        s->my_enqueue_pos = 0;
+        s->my_dequeue_pos = 0;
+        s->next = NULL;
+        for( uintptr_t i = 0; i < size; ++i )
+            s->my_cells[i].sequence = i;
+        return s;
+    }
+
+    static void deallocate( lockfree_segment* s ) { NFS_Free( s ); }
+
+    //! Pushes up to n tasks keeping their order. Returns the number of pushed tasks, 0 if the segment is closed.
+    size_t try_push( task* const* sources, size_t n ) {
+        uintptr_t pos = my_enqueue_pos;
+        for( ; ; ) {
+            if( pos & closed )
+                return 0;
+            // Cells ready for the positions being claimed stay so until the claim succeeds
+            size_t k = 0;
+            intptr_t diff = 0;
+            for( ; k < n && k < size; ++k ) {
+                diff = intptr_t(my_cells[(pos+k)&(size-1)].sequence) - intptr_t(pos+k);
+                if( diff )
+                    break;
+            }
+            if( k ) {
+                uintptr_t p = my_enqueue_pos.compare_and_swap( pos+k, pos );
+                if( p == pos ) {
+                    for( size_t i = 0; i < k; ++i ) {
+                        cell& c = my_cells[(pos+i)&(size-1)];
+                        c.value = sources[i];
+                        c.sequence = pos+i+1;
+                    }
+                    return k;
+                }
+                pos = p;
+            } else if( diff < 0 ) {
+                // The cell still holds a task from the previous round, i.e. the segment is full
+                uintptr_t p = my_enqueue_pos.compare_and_swap( pos|closed, pos );
+                if( p == pos )
+                    return 0;
+                pos = p;
+            } else
+                pos = my_enqueue_pos;
+        }
+    }
+
+    //! Pops the oldest task. Returns NULL if there is none, or it is not written yet.
+    task* try_pop() {
+        uintptr_t pos = my_dequeue_pos;
+        for( ; ; ) {
+            cell& c = my_cells[pos&(size-1)];
+            intptr_t diff = intptr_t(c.sequence) - intptr_t(pos+1);
+            if( diff == 0 ) {
+                uintptr_t p = my_dequeue_pos.compare_and_swap( pos+1, pos );
+                if( p == pos ) {
+                    task* result = c.value;
+                    c.sequence = pos+size;
+                    return result;
+                }
+                pos = p;
+            } else if( diff < 0 )
+                return NULL;
+            else
+                pos = my_dequeue_pos;
+        }
+    }
+
+    //! True if all positions claimed by producers are claimed by consumers as well.
+    bool drained() const {
+        return my_dequeue_pos >= (my_enqueue_pos & ~closed);
+    }
+
+    //! The segment that follows this one after it is closed.
+    atomic<lockfree_segment*> next;
+
+private:
+    struct cell {
+        atomic<uintptr_t> sequence;
+        task* value;
+    };
+    atomic<uintptr_t> my_enqueue_pos;
+    char pad1[NFS_MaxLineSize-sizeof(atomic<uintptr_t>)];
+    atomic<uintptr_t> my_dequeue_pos;
+    char pad2[NFS_MaxLineSize-sizeof(atomic<uintptr_t>)];
+    cell my_cells[size];
+};
+
+//! Unbounded lock-free MPMC queue of tasks, made of a list of lockfree_segments.
+/** A segment left by consumers may still be accessed by threads that have read
+    a pointer to it before. So the operations run in epochs, and the segment is
+    retired to the epoch-based reclamation, which frees it when no operation that
+    could see it is in progress. **/
+class lockfree_lane : no_copy {
+private:
+    atomic<lockfree_segment*> my_tail;
+    char pad[NFS_MaxLineSize-sizeof(atomic<lockfree_segment*>)];
+    atomic<lockfree_segment*> my_head;
+    //! Number of segments allocated and not freed yet, including the retired ones.
+    atomic<intptr_t> my_segment_count;
+
+    lockfree_segment* allocate_segment() {
+        my_segment_count.fetch_and_increment();
+        return lockfree_segment::allocate();
+    }
+
+    void deallocate_segment( lockfree_segment* s ) {
+        lockfree_segment::deallocate( s );
+        my_segment_count.fetch_and_decrement();
+    }
+
+    static void free_retired_segment( void* s, void* lane ) {
+        static_cast<lockfree_lane*>(lane)->deallocate_segment( static_cast<lockfree_segment*>(s) );
+    }
+
+    //! Returns the segment to push into, creating the first one if necessary.
+    lockfree_segment* tail() {
+        lockfree_segment* s = my_tail;
+        if( !s ) {
+            s = my_head;
+            if( !s ) {
+                lockfree_segment* new_s = allocate_segment();
+                s = my_head.compare_and_swap( new_s, NULL );
+                if( s )
+                    deallocate_segment( new_s );
+                else
+                    s = new_s;
+            }
+            my_tail.compare_and_swap( s, NULL );
+        }
+        return s;
+    }
+
+    //! True if the lane has no tasks, or only ones that are not completely pushed yet.
+    bool is_empty() {
+        lockfree_segment* s = my_head;
+        return !s || ( s->drained() && !s->next );
+    }
+
+public:
+    lockfree_lane() {
+        my_tail = NULL;
+        my_head = NULL;
+        my_segment_count = 0;
+    }
+
+    ~lockfree_lane() {
+        epoch_purge( this );
+        for( lockfree_segment* s = my_head; s; ) {
+            lockfree_segment* next = s->next;
+            deallocate_segment( s );
+            s = next;
+        }
+        __TBB_ASSERT( !my_segment_count, "Segments of the lane are leaked" );
+    }
+
+    //! Pushes n tasks keeping their order.
+    void push( task* const* sources, size_t n ) {
+        epoch_guard guard;
+        while( n ) {
+            lockfree_segment* s = tail();
+            if( size_t k = s->try_push( sources, n ) ) {
+                sources += k;
+                n -= k;
+                continue;
+            }
+            // The segment is closed; go to the next one, appending it if necessary
+            lockfree_segment* next = s->next;
+            if( !next ) {
+                lockfree_segment* new_s = allocate_segment();
+                next = s->next.compare_and_swap( new_s, NULL );
+                if( next )
+                    deallocate_segment( new_s );
+                else
+                    next = new_s;
+            }
+            my_tail.compare_and_swap( next, s );
+        }
+    }
+
+    //! Pops the oldest task, if any. Sets is_empty_after if the lane appears to be empty after that.
+    task* pop( bool& is_empty_after ) {
+        epoch_guard guard;
+        task* result = NULL;
+        while( lockfree_segment* s = my_head ) {
+            if( (result = s->try_pop()) )
+                break;
+            // The next segment exists only if this one is closed
+            lockfree_segment* next = s->next;
+            if( !next || !s->drained() )
+                break;
+            my_tail.compare_and_swap( next, s );
+            if( my_head.compare_and_swap( next, s ) == s )
+                epoch_retire( s, &free_retired_segment, this );
+        }
+        is_empty_after = is_empty();
+        return result;
+    }
+
+    bool empty() {
+        epoch_guard guard;
+        return is_empty();
+    }
+};
+#endif /* __TBB_LOCKFREE_TASK_STREAM */
+
 //! The container for "fairness-oriented" aka "enqueued" tasks.
 template<int Levels>
 class task_stream : no_copy {
+#if __TBB_LOCKFREE_TASK_STREAM
+    typedef lockfree_lane lane_t;
+#else
     typedef queue_and_mutex <task*, spin_mutex> lane_t;
+#endif
     population_t population[Levels];
     padded<lane_t>* lanes[Levels];
     unsigned N;
@@ -101,6 +332,48 @@ public:
             if (lanes[level]) delete[] lanes[level];
     }
 
+#if __TBB_LOCKFREE_TASK_STREAM
+    //! Push a task into a lane.
+    void push( task* source, int level, FastRandom& random ) {
+        push( &source, 1, level, random );
+    }
+
+    //! Push n tasks into a single lane, preserving their order.
+    void push( task* const* sources, size_t n, int level, FastRandom& random ) {
+        // Lane selection is random. Each thread should keep a separate seed value.
+        unsigned idx = random.get() & (N-1);
+        lanes[level][idx].push( sources, n );
+        // A consumer that has emptied the lane and cleared the bit is either seen here,
+        // or sees the pushed tasks when checking the lane after clearing the bit.
+        __TBB_full_memory_fence();
+        if( !is_bit_set( population[level], idx ) )
+            set_one_bit( population[level], idx );
+    }
+
+    //! Try finding and popping a task.
+    task* pop( int level, unsigned& last_used_lane ) {
+        task* result = NULL;
+        // Lane selection is round-robin. Each thread should keep its last used lane.
+        unsigned idx = (last_used_lane+1)&(N-1);
+        for( ; population[level]; idx=(idx+1)&(N-1) ) {
+            if( is_bit_set( population[level], idx ) ) {
+                lane_t& lane = lanes[level][idx];
+                bool is_empty_after = false;
+                result = lane.pop( is_empty_after );
+                if( is_empty_after ) {
+                    clear_one_bit( population[level], idx );
+                    // A producer might have seen the bit still set
+                    if( !lane.empty() )
+                        set_one_bit( population[level], idx );
+                }
+                if( result )
+                    break;
+            }
+        }
+        last_used_lane = idx;
+        return result;
+    }
+#else /* !__TBB_LOCKFREE_TASK_STREAM */
     //! Push a task into a lane.
     void push( task* source, int level, FastRandom& random ) {
         // Lane selection is random. Each thread should keep a separate seed value.
@@ -116,6 +389,20 @@ public:
         }
     }
 
+    //! Push n tasks into a single lane under one lock, preserving their order.
+    void push( task* const* sources, size_t n, int level, FastRandom& random ) {
+        unsigned idx;
+        for( ; ; ) {
+            idx = random.get() & (N-1);
+            spin_mutex::scoped_lock lock;
+            if( lock.try_acquire(lanes[level][idx].my_mutex) ) {
+                lanes[level][idx].my_queue.insert( lanes[level][idx].my_queue.end(), sources, sources+n );
+                set_one_bit( population[level], idx );
+                break;
+            }
+        }
+    }
+
     //! Try finding and popping a task.
     task* pop( int level, unsigned& last_used_lane ) {
         task* result = NULL;
@@ -137,6 +424,7 @@ public:
         last_used_lane = idx;
         return result;
     }
+#endif /* !__TBB_LOCKFREE_TASK_STREAM */
 
     //! Checks existence of a task.
     bool empty(int level) {
@@ -151,6 +439,14 @@ public:
         for(int level = 0; level < Levels; level++)
             for(unsigned i=0; i<N; ++i) {
                 lane_t& lane = lanes[level][i];
+#if __TBB_LOCKFREE_TASK_STREAM
+                bool is_empty_after;
+                while( task* t = lane.pop( is_empty_after ) ) {
+                    __TBB_ASSERT( is_bit_set( population[level], i ), NULL );
+                    tbb::task::destroy(*t);
+                    ++result;
+                }
+#else
                 spin_mutex::scoped_lock lock(lane.my_mutex);
                 for(lane_t::queue_base_t::iterator it=lane.my_queue.begin();
                     it!=lane.my_queue.end(); ++it, ++result)
@@ -160,6 +456,7 @@ public:
                     tbb::task::destroy(*t);
                 }
                 lane.my_queue.clear();
+#endif
                 clear_one_bit( population[level], i );
             }
         return result;
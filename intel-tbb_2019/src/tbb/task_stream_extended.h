@@ -205,6 +205,28 @@ public:
         return false;
     }
 
+    //! Returns true if all n tasks were pushed into the lane, otherwise - false.
+    bool try_push( task* const* sources, size_t n, int level, unsigned lane_idx ) {
+        __TBB_ASSERT( 0 <= level && level < Levels, "Incorrect lane level specified." );
+        spin_mutex::scoped_lock lock;
+        if( lock.try_acquire( lanes[level][lane_idx].my_mutex ) ) {
+            lanes[level][lane_idx].my_queue.insert( lanes[level][lane_idx].my_queue.end(), sources, sources+n );
+            set_one_bit( population[level], lane_idx );
+            return true;
+        }
+        return false;
+    }
+
+    //! Push n tasks into a single lane, preserving their order. Lane selection is performed by passed functor.
+    template<typename lane_selector_t>
+    void push( task* const* sources, size_t n, int level, const lane_selector_t& next_lane ) {
+        unsigned lane = 0;
+        do {
+            lane = next_lane( /*out_of=*/N );
+            __TBB_ASSERT( lane < N, "Incorrect lane index." );
+        } while( !try_push( sources, n, level, lane ) );
+    }
+
     //! Push a task into a lane. Lane selection is performed by passed functor.
     template<typename lane_selector_t>
     void push( task* source, int level, const lane_selector_t& next_lane ) {
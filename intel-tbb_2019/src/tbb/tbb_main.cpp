@@ -45,6 +45,9 @@ rml::tbb_factory governor::theRMLServerFactory;
 bool governor::UsePrivateRML;
 bool governor::is_speculation_enabled;
 bool governor::is_rethrow_broken;
+cpu_topology governor::theTopology;
+bool governor::is_topology_stealing_enabled;
+bool governor::is_worker_pinning_enabled;
 
 //------------------------------------------------------------------------
 // market data
@@ -488,15 +491,34 @@ class stack_size_control : public padded<control_storage> {
     }
 };
 
+class spin_time_control : public padded<control_storage> {
+    virtual size_t default_value() const __TBB_override {
+        return market::unlimited_spin_time;
+    }
+    virtual bool is_first_arg_preferred(size_t a, size_t b) const __TBB_override {
+        return a<b; // prefer the shortest spinning
+    }
+public:
+    //! Non-virtual version of active_value() for use in the stealing loop
+    size_t current_value() const {
+        return my_head? my_active_value : market::unlimited_spin_time;
+    }
+};
+
 static allowed_parallelism_control allowed_parallelism_ctl;
 static stack_size_control stack_size_ctl;
+static spin_time_control spin_time_ctl;
 
-static control_storage *controls[] = {&allowed_parallelism_ctl, &stack_size_ctl};
+static control_storage *controls[] = {&allowed_parallelism_ctl, &stack_size_ctl, &spin_time_ctl};
 
 unsigned market::app_parallelism_limit() {
     return allowed_parallelism_ctl.active_value_if_present();
 }
 
+size_t market::max_spin_time() {
+    return spin_time_ctl.current_value();
+}
+
 } // namespace internal
 
 namespace interface9 {
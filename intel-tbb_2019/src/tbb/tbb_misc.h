@@ -263,6 +263,62 @@ inline void run_initializer( bool (*f)(), atomic<do_once_state>& state ) {
     inline void destroy_process_mask(){}
 #endif /* __TBB_USE_OS_AFFINITY_SYSCALL */
 
+//! Distance between two logical CPUs, from the nearest to the farthest.
+enum cpu_distance {
+    //! SMT siblings, or the same CPU
+    cpu_same_core = 0,
+    //! Share the last level cache
+    cpu_same_llc,
+    //! Belong to the same NUMA node
+    cpu_same_node,
+    cpu_remote,
+    cpu_distance_levels
+};
+
+//! Machine topology as seen by the task scheduler.
+/** Describes which logical CPUs share a core, the last level cache and a NUMA node.
+    The description is read from the sysfs tree, whose root can be any directory,
+    so a fake topology can be used for testing. **/
+class cpu_topology : no_copy {
+public:
+    static const int max_cpus = 1024;
+
+    //! Read topology from root (normally "/sys/devices/system"). Returns false if it is unknown.
+    bool read( const char* root );
+
+    //! Number of logical CPUs, i.e. the largest known CPU id + 1. Zero if the topology is unknown.
+    int num_cpus() const { return my_num_cpus; }
+
+    //! Distance between CPUs; cpu_remote if any of them is unknown.
+    cpu_distance distance( int cpu1, int cpu2 ) const {
+        if ( cpu1 < 0 || cpu2 < 0 || cpu1 >= my_num_cpus || cpu2 >= my_num_cpus || my_core[cpu1] < 0 )
+            return cpu_remote;
+        if ( my_core[cpu1] == my_core[cpu2] )
+            return cpu_same_core;
+        if ( my_llc[cpu1] == my_llc[cpu2] )
+            return cpu_same_llc;
+        return my_node[cpu1] == my_node[cpu2] ? cpu_same_node : cpu_remote;
+    }
+
+    //! i-th online CPU in the order that places SMT siblings, then CPUs sharing cache, then node together.
+    int ordered_cpu( int i ) const { return my_order[i % my_num_online]; }
+
+private:
+    int my_num_cpus;
+    int my_num_online;
+    //! Ids of the first CPU of the core, cache and node that the CPU belongs to; -1 for offline CPUs.
+    int my_core[max_cpus];
+    int my_llc[max_cpus];
+    int my_node[max_cpus];
+    int my_order[max_cpus];
+};
+
+//! Returns the CPU the calling thread runs on, or -1 if unknown.
+int current_cpu();
+
+//! Binds the calling thread to the given CPU, if the CPU is allowed for the process.
+void pin_current_thread( int cpu );
+
 bool cpu_has_speculation();
 bool gcc_rethrow_exception_broken();
 void fix_broken_rethrow();
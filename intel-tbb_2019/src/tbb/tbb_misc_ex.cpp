@@ -403,3 +403,142 @@ int AvailableHwConcurrency() {
 } // namespace tbb
 
 #endif /* !__TBB_HardwareConcurrency */
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#if __linux__
+#include <sched.h>
+#endif
+
+namespace tbb {
+namespace internal {
+
+#if __linux__
+
+//! Parses a CPU list like "0-3,8,10-11" from the file; sets map[cpu] = value for each listed CPU.
+/** Returns the first CPU of the list, or -1 if the file can't be read. **/
+static int read_cpu_list( const char* path, int* map, int value ) {
+    FILE* f = fopen( path, "r" );
+    if ( !f )
+        return -1;
+    int first = -1, lower, upper;
+    char sep;
+    while ( fscanf( f, "%d", &lower ) == 1 ) {
+        upper = lower;
+        if ( fscanf( f, "%c", &sep ) == 1 && sep == '-' ) {
+            if ( fscanf( f, "%d", &upper ) != 1 )
+                break;
+            if ( fscanf( f, "%c", &sep ) != 1 )
+                sep = 0;
+        }
+        for ( int c = lower; c <= upper && c < cpu_topology::max_cpus; ++c ) {
+            if ( map )
+                map[c] = value;
+            if ( first < 0 || c < first )
+                first = c;
+        }
+        if ( sep != ',' )
+            break;
+    }
+    fclose( f );
+    return first;
+}
+
+//! Orders CPUs by node, then cache, then core, so that neighbours in the order are close.
+class cpu_order_compare {
+    const int *my_core, *my_llc, *my_node;
+public:
+    cpu_order_compare( const int* core, const int* llc, const int* node ) : my_core(core), my_llc(llc), my_node(node) {}
+    bool operator()( int a, int b ) const {
+        if ( my_node[a] != my_node[b] ) return my_node[a] < my_node[b];
+        if ( my_llc[a] != my_llc[b] ) return my_llc[a] < my_llc[b];
+        if ( my_core[a] != my_core[b] ) return my_core[a] < my_core[b];
+        return a < b;
+    }
+};
+
+bool cpu_topology::read( const char* root ) {
+    const size_t path_size = 256;
+    char path[path_size];
+    my_num_cpus = my_num_online = 0;
+    for ( int c = 0; c < max_cpus; ++c )
+        my_core[c] = my_llc[c] = my_node[c] = -1;
+
+    snprintf( path, path_size, "%s/cpu/online", root );
+    if ( read_cpu_list( path, my_core, 0 ) < 0 )
+        return false;
+    for ( int c = 0; c < max_cpus; ++c ) {
+        if ( my_core[c] < 0 )
+            continue;
+        my_num_cpus = c + 1;
+        snprintf( path, path_size, "%s/cpu/cpu%d/topology/thread_siblings_list", root, c );
+        int core = read_cpu_list( path, NULL, 0 );
+        my_core[c] = core >= 0 ? core : c;
+        // The last level cache is the one with the largest index
+        int llc = -1;
+        for ( int index = 0; index < 16; ++index ) {
+            snprintf( path, path_size, "%s/cpu/cpu%d/cache/index%d/shared_cpu_list", root, c, index );
+            int first = read_cpu_list( path, NULL, 0 );
+            if ( first < 0 )
+                break;
+            llc = first;
+        }
+        my_llc[c] = llc >= 0 ? llc : my_core[c];
+        my_order[my_num_online++] = c;
+    }
+    // Nodes; without NUMA support in the kernel all CPUs are in the same node
+    int nodes[max_cpus];
+    for ( int n = 0; n < max_cpus; ++n )
+        nodes[n] = -1;
+    snprintf( path, path_size, "%s/node/online", root );
+    read_cpu_list( path, nodes, 0 );
+    for ( int n = 0; n < max_cpus; ++n ) {
+        if ( nodes[n] < 0 )
+            continue;
+        snprintf( path, path_size, "%s/node/node%d/cpulist", root, n );
+        read_cpu_list( path, my_node, n );
+    }
+    for ( int c = 0; c < my_num_cpus; ++c )
+        if ( my_core[c] >= 0 && my_node[c] < 0 )
+            my_node[c] = 0;
+    std::sort( my_order, my_order + my_num_online, cpu_order_compare(my_core, my_llc, my_node) );
+    return my_num_online > 0;
+}
+
+int current_cpu() {
+    return sched_getcpu();
+}
+
+void pin_current_thread( int cpu ) {
+    if ( cpu < 0 || cpu >= CPU_SETSIZE )
+        return;
+#if __TBB_USE_OS_AFFINITY_SYSCALL
+    // The first mask covers CPU_SETSIZE processors
+    if ( process_mask && !CPU_ISSET( cpu, process_mask ) )
+        return;
+#endif
+    cpu_set_t mask;
+    CPU_ZERO( &mask );
+    CPU_SET( cpu, &mask );
+    if ( sched_setaffinity( 0, sizeof(mask), &mask ) )
+        runtime_warning( "setaffinity syscall failed" );
+}
+
+#else /* !__linux__ */
+
+bool cpu_topology::read( const char* ) {
+    my_num_cpus = my_num_online = 0;
+    return false;
+}
+
+int current_cpu() {
+    return -1;
+}
+
+void pin_current_thread( int ) {}
+
+#endif /* !__linux__ */
+
+} // namespace internal
+} // namespace tbb
@@ -37,7 +37,7 @@ namespace internal {
 /** The order of this vector elements must correspond to the statistics_counters
     structure layout. **/
 const char* StatGroupTitles[] = {
-    "task objects", "tasks executed", "stealing attempts", "task proxies", "arena", "market", "priority ops", "prio ops details"
+    "task objects", "tasks executed", "stealing attempts", "task proxies", "arena", "market", "priority ops", "prio ops details", "time, ns"
 };
 
 //! Human readable titles of statistics elements defined by statistics_counters struct.
@@ -46,12 +46,13 @@ const char* StatGroupTitles[] = {
 const char* StatFieldTitles[] = {
     /*task objects*/        "active", "freed", "big", NULL,
     /*tasks executed*/      "total", "w/o spawn", NULL,
-    /*stealing attempts*/   "succeeded", "failed", "conflicts", "backoffs", NULL,
+    /*stealing attempts*/   "succeeded", "failed", "conflicts", "backoffs", "core", "llc", "node", "remote", NULL,
     /*task proxies*/        "mailed", "revoked", "stolen", "bypassed", "ignored", NULL,
     /*arena*/               "switches", "roundtrips", "avg.conc", "avg.allot", NULL,
     /*market*/              "roundtrips", NULL,
     /*priority ops*/        "ar.switch", "mkt.switch", "ar.reset", "ref.fixup", "avg.ar.pr", "avg.mkt.pr", NULL,
-    /*prio ops details*/    "winnows", "reloads", "orphaned", "winnowed", "reloaded", NULL
+    /*prio ops details*/    "winnows", "reloads", "orphaned", "winnowed", "reloaded", NULL,
+    /*time, ns*/            "spinning", "sleeping", "working", NULL
 };
 
 //! Class for logging statistics
@@ -69,6 +69,7 @@
 #if __TBB_STATISTICS
 
 #include <string.h>  // for memset
+#include "tbb/tick_count.h"
 
 //! Dump counters into stdout as well.
 /** By default statistics counters are written to the file "statistics.txt" only. **/
@@ -102,12 +103,13 @@ enum statistics_groups {
     sg_market = 0x20,
     sg_prio = 0x40,
     sg_prio_ex = 0x80,
+    sg_idle = 0x100,
     // List end marker. Insert new groups only before it.
     sg_end
 };
 
 //! Groups of counters to output
-const uintptr_t __TBB_ActiveStatisticsGroups = sg_task_execution | sg_stealing | sg_affinity | sg_arena | sg_market;
+const uintptr_t __TBB_ActiveStatisticsGroups = sg_task_execution | sg_stealing | sg_affinity | sg_arena | sg_market | sg_idle;
 
 //! A set of various statistics counters that are updated by the library on per thread basis.
 /** All the fields must be of the same type (statistics_counters::counter_type).
@@ -145,6 +147,12 @@ struct statistics_counters {
     counter_type thieves_conflicts;
     //! Number of times thief backed off because of the collision with the owner
     counter_type thief_backoffs;
+    //! Number of tasks stolen from SMT siblings, CPUs sharing the last level cache,
+    //! CPUs of the same NUMA node and remote CPUs (the order must follow cpu_distance)
+    counter_type steals_same_core;
+    counter_type steals_same_llc;
+    counter_type steals_same_node;
+    counter_type steals_remote;
 
     // Group: sg_affinity
 
@@ -204,6 +212,15 @@ struct statistics_counters {
     //! Number of tasks reloaded from secondary task pools
     counter_type prio_tasks_reloaded;
 
+    // Group: sg_idle
+
+    //! Time in nanoseconds spent looking for work after the first failed attempt
+    counter_type spin_time;
+    //! Time in nanoseconds a worker spent outside of the market (sleeping in RML)
+    counter_type sleep_time;
+    //! Time in nanoseconds a worker spent in arenas less the spinning time
+    counter_type work_time;
+
     // Constructor and helpers
 
     statistics_counters() { reset(); }
@@ -223,6 +240,11 @@ struct statistics_counters {
     }
 }; // statistics_counters
 
+//! Converts a time interval into the units of the time counters (nanoseconds)
+inline statistics_counters::counter_type time_counter ( const tick_count::interval_t& i ) {
+    return statistics_counters::counter_type( i.seconds()*1e9 );
+}
+
 static const size_t workers_counters_total = (size_t)-1;
 static const size_t arena_counters_total = (size_t)-2;
 
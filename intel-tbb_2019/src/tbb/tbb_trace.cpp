@@ -0,0 +1,260 @@
+/*
+    Copyright (c) 2005-2019 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+#include "tbb_trace.h"
+#include "tbb/scheduler_trace.h"
+#include "tbb/spin_mutex.h"
+#include "tbb/cache_aligned_allocator.h"
+#include "scheduler.h"
+#include "governor.h"
+#include "tbb_misc.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <typeinfo>
+#if __GNUC__ && !__INTEL_COMPILER
+#include <cxxabi.h>
+#define __TBB_TRACE_DEMANGLE 1
+#endif
+
+namespace tbb {
+namespace internal {
+
+#if __TBB_TRACE
+
+//! File given by TBB_TRACE; NULL if tracing is disabled.
+static const char* the_trace_file;
+//! Copy of TBB_TRACE, as the environment can be changed later.
+static char the_trace_file_name[1024];
+//! Moment the tracing started; the events are timed from it.
+static tick_count the_trace_start;
+static atomic<do_once_state> the_trace_init_state;
+
+//! All buffers ever created, the most recent first.
+static trace_buffer* the_buffers;
+static int the_buffer_count;
+static size_t the_master_count;
+//! Protects the list of buffers.
+static spin_mutex the_buffers_mutex;
+
+static void initialize_trace() {
+    const char* file = std::getenv("TBB_TRACE");
+    if( file && *file && std::strlen(file) < sizeof(the_trace_file_name) ) {
+        std::strcpy( the_trace_file_name, file );
+        the_trace_start = tick_count::now();
+        the_trace_file = the_trace_file_name;
+    }
+}
+
+trace_buffer* trace_buffer::create( bool is_worker, size_t index ) {
+    atomic_do_once( &initialize_trace, the_trace_init_state );
+    if( !the_trace_file )
+        return NULL;
+    spin_mutex::scoped_lock lock( the_buffers_mutex );
+    for( trace_buffer* b = the_buffers; b; b = b->my_next )
+        if( !b->my_in_use && b->my_is_worker == is_worker && (!is_worker || b->my_index == index) ) {
+            b->my_in_use = true;
+            return b;
+        }
+    if( the_buffer_count == max_buffers )
+        return NULL;
+    trace_buffer* b = new( NFS_Allocate( 1, sizeof(trace_buffer), NULL ) ) trace_buffer;
+    std::memset( b->my_names, 0, sizeof(b->my_names) );
+    b->my_is_worker = is_worker;
+    b->my_count = 0;
+    b->my_in_use = true;
+    b->my_index = is_worker ? index : the_master_count++;
+    b->my_id = the_buffer_count++;
+    b->my_next = the_buffers;
+    the_buffers = b;
+    return b;
+}
+
+void trace_buffer::release( trace_buffer* b ) {
+    if( b ) {
+        spin_mutex::scoped_lock lock( the_buffers_mutex );
+        b->my_in_use = false;
+    }
+}
+
+//! Copy of a task type name
+struct task_name_node {
+    const std::type_info* type;
+    task_name_node* next;
+    char name[1];
+};
+
+//! Names of all the task types ever traced
+static task_name_node* the_task_names;
+//! Protects the list of names.
+static spin_mutex the_task_names_mutex;
+
+const char* trace_buffer::intern_task_name( const std::type_info& type ) {
+    spin_mutex::scoped_lock lock( the_task_names_mutex );
+    for( task_name_node* n = the_task_names; n; n = n->next )
+        if( n->type == &type )
+            return n->name;
+    const char* name = type.name();
+#if __TBB_TRACE_DEMANGLE
+    int status = 0;
+    char* demangled = abi::__cxa_demangle( name, NULL, NULL, &status );
+    if( demangled )
+        name = demangled;
+#endif
+    const size_t length = std::strlen( name );
+    task_name_node* n = static_cast<task_name_node*>( NFS_Allocate( 1, sizeof(task_name_node) + length, NULL ) );
+    n->type = &type;
+    std::memcpy( n->name, name, length + 1 );
+#if __TBB_TRACE_DEMANGLE
+    std::free( demangled );
+#endif
+    n->next = the_task_names;
+    the_task_names = n;
+    return n->name;
+}
+
+void trace_current_thread( trace_event_kind kind ) {
+    if( the_trace_file )
+        if( generic_scheduler* s = governor::local_scheduler_if_initialized() )
+            TRACE_EVENT( s->my_trace, kind, NULL, 0 );
+}
+
+//! Writes JSON string contents, escaping the characters that need it.
+static void write_escaped( FILE* f, const char* s ) {
+    for( ; *s; ++s ) {
+        if( *s == '"' || *s == '\\' )
+            fputc( '\\', f );
+        fputc( *s, f );
+    }
+}
+
+//! Writes events of one thread. Spans that began before the oldest kept event are skipped.
+static void write_events( FILE* f, int tid, const trace_event* events, size_t n ) {
+    int depth = 0;
+    for( size_t i = 0; i < n; ++i ) {
+        const trace_event& e = events[i];
+        const double ts = (e.time - the_trace_start).seconds() * 1e6;
+        char phase = 'i';
+        switch( e.kind ) {
+        case te_task_begin: case te_arena_join: case te_sleep:
+            phase = 'B';
+            ++depth;
+            break;
+        case te_task_end: case te_arena_leave: case te_wake:
+            if( !depth )
+                continue;
+            phase = 'E';
+            --depth;
+            break;
+        }
+        fprintf( f, ",\n{\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d", phase, ts, tid );
+        switch( e.kind ) {
+        case te_task_begin:
+            fputs( ",\"cat\":\"task\",\"name\":\"", f );
+            write_escaped( f, static_cast<const char*>(e.data) );
+            fputs( "\"}", f );
+            break;
+        case te_spawn:
+            fprintf( f, ",\"s\":\"t\",\"cat\":\"scheduler\",\"name\":\"spawn\",\"args\":{\"tasks\":%d}}", e.arg );
+            break;
+        case te_steal:
+            fprintf( f, ",\"s\":\"t\",\"cat\":\"scheduler\",\"name\":\"steal\",\"args\":{\"arena\":\"%p\",\"victim\":%d}}", e.data, e.arg );
+            break;
+        case te_mailbox_hit:
+            fputs( ",\"s\":\"t\",\"cat\":\"scheduler\",\"name\":\"mailbox\"}", f );
+            break;
+        case te_arena_join:
+            fprintf( f, ",\"cat\":\"arena\",\"name\":\"arena\",\"args\":{\"arena\":\"%p\",\"slot\":%d}}", e.data, e.arg );
+            break;
+        case te_sleep:
+            fputs( ",\"cat\":\"worker\",\"name\":\"sleep\"}", f );
+            break;
+        default:
+            fputs( "}", f );
+        }
+    }
+}
+
+bool dump_scheduler_trace( const char* file_name ) {
+    if( !the_trace_file )
+        return false;
+    FILE* f = fopen( file_name ? file_name : the_trace_file, "w" );
+    if( !f )
+        return false;
+    trace_event* events = static_cast<trace_event*>( NFS_Allocate( trace_buffer::capacity, sizeof(trace_event), NULL ) );
+    fputs( "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+           "{\"ph\":\"M\",\"pid\":1,\"name\":\"process_name\",\"args\":{\"name\":\"TBB\"}}", f );
+    spin_mutex::scoped_lock lock( the_buffers_mutex );
+    for( trace_buffer* b = the_buffers; b; b = b->my_next ) {
+        fprintf( f, ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":\"%s %u\"}}",
+                 b->my_id, b->my_is_worker ? "worker" : "master", unsigned(b->my_index) );
+        // The thread may be recording while its events are copied
+        const size_t end = __TBB_load_with_acquire( b->my_count );
+        size_t begin = end > trace_buffer::capacity ? end - trace_buffer::capacity : 0;
+        for( size_t i = begin; i < end; ++i )
+            events[i - begin] = b->my_events[i & (trace_buffer::capacity-1)];
+        // The slot of the event being recorded now is overwritten as well
+        const size_t overwritten = __TBB_load_with_acquire( b->my_count ) + 1;
+        size_t skip = 0;
+        if( overwritten > begin + trace_buffer::capacity )
+            skip = min( overwritten - trace_buffer::capacity - begin, end - begin );
+        write_events( f, b->my_id, events + skip, end - begin - skip );
+    }
+    lock.release();
+    fputs( "\n]}\n", f );
+    NFS_Free( events );
+    return fclose( f ) == 0;
+}
+
+//! Writes the trace at exit
+class trace_writer {
+public:
+    ~trace_writer() {
+        if( the_trace_file )
+            dump_scheduler_trace( NULL );
+    }
+};
+
+static trace_writer the_trace_writer;
+
+#else /* !__TBB_TRACE */
+
+trace_buffer* trace_buffer::create( bool, size_t ) {
+    return NULL;
+}
+
+void trace_buffer::release( trace_buffer* ) {}
+
+const char* trace_buffer::intern_task_name( const std::type_info& type ) {
+    return type.name();
+}
+
+void trace_current_thread( trace_event_kind ) {}
+
+bool dump_scheduler_trace( const char* ) {
+    return false;
+}
+
+#endif /* !__TBB_TRACE */
+
+} // namespace internal
+} // namespace tbb
@@ -0,0 +1,149 @@
+/*
+    Copyright (c) 2005-2019 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+#ifndef _TBB_tbb_trace_H
+#define _TBB_tbb_trace_H
+
+//! Built-in tracer of the scheduler events.
+/** It is compiled in unless __TBB_TRACE is defined to 0, but records events only if the
+    TBB_TRACE environment variable is set when the first thread initializes the scheduler.
+    The value of the variable is the name of the file that the trace is written to at exit,
+    in the Chrome trace event format (chrome://tracing, ui.perfetto.dev). **/
+#ifndef __TBB_TRACE
+#define __TBB_TRACE 1
+#endif
+
+#include "tbb/tbb_stddef.h"
+#include "tbb/tbb_machine.h"
+#include "tbb/tick_count.h"
+#include <typeinfo>
+
+namespace tbb {
+namespace internal {
+
+//! Kinds of the recorded events. The meaning of the event data and argument is given for each.
+enum trace_event_kind {
+    //! Start of task::execute; name of the task type, see trace_buffer::task_name()
+    te_task_begin,
+    //! End of task::execute
+    te_task_end,
+    //! Tasks put into the local task pool; number of the tasks
+    te_spawn,
+    //! Task stolen; arena, index of the victim slot
+    te_steal,
+    //! Task taken from the mailbox, i.e. executed by the thread it has affinity to
+    te_mailbox_hit,
+    //! Thread occupied a slot; arena, index of the slot
+    te_arena_join,
+    //! Thread left the slot; arena, index of the slot
+    te_arena_leave,
+    //! Worker is going to sleep in RML
+    te_sleep,
+    //! Worker is woken up
+    te_wake
+};
+
+struct trace_event {
+    tick_count time;
+    const void* data;
+    int kind;
+    int arg;
+};
+
+//! Events of a thread.
+/** The ring buffer is written by its thread only. Other threads may read it while it is
+    written, and detect the overwritten events by the count of the recorded events. **/
+class trace_buffer : no_copy {
+public:
+    static const size_t capacity = 1<<16;
+
+    //! Limit of the number of buffers; the threads created beyond it are not traced.
+    static const int max_buffers = 256;
+
+    //! Returns a registered buffer if tracing is enabled, otherwise NULL.
+    /** Buffers are kept until exit, so that the events of finished threads are written too.
+        A buffer released by a finished thread is reused by the next worker with the same
+        index, or by the next master; the thread continues the events of the previous one.
+        index is ignored for masters. **/
+    static trace_buffer* create( bool is_worker, size_t index );
+
+    //! Makes the buffer of a finished thread available to create(). Does nothing for NULL.
+    static void release( trace_buffer* b );
+
+    //! Returns the name of the task type, which the tracer keeps until exit.
+    /** The type_info may be gone by the time the trace is written, e.g. if the module
+        of the task is unloaded, so the name is copied when first seen. **/
+    const char* task_name( const std::type_info& type ) {
+        name_cache_entry& c = my_names[(uintptr_t(&type) / sizeof(void*)) & (name_cache_size-1)];
+        if( c.type != &type ) {
+            c.name = intern_task_name( type );
+            c.type = &type;
+        }
+        return c.name;
+    }
+
+    void record( trace_event_kind kind, const void* data, int arg ) {
+        size_t n = my_count;
+        trace_event& e = my_events[n & (capacity-1)];
+        e.time = tick_count::now();
+        e.data = data;
+        e.kind = kind;
+        e.arg = arg;
+        __TBB_store_with_release( my_count, n+1 );
+    }
+
+    //! Next buffer in the list of all buffers.
+    trace_buffer* my_next;
+    //! Index of the buffer in the list; used as thread id in the trace.
+    int my_id;
+    bool my_is_worker;
+    //! Index of the worker, or of the master among the masters.
+    size_t my_index;
+    //! Number of events ever recorded.
+    size_t my_count;
+    //! True while a thread records into the buffer.
+    bool my_in_use;
+    trace_event my_events[capacity];
+
+private:
+    static const size_t name_cache_size = 64;
+    struct name_cache_entry {
+        const std::type_info* type;
+        const char* name;
+    };
+    //! Recently seen task types of the thread, to look up the global copies of the names rarely.
+    name_cache_entry my_names[name_cache_size];
+
+    static const char* intern_task_name( const std::type_info& type );
+};
+
+//! Records an event for the calling thread, if it has a scheduler. Use outside of the scheduler code.
+void trace_current_thread( trace_event_kind kind );
+
+} // namespace internal
+} // namespace tbb
+
+#if __TBB_TRACE
+    #define TRACE_EVENT(buffer, kind, data, arg) ((buffer) ? (buffer)->record(kind, data, arg) : (void)0)
+#else
+    #define TRACE_EVENT(buffer, kind, data, arg)
+#endif /* __TBB_TRACE */
+
+#endif /* _TBB_tbb_trace_H */
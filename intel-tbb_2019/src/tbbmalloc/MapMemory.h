@@ -170,6 +170,39 @@ int UnmapMemory(void *area, size_t bytes)
     return ret;
 }
 
+// Release physical pages, but keep the range mapped.
+int DecommitMemory(void *area, size_t bytes)
+{
+    int prevErrno = errno;
+#if __linux__ || !defined(MADV_FREE)
+    // MADV_FREE under Linux* keeps pages in RSS until memory pressure
+    int ret = madvise(area, bytes, MADV_DONTNEED);
+#else
+    int ret = madvise(area, bytes, MADV_FREE);
+#endif
+    if (-1 == ret)
+        errno = prevErrno;
+    return ret;
+}
+
+// Ask to back the range with transparent huge pages. It's required when
+// the system uses them only for advised ranges.
+#if __linux__ && defined(MADV_HUGEPAGE)
+int AdviseHugePages(void *area, size_t bytes)
+{
+    int prevErrno = errno;
+    int ret = madvise(area, bytes, MADV_HUGEPAGE);
+    if (-1 == ret)
+        errno = prevErrno;
+    return ret;
+}
+#else
+int AdviseHugePages(void * /*area*/, size_t /*bytes*/)
+{
+    return -1;
+}
+#endif
+
 #elif (_WIN32 || _WIN64) && !__TBB_WIN8UI_SUPPORT
 #include <windows.h>
 
@@ -186,6 +219,17 @@ int UnmapMemory(void *area, size_t /*bytes*/)
     return !result;
 }
 
+int DecommitMemory(void *area, size_t bytes)
+{
+    // MEM_RESET keeps the range committed, so no re-commit is needed on reuse
+    return !VirtualAlloc(area, bytes, MEM_RESET, PAGE_READWRITE);
+}
+
+int AdviseHugePages(void * /*area*/, size_t /*bytes*/)
+{
+    return -1;
+}
+
 #else
 
 #define MEMORY_MAPPING_USES_MALLOC 1
@@ -200,6 +244,16 @@ int UnmapMemory(void *area, size_t /*bytes*/)
     return 0;
 }
 
+int DecommitMemory(void * /*area*/, size_t /*bytes*/)
+{
+    return -1;
+}
+
+int AdviseHugePages(void * /*area*/, size_t /*bytes*/)
+{
+    return -1;
+}
+
 #endif /* OS dependent */
 
 #if MALLOC_CHECK_RECURSION && MEMORY_MAPPING_USES_MALLOC
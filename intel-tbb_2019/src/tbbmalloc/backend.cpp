@@ -51,6 +51,14 @@ int freeRawMemory (void *object, size_t size) {
     return UnmapMemory(object, size);
 }
 
+int decommitRawMemory (void *object, size_t size) {
+    return DecommitMemory(object, size);
+}
+
+int adviseHugePages (void *object, size_t size) {
+    return AdviseHugePages(object, size);
+}
+
 #if CHECK_ALLOCATION_RANGE
 
 void Backend::UsedAddressRange::registerAlloc(uintptr_t left, uintptr_t right)
@@ -83,12 +91,14 @@ void Backend::UsedAddressRange::registerFree(uintptr_t left, uintptr_t right)
 
 // Initialized in frontend inside defaultMemPool
 extern HugePagesStatus hugePages;
+extern NumaTopology numaTopology;
 
-void *Backend::allocRawMem(size_t &size)
+void *Backend::allocRawMem(size_t &size, bool *hugePagesUsed)
 {
     void *res = NULL;
     size_t allocSize = 0;
 
+    *hugePagesUsed = false;
     if (extMemPool->userPool()) {
         if (extMemPool->fixedPool && bootsrapMemDone == FencedLoad(bootsrapMemStatus))
             return NULL;
@@ -113,6 +123,7 @@ void *Backend::allocRawMem(size_t &size)
             if (!res && hugePages.isTHPAvailable) {
                 res = getRawMemory(allocSize, TRANSPARENT_HUGE_PAGE);
             }
+            *hugePagesUsed = res != NULL;
         }
 
         if (!res) {
@@ -205,6 +216,8 @@ struct MemRegion {
     size_t     allocSz,   // got from pool callback
                blockSz;   // initial and maximal inner block size
     MemRegionType type;
+    int        numaNode;  // all blocks of the region belong to this node
+    bool       hugePages; // region is backed by huge pages
 };
 
 // this data must be unmodified while block is in use, so separate it
@@ -212,12 +225,15 @@ class BlockMutexes {
 protected:
     GuardedSize myL,   // lock for me
                 leftL; // lock for left neighbor
+public:
+    intptr_t    numaNode; // BlockI::numaNode, inherited by split parts
 };
 
 class FreeBlock : BlockMutexes {
 public:
     static const size_t minBlockSize;
     friend void Backend::IndexedBins::verify();
+    using BlockMutexes::numaNode;
 
     FreeBlock    *prev,       // in 2-linked list related to bin
                  *next,
@@ -227,6 +243,8 @@ public:
     int           myBin;      // bin that is owner of the block
     bool          aligned;
     bool          blockInBin; // this block in myBin already
+    bool          decayed;    // pages of the block were returned to OS
+    intptr_t      freeEpoch;  // memoryDecay.epoch when the block became free
 
     FreeBlock *rightNeig(size_t sz) const {
         MALLOC_ASSERT(sz, ASSERT_TEXT);
@@ -270,9 +288,11 @@ public:
         nextToFree = NULL;
     }
     static void markBlocks(FreeBlock *fBlock, int num, size_t size) {
+        const intptr_t node = fBlock->numaNode;
         for (int i=1; i<num; i++) {
             fBlock = (FreeBlock*)((uintptr_t)fBlock + size);
             fBlock->initHeader();
+            fBlock->numaNode = node;
         }
     }
 };
@@ -439,6 +459,7 @@ try_next:
                     fBlock = (FreeBlock*)((uintptr_t)newFBlock + szBlock - size);
                     MALLOC_ASSERT(isAligned(fBlock, slabSize), "Invalid free block");
                     fBlock->initHeader();
+                    fBlock->numaNode = newFBlock->numaNode;
                     fBlock->setLeftFree(szBlock - size);
                     newFBlock->setMeFree(szBlock - size);
 
@@ -487,6 +508,32 @@ try_next:
                                       /*reportBlocksProcessed=*/false);
 }
 
+// Return to OS pages of blocks that are free since decayEpoch at least.
+// The blocks stay in the bin, so only the pages beyond the header are released.
+size_t Backend::IndexedBins::decayBlocks(int binIdx, Backend *backend, intptr_t decayEpoch)
+{
+    Bin *b = &freeBins[binIdx];
+    size_t released = 0;
+    bool locked;
+    // purging is not urgent, so do not wait for the bin
+    MallocMutex::scoped_lock binLock(b->tLock, /*wait=*/false, &locked);
+    if (!locked)
+        return 0;
+    for (FreeBlock *curr = b->head; curr; curr = curr->next) {
+        if (curr->decayed || curr->freeEpoch > decayEpoch)
+            continue;
+        size_t szBlock = curr->tryLockBlock();
+        if (!szBlock) // the block is coalescing now
+            continue;
+        released += backend->releasePages((char*)curr + sizeof(FreeBlock),
+                                          szBlock - sizeof(FreeBlock));
+        curr->decayed = true;
+        curr->setMeFree(szBlock);
+        curr->rightNeig(szBlock)->setLeftFree(szBlock);
+    }
+    return released;
+}
+
 void Backend::Bin::removeBlock(FreeBlock *fBlock)
 {
     MALLOC_ASSERT(fBlock->next||fBlock->prev||fBlock==head,
@@ -591,6 +638,8 @@ FreeBlock *Backend::splitUnalignedBlock(FreeBlock *fBlock, int num, size_t size,
                                         bool needAlignedBlock)
 {
     const size_t totalSize = num*size;
+    // parts of the block stay on the same node
+    const intptr_t node = fBlock->numaNode;
     if (needAlignedBlock) {
         size_t fBlockSz = fBlock->sizeTmp;
         uintptr_t fBlockEnd = (uintptr_t)fBlock + fBlockSz;
@@ -601,11 +650,13 @@ FreeBlock *Backend::splitUnalignedBlock(FreeBlock *fBlock, int num, size_t size,
         // ... return free right part
         if ((uintptr_t)rightPart != fBlockEnd) {
             rightPart->initHeader();  // to prevent coalescing rightPart with fBlock
+            rightPart->numaNode = node;
             coalescAndPut(rightPart, fBlockEnd - (uintptr_t)rightPart);
         }
         // ... and free left part
         if (newB != fBlock) {
             newB->initHeader(); // to prevent coalescing fBlock with newB
+            newB->numaNode = node;
             coalescAndPut(fBlock, (uintptr_t)newB - (uintptr_t)fBlock);
         }
 
@@ -616,6 +667,7 @@ FreeBlock *Backend::splitUnalignedBlock(FreeBlock *fBlock, int num, size_t size,
             // split block and return free right part
             FreeBlock *splitB = (FreeBlock*)((uintptr_t)fBlock + totalSize);
             splitB->initHeader();
+            splitB->numaNode = node;
             coalescAndPut(splitB, splitSz);
         }
     }
@@ -636,11 +688,13 @@ FreeBlock *Backend::splitAlignedBlock(FreeBlock *fBlock, int num, size_t size,
                                   - num*size);
             MALLOC_ASSERT(isAligned(fBlock, slabSize), "Invalid free block");
             fBlock->initHeader();
+            fBlock->numaNode = newAlgnd->numaNode;
             newSz = newAlgnd->sizeTmp - num*size;
         } else {
             newAlgnd = (FreeBlock*)((uintptr_t)fBlock + num*size);
             newSz = fBlock->sizeTmp - num*size;
             newAlgnd->initHeader();
+            newAlgnd->numaNode = fBlock->numaNode;
         }
         coalescAndPut(newAlgnd, newSz);
     }
@@ -681,7 +735,7 @@ FreeBlock *Backend::releaseMemInCaches(intptr_t startModifiedCnt,
 
 FreeBlock *Backend::askMemFromOS(size_t blockSize, intptr_t startModifiedCnt,
                                  int *lockedBinsThreshold, int numOfLockedBins,
-                                 bool *splittableRet)
+                                 bool *splittableRet, int node)
 {
     FreeBlock *block;
     // The block sizes can be divided into 3 groups:
@@ -704,7 +758,7 @@ FreeBlock *Backend::askMemFromOS(size_t blockSize, intptr_t startModifiedCnt,
     if (blockSize >= quiteLarge) {
         // Do not interact with other threads via semaphores, as for exact fit
         // we can't share regions with them, memory requesting is individual.
-        block = addNewRegion(blockSize, MEMREG_ONE_BLOCK, /*addToBin=*/false);
+        block = addNewRegion(blockSize, MEMREG_ONE_BLOCK, /*addToBin=*/false, node);
         if (!block)
             return releaseMemInCaches(startModifiedCnt, lockedBinsThreshold, numOfLockedBins);
         *splittableRet = false;
@@ -730,13 +784,13 @@ FreeBlock *Backend::askMemFromOS(size_t blockSize, intptr_t startModifiedCnt,
             // This must be done carefully, because blocks in bins can be released
             // in releaseCachesToLimit().
             const unsigned NUM_OF_REG = 3;
-            block = addNewRegion(regSz_sizeBased, MEMREG_FLEXIBLE_SIZE, /*addToBin=*/false);
+            block = addNewRegion(regSz_sizeBased, MEMREG_FLEXIBLE_SIZE, /*addToBin=*/false, node);
             if (block)
                 for (unsigned idx=0; idx<NUM_OF_REG; idx++)
-                    if (! addNewRegion(regSz_sizeBased, MEMREG_FLEXIBLE_SIZE, /*addToBin=*/true))
+                    if (! addNewRegion(regSz_sizeBased, MEMREG_FLEXIBLE_SIZE, /*addToBin=*/true, node))
                         break;
         } else {
-            block = addNewRegion(regSz_sizeBased, MEMREG_SEVERAL_BLOCKS, /*addToBin=*/false);
+            block = addNewRegion(regSz_sizeBased, MEMREG_SEVERAL_BLOCKS, /*addToBin=*/false, node);
         }
         memExtendingSema.signal();
 
@@ -789,7 +843,7 @@ FreeBlock *Backend::IndexedBins::
     return NULL;
 }
 
-void Backend::requestBootstrapMem()
+void Backend::requestBootstrapMem(int node)
 {
     if (bootsrapMemDone == FencedLoad(bootsrapMemStatus))
         return;
@@ -800,10 +854,45 @@ void Backend::requestBootstrapMem()
     bootsrapMemStatus = bootsrapMemInitializing;
     // request some rather big region during bootstrap in advance
     // ok to get NULL here, as later we re-do a request with more modest size
-    addNewRegion(2*1024*1024, MEMREG_FLEXIBLE_SIZE, /*addToBin=*/true);
+    addNewRegion(2*1024*1024, MEMREG_FLEXIBLE_SIZE, /*addToBin=*/true, node);
     bootsrapMemStatus = bootsrapMemDone;
 }
 
+FreeBlock *Backend::findBlockInBins(int node, int nativeBin, size_t size,
+                                    bool needAlignedBlock, int *numOfLockedBins)
+{
+    FreeBlock *block;
+    // TODO: try different bin search order
+    if (needAlignedBlock) {
+        block = freeAlignedBins[node].findBlock(nativeBin, &bkndSync, size,
+                            /*needAlignedBlock=*/true, /*alignedBin=*/true,
+                            numOfLockedBins);
+        if (!block)
+            block = freeLargeBins[node].findBlock(nativeBin, &bkndSync, size,
+                            /*needAlignedBlock=*/true, /*alignedBin=*/false,
+                            numOfLockedBins);
+    } else {
+        block = freeLargeBins[node].findBlock(nativeBin, &bkndSync, size,
+                            /*needAlignedBlock=*/false, /*alignedBin=*/false,
+                            numOfLockedBins);
+        if (!block)
+            block = freeAlignedBins[node].findBlock(nativeBin, &bkndSync, size,
+                            /*needAlignedBlock=*/false, /*alignedBin=*/true,
+                            numOfLockedBins);
+    }
+    return block;
+}
+
+FreeBlock *Backend::findBlockOnOtherNodes(int node, int nativeBin, size_t size,
+                                          bool needAlignedBlock, int *numOfLockedBins)
+{
+    for (int i=1; i<maxNumaNodes; i++)
+        if (FreeBlock *block = findBlockInBins((node+i) % maxNumaNodes, nativeBin,
+                                               size, needAlignedBlock, numOfLockedBins))
+            return block;
+    return NULL;
+}
+
 // try to allocate size Byte block in available bins
 // needAlignedRes is true if result must be slab-aligned
 FreeBlock *Backend::genericGetBlock(int num, size_t size, bool needAlignedBlock)
@@ -812,8 +901,10 @@ FreeBlock *Backend::genericGetBlock(int num, size_t size, bool needAlignedBlock)
     const size_t totalReqSize = num*size;
     // no splitting after requesting new region, asks exact size
     const int nativeBin = sizeToBin(totalReqSize);
+    // blocks and regions of the thread's node are preferred
+    const int node = currentNumaNode();
 
-    requestBootstrapMem();
+    requestBootstrapMem(node);
     // If we found 2 or less locked bins, it's time to ask more memory from OS.
     // But nothing can be asked from fixed pool. And we prefer wait, not ask
     // for more memory, if block is quite large.
@@ -831,24 +922,12 @@ FreeBlock *Backend::genericGetBlock(int num, size_t size, bool needAlignedBlock)
         do {
             numOfLockedBins = 0;
 
-            // TODO: try different bin search order
-            if (needAlignedBlock) {
-                block = freeAlignedBins.findBlock(nativeBin, &bkndSync, num*size,
-                                    /*needAlignedBlock=*/true, /*alignedBin=*/true,
-                                    &numOfLockedBins);
-                if (!block)
-                    block = freeLargeBins.findBlock(nativeBin, &bkndSync, num*size,
-                                    /*needAlignedBlock=*/true, /*alignedBin=*/false,
-                                    &numOfLockedBins);
-            } else {
-                block = freeLargeBins.findBlock(nativeBin, &bkndSync, num*size,
-                                    /*needAlignedBlock=*/false, /*alignedBin=*/false,
-                                    &numOfLockedBins);
-                if (!block)
-                    block = freeAlignedBins.findBlock(nativeBin, &bkndSync, num*size,
-                                    /*needAlignedBlock=*/false, /*alignedBin=*/true,
+            block = findBlockInBins(node, nativeBin, totalReqSize, needAlignedBlock,
                                     &numOfLockedBins);
-            }
+            // blocks of other nodes are left in bins after NUMA mode switched off
+            if (!block && !numaTopology.isEnabled)
+                block = findBlockOnOtherNodes(node, nativeBin, totalReqSize,
+                                              needAlignedBlock, &numOfLockedBins);
         } while (!block && numOfLockedBins>lockedBinsThreshold);
 
         if (block)
@@ -856,13 +935,26 @@ FreeBlock *Backend::genericGetBlock(int num, size_t size, bool needAlignedBlock)
 
         if (!(scanCoalescQ(/*forceCoalescQDrop=*/true)
               | extMemPool->softCachesCleanup())) {
+            // Above the soft limit, reuse memory of other nodes
+            // instead of growing the heap.
+            if (numaTopology.isEnabled && memSoftLimit && totalMemSize > memSoftLimit
+                && (block = findBlockOnOtherNodes(node, nativeBin, totalReqSize,
+                                                  needAlignedBlock, &numOfLockedBins)))
+                break;
             // bins are not updated,
             // only remaining possibility is to ask for more memory
             block =
                 askMemFromOS(totalReqSize, startModifiedCnt, &lockedBinsThreshold,
-                             numOfLockedBins, &splittable);
-            if (!block)
-                return NULL;
+                             numOfLockedBins, &splittable, node);
+            if (!block) {
+                // OS can't give us more memory, the last chance is other nodes
+                if (numaTopology.isEnabled)
+                    block = findBlockOnOtherNodes(node, nativeBin, totalReqSize,
+                                                  needAlignedBlock, &numOfLockedBins);
+                if (!block)
+                    return NULL;
+                break;
+            }
             if (block != (FreeBlock*)VALID_BLOCK_IN_BIN) {
                 // size can be increased in askMemFromOS, that's why >=
                 MALLOC_ASSERT(block->sizeTmp >= size, ASSERT_TEXT);
@@ -895,6 +987,43 @@ LargeMemoryBlock *Backend::getLargeBlock(size_t size)
     return lmb;
 }
 
+BlockI *Backend::getHugePageSlabs()
+{
+    // The region is large enough to hold a huge page aligned part
+    // at any region alignment, rest of the region goes to bins.
+    FreeBlock *block = addNewRegion(2*HUGE_PAGE_SIZE+slabSize, MEMREG_FLEXIBLE_SIZE,
+                                    /*addToBin=*/false, currentNumaNode());
+    if (!block)
+        return NULL;
+    const uintptr_t start = (uintptr_t)block,
+        end = start + block->sizeTmp,
+        res = alignUp(start, HUGE_PAGE_SIZE);
+    MALLOC_ASSERT(res + HUGE_PAGE_SIZE <= end, ASSERT_TEXT);
+    MALLOC_ASSERT(res == start || res - start >= FreeBlock::minBlockSize, ASSERT_TEXT);
+
+    FreeBlock *slabs = (FreeBlock*)res;
+    if (res != start) {
+        slabs->initHeader();
+        slabs->numaNode = block->numaNode;
+    }
+    // every slab can be released separately
+    FreeBlock::markBlocks(slabs, HUGE_PAGE_SIZE/slabSize, slabSize);
+    if (end != res + HUGE_PAGE_SIZE) {
+        FreeBlock *tail = (FreeBlock*)(res + HUGE_PAGE_SIZE);
+        tail->initHeader();
+        tail->numaNode = block->numaNode;
+        coalescAndPut(tail, end - (res + HUGE_PAGE_SIZE));
+    }
+    if (res != start)
+        coalescAndPut(block, res - start);
+    // matched blockConsumed() from startUseBlock()
+    bkndSync.blockReleased();
+    releaseCachesToLimit();
+
+    adviseHugePages(slabs, HUGE_PAGE_SIZE);
+    return (BlockI*)slabs;
+}
+
 void *Backend::getBackRefSpace(size_t size, bool *rawMemUsed)
 {
     // This block is released only at shutdown, so it can prevent
@@ -920,9 +1049,9 @@ void Backend::removeBlockFromBin(FreeBlock *fBlock)
 {
     if (fBlock->myBin != Backend::NO_BIN) {
         if (fBlock->aligned)
-            freeAlignedBins.lockRemoveBlock(fBlock->myBin, fBlock);
+            freeAlignedBins[fBlock->numaNode].lockRemoveBlock(fBlock->myBin, fBlock);
         else
-            freeLargeBins.lockRemoveBlock(fBlock->myBin, fBlock);
+            freeLargeBins[fBlock->numaNode].lockRemoveBlock(fBlock->myBin, fBlock);
     }
 }
 
@@ -1073,6 +1202,8 @@ FreeBlock *Backend::doCoalesc(FreeBlock *fBlock, MemRegion **mRegion)
                 return NULL;
             } else {
                 MALLOC_ASSERT(lSz == leftSz, "Invalid header");
+                MALLOC_ASSERT(left->numaNode == fBlock->numaNode,
+                              "Neighbors must be from same region");
                 left->blockInBin = true;
                 resBlock = left;
                 resSize += leftSz;
@@ -1108,6 +1239,8 @@ FreeBlock *Backend::doCoalesc(FreeBlock *fBlock, MemRegion **mRegion)
                 return NULL;
             } else {
                 MALLOC_ASSERT(rSz == rightSz, "Invalid header");
+                MALLOC_ASSERT(right->numaNode == fBlock->numaNode,
+                              "Neighbors must be from same region");
                 removeBlockFromBin(right);
                 resSize += rightSz;
 
@@ -1151,6 +1284,8 @@ bool Backend::coalescAndPutList(FreeBlock *list, bool forceCoalescQDrop,
         FreeBlock *toRet = doCoalesc(list, &memRegion);
         if (!toRet)
             continue;
+        toRet->freeEpoch = FencedLoad(memoryDecay.epoch);
+        toRet->decayed = false;
 
         if (memRegion && memRegion->blockSz == toRet->sizeTmp
             && !extMemPool->fixedPool) {
@@ -1188,7 +1323,8 @@ bool Backend::coalescAndPutList(FreeBlock *list, bool forceCoalescQDrop,
             // It's not a leak because the block later can be coalesced.
             if (currSz >= minBinnedSize) {
                 toRet->sizeTmp = currSz;
-                IndexedBins *target = toAligned? &freeAlignedBins : &freeLargeBins;
+                IndexedBins *target = toAligned? freeAlignedBins+toRet->numaNode
+                    : freeLargeBins+toRet->numaNode;
                 if (forceCoalescQDrop) {
                     target->addBlock(bin, toRet, toRet->sizeTmp, addToTail);
                 } else if (!target->tryAddBlock(bin, toRet, addToTail)) {
@@ -1273,6 +1409,10 @@ void Backend::startUseBlock(MemRegion *region, FreeBlock *fBlock, bool addToBin)
 {
     size_t blockSz = region->blockSz;
     fBlock->initHeader();
+    fBlock->numaNode = region->numaNode;
+    // pages of a new region are not touched yet
+    fBlock->decayed = true;
+    fBlock->freeEpoch = FencedLoad(memoryDecay.epoch);
     fBlock->setMeFree(blockSz);
 
     LastFreeBlock *lastBl = static_cast<LastFreeBlock*>(fBlock->rightNeig(blockSz));
@@ -1282,6 +1422,7 @@ void Backend::startUseBlock(MemRegion *region, FreeBlock *fBlock, bool addToBin)
     lastBl->setMeFree(GuardedSize::LAST_REGION_BLOCK);
     lastBl->setLeftFree(blockSz);
     lastBl->myBin = NO_BIN;
+    lastBl->numaNode = region->numaNode;
     lastBl->memRegion = region;
 
     if (addToBin) {
@@ -1289,9 +1430,9 @@ void Backend::startUseBlock(MemRegion *region, FreeBlock *fBlock, bool addToBin)
         // during adding advance regions, register bin for a largest block in region
         advRegBins.registerBin(targetBin);
         if (region->type!=MEMREG_ONE_BLOCK && toAlignedBin(fBlock, blockSz)) {
-            freeAlignedBins.addBlock(targetBin, fBlock, blockSz, /*addToTail=*/false);
+            freeAlignedBins[region->numaNode].addBlock(targetBin, fBlock, blockSz, /*addToTail=*/false);
         } else {
-            freeLargeBins.addBlock(targetBin, fBlock, blockSz, /*addToTail=*/false);
+            freeLargeBins[region->numaNode].addBlock(targetBin, fBlock, blockSz, /*addToTail=*/false);
         }
     } else {
         // to match with blockReleased() in genericGetBlock
@@ -1323,22 +1464,36 @@ void MemRegionList::remove(MemRegion *r)
         r->prev->next = r->next;
 }
 
+void MemRegionList::collectStatistics(ScalableAllocationStatistics *stat)
+{
+    MallocMutex::scoped_lock lock(regionListLock);
+    for (MemRegion *curr = head; curr; curr = curr->next) {
+        stat->regions++;
+        stat->regionsSize += curr->allocSz;
+        if (curr->hugePages) {
+            stat->hugePageRegions++;
+            stat->hugePageRegionsSize += curr->allocSz;
+        }
+    }
+}
+
 #if __TBB_MALLOC_BACKEND_STAT
 int MemRegionList::reportStat(FILE *f)
 {
     int regNum = 0;
     MallocMutex::scoped_lock lock(regionListLock);
     for (MemRegion *curr = head; curr; curr = curr->next) {
-        fprintf(f, "%p: max block %lu B, ", curr, curr->blockSz);
+        fprintf(f, "%p: max block %lu B, node %d, ", curr, curr->blockSz, curr->numaNode);
         regNum++;
     }
     return regNum;
 }
 #endif
 
-FreeBlock *Backend::addNewRegion(size_t size, MemRegionType memRegType, bool addToBin)
+FreeBlock *Backend::addNewRegion(size_t size, MemRegionType memRegType, bool addToBin,
+                                int node)
 {
-    MALLOC_STATIC_ASSERT(sizeof(BlockMutexes) <= sizeof(BlockI),
+    MALLOC_STATIC_ASSERT(sizeof(BlockMutexes) == sizeof(BlockI),
                  "Header must be not overwritten in used blocks");
     MALLOC_ASSERT(FreeBlock::minBlockSize > GuardedSize::MAX_SPEC_VAL,
           "Block length must not conflict with special values of GuardedSize");
@@ -1349,7 +1504,8 @@ FreeBlock *Backend::addNewRegion(size_t size, MemRegionType memRegType, bool add
              +  FreeBlock::minBlockSize + sizeof(LastFreeBlock);
 
     size_t rawSize = requestSize;
-    MemRegion *region = (MemRegion*)allocRawMem(rawSize);
+    bool hugePagesUsed;
+    MemRegion *region = (MemRegion*)allocRawMem(rawSize, &hugePagesUsed);
     if (!region) {
         MALLOC_ASSERT(rawSize==requestSize, "getRawMem has not allocated memory but changed the allocated size.");
         return NULL;
@@ -1362,6 +1518,10 @@ FreeBlock *Backend::addNewRegion(size_t size, MemRegionType memRegType, bool add
 
     region->type = memRegType;
     region->allocSz = rawSize;
+    // The node is only a tag, physical pages are placed by the OS
+    // on first touch, i.e. by the thread that requested the region.
+    region->numaNode = node;
+    region->hugePages = hugePagesUsed;
     FreeBlock *fBlock = findBlockInRegion(region, size);
     if (!fBlock) {
         if (!extMemPool->fixedPool)
@@ -1388,8 +1548,10 @@ void Backend::reset()
     // no active threads are allowed in backend while reset() called
     verify();
 
-    freeLargeBins.reset();
-    freeAlignedBins.reset();
+    for (int i=0; i<maxNumaNodes; i++) {
+        freeLargeBins[i].reset();
+        freeAlignedBins[i].reset();
+    }
     advRegBins.reset();
 
     for (MemRegion *curr = regionList.head; curr; curr = curr->next) {
@@ -1405,8 +1567,10 @@ bool Backend::destroy()
     // no active threads are allowed in backend while destroy() called
     verify();
     if (!inUserPool()) {
-        freeLargeBins.reset();
-        freeAlignedBins.reset();
+        for (int i=0; i<maxNumaNodes; i++) {
+            freeLargeBins[i].reset();
+            freeAlignedBins[i].reset();
+        }
     }
     while (regionList.head) {
         MemRegion *helper = regionList.head->next;
@@ -1424,16 +1588,46 @@ bool Backend::clean()
     // We can have several blocks occupying a whole region,
     // because such regions are added in advance (see askMemFromOS() and reset()),
     // and never used. Release them all.
-    for (int i = advRegBins.getMinUsedBin(0); i != -1; i = advRegBins.getMinUsedBin(i+1)) {
-        if (i == freeAlignedBins.getMinNonemptyBin(i))
-            res |= freeAlignedBins.tryReleaseRegions(i, this);
-        if (i == freeLargeBins.getMinNonemptyBin(i))
-            res |= freeLargeBins.tryReleaseRegions(i, this);
-    }
+    for (int i = advRegBins.getMinUsedBin(0); i != -1; i = advRegBins.getMinUsedBin(i+1))
+        for (int n = 0; n < maxNumaNodes; n++) {
+            if (i == freeAlignedBins[n].getMinNonemptyBin(i))
+                res |= freeAlignedBins[n].tryReleaseRegions(i, this);
+            if (i == freeLargeBins[n].getMinNonemptyBin(i))
+                res |= freeLargeBins[n].tryReleaseRegions(i, this);
+        }
 
     return res;
 }
 
+size_t Backend::releasePages(void *start, size_t size)
+{
+    // memory of user pools is owned by user callbacks
+    if (inUserPool())
+        return 0;
+    size_t pageSize = hugePages.isEnabled ? hugePages.getGranularity() : extMemPool->granularity;
+    uintptr_t left = alignUp((uintptr_t)start, pageSize),
+        right = alignDown((uintptr_t)start + size, pageSize);
+    if (left >= right || decommitRawMemory((void*)left, right - left))
+        return 0;
+    return right - left;
+}
+
+size_t Backend::decay(intptr_t decayEpoch)
+{
+    if (decayEpoch < 0 || inUserPool())
+        return 0;
+    size_t released = 0;
+    for (int n = 0; n < maxNumaNodes; n++) {
+        for (int i = freeLargeBins[n].getMinNonemptyBin(0); i < freeBinsNum;
+             i = freeLargeBins[n].getMinNonemptyBin(i+1))
+            released += freeLargeBins[n].decayBlocks(i, this, decayEpoch);
+        for (int i = freeAlignedBins[n].getMinNonemptyBin(0); i < freeBinsNum;
+             i = freeAlignedBins[n].getMinNonemptyBin(i+1))
+            released += freeAlignedBins[n].decayBlocks(i, this, decayEpoch);
+    }
+    return released;
+}
+
 void Backend::IndexedBins::verify()
 {
     for (int i=0; i<freeBinsNum; i++) {
@@ -1456,8 +1650,10 @@ void Backend::verify()
 #if MALLOC_DEBUG
     scanCoalescQ(/*forceCoalescQDrop=*/false);
 
-    freeLargeBins.verify();
-    freeAlignedBins.verify();
+    for (int i=0; i<maxNumaNodes; i++) {
+        freeLargeBins[i].verify();
+        freeAlignedBins[i].verify();
+    }
 #endif // MALLOC_DEBUG
 }
 
@@ -1504,11 +1700,14 @@ void Backend::reportStat(FILE *f)
 
     fprintf(f, "\n  regions:\n");
     int regNum = regionList.reportStat(f);
-    fprintf(f, "\n%d regions, %lu KB in all regions\n  free bins:\nlarge bins: ",
+    fprintf(f, "\n%d regions, %lu KB in all regions\n  free bins:",
             regNum, totalMemSize/1024);
-    freeLargeBins.reportStat(f);
-    fprintf(f, "\naligned bins: ");
-    freeAlignedBins.reportStat(f);
+    for (int i=0; i<maxNumaNodes; i++) {
+        fprintf(f, "\nnode %d large bins: ", i);
+        freeLargeBins[i].reportStat(f);
+        fprintf(f, "\nnode %d aligned bins: ", i);
+        freeAlignedBins[i].reportStat(f);
+    }
     fprintf(f, "\n");
 }
 #endif // __TBB_MALLOC_BACKEND_STAT
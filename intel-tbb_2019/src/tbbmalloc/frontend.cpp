@@ -39,6 +39,7 @@
     #define __asm__ asm
     #endif
     #include <unistd.h> // sysconf(_SC_PAGESIZE)
+    #include <sys/time.h> // gettimeofday for the purging thread
 #elif USE_WINTHREAD
     #define GetMyTID() GetCurrentThreadId()
 #if __TBB_WIN8UI_SUPPORT
@@ -305,6 +306,12 @@ const size_t MemoryPool::defaultGranularity;
 MallocMutex  MemoryPool::memPoolListLock;
 // TODO: move huge page status to default pool, because that's its states
 HugePagesStatus hugePages;
+NumaTopology numaTopology;
+StatisticsMode statisticsMode;
+HugePageSlabsMode hugePageSlabs;
+RemoteFreeBatching remoteFreeBatching;
+AdaptiveLOCMode adaptiveLOC;
+LocalLOCSize localLOCSize;
 static bool usedBySrcIncluded = false;
 
 // Padding helpers
@@ -349,6 +356,7 @@ protected:
     friend class LifoList;
     friend void *BootStrapBlocks::allocate(MemoryPool *, size_t);
     friend bool OrphanedBlocks::cleanup(Backend*);
+    friend void OrphanedBlocks::moveToNode0(int, unsigned int);
     friend Block *MemoryPool::getEmptyBlock(size_t);
 };
 
@@ -360,11 +368,17 @@ class Block : public LocalBlockFields,
 public:
     bool empty() const { return allocatedCount==0 && !isSolidPtr(publicFreeList); }
     inline FreeObject* allocate();
+    inline unsigned allocateBatch(FreeObject **objects, unsigned num);
     inline FreeObject *allocateFromFreeList();
     inline bool emptyEnoughToUse();
     bool freeListNonNull() { return freeList; }
-    void freePublicObject(FreeObject *objectToFree);
+    void freePublicObject(FreeObject *objectToFree) { freePublicObjects(objectToFree, objectToFree); }
+    void freePublicObjects(FreeObject *head, FreeObject *tail);
+    inline void freeRemoteObject(FreeObject *objectToFree);
     inline void freeOwnObject(void *object);
+    inline void freeOwnObjects(FreeObject *head, FreeObject *tail, unsigned num);
+    inline void countObjects(intptr_t num);
+    inline void countSlab(intptr_t num);
     void reset();
     void privatizePublicFreeList( bool cleanup = false );
     void restoreBumpPtr();
@@ -467,7 +481,7 @@ public:
         MALLOC_ASSERT( mailbox == 0, ASSERT_TEXT );
     }
 
-    friend void Block::freePublicObject (FreeObject *objectToFree);
+    friend void Block::freePublicObjects(FreeObject *head, FreeObject *tail);
 };
 
 /********* End of the data structures                    **************/
@@ -544,9 +558,10 @@ public:
     bool externalCleanup(); // can be called by another thread
 };
 
+// Total size of cached objects is limited by localLOCSize.
 template<int LOW_MARK, int HIGH_MARK>
 class LocalLOCImpl {
-    static const size_t MAX_TOTAL_SIZE = 4*1024*1024;
+private:
     // TODO: can single-linked list be faster here?
     LargeMemoryBlock *head,
                      *tail; // need it when do releasing on overflow
@@ -558,7 +573,7 @@ public:
     bool externalCleanup(ExtMemoryPool *extMemPool);
 #if __TBB_MALLOC_WHITEBOX_TEST
     LocalLOCImpl() : head(NULL), tail(NULL), totalSize(0), numOfBlocks(0) {}
-    static size_t getMaxSize() { return MAX_TOTAL_SIZE; }
+    static size_t getMaxSize() { return localLOCSize.get(); }
     static const int LOC_HIGH_MARK = HIGH_MARK;
 #else
     // no ctor, object must be created in zero-initialized memory
@@ -567,13 +582,93 @@ public:
 
 typedef LocalLOCImpl<8,32> LocalLOC; // set production code parameters
 
+/*
+ * Not yet used slabs of a huge page dedicated to a group of bins of a thread.
+ * Slabs are taken sequentially, it keeps the group in one huge page.
+ */
+/*
+ * Not yet used slabs of a huge page dedicated to a thread. The slabs are taken
+ * by the owner, but can be returned to the backend by any thread, so the group
+ * is a single word: the first unused slab, or 0. The group ends at the huge
+ * page boundary.
+ */
+struct HugePageSlabGroup {
+    intptr_t next;
+
+    // called by the owner only
+    void set(BlockI *slabs) {
+        MALLOC_ASSERT(!next && !isAligned(slabs, HUGE_PAGE_SIZE), ASSERT_TEXT);
+        FencedStore(next, (intptr_t)slabs);
+    }
+    // called by the owner only
+    Block *get() {
+        for (;;) {
+            intptr_t curr = FencedLoad(next);
+            if (!curr)
+                return NULL;
+            intptr_t following = curr + slabSize;
+            if (isAligned((void*)following, HUGE_PAGE_SIZE))
+                following = 0;
+            if (AtomicCompareExchange(next, following, curr) == curr)
+                return (Block*)curr;
+        }
+    }
+    // can be called by another thread
+    bool release(Backend *backend) {
+        uintptr_t curr = AtomicFetchStore(&next, 0);
+        if (!curr)
+            return false;
+        backend->putSlabBlocks((BlockI*)curr,
+                               (alignDown(curr, HUGE_PAGE_SIZE) + HUGE_PAGE_SIZE - curr)/slabSize);
+        return true;
+    }
+};
+
+const uint32_t numSlabGroups = 3;
+
+/* Chain of objects to be released from the same block */
+struct BlockFreeChain {
+    Block      *block;
+    FreeObject *head,
+               *tail;
+    unsigned    num;
+
+    void flush() {
+        if (block->isOwnedByCurrentThread())
+            block->freeOwnObjects(head, tail, num);
+        else
+            block->freePublicObjects(head, tail);
+        block = NULL;
+    }
+};
+
+/*
+ * Objects from blocks of other threads released by this thread. Objects
+ * are linked in chains by block, and a chain is published to its block
+ * at once, so cache lines of the owner are touched once per chain.
+ */
+class RemoteFreeBuffer {
+private:
+    static const unsigned chainsNum = 32;
+    BlockFreeChain chains[chainsNum];
+    intptr_t       objects;  // in all chains
+public:
+    // allocated in zero-initialized memory
+    inline void put(Block *block, FreeObject *object, intptr_t batchSize);
+    bool flush();
+};
+
 class TLSData : public TLSRemote {
     MemoryPool   *memPool;
 public:
     Bin           bin[numBlockBinLimit];
     FreeBlockPool freeSlabBlocks;
     LocalLOC      lloc;
+    HugePageSlabGroup slabGroups[numSlabGroups]; // used in huge page slabs mode
+    RemoteFreeBuffer remoteFrees;
     unsigned      currCacheIdx;
+    intptr_t      bytesToSample; // until the next allocation to be profiled
+    bool          inProfiler;    // to not sample allocations done by the profiler
 private:
     bool unused;
 public:
@@ -581,11 +676,7 @@ public:
     MemoryPool *getMemPool() const { return memPool; }
     Bin* getAllocationBin(size_t size);
     void release(MemoryPool *mPool);
-    bool externalCleanup(ExtMemoryPool *mPool, bool cleanOnlyUnused) {
-        if (!unused && cleanOnlyUnused) return false;
-        // both cleanups to be called, and the order is not important
-        return lloc.externalCleanup(mPool) | freeSlabBlocks.externalCleanup();
-    }
+    bool externalCleanup(ExtMemoryPool *mPool, bool cleanOnlyUnused);
     bool cleanUnusedActiveBlocks(Backend *backend, bool userPool);
     void markUsed() { unused = false; } // called by owner when TLS touched
     void markUnused() { unused =  true; } // can be called by not owner thread
@@ -608,6 +699,17 @@ TLSData *TLSKey::createTLS(MemoryPool *memPool, Backend *backend)
     return tls;
 }
 
+bool TLSData::externalCleanup(ExtMemoryPool *mPool, bool cleanOnlyUnused)
+{
+    if (!unused && cleanOnlyUnused) return false;
+    // all cleanups to be called, and the order is not important
+    bool released = lloc.externalCleanup(mPool) | freeSlabBlocks.externalCleanup();
+    // not used parts of dedicated huge pages are available for everyone
+    for (unsigned i = 0; i < numSlabGroups; i++)
+        released |= slabGroups[i].release(&mPool->backend);
+    return released;
+}
+
 bool TLSData::cleanUnusedActiveBlocks(Backend *backend, bool userPool)
 {
     bool released = false;
@@ -616,6 +718,7 @@ bool TLSData::cleanUnusedActiveBlocks(Backend *backend, bool userPool)
         if (bin[i].activeBlockUnused()) {
             Block *block = bin[i].getActiveBlock();
             bin[i].outofTLSBin(block);
+            block->countSlab(-1);
             // slab blocks in user's pools do not have valid backRefIdx
             if (!userPool)
                 removeBackRef(*(block->getBackRefIdx()));
@@ -653,6 +756,7 @@ void AllLocalCaches::unregisterThread(TLSRemote *tls)
 {
     MallocMutex::scoped_lock lock(listLock);
     MALLOC_ASSERT(head, "Can't unregister thread: no threads are registered.");
+    unregisteredStat.add(tls->stat);
     if (head == tls)
         head = tls->next;
     if (tls->next)
@@ -675,6 +779,15 @@ bool AllLocalCaches::cleanup(ExtMemoryPool *extPool, bool cleanOnlyUnused)
     return total;
 }
 
+void AllLocalCaches::collectStatistics(ThreadStatistics *total)
+{
+    MallocMutex::scoped_lock lock(listLock);
+
+    total->add(unregisteredStat);
+    for (TLSRemote *curr=head; curr; curr=curr->next)
+        total->add(curr->stat);
+}
+
 void AllLocalCaches::markUnused()
 {
     bool locked;
@@ -735,115 +848,87 @@ ALWAYSINLINE( bool isMallocInitialized() );
 /********* Now some rough utility code to deal with indexing the size bins. **************/
 
 /*
- * Given a number return the highest non-zero bit in it. It is intended to work with 32-bit values only.
- * Moreover, on IPF, for sake of simplicity and performance, it is narrowed to only serve for 64 to 1023.
- * This is enough for current algorithm of distribution of sizes among bins.
- * __TBB_Log2 is not used here to minimize dependencies on TBB specific sources.
+ * Sizes of all bins are multiples of 8, so the bin index for every size below
+ * minLargeObjectSize is precomputed into a table indexed by (size-1)/8.
+ * The table is built by the compiler from constant expressions, so it resides
+ * in read-only data and can be used before any initialization.
  */
-#if _WIN64 && _MSC_VER>=1400 && !__INTEL_COMPILER
-extern "C" unsigned char _BitScanReverse( unsigned long* i, unsigned long w );
-#pragma intrinsic(_BitScanReverse)
-#endif
-static inline unsigned int highestBitPos(unsigned int n)
-{
-    MALLOC_ASSERT( n>=64 && n<1024, ASSERT_TEXT ); // only needed for bsr array lookup, but always true
-    unsigned int pos;
-#if __ARCH_x86_32||__ARCH_x86_64
+const uint32_t sizeTableGranularityShift = 3;
+
+/* For 64-bit malloc, 16 byte alignment is needed except for bin 0,
+   so bins 2,4,6 (24,40,56 bytes) are not used */
+#define SMALL_OBJECT_INDEX(s) \
+    ( (sizeof(size_t)<=4 || !(((s)-1)>>3))? ((s)-1)>>3 : (((s)-1)>>3)|1 )
+/* 4 bins between each couple of powers of 2, order is log2 of the group end */
+#define SEGREGATED_ORDER(s) \
+    ( ((s)-1)>=512? 9 : ((s)-1)>=256? 8 : ((s)-1)>=128? 7 : 6 )
+#define SEGREGATED_OBJECT_INDEX(s) \
+    ( minSegregatedObjectIndex - (4*6) - 4 + (4*SEGREGATED_ORDER(s)) + (((s)-1)>>(SEGREGATED_ORDER(s)-2)) )
+#define FITTING_OBJECT_INDEX(s) \
+    ( (s)<=fittingSize1? minFittingIndex   : (s)<=fittingSize2? minFittingIndex+1 : \
+      (s)<=fittingSize3? minFittingIndex+2 : (s)<=fittingSize4? minFittingIndex+3 : \
+      (s)<=fittingSize5? minFittingIndex+4 : 0xFF /* large object, not used */ )
+#define SIZE_TO_INDEX(s) \
+    ( (s)<=maxSmallObjectSize? SMALL_OBJECT_INDEX(s) : \
+      (s)<=maxSegregatedObjectSize? SEGREGATED_OBJECT_INDEX(s) : FITTING_OBJECT_INDEX(s) )
+
+// i-th entry serves sizes (8*i;8*i+8]
+#define SIZE_INDEX_1(i)    (uint8_t)SIZE_TO_INDEX(((i)+1)<<sizeTableGranularityShift),
+#define SIZE_INDEX_4(i)    SIZE_INDEX_1(i)    SIZE_INDEX_1((i)+1)     SIZE_INDEX_1((i)+2)     SIZE_INDEX_1((i)+3)
+#define SIZE_INDEX_16(i)   SIZE_INDEX_4(i)    SIZE_INDEX_4((i)+4)     SIZE_INDEX_4((i)+8)     SIZE_INDEX_4((i)+12)
+#define SIZE_INDEX_64(i)   SIZE_INDEX_16(i)   SIZE_INDEX_16((i)+16)   SIZE_INDEX_16((i)+32)   SIZE_INDEX_16((i)+48)
+#define SIZE_INDEX_256(i)  SIZE_INDEX_64(i)   SIZE_INDEX_64((i)+64)   SIZE_INDEX_64((i)+128)  SIZE_INDEX_64((i)+192)
+#define SIZE_INDEX_1024(i) SIZE_INDEX_256(i)  SIZE_INDEX_256((i)+256) SIZE_INDEX_256((i)+512) SIZE_INDEX_256((i)+768)
+
+static const uint8_t sizeToIndexTable[] = { SIZE_INDEX_1024(0) };
+MALLOC_STATIC_ASSERT(((minLargeObjectSize-2)>>sizeTableGranularityShift) <
+                     sizeof(sizeToIndexTable)/sizeof(sizeToIndexTable[0]),
+                     "The table must cover all sizes of small objects.");
+
+// objects size for bins 0-7 is (index+1)*8, for group g of segregated bins
+// (64<<g) + (k+1)*(16<<g), where k is the bin position inside the group
+#define SEGREGATED_OBJECT_SIZE(g,k) ( (64<<(g)) + ((k)+1)*(16<<(g)) )
+#define SEGREGATED_GROUP_SIZES(g) SEGREGATED_OBJECT_SIZE(g,0), SEGREGATED_OBJECT_SIZE(g,1), \
+                                  SEGREGATED_OBJECT_SIZE(g,2), SEGREGATED_OBJECT_SIZE(g,3)
+
+static const uint16_t indexToObjectSizeTable[numBlockBins] = {
+    8, 16, 24, 32, 40, 48, 56, 64,
+    SEGREGATED_GROUP_SIZES(0), SEGREGATED_GROUP_SIZES(1),
+    SEGREGATED_GROUP_SIZES(2), SEGREGATED_GROUP_SIZES(3),
+    fittingSize1, fittingSize2, fittingSize3, fittingSize4, fittingSize5
+};
 
-# if __linux__||__APPLE__||__FreeBSD__||__NetBSD__||__OpenBSD__||__sun||__MINGW32__
-    __asm__ ("bsr %1,%0" : "=r"(pos) : "r"(n));
-# elif (_WIN32 && (!_WIN64 || __INTEL_COMPILER))
-    __asm
-    {
-        bsr eax, n
-        mov pos, eax
-    }
-# elif _WIN64 && _MSC_VER>=1400
-    _BitScanReverse((unsigned long*)&pos, (unsigned long)n);
-# else
-#   error highestBitPos() not implemented for this platform
-# endif
-#elif __arm__
-    __asm__ __volatile__
-    (
-       "clz %0, %1\n"
-       "rsb %0, %0, %2\n"
-       :"=r" (pos) :"r" (n), "I" (31)
-    );
-#else
-    static unsigned int bsr[16] = {0/*N/A*/,6,7,7,8,8,8,8,9,9,9,9,9,9,9,9};
-    pos = bsr[ n>>6 ];
-#endif /* __ARCH_* */
-    return pos;
-}
+#undef SEGREGATED_GROUP_SIZES
+#undef SEGREGATED_OBJECT_SIZE
+#undef SIZE_INDEX_1024
+#undef SIZE_INDEX_256
+#undef SIZE_INDEX_64
+#undef SIZE_INDEX_16
+#undef SIZE_INDEX_4
+#undef SIZE_INDEX_1
+#undef SIZE_TO_INDEX
+#undef FITTING_OBJECT_INDEX
+#undef SEGREGATED_OBJECT_INDEX
+#undef SEGREGATED_ORDER
+#undef SMALL_OBJECT_INDEX
 
-template<bool Is32Bit>
-unsigned int getSmallObjectIndex(unsigned int size)
-{
-    return (size-1)>>3;
-}
-template<>
-unsigned int getSmallObjectIndex</*Is32Bit=*/false>(unsigned int size)
+static unsigned int getIndex (unsigned int size)
 {
-    // For 64-bit malloc, 16 byte alignment is needed except for bin 0.
-    unsigned int result = (size-1)>>3;
-    if (result) result |= 1; // 0,1,3,5,7; bins 2,4,6 are not aligned to 16 bytes
-    return result;
-}
-/*
- * Depending on indexRequest, for a given size return either the index into the bin
- * for objects of this size, or the actual size of objects in this bin.
- */
-template<bool indexRequest>
-static unsigned int getIndexOrObjectSize (unsigned int size)
-{
-    if (size <= maxSmallObjectSize) { // selection from 8/16/24/32/40/48/56/64
-        unsigned int index = getSmallObjectIndex</*Is32Bit=*/(sizeof(size_t)<=4)>( size );
-         /* Bin 0 is for 8 bytes, bin 1 is for 16, and so forth */
-        return indexRequest ? index : (index+1)<<3;
-    }
-    else if (size <= maxSegregatedObjectSize ) { // 80/96/112/128 / 160/192/224/256 / 320/384/448/512 / 640/768/896/1024
-        unsigned int order = highestBitPos(size-1); // which group of bin sizes?
-        MALLOC_ASSERT( 6<=order && order<=9, ASSERT_TEXT );
-        if (indexRequest)
-            return minSegregatedObjectIndex - (4*6) - 4 + (4*order) + ((size-1)>>(order-2));
-        else {
-            unsigned int alignment = 128 >> (9-order); // alignment in the group
-            MALLOC_ASSERT( alignment==16 || alignment==32 || alignment==64 || alignment==128, ASSERT_TEXT );
-            return alignUp(size,alignment);
-        }
-    }
-    else {
-        if( size <= fittingSize3 ) {
-            if( size <= fittingSize2 ) {
-                if( size <= fittingSize1 )
-                    return indexRequest ? minFittingIndex : fittingSize1;
-                else
-                    return indexRequest ? minFittingIndex+1 : fittingSize2;
-            } else
-                return indexRequest ? minFittingIndex+2 : fittingSize3;
-        } else {
-            if( size <= fittingSize5 ) {
-                if( size <= fittingSize4 )
-                    return indexRequest ? minFittingIndex+3 : fittingSize4;
-                else
-                    return indexRequest ? minFittingIndex+4 : fittingSize5;
-            } else {
-                MALLOC_ASSERT( 0,ASSERT_TEXT ); // this should not happen
-                return ~0U;
-            }
-        }
-    }
+    MALLOC_ASSERT( size && size < minLargeObjectSize, ASSERT_TEXT );
+    return sizeToIndexTable[(size-1)>>sizeTableGranularityShift];
 }
 
-static unsigned int getIndex (unsigned int size)
+static unsigned int getObjectSize (unsigned int size)
 {
-    return getIndexOrObjectSize</*indexRequest=*/true>(size);
+    return indexToObjectSizeTable[getIndex(size)];
 }
 
-static unsigned int getObjectSize (unsigned int size)
+/*
+ * Group of bins that share huge pages in huge page slabs mode.
+ */
+static unsigned int getSlabGroup (unsigned int size)
 {
-    return getIndexOrObjectSize</*indexRequest=*/false>(size);
+    return size <= maxSmallObjectSize? 0 : size <= maxSegregatedObjectSize? 1 : 2;
 }
 
 
@@ -984,17 +1069,42 @@ inline Bin* TLSData::getAllocationBin(size_t size)
 Block *MemoryPool::getEmptyBlock(size_t size)
 {
     TLSData* tls = extMemPool.tlsPointerKey.getThreadMallocTLS();
+    // user pools manage their memory, so huge pages are not dedicated there
+    HugePageSlabGroup *group = tls && hugePageSlabs.get() && !extMemPool.userPool()?
+        tls->slabGroups + getSlabGroup(size) : NULL;
+    // slabs of the group are preferred over cached ones, to keep the group compact
+    Block *result = group? group->get() : NULL;
+    FreeBlockPool::ResOfGet resOfGet(NULL, false);
+    bool newSlab = result;
+
     // try to use per-thread cache, if TLS available
-    FreeBlockPool::ResOfGet resOfGet = tls?
-        tls->freeSlabBlocks.getBlock() : FreeBlockPool::ResOfGet(NULL, false);
-    Block *result = resOfGet.block;
+    if (!result && tls) {
+        resOfGet = tls->freeSlabBlocks.getBlock();
+        result = resOfGet.block;
+    }
+    if (!result && group) { // dedicate one more huge page to the group
+        if (BlockI *slabs = extMemPool.backend.getHugePageSlabs()) {
+            // the first slab is taken at once, as the group can be released by another thread
+            result = (Block*)slabs;
+            group->set((BlockI*)((uintptr_t)slabs + slabSize));
+            if (statisticsMode.get())
+                AtomicIncrement(extMemPool.stat.hugePageSlabGroups);
+            newSlab = true;
+        }
+    }
+    if (newSlab && statisticsMode.get())
+        AtomicIncrement(extMemPool.stat.groupedSlabs);
 
-    if (!result) { // not found in local cache, asks backend for slabs
-        int num = resOfGet.lastAccMiss? Backend::numOfSlabAllocOnMiss : 1;
+    if (!result || newSlab) { // not found in local cache, asks backend for slabs
+        int num = resOfGet.lastAccMiss && !newSlab? Backend::numOfSlabAllocOnMiss : 1;
         BackRefIdx backRefIdx[Backend::numOfSlabAllocOnMiss];
 
-        result = static_cast<Block*>(extMemPool.backend.getSlabBlock(num));
-        if (!result) return NULL;
+        if (!result) {
+            result = static_cast<Block*>(extMemPool.backend.getSlabBlock(num));
+            if (!result) return NULL;
+            if (statisticsMode.get())
+                AtomicAdd(extMemPool.stat.ungroupedSlabs, num);
+        }
 
         if (!extMemPool.userPool())
             for (int i=0; i<num; i++) {
@@ -1037,6 +1147,9 @@ Block *MemoryPool::getEmptyBlock(size_t size)
 void MemoryPool::returnEmptyBlock(Block *block, bool poolTheBlock)
 {
     block->reset();
+    // keep only blocks of own node in per-thread pool
+    if (poolTheBlock && numaTopology.isEnabled)
+        poolTheBlock = block->getNumaNode() == extMemPool.backend.currentNumaNode();
     if (poolTheBlock) {
         extMemPool.tlsPointerKey.getThreadMallocTLS()->freeSlabBlocks.returnBlock(block);
     }
@@ -1302,11 +1415,29 @@ void Block::restoreBumpPtr()
     isFull = 0;
 }
 
+/* Account objects allocated (num>0) or released (num<0) for statistics */
+void Block::countObjects(intptr_t num)
+{
+    if (!statisticsMode.get())
+        return;
+    if (tlsPtr)
+        tlsPtr->stat.slabObjects[getIndex(objectSize)] += num;
+    else // orphaned block is cleaned up by a non-owner
+        AtomicAdd(poolPtr->extMemPool.stat.slabObjects[getIndex(objectSize)], num);
+}
+
+void Block::countSlab(intptr_t num)
+{
+    if (statisticsMode.get())
+        AtomicAdd(poolPtr->extMemPool.stat.slabBlocks[getIndex(objectSize)], num);
+}
+
 void Block::freeOwnObject(void *object)
 {
     tlsPtr->markUsed();
     allocatedCount--;
     MALLOC_ASSERT( allocatedCount < (slabSize-sizeof(Block))/objectSize, ASSERT_TEXT );
+    countObjects(-1);
 #if COLLECT_STATISTICS
     // Note that getAllocationBin is not called on the hottest path with statistics off.
     if (tlsPtr->getAllocationBin(objectSize)->getActiveBlock() != this)
@@ -1331,7 +1462,74 @@ void Block::freeOwnObject(void *object)
     }
 }
 
-void Block::freePublicObject (FreeObject *objectToFree)
+/* Release num objects of the block linked from head to tail at once */
+void Block::freeOwnObjects(FreeObject *head, FreeObject *tail, unsigned num)
+{
+    tlsPtr->markUsed();
+    MALLOC_ASSERT( allocatedCount >= num, ASSERT_TEXT );
+    allocatedCount -= num;
+    countObjects(-(intptr_t)num);
+    if (empty()) {
+        // as in freeOwnObject, the bump pointer is restored, so the chain is not needed;
+        // unlike single object releasing, full slab can become empty at once
+        isFull = false;
+        tlsPtr->getAllocationBin(objectSize)->processLessUsedBlock(poolPtr, this);
+    } else {
+        tail->next = freeList;
+        freeList = head;
+
+        if (isFull && emptyEnoughToUse())
+            tlsPtr->getAllocationBin(objectSize)->moveBlockToFront(this);
+    }
+}
+
+/* Release object of a block owned by other thread, or orphaned one.
+   It's buffered by the current thread when remote free batching is on. */
+void Block::freeRemoteObject(FreeObject *objectToFree)
+{
+    if (intptr_t batchSize = remoteFreeBatching.get())
+        if (TLSData *tls = poolPtr->extMemPool.tlsPointerKey.getThreadMallocTLS()) {
+            tls->remoteFrees.put(this, objectToFree, batchSize);
+            return;
+        }
+    freePublicObject(objectToFree);
+}
+
+void RemoteFreeBuffer::put(Block *block, FreeObject *object, intptr_t batchSize)
+{
+    // a chain per slot, objects of another block in the slot are flushed
+    BlockFreeChain &chain = chains[(uintptr_t)block/slabSize % chainsNum];
+    if (chain.block == block) {
+        object->next = chain.head;
+        chain.head = object;
+        chain.num++;
+    } else {
+        if (chain.block) {
+            objects -= chain.num;
+            chain.flush();
+        }
+        chain.block = block;
+        chain.head = chain.tail = object;
+        chain.num = 1;
+    }
+    if (++objects >= batchSize)
+        flush();
+}
+
+bool RemoteFreeBuffer::flush()
+{
+    if (!objects)
+        return false;
+    for (unsigned i=0; i<chainsNum; i++)
+        if (chains[i].block)
+            chains[i].flush();
+    objects = 0;
+    return true;
+}
+
+/* Put the chain of objects linked from head to tail to the public free list.
+   The whole chain is published with single atomic operation. */
+void Block::freePublicObjects(FreeObject *head, FreeObject *tail)
 {
     FreeObject *localPublicFreeList;
 
@@ -1339,18 +1537,18 @@ void Block::freePublicObject (FreeObject *objectToFree)
 #if FREELIST_NONBLOCKING
     FreeObject *temp = publicFreeList;
     do {
-        localPublicFreeList = objectToFree->next = temp;
+        localPublicFreeList = tail->next = temp;
         temp = (FreeObject*)AtomicCompareExchange(
                                 (intptr_t&)publicFreeList,
-                                (intptr_t)objectToFree, (intptr_t)localPublicFreeList );
+                                (intptr_t)head, (intptr_t)localPublicFreeList );
         // no backoff necessary because trying to make change, not waiting for a change
     } while( temp != localPublicFreeList );
 #else
     STAT_increment(getThreadId(), ThreadCommonCounters, lockPublicFreeList);
     {
         MallocMutex::scoped_lock scoped_cs(publicFreeListLock);
-        localPublicFreeList = objectToFree->next = publicFreeList;
-        publicFreeList = objectToFree;
+        localPublicFreeList = tail->next = publicFreeList;
+        publicFreeList = head;
     }
 #endif
 
@@ -1405,6 +1603,7 @@ void Block::privatizePublicFreeList( bool cleanup )
     MALLOC_ASSERT( localPublicFreeList==temp, ASSERT_TEXT );
     if( isSolidPtr(temp) ) {
         MALLOC_ASSERT( allocatedCount <= (slabSize-sizeof(Block))/objectSize, ASSERT_TEXT );
+        const intptr_t prevCount = allocatedCount;
         /* other threads did not change the counter freeing our blocks */
         allocatedCount--;
         while( isSolidPtr(temp->next) ){ // the list will end with either NULL or UNUSABLE
@@ -1412,6 +1611,7 @@ void Block::privatizePublicFreeList( bool cleanup )
             allocatedCount--;
             MALLOC_ASSERT( allocatedCount < (slabSize-sizeof(Block))/objectSize, ASSERT_TEXT );
         }
+        countObjects(allocatedCount - prevCount);
         /* merge with local freeList */
         temp->next = freeList;
         freeList = localPublicFreeList;
@@ -1513,6 +1713,8 @@ void Block::initEmptyBlock(TLSData *tls, size_t size)
     // each block should have the address where the head of the list of "privatizable" blocks is kept
     // the only exception is a block for boot strap which is initialized when TLS is yet NULL
     nextPrivatizable = tls? (Block*)(tls->bin + index) : NULL;
+    if (tls) // boot strap blocks are not counted
+        countSlab(1);
     TRACEF(( "[ScalableMalloc trace] Empty block %p is initialized, owner is %ld, objectSize is %d, bumpPtr is %p\n",
              this, tlsPtr ? getThreadId() : -1, objectSize, bumpPtr ));
 }
@@ -1521,34 +1723,81 @@ Block *OrphanedBlocks::get(TLSData *tls, unsigned int size)
 {
     // TODO: try to use index from getAllocationBin
     unsigned int index = getIndex(size);
-    Block *block = bins[index].pop();
+    LifoList *bin = bins[tls->getMemPool()->extMemPool.backend.currentNumaNode()] + index;
+    Block *block = bin->pop();
     if (block) {
-        MALLOC_ITT_SYNC_ACQUIRED(bins+index);
+        MALLOC_ITT_SYNC_ACQUIRED(bin);
         block->privatizeOrphaned(tls, index);
     }
     return block;
 }
 
+// Used when no memory is available on the thread's node.
+Block *OrphanedBlocks::getFromOtherNodes(TLSData *tls, unsigned int size)
+{
+    unsigned int index = getIndex(size);
+    int node = tls->getMemPool()->extMemPool.backend.currentNumaNode();
+    for (int i=1; i<maxNumaNodes; i++) {
+        LifoList *bin = bins[(node+i) % maxNumaNodes] + index;
+        if (Block *block = bin->pop()) {
+            MALLOC_ITT_SYNC_ACQUIRED(bin);
+            block->privatizeOrphaned(tls, index);
+            return block;
+        }
+    }
+    return NULL;
+}
+
 void OrphanedBlocks::put(intptr_t binTag, Block *block)
 {
     unsigned int index = getIndex(block->getSize());
+    // w/o NUMA mode all threads look for orphaned blocks at node 0
+    int node = numaTopology.isEnabled? block->getNumaNode() : 0;
+    LifoList *bin = bins[node] + index;
     block->shareOrphaned(binTag, index);
-    MALLOC_ITT_SYNC_RELEASING(bins+index);
-    bins[index].push(block);
+    MALLOC_ITT_SYNC_RELEASING(bin);
+    bin->push(block);
+    // The mode can be switched off meanwhile. Then either mergeNodes() grabs the bin
+    // after the push, or the mode is seen off here, as both take the lock of the bin.
+    if (node && !numaTopology.isEnabled)
+        moveToNode0(node, index);
+}
+
+void OrphanedBlocks::moveToNode0(int node, unsigned int index)
+{
+    LifoList *bin = bins[node] + index;
+    Block *block = bin->grab();
+    MALLOC_ITT_SYNC_ACQUIRED(bin);
+    while (block) {
+        Block *next = block->next;
+        MALLOC_ITT_SYNC_RELEASING(bins[0] + index);
+        bins[0][index].push(block);
+        block = next;
+    }
+}
+
+void OrphanedBlocks::mergeNodes()
+{
+    for (int n=1; n<maxNumaNodes; n++)
+        for (uint32_t i=0; i<numBlockBinLimit; i++)
+            moveToNode0(n, i);
 }
 
 void OrphanedBlocks::reset()
 {
-    for (uint32_t i=0; i<numBlockBinLimit; i++)
-        new (bins+i) LifoList();
+    for (int n=0; n<maxNumaNodes; n++)
+        for (uint32_t i=0; i<numBlockBinLimit; i++)
+            new (bins[n]+i) LifoList();
 }
 
 bool OrphanedBlocks::cleanup(Backend* backend)
 {
     bool result = false;
+    for (int n=0; n<maxNumaNodes; n++)
     for (uint32_t i=0; i<numBlockBinLimit; i++) {
-        Block* block = bins[i].grab();
-        MALLOC_ITT_SYNC_ACQUIRED(bins+i);
+        LifoList *bin = bins[n] + i;
+        Block* block = bin->grab();
+        MALLOC_ITT_SYNC_ACQUIRED(bin);
         while (block) {
             Block* next = block->next;
             block->privatizePublicFreeList( /*cleanup=*/true );
@@ -1560,8 +1809,8 @@ bool OrphanedBlocks::cleanup(Backend* backend)
                 backend->putSlabBlock(block);
                 result = true;
             } else {
-                MALLOC_ITT_SYNC_RELEASING(bins+i);
-                bins[i].push(block);
+                MALLOC_ITT_SYNC_RELEASING(bin);
+                bin->push(block);
             }
             block = next;
         }
@@ -1636,8 +1885,10 @@ void Block::reset()
     // it is caller's responsibility to ensure no data is lost before calling this
     MALLOC_ASSERT( allocatedCount==0, ASSERT_TEXT );
     MALLOC_ASSERT( !isSolidPtr(publicFreeList), ASSERT_TEXT );
-    if (!isStartupAllocObject())
+    if (!isStartupAllocObject()) {
         STAT_increment(getThreadId(), getIndex(objectSize), freeBlockBack);
+        countSlab(-1);
+    }
 
     cleanBlockHeader();
 
@@ -1700,6 +1951,7 @@ void TLSData::release(MemoryPool *mPool)
 {
     mPool->extMemPool.allLocalCaches.unregisterThread(this);
     externalCleanup(&mPool->extMemPool, /*cleanOnlyUnused=*/false);
+    remoteFrees.flush();
 
     for (unsigned index = 0; index < numBlockBins; index++) {
         Block *activeBlk = bin[index].getActiveBlock();
@@ -1881,18 +2133,125 @@ static char VersionString[] = "\0" TBBMALLOC_VERSION_STRINGS;
 void AllocControlledMode::initReadEnv(const char *envName, intptr_t defaultVal)
 {
     if (!setDone) {
+        val = defaultVal;
 #if !__TBB_WIN8UI_SUPPORT
-    // TODO: use strtol to get the actual value of the envirable
-        const char *envVal = getenv(envName);
-        if (envVal && !strcmp(envVal, "1"))
-            val = 1;
-        else
+        if (const char *envVal = getenv(envName)) {
+            const int savedErrno = errno;
+            char *end;
+            errno = 0;
+            long parsed = strtol(envVal, &end, 10);
+            // ignore malformed, out of range and negative values
+            if (end != envVal && !*end && !errno && parsed >= 0)
+                val = parsed;
+            errno = savedErrno;
+        }
 #endif
-            val = defaultVal;
         setDone = true;
     }
 }
 
+void NumaTopology::parseSystemTopology()
+{
+    int foundNodes = 0;
+#if __linux__
+    // node ids can be sparse, so scan a reasonable range;
+    // missing files must not change errno seen by user
+    const int maxScannedNodes = 64;
+    const int savedErrno = errno;
+    for (int node = 0; node < maxScannedNodes; node++) {
+        char fileName[64], cpuList[256];
+        sprintf(fileName, "/sys/devices/system/node/node%d/cpulist", node);
+        FILE *f = fopen(fileName, "r");
+        if (!f)
+            continue;
+        const bool listRead = fgets(cpuList, sizeof(cpuList), f);
+        fclose(f);
+        if (!listRead)
+            continue;
+        const uint8_t foldedNode = foundNodes % maxNumaNodes;
+        foundNodes++;
+        // the list looks like "0-7,16-23"
+        for (char *p = cpuList; *p >= '0' && *p <= '9'; ) {
+            char *end;
+            unsigned long first = strtoul(p, &end, 10), last = first;
+            if (*end == '-')
+                last = strtoul(end+1, &end, 10);
+            for (unsigned long cpu = first; cpu <= last && cpu < (unsigned long)maxCpus; cpu++)
+                cpuToNode[cpu] = foldedNode;
+            p = *end == ',' ? end+1 : end;
+        }
+    }
+    errno = savedErrno;
+#endif
+    nodesNum = !foundNodes? 1 : min(foundNodes, maxNumaNodes);
+}
+
+bool NumaTopology::initFakeTopology(int fakeNodesNum)
+{
+#if __linux__
+    if (fakeNodesNum < 2 || fakeNodesNum > maxNumaNodes)
+        return false;
+    if (!isFake && pthread_key_create(&fakeNodeKey, NULL))
+        return false;
+    nodesNum = fakeNodesNum;
+    isFake = true;
+    return true;
+#else
+    suppress_unused_warning(fakeNodesNum);
+    return false;
+#endif
+}
+
+void NumaTopology::init()
+{
+    parseSystemTopology();
+#if !__TBB_WIN8UI_SUPPORT
+    if (const char *fakeNodes = getenv("TBB_MALLOC_NUMA_FAKE_NODES"))
+        initFakeTopology(strtol(fakeNodes, NULL, 10));
+#endif
+    MallocMutex::scoped_lock lock(setModeLock);
+    requestedMode.initReadEnv("TBB_MALLOC_USE_NUMA", 0);
+    isEnabled = nodesNum > 1 && requestedMode.get();
+}
+
+void NumaTopology::setMode(intptr_t newVal)
+{
+    MallocMutex::scoped_lock lock(setModeLock);
+    requestedMode.set(newVal);
+    isEnabled = nodesNum > 1 && newVal;
+}
+
+void NumaTopology::reset()
+{
+#if __linux__
+    if (isFake)
+        pthread_key_delete(fakeNodeKey);
+#endif
+    nodesNum = 0;
+    fakeNodesAssigned = 0;
+    isFake = isEnabled = false;
+}
+
+int NumaTopology::detectCurrentNode()
+{
+#if __linux__
+    if (isFake) {
+        intptr_t node = (intptr_t)pthread_getspecific(fakeNodeKey);
+        if (!node) {
+            RecursiveMallocCallProtector scoped;
+            // 1st call from this thread, assign the next fake node (stored +1)
+            node = (AtomicIncrement(fakeNodesAssigned)-1) % nodesNum + 1;
+            pthread_setspecific(fakeNodeKey, (void*)node);
+        }
+        return node-1;
+    }
+    int cpu = sched_getcpu();
+    return 0 <= cpu && cpu < maxCpus? cpuToNode[cpu] : 0;
+#else
+    return 0;
+#endif
+}
+
 #if USE_PTHREAD && (__TBB_SOURCE_DIRECTLY_INCLUDED || __TBB_USE_DLOPEN_REENTRANCY_WORKAROUND)
 
 /* Decrease race interval between dynamic library unloading and pthread key
@@ -1959,6 +2318,170 @@ extern "C" void MallocInitializeITT() {
 
 void MemoryPool::initDefaultPool() {
     hugePages.init();
+    numaTopology.init();
+    statisticsMode.init("TBB_MALLOC_COLLECT_STATISTICS");
+    hugePageSlabs.init("TBB_MALLOC_HUGE_PAGE_SLABS");
+    remoteFreeBatching.init("TBB_MALLOC_REMOTE_FREE_BATCH");
+    adaptiveLOC.init("TBB_MALLOC_ADAPTIVE_LOC");
+    localLOCSize.init("TBB_MALLOC_LOCAL_LOC_SIZE");
+    memoryDecay.init();
+}
+
+/*********** Background memory decay **********/
+
+MemoryDecay memoryDecay;
+
+#if USE_PTHREAD
+/* The thread sleeps on the condition variable while decay time is 0,
+   otherwise it wakes up twice per decay time and does a purging pass.
+   Note that a child process after fork() has no purging thread,
+   until decay time is set again.
+*/
+class PurgingThread {
+    pthread_t       thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    bool            started,
+                    stopRequested,
+                    atForkRegistered;
+
+    static void *threadRoutine(void *arg) {
+        static_cast<PurgingThread*>(arg)->run();
+        return NULL;
+    }
+    static void forkChild();
+    void run();
+public:
+    // The methods must be called under MemoryDecay::setTimeLock
+    bool start();
+    void wakeUp();
+    void stop();
+};
+
+// zero-initialized, so no ctor needed
+static PurgingThread purgingThread;
+
+void PurgingThread::run()
+{
+    pthread_mutex_lock(&mutex);
+    while (!stopRequested) {
+        intptr_t decayTime = FencedLoad(memoryDecay.decayTime);
+        if (!decayTime) {
+            pthread_cond_wait(&cond, &mutex);
+            continue;
+        }
+        // blocks are decayed after 2-3 passes, see LargeObjectCache::decay()
+        const intptr_t periodMs = decayTime > 1 ? decayTime/2 : 1;
+        struct timeval now;
+        gettimeofday(&now, NULL);
+        struct timespec deadline;
+        long long nsec = now.tv_usec*1000LL + (periodMs%1000)*1000000LL;
+        deadline.tv_sec = now.tv_sec + periodMs/1000 + nsec/1000000000LL;
+        deadline.tv_nsec = nsec%1000000000LL;
+        if (pthread_cond_timedwait(&cond, &mutex, &deadline) == ETIMEDOUT) {
+            intptr_t epoch = memoryDecay.epoch+1;
+            FencedStore(memoryDecay.epoch, epoch);
+            pthread_mutex_unlock(&mutex);
+            defaultMemPool->extMemPool.decay(epoch);
+            pthread_mutex_lock(&mutex);
+        }
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+void PurgingThread::forkChild()
+{
+    // only the forking thread exists in the child
+    purgingThread.started = false;
+}
+
+bool PurgingThread::start()
+{
+    if (started)
+        return true;
+    if (!atForkRegistered) {
+        if (pthread_atfork(NULL, NULL, forkChild))
+            return false;
+        atForkRegistered = true;
+    }
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&cond, NULL);
+    stopRequested = false;
+    if (pthread_create(&thread, NULL, threadRoutine, this)) {
+        pthread_cond_destroy(&cond);
+        pthread_mutex_destroy(&mutex);
+        return false;
+    }
+    started = true;
+    return true;
+}
+
+void PurgingThread::wakeUp()
+{
+    if (!started)
+        return;
+    pthread_mutex_lock(&mutex);
+    pthread_cond_signal(&cond);
+    pthread_mutex_unlock(&mutex);
+}
+
+void PurgingThread::stop()
+{
+    if (!started)
+        return;
+    pthread_mutex_lock(&mutex);
+    stopRequested = true;
+    pthread_cond_signal(&cond);
+    pthread_mutex_unlock(&mutex);
+    pthread_join(thread, NULL);
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&mutex);
+    started = false;
+}
+#endif // USE_PTHREAD
+
+void MemoryDecay::init()
+{
+    MallocMutex::scoped_lock lock(setTimeLock);
+    requestedTime.initReadEnv("TBB_MALLOC_DECAY_TIME", 0);
+    FencedStore(decayTime, requestedTime.get());
+}
+
+bool MemoryDecay::setTime(intptr_t ms)
+{
+#if USE_PTHREAD
+    MallocMutex::scoped_lock lock(setTimeLock);
+    requestedTime.set(ms);
+    FencedStore(decayTime, ms);
+    // before initialization the thread is started by startRequested()
+    if (isMallocInitialized()) {
+        if (ms)
+            purgingThread.start();
+        // the thread must notice the new period
+        purgingThread.wakeUp();
+    }
+    return true;
+#else
+    suppress_unused_warning(ms);
+    return false;
+#endif
+}
+
+void MemoryDecay::startRequested()
+{
+#if USE_PTHREAD
+    MallocMutex::scoped_lock lock(setTimeLock);
+    if (decayTime)
+        purgingThread.start();
+#endif
+}
+
+void MemoryDecay::shutdown()
+{
+#if USE_PTHREAD
+    MallocMutex::scoped_lock lock(setTimeLock);
+    purgingThread.stop();
+#endif
 }
 
 /*
@@ -2034,6 +2557,7 @@ static bool doInitialization()
             fputs(VersionString+1,stderr);
             hugePages.printStatus();
         }
+        memoryDecay.startRequested();
     }
     /* It can't be 0 or I would have initialized it */
     MALLOC_ASSERT( mallocInitialized==2, ASSERT_TEXT );
@@ -2057,6 +2581,7 @@ FreeObject *Block::allocateFromFreeList()
     freeList = result->next;
     MALLOC_ASSERT( allocatedCount < (slabSize-sizeof(Block))/objectSize, ASSERT_TEXT );
     allocatedCount++;
+    countObjects(1);
     STAT_increment(getThreadId(), getIndex(objectSize), allocFreeListUsed);
 
     return result;
@@ -2072,6 +2597,7 @@ FreeObject *Block::allocateFromBumpPtr()
         }
         MALLOC_ASSERT( allocatedCount < (slabSize-sizeof(Block))/objectSize, ASSERT_TEXT );
         allocatedCount++;
+        countObjects(1);
         STAT_increment(getThreadId(), getIndex(objectSize), allocBumpPtrUsed);
     }
     return result;
@@ -2098,6 +2624,37 @@ inline FreeObject* Block::allocate()
     return NULL;
 }
 
+/* Get up to num objects, first from the free list, then from the bump pointer.
+   Returns number of objects obtained, the block is full if it's less than num. */
+inline unsigned Block::allocateBatch(FreeObject **objects, unsigned num)
+{
+    MALLOC_ASSERT( isOwnedByCurrentThread(), ASSERT_TEXT );
+    unsigned got = 0;
+
+    for (; got<num && freeList; got++) {
+        objects[got] = freeList;
+        freeList = freeList->next;
+    }
+    if (got<num && bumpPtr) {
+        // objects below bumpPtr are never used, so take them at once
+        const uintptr_t blockStart = (uintptr_t)this+sizeof(Block);
+        unsigned avail = ((uintptr_t)bumpPtr - blockStart)/objectSize + 1;
+        unsigned fromBumpPtr = min(avail, num-got);
+        uintptr_t obj = (uintptr_t)bumpPtr;
+
+        for (unsigned i=0; i<fromBumpPtr; i++, obj -= objectSize)
+            objects[got++] = (FreeObject*)obj;
+        bumpPtr = fromBumpPtr<avail? (FreeObject*)obj : NULL;
+        STAT_increment(getThreadId(), getIndex(objectSize), allocBumpPtrUsed);
+    }
+    allocatedCount += got;
+    MALLOC_ASSERT( allocatedCount <= (slabSize-sizeof(Block))/objectSize, ASSERT_TEXT );
+    countObjects(got);
+    if (got<num)
+        isFull = 1;
+    return got;
+}
+
 size_t Block::findObjectSize(void *object) const
 {
     size_t blSize = getSize();
@@ -2139,8 +2696,9 @@ template<int LOW_MARK, int HIGH_MARK>
 bool LocalLOCImpl<LOW_MARK, HIGH_MARK>::put(LargeMemoryBlock *object, ExtMemoryPool *extMemPool)
 {
     const size_t size = object->unalignedSize;
+    const size_t maxTotalSize = localLOCSize.get();
     // not spoil cache with too large object, that can cause its total cleanup
-    if (size > MAX_TOTAL_SIZE)
+    if (size > maxTotalSize)
         return false;
     LargeMemoryBlock *localHead = (LargeMemoryBlock*)AtomicFetchStore(&head, 0);
 
@@ -2158,9 +2716,9 @@ bool LocalLOCImpl<LOW_MARK, HIGH_MARK>::put(LargeMemoryBlock *object, ExtMemoryP
     totalSize += size;
     numOfBlocks++;
     // must meet both size and number of cached objects constrains
-    if (totalSize > MAX_TOTAL_SIZE || numOfBlocks >= HIGH_MARK) {
+    if (totalSize > maxTotalSize || numOfBlocks >= HIGH_MARK) {
         // scanning from tail until meet conditions
-        while (totalSize > MAX_TOTAL_SIZE || numOfBlocks > LOW_MARK) {
+        while (totalSize > maxTotalSize || numOfBlocks > LOW_MARK) {
             totalSize -= tail->unalignedSize;
             numOfBlocks--;
             tail = tail->prev;
@@ -2180,7 +2738,7 @@ LargeMemoryBlock *LocalLOCImpl<LOW_MARK, HIGH_MARK>::get(size_t size)
 {
     LargeMemoryBlock *localHead, *res=NULL;
 
-    if (size > MAX_TOTAL_SIZE)
+    if (size > localLOCSize.get())
         return NULL;
 
     if (!head || (localHead = (LargeMemoryBlock*)AtomicFetchStore(&head, 0)) == NULL) {
@@ -2232,6 +2790,8 @@ void *MemoryPool::getFromLLOCache(TLSData* tls, size_t size, size_t alignment)
     if (tls) {
         tls->markUsed();
         lmb = tls->lloc.get(allocationSize);
+        if (lmb && statisticsMode.get())
+            tls->stat.largeLocalCacheHits++;
     }
     if (!lmb)
         lmb = extMemPool.mallocLargeObject(this, allocationSize);
@@ -2284,6 +2844,7 @@ void MemoryPool::putToLLOCache(TLSData *tls, void *object)
     LargeObjectHdr *header = (LargeObjectHdr*)object - 1;
     // overwrite backRefIdx to simplify double free detection
     header->backRefIdx = BackRefIdx();
+    heapProfiler.recordRelease(object);
 
     if (tls) {
         tls->markUsed();
@@ -2366,8 +2927,11 @@ static void *reallocAligned(MemoryPool *memPool, void *ptr,
         copySize = lmb->objectSize;
 #if BACKEND_HAS_MREMAP
         if (void *r = memPool->extMemPool.remap(ptr, copySize, newSize,
-                          alignment < largeObjectAlignment ? largeObjectAlignment : alignment))
+                          alignment < largeObjectAlignment ? largeObjectAlignment : alignment)) {
+            if (r != ptr)
+                heapProfiler.recordRelease(ptr);
             return r;
+        }
 #endif
         result = alignment ? allocateAligned(memPool, newSize, alignment) :
             internalPoolMalloc(memPool, newSize);
@@ -2478,11 +3042,12 @@ static inline void freeSmallObject(void *object)
         return;
     }
 #endif
+    heapProfiler.recordRelease(object);
     if (block->isOwnedByCurrentThread()) {
         block->freeOwnObject(object);
     } else { /* Slower path to add to the shared list, the allocatedCount is updated by the owner thread in malloc. */
         FreeObject *objectToFree = block->findObjectToFree(object);
-        block->freePublicObject(objectToFree);
+        block->freeRemoteObject(objectToFree);
     }
 }
 
@@ -2519,6 +3084,12 @@ static void *internalPoolMalloc(MemoryPool* memPool, size_t size)
             return result;
     }
 
+    /*
+     * the thread goes slow path, so it's a good time to publish the objects
+     * of other threads it buffered, else they wait for the full batch
+     */
+    tls->remoteFrees.flush();
+
     /*
      * else privatize publicly freed objects in some block and allocate from it
      */
@@ -2551,6 +3122,11 @@ static void *internalPoolMalloc(MemoryPool* memPool, size_t size)
      * else try to get a new empty block
      */
     mallocBlock = memPool->getEmptyBlock(size);
+    /*
+     * no memory for the thread's node, take a partial block from other nodes
+     */
+    if (!mallocBlock && numaTopology.isEnabled)
+        mallocBlock = memPool->extMemPool.orphanedBlocks.getFromOtherNodes(tls, size);
     if (mallocBlock) {
         bin->pushTLSBin(mallocBlock);
         bin->setActiveBlock(mallocBlock);
@@ -2588,6 +3164,116 @@ static bool internalPoolFree(MemoryPool *memPool, void *object, size_t size)
     return true;
 }
 
+/* Allocate up to num objects of the same size. Objects are taken from
+   the active block in bulk, the slow path of internalPoolMalloc is used
+   only when the block is exhausted. Returns the number of objects allocated. */
+static size_t internalPoolMallocBatch(MemoryPool* memPool, size_t size, size_t num, void **objects)
+{
+    size_t done = 0;
+
+    if (!size) size = sizeof(size_t);
+    TLSData *tls = size < minLargeObjectSize? memPool->getTLS(/*create=*/true) : NULL;
+    Bin *bin = tls? tls->getAllocationBin(size) : NULL;
+
+    while (done < num) {
+        if (bin) {
+            if (Block *activeBlk = bin->getActiveBlock()) {
+                unsigned portion = (unsigned)min(num-done, (size_t)UINT_MAX);
+                done += activeBlk->allocateBatch((FreeObject**)objects+done, portion);
+                if (done == num)
+                    break;
+            }
+        }
+        // no more objects in the active block (or large objects requested),
+        // let the generic path find or set up a block
+        if (!(objects[done] = internalPoolMalloc(memPool, size)))
+            break;
+        done++;
+    }
+    if (tls && done)
+        tls->markUsed();
+    return done;
+}
+
+/* Release objects grouped by owning block. Objects of a block are linked
+   together and released to it at once, so for a foreign block the whole
+   chain is published with single atomic operation. */
+static void internalPoolFreeBatch(MemoryPool *memPool, void **objects, size_t num)
+{
+    // only few chains are open at once, it's enough for objects
+    // allocated in batches, as they mostly come from few blocks
+    const int openChainsNum = 8;
+    BlockFreeChain chains[openChainsNum];
+    int nextToFlush = 0;
+
+    for (int i=0; i<openChainsNum; i++)
+        chains[i].block = NULL;
+    for (size_t i=0; i<num; i++) {
+        void *object = objects[i];
+        if (!object)
+            continue;
+        MALLOC_ASSERT(memPool->extMemPool.userPool() || isRecognized(object),
+                      "Invalid pointer during object releasing is detected.");
+        Block *block = (Block *)alignDown(object, slabSize);
+        if (isLargeObject<ourMem>(object)
+#if MALLOC_CHECK_RECURSION
+            || block->isStartupAllocObject()
+#endif
+            ) {
+            internalPoolFree(memPool, object, 0);
+            continue;
+        }
+        block->checkFreePrecond(object);
+        heapProfiler.recordRelease(object);
+        FreeObject *objectToFree = block->findObjectToFree(object);
+
+        int c = 0;
+        while (c<openChainsNum && chains[c].block != block)
+            c++;
+        if (c < openChainsNum) {
+            objectToFree->next = chains[c].head;
+            chains[c].head = objectToFree;
+            chains[c].num++;
+        } else {
+            for (c=0; c<openChainsNum && chains[c].block; c++)
+                ;
+            if (c == openChainsNum) {
+                c = nextToFlush;
+                nextToFlush = (nextToFlush+1) % openChainsNum;
+                chains[c].flush();
+            }
+            chains[c].block = block;
+            chains[c].head = chains[c].tail = objectToFree;
+            chains[c].num = 1;
+        }
+    }
+    for (int i=0; i<openChainsNum; i++)
+        if (chains[i].block)
+            chains[i].flush();
+}
+
+/* Record stack of the allocation, if the thread allocated
+   at least samplingInterval bytes since the previous sample */
+static void sampleAllocation(void *object, size_t size)
+{
+    TLSData *tls = defaultMemPool->getTLS(/*create=*/false);
+    if (!tls || tls->inProfiler)
+        return;
+    tls->bytesToSample -= size;
+    if (tls->bytesToSample > 0)
+        return;
+    tls->bytesToSample = heapProfiler.samplingInterval;
+    tls->inProfiler = true;
+    heapProfiler.recordAllocation(object, size);
+    tls->inProfiler = false;
+}
+
+static inline void profileAllocation(void *object, size_t size)
+{
+    if (heapProfiler.samplingInterval && object)
+        sampleAllocation(object, size);
+}
+
 static void *internalMalloc(size_t size)
 {
     if (!size) size = sizeof(size_t);
@@ -2602,7 +3288,9 @@ static void *internalMalloc(size_t size)
     if (!isMallocInitialized())
         if (!doInitialization())
             return NULL;
-    return internalPoolMalloc(defaultMemPool, size);
+    void *object = internalPoolMalloc(defaultMemPool, size);
+    profileAllocation(object, size);
+    return object;
 }
 
 static void internalFree(void *object)
@@ -2844,6 +3532,8 @@ extern "C" void __TBB_mallocProcessShutdownNotification(bool windows_process_dyi
 {
     if (!isMallocInitialized()) return;
 
+    // the purging thread works with default pool, so stop it first
+    memoryDecay.shutdown();
     // Don't clean allocator internals if the entire process is exiting
     if (!windows_process_dying) {
         doThreadShutdownNotification(NULL, /*main_thread=*/true);
@@ -2863,6 +3553,14 @@ extern "C" void __TBB_mallocProcessShutdownNotification(bool windows_process_dyi
     destroyBackRefMaster(&defaultMemPool->extMemPool.backend);
     ThreadId::destroy();      // Delete key for thread id
     hugePages.reset();
+    numaTopology.reset();
+    statisticsMode.reset();
+    hugePageSlabs.reset();
+    remoteFreeBatching.reset();
+    adaptiveLOC.reset();
+    localLOCSize.reset();
+    heapProfiler.reset();
+    memoryDecay.reset();
     // new total malloc initialization is possible after this point
     FencedStore(mallocInitialized, 0);
 #elif __TBB_USE_DLOPEN_REENTRANCY_WORKAROUND
@@ -2898,6 +3596,54 @@ extern "C" void scalable_free(void *object)
     internalFree(object);
 }
 
+extern "C" size_t scalable_malloc_batch(size_t size, size_t num, void **objects)
+{
+    if (!objects)
+        return 0;
+#if MALLOC_CHECK_RECURSION
+    if (RecursiveMallocCallProtector::sameThreadActive()) {
+        size_t i = 0;
+        for (; i<num && (objects[i] = internalMalloc(size)); i++)
+            ;
+        if (i<num) errno = ENOMEM;
+        return i;
+    }
+#endif
+    if (!isMallocInitialized())
+        if (!doInitialization()) {
+            errno = ENOMEM;
+            return 0;
+        }
+    size_t done = internalPoolMallocBatch(defaultMemPool, size, num, objects);
+    if (heapProfiler.samplingInterval)
+        for (size_t i=0; i<done; i++)
+            sampleAllocation(objects[i], size);
+    if (done<num) errno = ENOMEM;
+    return done;
+}
+
+extern "C" void scalable_free_batch(void **objects, size_t num)
+{
+    if (!objects || !num)
+        return;
+    internalPoolFreeBatch(defaultMemPool, objects, num);
+}
+
+/* The size is the one requested on allocation, so it tells whether the object
+   is small or large, and checking the object to be large is not needed. */
+extern "C" void scalable_free_sized(void *object, size_t size)
+{
+    if (!object)
+        return;
+    MALLOC_ASSERT(isRecognized(object), "Invalid pointer during object releasing is detected.");
+    MALLOC_ASSERT((size >= minLargeObjectSize) == isLargeObject<ourMem>(object),
+                  "Object size does not match the one requested on allocation.");
+    if (size >= minLargeObjectSize)
+        defaultMemPool->putToLLOCache(defaultMemPool->getTLS(/*create=*/false), object);
+    else
+        freeSmallObject(object);
+}
+
 #if MALLOC_ZONE_OVERLOAD_ENABLED
 extern "C" void __TBB_malloc_free_definite_size(void *object, size_t size)
 {
@@ -2932,6 +3678,30 @@ extern "C" void __TBB_malloc_safer_free(void *object, void (*original_free)(void
         original_free(object);
 }
 
+/*
+ * The same as above, but for objects of known size. Objects allocated by
+ * the allocator with such size are of single kind, so only it is checked.
+ */
+extern "C" void __TBB_malloc_safer_free_sized(void *object, size_t size, void (*original_free)(void*))
+{
+    if (!object)
+        return;
+
+    if (FencedLoad(mallocInitialized) && defaultMemPool->extMemPool.backend.ptrCanBeValid(object)) {
+        if (size >= minLargeObjectSize) {
+            if (isLargeObject<unknownMem>(object)) {
+                defaultMemPool->putToLLOCache(defaultMemPool->getTLS(/*create=*/false), object);
+                return;
+            }
+        } else if (isSmallObject(object)) {
+            freeSmallObject(object);
+            return;
+        }
+    }
+    if (original_free)
+        original_free(object);
+}
+
 /********* End the free code        *************/
 
 /********* Code for scalable_realloc       ***********/
@@ -2953,8 +3723,12 @@ extern "C" void* scalable_realloc(void* ptr, size_t size)
     else if (!size) {
         internalFree(ptr);
         return NULL;
-    } else
+    } else {
         tmp = reallocAligned(defaultMemPool, ptr, size, 0);
+        // a moved object is a new allocation
+        if (tmp != ptr)
+            profileAllocation(tmp, size);
+    }
 
     if (!tmp) errno = ENOMEM;
     return tmp;
@@ -2976,6 +3750,8 @@ extern "C" void* __TBB_malloc_safer_realloc(void* ptr, size_t sz, void* original
             return NULL;
         } else {
             tmp = reallocAligned(defaultMemPool, ptr, sz, 0);
+            if (tmp != ptr)
+                profileAllocation(tmp, sz);
         }
     }
 #if USE_WINTHREAD
@@ -3050,6 +3826,7 @@ extern "C" int scalable_posix_memalign(void **memptr, size_t alignment, size_t s
     void *result = allocateAligned(defaultMemPool, size, alignment);
     if (!result)
         return ENOMEM;
+    profileAllocation(result, size);
     *memptr = result;
     return 0;
 }
@@ -3061,6 +3838,7 @@ extern "C" void * scalable_aligned_malloc(size_t size, size_t alignment)
         return NULL;
     }
     void *tmp = allocateAligned(defaultMemPool, size, alignment);
+    profileAllocation(tmp, size);
     if (!tmp) errno = ENOMEM;
     return tmp;
 }
@@ -3080,6 +3858,8 @@ extern "C" void * scalable_aligned_realloc(void *ptr, size_t size, size_t alignm
         return NULL;
     } else
         tmp = reallocAligned(defaultMemPool, ptr, size, alignment);
+    if (tmp != ptr)
+        profileAllocation(tmp, size);
 
     if (!tmp) errno = ENOMEM;
     return tmp;
@@ -3096,12 +3876,15 @@ extern "C" void * __TBB_malloc_safer_aligned_realloc(void *ptr, size_t size, siz
 
     if (!ptr) {
         tmp = allocateAligned(defaultMemPool, size, alignment);
+        profileAllocation(tmp, size);
     } else if (FencedLoad(mallocInitialized) && isRecognized(ptr)) {
         if (!size) {
             internalFree(ptr);
             return NULL;
         } else {
             tmp = reallocAligned(defaultMemPool, ptr, size, alignment);
+            if (tmp != ptr)
+                profileAllocation(tmp, size);
         }
     }
 #if USE_WINTHREAD
@@ -3114,6 +3897,7 @@ extern "C" void * __TBB_malloc_safer_aligned_realloc(void *ptr, size_t size, siz
                 // set alignment and offset to have possibly correct oldSize
                 size_t oldSize = original_ptrs->aligned_msize(ptr, sizeof(void*), 0);
                 tmp = allocateAligned(defaultMemPool, size, alignment);
+                profileAllocation(tmp, size);
                 if (tmp) {
                     memcpy(tmp, ptr, size<oldSize? size : oldSize);
                     if ( original_ptrs->aligned_free ){
@@ -3218,6 +4002,69 @@ extern "C" int scalable_allocation_mode(int param, intptr_t value)
 #else
         return TBBMALLOC_NO_EFFECT;
 #endif
+    } else if (param == TBBMALLOC_USE_NUMA) {
+        switch (value) {
+        case 0:
+        case 1:
+            if (!isMallocInitialized() && !doInitialization())
+                return TBBMALLOC_NO_MEMORY;
+            numaTopology.setMode(value);
+            // w/o NUMA mode threads look for orphaned blocks at node 0 only
+            if (!numaTopology.isEnabled)
+                defaultMemPool->extMemPool.orphanedBlocks.mergeNodes();
+            return numaTopology.nodesNum > 1? TBBMALLOC_OK : TBBMALLOC_NO_EFFECT;
+        default:
+            return TBBMALLOC_INVALID_PARAM;
+        }
+    } else if (param == TBBMALLOC_COLLECT_STATISTICS) {
+        switch (value) {
+        case 0:
+        case 1:
+            statisticsMode.set(value);
+            return TBBMALLOC_OK;
+        default:
+            return TBBMALLOC_INVALID_PARAM;
+        }
+    } else if (param == TBBMALLOC_USE_HUGE_PAGE_SLABS) {
+        switch (value) {
+        case 0:
+        case 1:
+            hugePageSlabs.set(value);
+#if __linux__
+            return TBBMALLOC_OK;
+#else
+            return TBBMALLOC_NO_EFFECT;
+#endif
+        default:
+            return TBBMALLOC_INVALID_PARAM;
+        }
+    } else if (param == TBBMALLOC_USE_ADAPTIVE_LOC) {
+        switch (value) {
+        case 0:
+        case 1:
+            adaptiveLOC.set(value);
+            return TBBMALLOC_OK;
+        default:
+            return TBBMALLOC_INVALID_PARAM;
+        }
+    } else if (param == TBBMALLOC_SET_LOCAL_LOC_SIZE) {
+        if (value < 0)
+            return TBBMALLOC_INVALID_PARAM;
+        localLOCSize.set(value);
+        return TBBMALLOC_OK;
+    } else if (param == TBBMALLOC_SET_REMOTE_FREE_BATCH) {
+        if (value < 0)
+            return TBBMALLOC_INVALID_PARAM;
+        remoteFreeBatching.set(value);
+        return TBBMALLOC_OK;
+    } else if (param == TBBMALLOC_HEAP_PROFILE_SAMPLING) {
+        if (value < 0)
+            return TBBMALLOC_INVALID_PARAM;
+        return heapProfiler.setSampling(value)? TBBMALLOC_OK : TBBMALLOC_NO_EFFECT;
+    } else if (param == TBBMALLOC_SET_DECAY_TIME) {
+        if (value < 0)
+            return TBBMALLOC_INVALID_PARAM;
+        return memoryDecay.setTime(value)? TBBMALLOC_OK : TBBMALLOC_NO_EFFECT;
 #if __TBB_SOURCE_DIRECTLY_INCLUDED
     } else if (param == TBBMALLOC_INTERNAL_SOURCE_INCLUDED) {
         switch (value) {
@@ -3233,16 +4080,80 @@ extern "C" int scalable_allocation_mode(int param, intptr_t value)
     return TBBMALLOC_INVALID_PARAM;
 }
 
+static void collectStatistics(ScalableAllocationStatistics *stat)
+{
+    ExtMemoryPool *extMemPool = &defaultMemPool->extMemPool;
+    ThreadStatistics threadStat;
+    memset(&threadStat, 0, sizeof(ThreadStatistics));
+    extMemPool->allLocalCaches.collectStatistics(&threadStat);
+
+    memset(stat, 0, sizeof(ScalableAllocationStatistics));
+    MALLOC_STATIC_ASSERT(numBlockBinLimit <= TBBMALLOC_STATISTICS_BINS,
+                         "Not enough room for bins statistics.");
+    stat->binsNum = numBlockBinLimit;
+    // counters are changed only while the mode is on, so can be negative
+    for (unsigned size = 1; size < minLargeObjectSize; size = getObjectSize(size)+1) {
+        unsigned idx = getIndex(size);
+        ScalableBinStatistics *bin = stat->bins + idx;
+        intptr_t slabs = FencedLoad(extMemPool->stat.slabBlocks[idx]),
+            objects = threadStat.slabObjects[idx]
+                + FencedLoad(extMemPool->stat.slabObjects[idx]);
+        size_t capacity;
+
+        bin->objectSize = getObjectSize(size);
+        bin->slabs = slabs>0? slabs : 0;
+        bin->allocatedObjects = objects>0? objects : 0;
+        capacity = bin->slabs*((slabSize-sizeof(Block))/bin->objectSize);
+        bin->freeObjects = capacity>bin->allocatedObjects?
+            capacity-bin->allocatedObjects : 0;
+    }
+    stat->largeLocalCacheHits = threadStat.largeLocalCacheHits;
+    stat->largeCacheHits = extMemPool->stat.locHits;
+    stat->largeCacheMisses = extMemPool->stat.locMisses;
+    stat->largeCacheEvictions = extMemPool->stat.locEvictions;
+    stat->hugePageSlabGroups = extMemPool->stat.hugePageSlabGroups;
+    stat->groupedSlabs = extMemPool->stat.groupedSlabs;
+    stat->ungroupedSlabs = extMemPool->stat.ungroupedSlabs;
+    extMemPool->backend.collectStatistics(stat);
+}
+
 extern "C" int scalable_allocation_command(int cmd, void *param)
 {
+    if (cmd == TBBMALLOC_GET_NUMA_NODE) {
+        if (!param)
+            return TBBMALLOC_INVALID_PARAM;
+        if (!isMallocInitialized() && !doInitialization())
+            return TBBMALLOC_NO_MEMORY;
+        *(int*)param = numaTopology.threadNode();
+        return numaTopology.nodesNum>1? TBBMALLOC_OK : TBBMALLOC_NO_EFFECT;
+    }
+    if (cmd == TBBMALLOC_GET_STATISTICS) {
+        if (!param)
+            return TBBMALLOC_INVALID_PARAM;
+        if (!isMallocInitialized() && !doInitialization())
+            return TBBMALLOC_NO_MEMORY;
+        collectStatistics((ScalableAllocationStatistics*)param);
+        return statisticsMode.get()? TBBMALLOC_OK : TBBMALLOC_NO_EFFECT;
+    }
+    if (cmd == TBBMALLOC_DUMP_HEAP_PROFILE) {
+        if (!param)
+            return TBBMALLOC_INVALID_PARAM;
+        if (!heapProfiler.samplingInterval)
+            return TBBMALLOC_NO_EFFECT;
+        return heapProfiler.dump((const char*)param)?
+            TBBMALLOC_OK : TBBMALLOC_INVALID_PARAM;
+    }
     if (param)
         return TBBMALLOC_INVALID_PARAM;
     switch(cmd) {
     case TBBMALLOC_CLEAN_THREAD_BUFFERS:
-        if (TLSData *tls = defaultMemPool->getTLS(/*create=*/false))
-            return tls->externalCleanup(&defaultMemPool->extMemPool,
-                                        /*cleanOnlyUnused=*/false)?
-                TBBMALLOC_OK : TBBMALLOC_NO_EFFECT;
+        if (TLSData *tls = defaultMemPool->getTLS(/*create=*/false)) {
+            // both cleanups to be called, and the order is not important
+            bool released = tls->remoteFrees.flush();
+            released |= tls->externalCleanup(&defaultMemPool->extMemPool,
+                                             /*cleanOnlyUnused=*/false);
+            return released? TBBMALLOC_OK : TBBMALLOC_NO_EFFECT;
+        }
         return TBBMALLOC_NO_EFFECT;
     case TBBMALLOC_CLEAN_ALL_BUFFERS:
         return defaultMemPool->extMemPool.hardCachesCleanup()?
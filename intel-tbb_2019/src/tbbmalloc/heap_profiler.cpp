@@ -0,0 +1,263 @@
+/*
+    Copyright (c) 2005-2019 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+#include "tbbmalloc_internal.h"
+
+#if __linux__ && __GLIBC__
+#define __TBB_MALLOC_HEAP_PROFILING 1
+#include <execinfo.h>  // for backtrace
+#include <link.h>      // for dl_iterate_phdr
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#define __TBB_MALLOC_HEAP_PROFILING 0
+#endif
+
+namespace rml {
+namespace internal {
+
+/********* sampled heap profiling ***********************/
+/* Stacks are kept in fixed-size tables, as the profiler can't use the allocator
+ * it serves. When a table is exhausted, new samples are silently dropped.
+ * Memory is not allocated on dump as well, so it's safe to dump from any place.
+ */
+
+HeapProfiler heapProfiler;
+
+#if __TBB_MALLOC_HEAP_PROFILING
+
+/* Frames of the allocator itself, from recordAllocation up to the entry point
+ * called by the user (scalable_* function or replacement malloc of the proxy),
+ * are not recorded. How many of them are there depends on the entry point and
+ * on inlining, so the leading frames within the code of the library and of
+ * the proxy are skipped.
+ */
+static const int maxLibraryFrames = 8;
+
+class CodeRange {
+    uintptr_t begin, end;
+
+    static int find(struct dl_phdr_info *info, size_t, void *arg) {
+        CodeRange *r = (CodeRange*)arg;
+        for (int i=0; i<info->dlpi_phnum; i++) {
+            const ElfW(Phdr) &ph = info->dlpi_phdr[i];
+            uintptr_t b = info->dlpi_addr + ph.p_vaddr;
+            if (ph.p_type == PT_LOAD && b <= r->begin && r->begin < b + ph.p_memsz) {
+                r->begin = b;
+                r->end = b + ph.p_memsz;
+                return 1;
+            }
+        }
+        return 0;
+    }
+public:
+    // loaded segment that contains the address, empty if not found
+    void init(const void *address) {
+        begin = (uintptr_t)address;
+        end = 0;
+        if (!address || !dl_iterate_phdr(find, this))
+            begin = 0;
+    }
+    // segment with the code of the library
+    void initThisLibrary() { init((void*)&find); }
+    bool contains(const void *address) const {
+        return begin <= (uintptr_t)address && (uintptr_t)address < end;
+    }
+};
+
+static CodeRange libraryCode, proxyCode;
+
+bool HeapProfiler::setSampling(intptr_t interval)
+{
+    if (interval) {
+        // 1st call of backtrace loads unwinder, and it allocates memory,
+        // so do it before any sample is taken
+        void *warmUp[1];
+        backtrace(warmUp, 1);
+        libraryCode.initThisLibrary();
+        proxyCode.init((void*)malloc_proxy);
+    }
+    FencedStore(samplingInterval, interval);
+    return true;
+}
+
+HeapProfiler::StackRecord *HeapProfiler::findStack(void **frames, int depth)
+{
+    uintptr_t hash = depth;
+    for (int i=0; i<depth; i++)
+        hash = hash*31 + (uintptr_t)frames[i];
+
+    for (int i=0; i<stacksNum; i++) {
+        StackRecord *s = stacks + (hash+i)%stacksNum;
+        if (!s->depth) {
+            s->hash = hash;
+            s->depth = depth;
+            memcpy(s->frames, frames, depth*sizeof(void*));
+            return s;
+        }
+        if (s->hash == hash && s->depth == depth
+            && !memcmp(s->frames, frames, depth*sizeof(void*)))
+            return s;
+    }
+    return NULL;
+}
+
+void HeapProfiler::recordAllocation(const void *object, size_t size)
+{
+    void *frames[maxDepth+maxLibraryFrames];
+    int got = backtrace(frames, maxDepth+maxLibraryFrames);
+    int skipFrames = 0;
+    while (skipFrames < got && skipFrames < maxLibraryFrames
+           && (libraryCode.contains(frames[skipFrames]) || proxyCode.contains(frames[skipFrames])))
+        skipFrames++;
+    // the allocator is linked into the caller, so only recordAllocation is skipped
+    if (skipFrames == got || skipFrames == maxLibraryFrames)
+        skipFrames = 1;
+    int depth = got - skipFrames;
+    if (depth > maxDepth)
+        depth = maxDepth;
+    if (depth <= 0)
+        return;
+
+    MallocMutex::scoped_lock scoped_cs(lock);
+    StackRecord *s = findStack(frames+skipFrames, depth);
+    if (!s)
+        return;
+    s->allocObjs++;
+    s->allocBytes += size;
+
+    unsigned h = objectHash((intptr_t)object);
+    for (int i=0; i<maxProbes; i++) {
+        TrackedObject *t = tracked + (h+i)%trackedNum;
+        if (!t->object) {
+            t->stack = s;
+            t->size = size;
+            FencedStore(t->object, (intptr_t)object);
+            FencedStore(trackedObjects, trackedObjects+1);
+            s->inuseObjs++;
+            s->inuseBytes += size;
+            return;
+        }
+    }
+    // no room to track the object, so it's reported as released
+}
+
+void HeapProfiler::doRecordRelease(const void *object)
+{
+    unsigned h = objectHash((intptr_t)object);
+    int i = 0;
+
+    // most of released objects are not sampled, so look for without lock
+    for (; i<maxProbes; i++)
+        if (FencedLoad(tracked[(h+i)%trackedNum].object) == (intptr_t)object)
+            break;
+    if (i == maxProbes)
+        return;
+
+    MallocMutex::scoped_lock scoped_cs(lock);
+    // the object is released by the caller, so no one else can change its slot
+    TrackedObject *t = tracked + (h+i)%trackedNum;
+    MALLOC_ASSERT(t->object == (intptr_t)object, ASSERT_TEXT);
+    t->stack->inuseObjs--;
+    t->stack->inuseBytes -= t->size;
+    FencedStore(t->object, 0);
+    FencedStore(trackedObjects, trackedObjects-1);
+}
+
+static bool writeAll(int fd, const char *buf, size_t len)
+{
+    while (len) {
+        ssize_t done = write(fd, buf, len);
+        if (done <= 0)
+            return false;
+        buf += done;
+        len -= done;
+    }
+    return true;
+}
+
+bool HeapProfiler::dump(const char *fileName)
+{
+    int fd = open(fileName, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+
+    char buf[32 + maxDepth*20];
+    bool ok;
+    {
+        MallocMutex::scoped_lock scoped_cs(lock);
+        long long inuseObjs = 0, inuseBytes = 0, allocObjs = 0, allocBytes = 0;
+
+        for (int i=0; i<stacksNum; i++) {
+            inuseObjs += stacks[i].inuseObjs;
+            inuseBytes += stacks[i].inuseBytes;
+            allocObjs += stacks[i].allocObjs;
+            allocBytes += stacks[i].allocBytes;
+        }
+        int len = snprintf(buf, sizeof(buf),
+                           "heap profile: %lld: %lld [%lld: %lld] @ heap_v2/%lld\n",
+                           inuseObjs, inuseBytes, allocObjs, allocBytes,
+                           (long long)samplingInterval);
+        ok = writeAll(fd, buf, len);
+        for (int i=0; ok && i<stacksNum; i++) {
+            const StackRecord *s = stacks + i;
+            if (!s->depth)
+                continue;
+            len = snprintf(buf, sizeof(buf), "%lld: %lld [%lld: %lld] @",
+                           (long long)s->inuseObjs, (long long)s->inuseBytes,
+                           (long long)s->allocObjs, (long long)s->allocBytes);
+            for (int f=0; f<s->depth; f++)
+                len += snprintf(buf+len, sizeof(buf)-len, " %p", s->frames[f]);
+            buf[len++] = '\n';
+            ok = writeAll(fd, buf, len);
+        }
+    }
+    // symbolization needs the memory map of the process
+    const char mapsHeader[] = "\nMAPPED_LIBRARIES:\n";
+    ok = ok && writeAll(fd, mapsHeader, sizeof(mapsHeader)-1);
+    int maps = open("/proc/self/maps", O_RDONLY);
+    if (maps >= 0) {
+        ssize_t got;
+        while (ok && (got = read(maps, buf, sizeof(buf))) > 0)
+            ok = writeAll(fd, buf, got);
+        close(maps);
+    }
+    return !close(fd) && ok;
+}
+
+#else // __TBB_MALLOC_HEAP_PROFILING
+
+bool HeapProfiler::setSampling(intptr_t) { return false; }
+void HeapProfiler::recordAllocation(const void *, size_t) {}
+void HeapProfiler::doRecordRelease(const void *) {}
+bool HeapProfiler::dump(const char *) { return false; }
+
+#endif // __TBB_MALLOC_HEAP_PROFILING
+
+void HeapProfiler::reset()
+{
+    samplingInterval = 0;
+    trackedObjects = 0;
+    memset(stacks, 0, sizeof(stacks));
+    memset(tracked, 0, sizeof(tracked));
+}
+
+} // namespace internal
+} // namespace rml
@@ -45,7 +45,8 @@ class CacheBinFunctor {
        it demands the update of the moving average value in the bin.
        Only the last OP_CLEAN_TO_THRESHOLD operation has sense.
        The OP_CLEAN_ALL operation also should be performed only once.
-       Moreover it cancels the OP_CLEAN_TO_THRESHOLD operation. */
+       Moreover it cancels the OP_CLEAN_TO_THRESHOLD operation.
+       Only the most recent age of OP_DECAY operations has sense. */
     class OperationPreprocessor {
         // TODO: remove the dependency on CacheBin.
         typename LargeObjectCacheImpl<Props>::CacheBin *const  bin;
@@ -61,6 +62,10 @@ class CacheBinFunctor {
         /* The time of the last OP_CLEAN_TO_THRESHOLD operations */
         uintptr_t cleanTime;
 
+        /* opDecay contains all OP_DECAY operations, decayAge is the most recent age of them */
+        CacheBinOperation *opDecay;
+        uintptr_t decayAge;
+
         /* lastGetOpTime - the time of the last OP_GET operation.
            lastGet - the same meaning as CacheBin::lastGet */
         uintptr_t lastGetOpTime, lastGet;
@@ -83,7 +88,8 @@ class CacheBinFunctor {
     public:
         OperationPreprocessor(typename LargeObjectCacheImpl<Props>::CacheBin *bin) :
             bin(bin), lclTime(0), opGet(NULL), opClean(NULL), cleanTime(0),
-            lastGetOpTime(0), updateUsedSize(0), head(NULL), isCleanAll(false)  {}
+            opDecay(NULL), decayAge(0), lastGetOpTime(0), updateUsedSize(0),
+            head(NULL), isCleanAll(false)  {}
         void operator()(CacheBinOperation* opList);
         uintptr_t getTimeRange() const { return -lclTime; }
 
@@ -109,7 +115,8 @@ enum CacheBinOperationType {
     CBOP_PUT_LIST,
     CBOP_CLEAN_TO_THRESHOLD,
     CBOP_CLEAN_ALL,
-    CBOP_UPDATE_USED_SIZE
+    CBOP_UPDATE_USED_SIZE,
+    CBOP_DECAY
 };
 
 // The operation status list. CBST_NOWAIT can be specified for non-blocking operations.
@@ -148,6 +155,12 @@ struct OpUpdateUsedSize {
     size_t size;
 };
 
+struct OpDecay {
+    static const CacheBinOperationType type = CBOP_DECAY;
+    size_t *res;
+    uintptr_t decayAge;
+};
+
 union CacheBinOperationData {
 private:
     OpGet opGet;
@@ -155,6 +168,7 @@ private:
     OpCleanToThreshold opCleanToThreshold;
     OpCleanAll opCleanAll;
     OpUpdateUsedSize opUpdateUsedSize;
+    OpDecay opDecay;
 };
 
 // Forward declarations
@@ -326,6 +340,15 @@ template<typename Props> void CacheBinFunctor<Props>::
             }
             break;
 
+        case CBOP_DECAY:
+            {
+                uintptr_t age = opCast<OpDecay>(*op).decayAge;
+                if ( !opDecay || lessThanWithOverflow(decayAge, age) )
+                    decayAge = age;
+                addOpToOpList( op, &opDecay );
+            }
+            break;
+
         default:
             MALLOC_ASSERT( false, "Unknown operation." );
         }
@@ -407,19 +430,41 @@ template<typename Props> void CacheBinFunctor<Props>::operator()(CacheBinOperati
         }
     }
 
+    if ( CacheBinOperation *opDecay = prep.opDecay ) {
+        // blocks released by clean operations above are not in the bin already
+        *opCast<OpDecay>(*opDecay).res = bin->decay(&extMemPool->backend, prep.decayAge);
+
+        CacheBinOperation *opNext = opDecay->next;
+        prep.commitOperation( opDecay );
+
+        while ((opDecay = opNext) != NULL) {
+            opNext = opDecay->next;
+            prep.commitOperation(opDecay);
+        }
+    }
+
     if ( size_t size = prep.updateUsedSize )
         bin->updateUsedSize(size, bitMask, idx);
 }
 /* ----------------------------------------------------------------------------------------------------- */
 /* --------------------------- Methods for creating and executing operations --------------------------- */
+// count a block released from the cache to the backend
+static inline void countEviction(ExtMemoryPool *extMemPool)
+{
+    if (statisticsMode.get())
+        AtomicIncrement(extMemPool->stat.locEvictions);
+}
+
 template<typename Props> void LargeObjectCacheImpl<Props>::
     CacheBin::ExecuteOperation(CacheBinOperation *op, ExtMemoryPool *extMemPool, BinBitMask *bitMask, int idx, bool longLifeTime)
 {
     CacheBinFunctor<Props> func( this, extMemPool, bitMask, idx );
     aggregator.execute( op, func, longLifeTime );
 
-    if (  LargeMemoryBlock *toRelease = func.getToRelease() )
+    if (  LargeMemoryBlock *toRelease = func.getToRelease() ) {
+        countEviction(extMemPool);
         extMemPool->backend.returnLargeObject(toRelease);
+    }
 
     if ( func.isCleanupNeeded() )
         extMemPool->loc.doCleanup( func.getCurrTime(), /*doThreshDecr=*/false);
@@ -462,6 +507,7 @@ template<typename Props> bool LargeObjectCacheImpl<Props>::
     Backend *backend = &extMemPool->backend;
     while ( toRelease ) {
         LargeMemoryBlock *helper = toRelease->next;
+        countEviction(extMemPool);
         backend->returnLargeObject(toRelease);
         toRelease = helper;
     }
@@ -485,12 +531,26 @@ template<typename Props> bool LargeObjectCacheImpl<Props>::
         LargeMemoryBlock *helper = toRelease->next;
         MALLOC_ASSERT(!helper || lessThanWithOverflow(helper->age, toRelease->age),
                       ASSERT_TEXT);
+        countEviction(extMemPool);
         backend->returnLargeObject(toRelease);
         toRelease = helper;
     }
     return released;
 }
 
+template<typename Props> size_t LargeObjectCacheImpl<Props>::
+    CacheBin::decay(ExtMemoryPool *extMemPool, BinBitMask *bitMask, uintptr_t decayAge, int idx)
+{
+    size_t released = 0;
+
+    if (last) {
+        OpDecay data = {&released, decayAge};
+        CacheBinOperation op(data);
+        ExecuteOperation(&op, extMemPool, bitMask, idx);
+    }
+    return released;
+}
+
 template<typename Props> void LargeObjectCacheImpl<Props>::
     CacheBin::updateUsedSize(ExtMemoryPool *extMemPool, size_t size, BinBitMask *bitMask, int idx) {
     OpUpdateUsedSize data = {size};
@@ -507,7 +567,14 @@ template<typename Props> LargeMemoryBlock *LargeObjectCacheImpl<Props>::
     MALLOC_ASSERT( !last || (last->age != 0 && last->age != -1U), ASSERT_TEXT );
     MALLOC_ASSERT( (tail==head && num==1) || (tail!=head && num>1), ASSERT_TEXT );
     LargeMemoryBlock *toRelease = NULL;
-    if (!lastCleanedAge) {
+    if (!lastCleanedAge && adaptiveLOC.get() && (usedSize || reuseDistance)) {
+        // Other objects of the size are in use or the bin was reused before,
+        // so the burst is likely to repeat. Cache the 1st object and
+        // restore the threshold from the learned reuse distance.
+        lastCleanedAge = tail->age;
+        if (!ageThreshold)
+            ageThreshold = Props::OnMissFactor*reuseDistance;
+    } else if (!lastCleanedAge) {
         // 1st object of such size was released.
         // Not cache it, and remember when this occurs
         // to take into account during cache miss.
@@ -560,6 +627,50 @@ template<typename Props> LargeMemoryBlock *LargeObjectCacheImpl<Props>::
     return result;
 }
 
+template<typename Props> void LargeObjectCacheImpl<Props>::
+    CacheBin::updateMeanHitRange( intptr_t hitRange )
+{
+    hitRange = hitRange >= 0 ? hitRange : 0;
+    meanHitRange = meanHitRange ? (meanHitRange + hitRange)/2 : hitRange;
+    if (adaptiveLOC.get())
+        learnReuseDistance(hitRange);
+}
+
+template<typename Props> void LargeObjectCacheImpl<Props>::
+    CacheBin::updateAgeThreshold( uintptr_t currTime )
+{
+    if (!lastCleanedAge)
+        return;
+    intptr_t sinceCleaned = currTime - lastCleanedAge;
+    if (adaptiveLOC.get()) {
+        // the block released at lastCleanedAge would be reused now,
+        // grow the threshold at once, but shrink it only with the learned mean
+        learnReuseDistance(sinceCleaned);
+        if (sinceCleaned < reuseDistance)
+            sinceCleaned = reuseDistance;
+    }
+    ageThreshold = Props::OnMissFactor*sinceCleaned;
+}
+
+// exponential moving average with weight 1/4 of new sample
+template<typename Props> void LargeObjectCacheImpl<Props>::
+    CacheBin::learnReuseDistance( intptr_t distance )
+{
+    if (distance < 0)
+        distance = 0;
+    reuseDistance = reuseDistance ? (3*reuseDistance + distance)/4 : distance;
+}
+
+template<typename Props> void LargeObjectCacheImpl<Props>::
+    CacheBin::decreaseThreshold()
+{
+    if (ageThreshold)
+        ageThreshold = (ageThreshold + meanHitRange)/2;
+    // LOC is too large, so the learned distance must not restore the threshold
+    if (adaptiveLOC.get())
+        reuseDistance = (reuseDistance + meanHitRange)/2;
+}
+
 // forget the history for the bin if it was unused for long time
 template<typename Props> void LargeObjectCacheImpl<Props>::
     CacheBin::forgetOutdatedState(uintptr_t currTime)
@@ -639,6 +750,26 @@ template<typename Props> LargeMemoryBlock *LargeObjectCacheImpl<Props>::
 
     return toRelease;
 }
+
+// Return to OS pages of blocks cached before decayAge. Blocks stay in the bin,
+// so the list is not changed, and only the space after block header is released.
+template<typename Props> size_t LargeObjectCacheImpl<Props>::
+    CacheBin::decay(Backend *backend, uintptr_t decayAge)
+{
+    size_t released = 0;
+    // list is ordered from the most recent block, so skip recent ones
+    // and stop on blocks already decayed during previous passes
+    for (LargeMemoryBlock *curr = first; curr; curr = curr->next) {
+        if (!lessThanWithOverflow(curr->age, decayAge))
+            continue;
+        if (decayedAge && !lessThanWithOverflow(decayedAge, curr->age))
+            break;
+        released += backend->releasePages(curr+1,
+                        curr->unalignedSize - sizeof(LargeMemoryBlock));
+    }
+    decayedAge = decayAge;
+    return released;
+}
 /* ----------------------------------------------------------------------------------------------------- */
 
 template<typename Props> size_t LargeObjectCacheImpl<Props>::
@@ -703,6 +834,16 @@ bool LargeObjectCacheImpl<Props>::cleanAll(ExtMemoryPool *extMemPool)
     return released;
 }
 
+template<typename Props>
+size_t LargeObjectCacheImpl<Props>::decay(ExtMemoryPool *extMemPool, uintptr_t decayAge)
+{
+    size_t released = 0;
+    for (int i = numBins-1; i >= 0; i--)
+        if (bin[i].getSize())
+            released += bin[i].decay(extMemPool, &bitMask, decayAge, i);
+    return released;
+}
+
 #if __TBB_MALLOC_WHITEBOX_TEST
 template<typename Props>
 size_t LargeObjectCacheImpl<Props>::getLOCSize() const
@@ -764,6 +905,20 @@ bool LargeObjectCache::cleanAll()
     return largeCache.cleanAll(extMemPool) | hugeCache.cleanAll(extMemPool);
 }
 
+// Called by the purging thread only. Blocks cached before the pass done
+// two epochs ago are decayed, so a block is cached for 2-3 epochs
+// before its pages are returned to OS.
+size_t LargeObjectCache::decay(intptr_t epoch)
+{
+    uintptr_t decayAge = decayPassTime[(epoch+1)%3];
+    // advance the time, so the blocks cached before are older than the pass
+    // even if there were no operations with the cache between the passes
+    decayPassTime[epoch%3] = getCurrTime();
+    if (!decayAge)
+        return 0;
+    return largeCache.decay(extMemPool, decayAge) + hugeCache.decay(extMemPool, decayAge);
+}
+
 template<typename Props>
 LargeMemoryBlock *LargeObjectCacheImpl<Props>::get(ExtMemoryPool *extMemoryPool, size_t size)
 {
@@ -921,7 +1076,11 @@ LargeMemoryBlock *ExtMemoryPool::mallocLargeObject(MemoryPool *pool, size_t allo
         lmb->backRefIdx = backRefIdx;
         lmb->pool = pool;
         STAT_increment(getThreadId(), ThreadCommonCounters, allocNewLargeObj);
+        if (statisticsMode.get())
+            AtomicIncrement(stat.locMisses);
     } else {
+        if (statisticsMode.get())
+            AtomicIncrement(stat.locHits);
 #if __TBB_MALLOC_LOCACHE_STAT
         AtomicIncrement(cacheHits);
         AtomicAdd(memHitKB, allocationSize/1024);
@@ -956,6 +1115,22 @@ bool ExtMemoryPool::hardCachesCleanup()
     return ret;
 }
 
+// Returns the number of bytes whose pages were returned to OS.
+size_t ExtMemoryPool::decay(intptr_t epoch)
+{
+    if (userPool())
+        return 0;
+    // caches of threads idle since previous pass are moved to LOC and backend,
+    // so they can be decayed later
+    allLocalCaches.cleanup(this, /*cleanOnlyUnused=*/true);
+    allLocalCaches.markUnused();
+    size_t released = loc.decay(epoch);
+    // backend blocks are coalesced, so they are not reused quickly,
+    // the same delay as for LOC is used
+    released += backend.decay(epoch-2);
+    return released;
+}
+
 #if BACKEND_HAS_MREMAP
 void *ExtMemoryPool::remap(void *ptr, size_t oldSize, size_t newSize, size_t alignment)
 {
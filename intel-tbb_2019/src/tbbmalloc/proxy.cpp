@@ -160,6 +160,237 @@ static void *orig_msize;
 
 #endif // MALLOC_ZONE_OVERLOAD_ENABLED
 
+/*** recording of allocation calls, see proxy_trace.h ***/
+#include "proxy_trace.h"
+
+#if MALLOC_UNIXLIKE_OVERLOAD_ENABLED
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <time.h>
+
+// Records of a thread. Buffers are got from mmap, as malloc can't be used here,
+// and written to the trace file when full, on thread exit and on process exit.
+// Records made by a thread after its buffer is released (e.g., by TLS destructors
+// running later) and all records made after the process exit hook go to the shared
+// buffer, so no call is lost.
+struct TraceBuffer {
+    static const unsigned capacity = 4096;
+    TraceBuffer *next,
+                *prev;
+    uint32_t     thread;
+    uint32_t     count;
+    MallocTraceRecord records[capacity];
+};
+
+enum TraceState {
+    TRACE_UNKNOWN = 0, // environment is not read yet
+    TRACE_OFF,
+    TRACE_ON
+};
+
+static intptr_t traceState;
+static int traceFd;
+static ProxyMutex traceLock;    // protects the file and the list of buffers
+static TraceBuffer *traceBuffers;
+static uint32_t traceThreads;
+static TraceBuffer traceShared; // protected by traceLock
+static intptr_t traceExited;    // the process exit hook has run, write records at once
+static pthread_key_t traceKey;  // used only to write the buffer on thread exit
+static __thread TraceBuffer *traceBuffer __attribute__ ((tls_model("initial-exec")));
+static __thread uint32_t traceThread __attribute__ ((tls_model("initial-exec"))); // number+1
+static __thread bool traceThreadExited __attribute__ ((tls_model("initial-exec")));
+
+// must be called under traceLock
+static void traceWrite(const void *data, size_t bytes)
+{
+    const char *p = (const char*)data;
+    while (bytes) {
+        ssize_t res = write(traceFd, p, bytes);
+        if (res < 0) {
+            if (errno == EINTR)
+                continue;
+            FencedStore(traceState, TRACE_OFF); // no space or so, stop recording
+            return;
+        }
+        p += res;
+        bytes -= res;
+    }
+}
+
+static void traceFlush(TraceBuffer *buf)
+{
+    ProxyMutex::scoped_lock lock(traceLock);
+    traceWrite(buf->records, buf->count*sizeof(MallocTraceRecord));
+    buf->count = 0;
+}
+
+// must be called under traceLock
+static uint32_t traceThreadNumber()
+{
+    if (!traceThread)
+        traceThread = ++traceThreads;
+    return traceThread-1;
+}
+
+static void traceThreadExit(void *arg)
+{
+    TraceBuffer *buf = (TraceBuffer*)arg;
+    {
+        ProxyMutex::scoped_lock lock(traceLock);
+        traceWrite(buf->records, buf->count*sizeof(MallocTraceRecord));
+        if (buf->prev)
+            buf->prev->next = buf->next;
+        else
+            traceBuffers = buf->next;
+        if (buf->next)
+            buf->next->prev = buf->prev;
+    }
+    traceBuffer = NULL;
+    traceThreadExited = true;
+    munmap(buf, sizeof(TraceBuffer));
+}
+
+// Records of threads that are still running are written at process exit.
+// Those threads record to the shared buffer from now on; a record being put
+// to a thread buffer right at this moment can still be lost.
+__attribute__ ((destructor)) static void traceProcessExit()
+{
+    if (traceState != TRACE_ON)
+        return;
+    ProxyMutex::scoped_lock lock(traceLock);
+    FencedStore(traceExited, 1);
+    for (TraceBuffer *buf = traceBuffers; buf; buf = buf->next) {
+        traceWrite(buf->records, buf->count*sizeof(MallocTraceRecord));
+        buf->count = 0;
+    }
+    traceWrite(traceShared.records, traceShared.count*sizeof(MallocTraceRecord));
+    traceShared.count = 0;
+}
+
+// The trace is written to <TBB_MALLOC_TRACE>.<pid>, so processes started
+// with the same environment do not overwrite traces of each other.
+static void traceInit()
+{
+    ProxyMutex::scoped_lock lock(traceLock);
+    if (traceState != TRACE_UNKNOWN)
+        return;
+    const char *name = std::getenv("TBB_MALLOC_TRACE");
+    char path[4096];
+    size_t len = name? strlen(name) : 0;
+    if (len && len < sizeof(path)-24) {
+        memcpy(path, name, len);
+        path[len++] = '.';
+        char digits[24];
+        int n = 0;
+        for (unsigned long pid = getpid(); pid || !n; pid /= 10)
+            digits[n++] = '0' + pid%10;
+        while (n)
+            path[len++] = digits[--n];
+        path[len] = 0;
+        traceFd = open(path, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+        if (traceFd >= 0 && !pthread_key_create(&traceKey, traceThreadExit)) {
+            MallocTraceHeader header = {MALLOC_TRACE_MAGIC, MALLOC_TRACE_VERSION,
+                                        sizeof(MallocTraceRecord)};
+            FencedStore(traceState, TRACE_ON);
+            traceWrite(&header, sizeof(header));
+            return;
+        }
+    }
+    FencedStore(traceState, TRACE_OFF);
+}
+
+static TraceBuffer *traceNewBuffer()
+{
+    void *mem = mmap(NULL, sizeof(TraceBuffer), PROT_READ|PROT_WRITE,
+                     MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+        return NULL;
+    TraceBuffer *buf = (TraceBuffer*)mem; // zero-filled
+    {
+        ProxyMutex::scoped_lock lock(traceLock);
+        buf->thread = traceThreadNumber();
+        buf->next = traceBuffers;
+        if (traceBuffers)
+            traceBuffers->prev = buf;
+        traceBuffers = buf;
+    }
+    traceBuffer = buf;
+    pthread_setspecific(traceKey, buf);
+    return buf;
+}
+
+static void traceRecordShared(MallocTraceRecord &r)
+{
+    ProxyMutex::scoped_lock lock(traceLock);
+    r.thread = traceThreadNumber();
+    traceShared.records[traceShared.count] = r;
+    if (++traceShared.count == TraceBuffer::capacity || traceExited) {
+        traceWrite(traceShared.records, traceShared.count*sizeof(MallocTraceRecord));
+        traceShared.count = 0;
+    }
+}
+
+static void traceRecord(uint32_t op, void *ptr, uint64_t arg, uint64_t size)
+{
+    if (traceState == TRACE_UNKNOWN)
+        traceInit();
+    if (traceState != TRACE_ON)
+        return;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    MallocTraceRecord r = {(uint64_t)ts.tv_sec*1000000000 + ts.tv_nsec, (uintptr_t)ptr,
+                           arg, size, op, 0};
+    TraceBuffer *buf = traceBuffer;
+    const bool exited = FencedLoad(traceExited);
+    if (!buf && !traceThreadExited && !exited)
+        buf = traceNewBuffer();
+    if (!buf || exited) {
+        traceRecordShared(r);
+        return;
+    }
+    r.thread = buf->thread;
+    buf->records[buf->count] = r;
+    if (++buf->count == TraceBuffer::capacity)
+        traceFlush(buf);
+}
+
+// Allocations are recorded after the call and releases before the call,
+// so in a time-ordered trace an address is not allocated while it is live,
+// except for rare races with realloc, that the replayer tolerates.
+static inline void *traceAlloc(uint32_t op, void *res, size_t size, uint64_t arg = 0)
+{
+    if (res && traceState != TRACE_OFF)
+        traceRecord(op, res, arg, size);
+    return res;
+}
+
+static inline void traceFree(void *object)
+{
+    if (object && traceState != TRACE_OFF)
+        traceRecord(MALLOC_TRACE_FREE, object, 0, 0);
+}
+
+static inline void *traceRealloc(void *object, void *res, size_t size)
+{
+    if (traceState != TRACE_OFF) {
+        if (res)
+            traceRecord(MALLOC_TRACE_REALLOC, res, (uintptr_t)object, size);
+        else if (object && !size) // realloc(object, 0) releases the object
+            traceRecord(MALLOC_TRACE_FREE, object, 0, 0);
+    }
+    return res;
+}
+
+#else // recording is supported only on Linux
+
+static inline void *traceAlloc(uint32_t, void *res, size_t, uint64_t = 0) { return res; }
+static inline void traceFree(void *) {}
+static inline void *traceRealloc(void *, void *res, size_t) { return res; }
+
+#endif // MALLOC_UNIXLIKE_OVERLOAD_ENABLED
+
 // Original (i.e., replaced) functions,
 // they are never changed for MALLOC_ZONE_OVERLOAD_ENABLED.
 static void *orig_free,
@@ -203,24 +434,25 @@ inline void InitOrigPointers() {}
 
 void *PREFIX(malloc)(ZONE_ARG size_t size) __THROW
 {
-    return scalable_malloc(size);
+    return traceAlloc(MALLOC_TRACE_MALLOC, scalable_malloc(size), size);
 }
 
 void *PREFIX(calloc)(ZONE_ARG size_t num, size_t size) __THROW
 {
-    return scalable_calloc(num, size);
+    return traceAlloc(MALLOC_TRACE_CALLOC, scalable_calloc(num, size), num*size);
 }
 
 void PREFIX(free)(ZONE_ARG void *object) __THROW
 {
     InitOrigPointers();
+    traceFree(object);
     __TBB_malloc_safer_free(object, (void (*)(void*))orig_free);
 }
 
 void *PREFIX(realloc)(ZONE_ARG void* ptr, size_t sz) __THROW
 {
     InitOrigPointers();
-    return __TBB_malloc_safer_realloc(ptr, sz, orig_realloc);
+    return traceRealloc(ptr, __TBB_malloc_safer_realloc(ptr, sz, orig_realloc), sz);
 }
 
 /* The older *NIX interface for aligned allocations;
@@ -228,7 +460,7 @@ void *PREFIX(realloc)(ZONE_ARG void* ptr, size_t sz) __THROW
    so we do not expect it to cause cyclic dependency with C RTL. */
 void *PREFIX(memalign)(ZONE_ARG size_t alignment, size_t size) __THROW
 {
-    return scalable_aligned_malloc(size, alignment);
+    return traceAlloc(MALLOC_TRACE_ALIGNED, scalable_aligned_malloc(size, alignment), size, alignment);
 }
 
 /* valloc allocates memory aligned on a page boundary */
@@ -236,7 +468,8 @@ void *PREFIX(valloc)(ZONE_ARG size_t size) __THROW
 {
     if (! memoryPageSize) initPageSize();
 
-    return scalable_aligned_malloc(size, memoryPageSize);
+    return traceAlloc(MALLOC_TRACE_ALIGNED, scalable_aligned_malloc(size, memoryPageSize),
+                      size, memoryPageSize);
 }
 
 #undef ZONE_ARG
@@ -257,7 +490,10 @@ size_t malloc_usable_size(void *ptr) __THROW
 
 int posix_memalign(void **memptr, size_t alignment, size_t size) __THROW
 {
-    return scalable_posix_memalign(memptr, alignment, size);
+    int res = scalable_posix_memalign(memptr, alignment, size);
+    if (!res)
+        traceAlloc(MALLOC_TRACE_ALIGNED, *memptr, size, alignment);
+    return res;
 }
 
 /* pvalloc allocates smallest set of complete pages which can hold
@@ -269,7 +505,8 @@ void *pvalloc(size_t size) __THROW
     // pvalloc(0) returns 1 page, see man libmpatrol
     size = size? ((size-1) | (memoryPageSize-1)) + 1 : memoryPageSize;
 
-    return scalable_aligned_malloc(size, memoryPageSize);
+    return traceAlloc(MALLOC_TRACE_ALIGNED, scalable_aligned_malloc(size, memoryPageSize),
+                      size, memoryPageSize);
 }
 
 int mallopt(int /*param*/, int /*value*/) __THROW
@@ -307,13 +544,14 @@ void *__libc_valloc(size_t size) __attribute__ ((alias ("valloc")));
 void __libc_free(void *ptr)
 {
     InitOrigPointers();
+    traceFree(ptr);
     __TBB_malloc_safer_free(ptr, (void (*)(void*))orig_libc_free);
 }
 
 void *__libc_realloc(void *ptr, size_t size)
 {
     InitOrigPointers();
-    return __TBB_malloc_safer_realloc(ptr, size, orig_libc_realloc);
+    return traceRealloc(ptr, __TBB_malloc_safer_realloc(ptr, size, orig_libc_realloc), size);
 }
 #endif // !__ANDROID__
 
@@ -322,33 +560,48 @@ void *__libc_realloc(void *ptr, size_t size)
 /*** replacements for global operators new and delete ***/
 
 void* operator new(size_t sz) __TBB_THROW_BAD_ALLOC {
-    return InternalOperatorNew(sz);
+    return traceAlloc(MALLOC_TRACE_MALLOC, InternalOperatorNew(sz), sz);
 }
 void* operator new[](size_t sz) __TBB_THROW_BAD_ALLOC {
-    return InternalOperatorNew(sz);
+    return traceAlloc(MALLOC_TRACE_MALLOC, InternalOperatorNew(sz), sz);
 }
 void operator delete(void* ptr) __TBB_NO_THROW {
     InitOrigPointers();
+    traceFree(ptr);
     __TBB_malloc_safer_free(ptr, (void (*)(void*))orig_free);
 }
 void operator delete[](void* ptr) __TBB_NO_THROW {
     InitOrigPointers();
+    traceFree(ptr);
     __TBB_malloc_safer_free(ptr, (void (*)(void*))orig_free);
 }
 void* operator new(size_t sz, const std::nothrow_t&) __TBB_NO_THROW {
-    return scalable_malloc(sz);
+    return traceAlloc(MALLOC_TRACE_MALLOC, scalable_malloc(sz), sz);
 }
 void* operator new[](std::size_t sz, const std::nothrow_t&) __TBB_NO_THROW {
-    return scalable_malloc(sz);
+    return traceAlloc(MALLOC_TRACE_MALLOC, scalable_malloc(sz), sz);
 }
 void operator delete(void* ptr, const std::nothrow_t&) __TBB_NO_THROW {
     InitOrigPointers();
+    traceFree(ptr);
     __TBB_malloc_safer_free(ptr, (void (*)(void*))orig_free);
 }
 void operator delete[](void* ptr, const std::nothrow_t&) __TBB_NO_THROW {
     InitOrigPointers();
+    traceFree(ptr);
     __TBB_malloc_safer_free(ptr, (void (*)(void*))orig_free);
 }
+// C++14 sized deallocation, the size is one passed to operator new
+void operator delete(void* ptr, size_t sz) __TBB_NO_THROW {
+    InitOrigPointers();
+    traceFree(ptr);
+    __TBB_malloc_safer_free_sized(ptr, sz, (void (*)(void*))orig_free);
+}
+void operator delete[](void* ptr, size_t sz) __TBB_NO_THROW {
+    InitOrigPointers();
+    traceFree(ptr);
+    __TBB_malloc_safer_free_sized(ptr, sz, (void (*)(void*))orig_free);
+}
 
 #endif /* MALLOC_UNIXLIKE_OVERLOAD_ENABLED */
 #endif /* MALLOC_UNIXLIKE_OVERLOAD_ENABLED || MALLOC_ZONE_OVERLOAD_ENABLED */
@@ -42,6 +42,7 @@ extern "C" {
     int    scalable_posix_memalign(void **memptr, size_t alignment, size_t size);
     size_t scalable_msize(void *ptr);
     void   __TBB_malloc_safer_free( void *ptr, void (*original_free)(void*));
+    void   __TBB_malloc_safer_free_sized( void *ptr, size_t size, void (*original_free)(void*));
     void * __TBB_malloc_safer_realloc( void *ptr, size_t, void* );
     void * __TBB_malloc_safer_aligned_realloc( void *ptr, size_t, size_t, void* );
     size_t __TBB_malloc_safer_msize( void *ptr, size_t (*orig_msize_crt80d)(void*));
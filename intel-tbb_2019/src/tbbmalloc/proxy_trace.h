@@ -0,0 +1,61 @@
+/*
+    Copyright (c) 2005-2019 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+#ifndef _TBB_malloc_proxy_trace_H_
+#define _TBB_malloc_proxy_trace_H_
+
+/* Binary trace of allocation calls, recorded by the proxy library when
+   TBB_MALLOC_TRACE environment variable is set to a file name, and replayed
+   by src/perf/time_malloc_replay.cpp.
+   The file is MallocTraceHeader followed by records. Each thread buffers its
+   records and writes the whole buffer at once, so records of a thread are
+   ordered, while records of different threads are ordered only by time.
+   Calls made at thread and process exit, after the buffers are written,
+   are recorded via a shared buffer, so they are ordered by time as well. */
+
+#include <stdint.h>
+
+#define MALLOC_TRACE_MAGIC   0x43525442544D4254ULL // "TBMTBTRC"
+#define MALLOC_TRACE_VERSION 1
+
+enum MallocTraceOp {
+    MALLOC_TRACE_MALLOC = 1,
+    MALLOC_TRACE_CALLOC,
+    MALLOC_TRACE_REALLOC,  // arg is the reallocated object, ptr is the result
+    MALLOC_TRACE_ALIGNED,  // arg is the alignment
+    MALLOC_TRACE_FREE
+};
+
+struct MallocTraceHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t recordSize;
+};
+
+struct MallocTraceRecord {
+    uint64_t time;   // nanoseconds of CLOCK_MONOTONIC
+    uint64_t ptr;    // allocated or released object
+    uint64_t arg;
+    uint64_t size;
+    uint32_t op;     // MallocTraceOp
+    uint32_t thread; // sequential number of thread in the process
+};
+
+#endif /* _TBB_malloc_proxy_trace_H_ */
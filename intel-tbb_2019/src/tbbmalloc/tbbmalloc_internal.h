@@ -132,6 +132,16 @@ const size_t largeObjectAlignment = estimatedCacheLineSize;
  */
 const uint32_t numBlockBinLimit = 31;
 
+/*
+ * The number of NUMA nodes that memory regions and free blocks
+ * are kept separately for. Nodes above the limit are folded.
+ */
+#if __linux__
+const int maxNumaNodes = 4;
+#else
+const int maxNumaNodes = 1;
+#endif
+
 /********** End of numeric parameters controlling allocations *********/
 
 class BlockI;
@@ -236,23 +246,54 @@ public:
 };
 
 
+// Counters of events happening often, collected when statistics mode is on.
+// Changed only by the owning thread, so not atomic.
+struct ThreadStatistics {
+    intptr_t slabObjects[numBlockBinLimit]; // allocated minus released objects in slabs
+    intptr_t largeLocalCacheHits;           // got from thread-local large object cache
+
+    void add(const ThreadStatistics &s) {
+        for (unsigned i=0; i<numBlockBinLimit; i++)
+            slabObjects[i] += s.slabObjects[i];
+        largeLocalCacheHits += s.largeLocalCacheHits;
+    }
+};
+
+// Counters of rare events, collected when statistics mode is on.
+struct PoolStatistics {
+    intptr_t slabBlocks[numBlockBinLimit], // slabs that serve the bin
+             slabObjects[numBlockBinLimit], // changes made while no thread owns a slab
+             locHits,
+             locMisses,
+             locEvictions,                 // released from cache to backend
+             hugePageSlabGroups,           // huge pages given to threads for slabs
+             groupedSlabs,                 // slabs taken from such huge pages
+             ungroupedSlabs;               // slabs taken from backend directly
+};
+
 // The part of thread-specific data that can be modified by other threads.
 // Such modifications must be protected by AllLocalCaches::listLock.
 struct TLSRemote {
     TLSRemote *next,
               *prev;
+    ThreadStatistics stat; // changed by owner, read by others under listLock
 };
 
 // The list of all thread-local data; supporting cleanup of thread caches
 class AllLocalCaches {
     TLSRemote  *head;
     MallocMutex listLock; // protects operations in the list
+    ThreadStatistics unregisteredStat; // of threads that are already gone
 public:
     void registerThread(TLSRemote *tls);
     void unregisterThread(TLSRemote *tls);
     bool cleanup(ExtMemoryPool *extPool, bool cleanOnlyUnused);
     void markUnused();
-    void reset() { head = NULL; }
+    void collectStatistics(ThreadStatistics *total);
+    void reset() {
+        head = NULL;
+        memset(&unregisteredStat, 0, sizeof(ThreadStatistics));
+    }
 };
 
 class LifoList {
@@ -276,12 +317,18 @@ private:
  */
 
 class OrphanedBlocks {
-    LifoList bins[numBlockBinLimit];
 public:
     Block *get(TLSData *tls, unsigned int size);
+    Block *getFromOtherNodes(TLSData *tls, unsigned int size);
     void put(intptr_t binTag, Block *block);
+    // move blocks of all nodes to the list of node 0, used when NUMA mode is off
+    void mergeNodes();
+    void moveToNode0(int node, unsigned int index);
     void reset();
     bool cleanup(Backend* backend);
+
+private:
+    LifoList bins[maxNumaNodes][numBlockBinLimit];
 };
 
 /* cache blocks in range [MinSize; MaxSize) in bins with CacheStep
@@ -348,8 +395,13 @@ public:
                           cachedSize;
   /* mean time of presence of block in the bin before successful reuse */
         intptr_t          meanHitRange;
+  /* learned time between release of a block and next request for the bin,
+     kept when the history is forgotten; used only by adaptive policy */
+        intptr_t          reuseDistance;
   /* time of last get called for the bin */
         uintptr_t         lastGet;
+  /* blocks cached before this time are already decayed */
+        uintptr_t         decayedAge;
 
         typename MallocAggregator<CacheBinOperation>::type aggregator;
 
@@ -362,12 +414,10 @@ public:
         LargeMemoryBlock *get(ExtMemoryPool *extMemPool, size_t size, BinBitMask *bitMask, int idx);
         bool cleanToThreshold(ExtMemoryPool *extMemPool, BinBitMask *bitMask, uintptr_t currTime, int idx);
         bool releaseAllToBackend(ExtMemoryPool *extMemPool, BinBitMask *bitMask, int idx);
+        size_t decay(ExtMemoryPool *extMemPool, BinBitMask *bitMask, uintptr_t decayAge, int idx);
         void updateUsedSize(ExtMemoryPool *extMemPool, size_t size, BinBitMask *bitMask, int idx);
 
-        void decreaseThreshold() {
-            if (ageThreshold)
-                ageThreshold = (ageThreshold + meanHitRange)/2;
-        }
+        void decreaseThreshold();
         void updateBinsSummary(BinsSummary *binsSummary) const {
             binsSummary->update(usedSize, cachedSize);
         }
@@ -380,19 +430,15 @@ public:
         LargeMemoryBlock *get();
         LargeMemoryBlock *cleanToThreshold(uintptr_t currTime, BinBitMask *bitMask, int idx);
         LargeMemoryBlock *cleanAll(BinBitMask *bitMask, int idx);
+        size_t decay(Backend *backend, uintptr_t decayAge);
         void updateUsedSize(size_t size, BinBitMask *bitMask, int idx) {
             if (!usedSize) bitMask->set(idx, true);
             usedSize += size;
             if (!usedSize && !first) bitMask->set(idx, false);
         }
-        void updateMeanHitRange( intptr_t hitRange ) {
-            hitRange = hitRange >= 0 ? hitRange : 0;
-            meanHitRange = meanHitRange ? (meanHitRange + hitRange)/2 : hitRange;
-        }
-        void updateAgeThreshold( uintptr_t currTime ) {
-            if (lastCleanedAge)
-                ageThreshold = Props::OnMissFactor*(currTime - lastCleanedAge);
-        }
+        void updateMeanHitRange( intptr_t hitRange );
+        void updateAgeThreshold( uintptr_t currTime );
+        void learnReuseDistance( intptr_t distance );
         void updateCachedSize(size_t size) { cachedSize += size; }
         void setLastGet( uintptr_t newLastGet ) { lastGet = newLastGet; }
   /* -------------------------------------------------------- */
@@ -418,6 +464,7 @@ public:
     void updateCacheState(ExtMemoryPool *extMemPool, DecreaseOrIncrease op, size_t size);
     bool regularCleanup(ExtMemoryPool *extMemPool, uintptr_t currAge, bool doThreshDecr);
     bool cleanAll(ExtMemoryPool *extMemPool);
+    size_t decay(ExtMemoryPool *extMemPool, uintptr_t decayAge);
     void reset() {
         tooLargeLOC = 0;
         for (int i = numBins-1; i >= 0; i--)
@@ -462,6 +509,8 @@ private:
        and accuracy of predictors suffers.
     */
     uintptr_t cacheCurrTime;
+    // cacheCurrTime at the last passes of memory decay, see decay()
+    uintptr_t decayPassTime[3];
 
                      // memory pool that owns this LargeObjectCache,
     ExtMemoryPool *extMemPool; // strict 1:1 relation, never changed
@@ -480,9 +529,11 @@ public:
     bool decreasingCleanup();
     bool regularCleanup();
     bool cleanAll();
+    size_t decay(intptr_t epoch);
     void reset() {
         largeCache.reset();
         hugeCache.reset();
+        memset(decayPassTime, 0, sizeof(decayPassTime));
     }
     void reportStat(FILE *f);
 #if __TBB_MALLOC_WHITEBOX_TEST
@@ -534,6 +585,9 @@ public:
 // and must be preserved in used blocks.
 class BlockI {
     intptr_t     blockState[2];
+    intptr_t     numaNode;      // node of the backend region, set by backend
+public:
+    int getNumaNode() const { return (int)numaNode; }
 };
 
 struct LargeMemoryBlock : public BlockI {
@@ -632,6 +686,7 @@ public:
     void add(MemRegion *r);
     void remove(MemRegion *r);
     int reportStat(FILE *f);
+    void collectStatistics(ScalableAllocationStatistics *stat);
 };
 
 class Backend {
@@ -698,6 +753,7 @@ public:
         FreeBlock *findBlock(int nativeBin, BackendSync *sync, size_t size,
                              bool resSlabAligned, bool alignedBin, int *numOfLockedBins);
         bool tryReleaseRegions(int binIdx, Backend *backend);
+        size_t decayBlocks(int binIdx, Backend *backend, intptr_t decayEpoch);
         void lockRemoveBlock(int binIdx, FreeBlock *fBlock);
         void addBlock(int binIdx, FreeBlock *fBlock, size_t blockSz, bool addToTail);
         bool tryAddBlock(int binIdx, FreeBlock *fBlock, bool addToTail);
@@ -785,17 +841,21 @@ private:
     // TODO: decrease, not only increase it
     size_t           maxRequestedSize;
 
-    FreeBlock *addNewRegion(size_t size, MemRegionType type, bool addToBin);
+    FreeBlock *addNewRegion(size_t size, MemRegionType type, bool addToBin, int node);
     FreeBlock *findBlockInRegion(MemRegion *region, size_t exactBlockSize);
     void startUseBlock(MemRegion *region, FreeBlock *fBlock, bool addToBin);
     void releaseRegion(MemRegion *region);
 
     FreeBlock *releaseMemInCaches(intptr_t startModifiedCnt,
                                   int *lockedBinsThreshold, int numOfLockedBins);
-    void requestBootstrapMem();
+    void requestBootstrapMem(int node);
     FreeBlock *askMemFromOS(size_t totalReqSize, intptr_t startModifiedCnt,
                             int *lockedBinsThreshold, int numOfLockedBins,
-                            bool *splittable);
+                            bool *splittable, int node);
+    FreeBlock *findBlockInBins(int node, int nativeBin, size_t size,
+                               bool resSlabAligned, int *numOfLockedBins);
+    FreeBlock *findBlockOnOtherNodes(int node, int nativeBin, size_t size,
+                                     bool resSlabAligned, int *numOfLockedBins);
     FreeBlock *genericGetBlock(int num, size_t size, bool resSlabAligned);
     void genericPutBlock(FreeBlock *fBlock, size_t blockSz);
     FreeBlock *splitUnalignedBlock(FreeBlock *fBlock, int num, size_t size,
@@ -809,7 +869,7 @@ private:
 
     void removeBlockFromBin(FreeBlock *fBlock);
 
-    void *allocRawMem(size_t &size);
+    void *allocRawMem(size_t &size, bool *hugePagesUsed);
     bool freeRawMem(void *object, size_t size);
 
     void putLargeBlock(LargeMemoryBlock *lmb);
@@ -822,7 +882,14 @@ public:
     void reset();
     bool destroy();
     bool clean(); // clean on caches cleanup
+    // release pages of blocks freed not later than decayEpoch
+    size_t decay(intptr_t decayEpoch);
+    // return pages fully inside [start; start+size) to OS, keeping them mapped
+    size_t releasePages(void *start, size_t size);
     void reportStat(FILE *f);
+    void collectStatistics(ScalableAllocationStatistics *stat) {
+        regionList.collectStatistics(stat);
+    }
 
     BlockI *getSlabBlock(int num) {
         BlockI *b = (BlockI*)
@@ -833,10 +900,17 @@ public:
     void putSlabBlock(BlockI *block) {
         genericPutBlock((FreeBlock *)block, slabSize);
     }
+    void putSlabBlocks(BlockI *block, int num) {
+        genericPutBlock((FreeBlock *)block, num*slabSize);
+    }
+    // contiguous slabs that fill exactly one huge page
+    BlockI *getHugePageSlabs();
     void *getBackRefSpace(size_t size, bool *rawMemUsed);
     void putBackRefSpace(void *b, size_t size, bool rawMemUsed);
 
     bool inUserPool() const;
+    // the node to take memory from for the current thread
+    inline int currentNumaNode() const;
 
     LargeMemoryBlock *getLargeBlock(size_t size);
     void returnLargeObject(LargeMemoryBlock *lmb);
@@ -880,8 +954,9 @@ private:
 
     // register bins related to advance regions
     AdvRegionsBins advRegBins;
-    IndexedBins freeLargeBins,
-                freeAlignedBins;
+    // free blocks are kept separately for each NUMA node
+    IndexedBins freeLargeBins[maxNumaNodes],
+                freeAlignedBins[maxNumaNodes];
 };
 
 // An TBB allocator mode that can be controlled by user
@@ -901,7 +976,8 @@ public:
         val = newVal;
         setDone = true;
     }
-    // envName - environment variable to get controlled mode
+    // envName - environment variable to get controlled mode,
+    // its value must be a non-negative integer
     void initReadEnv(const char *envName, intptr_t defaultVal);
 };
 
@@ -1046,6 +1122,163 @@ public:
     }
 };
 
+// NUMA topology and mapping of threads to nodes. When enabled, the backend
+// keeps memory regions and free blocks for each node separately,
+// and threads prefer memory of the node they are running on.
+// Setting TBB_MALLOC_NUMA_FAKE_NODES=N emulates N nodes on a machine
+// with less nodes, threads are assigned to fake nodes round-robin.
+// init() and reset() are called only under global initialization lock,
+// setMode() can be called concurrently.
+// Object must reside in zero-initialized memory.
+class NumaTopology {
+    static const int maxCpus = 1024;
+
+    AllocControlledMode requestedMode; // changed only by user
+                                       // to keep enabled and requestedMode consistent
+    MallocMutex setModeLock;
+    tls_key_t   fakeNodeKey;      // node+1 of a thread for fake topology
+    intptr_t    fakeNodesAssigned;
+    uint8_t     cpuToNode[maxCpus];
+
+    void parseSystemTopology();
+    int  detectCurrentNode();
+public:
+    int  nodesNum;  // number of nodes used, 1 if no NUMA found
+    bool isFake;
+    bool isEnabled;
+
+    void init();
+    // emulate nodesNum nodes, returns false if not possible
+    bool initFakeTopology(int fakeNodesNum);
+    // Could be set from user code at any place.
+    void setMode(intptr_t newVal);
+    void reset();
+
+    int currentNode() { return isEnabled? detectCurrentNode() : 0; }
+    // node of the calling thread, regardless of the mode
+    int threadNode() { return nodesNum>1? detectCurrentNode() : 0; }
+};
+
+// A run time setting of the allocator, read on hot paths without locking.
+// The initial value is taken from an environment variable at init(),
+// set() from user code overrides it. Setters are serialized to keep
+// the value and the requested one consistent.
+// Object must reside in zero-initialized memory.
+template<typename T, intptr_t defaultVal = 0>
+class RuntimeSetting {
+    AllocControlledMode requested; // changed only by user
+    MallocMutex setLock;
+    T value;
+public:
+    // envName - environment variable to get the initial value
+    void init(const char *envName) {
+        MallocMutex::scoped_lock lock(setLock);
+        requested.initReadEnv(envName, defaultVal);
+        value = (T)requested.get();
+    }
+    // Could be set from user code at any place.
+    void set(intptr_t newVal) {
+        MallocMutex::scoped_lock lock(setLock);
+        requested.set(newVal);
+        value = (T)newVal;
+    }
+    T get() const { return value; }
+    void reset() { value = (T)defaultVal; }
+};
+
+// Collecting of statistics is switched in run time, as counters are
+// checked on hot paths.
+typedef RuntimeSetting<bool> StatisticsMode;
+
+// Slabs of a thread are taken from huge pages dedicated to groups of bins,
+// so hot size classes of the thread share few TLB entries.
+typedef RuntimeSetting<bool> HugePageSlabsMode;
+
+// Objects of blocks owned by other threads are not released one by one,
+// but buffered by the releasing thread and published in batches.
+// The value is the number of objects buffered by a thread, 0 if buffering is off.
+typedef RuntimeSetting<intptr_t> RemoteFreeBatching;
+
+// Adaptive policy of large object cache: each bin learns reuse distance
+// of its blocks from hits and misses and sets caching threshold from it,
+// so bursts of same-size objects are cached starting from the first one.
+typedef RuntimeSetting<bool> AdaptiveLOCMode;
+
+// Limit of total size of large objects cached by a thread.
+typedef RuntimeSetting<size_t, 4*1024*1024> LocalLOCSize;
+
+// Background releasing of free memory not reused for decay time. Pages are
+// returned to OS with madvise, so address space stays mapped and reusing
+// the memory costs only page faults. Object must reside in zero-initialized memory.
+class MemoryDecay {
+    AllocControlledMode requestedTime; // changed only by user
+    MallocMutex setTimeLock;
+public:
+    intptr_t decayTime; // in milliseconds, 0 if purging is off
+    intptr_t epoch;     // number of purging passes done
+
+    void init();
+    // Could be set from user code at any place. Returns false,
+    // if purging thread can't be used on the platform.
+    bool setTime(intptr_t ms);
+    // start purging thread if decay time was set before initialization
+    void startRequested();
+    void shutdown();
+    void reset() { decayTime = epoch = 0; }
+};
+
+// Sampled allocation-site profiling. After every samplingInterval bytes
+// allocated by a thread, the stack of the allocation is recorded and
+// the object is tracked until released. Object must reside in zero-initialized memory.
+class HeapProfiler {
+    static const int maxDepth = 24,
+                     stacksNum = 512,    // different stacks that can be recorded
+                     trackedNum = 4096,  // sampled objects that can be alive at once
+                     maxProbes = 16;     // search length in the table of tracked objects
+
+    struct StackRecord {
+        uintptr_t hash;
+        int       depth;
+        void     *frames[maxDepth];
+        intptr_t  allocObjs, allocBytes,
+                  inuseObjs, inuseBytes;
+    };
+    struct TrackedObject {
+        intptr_t     object;  // 0 for free slot
+        StackRecord *stack;
+        size_t       size;
+    };
+
+    MallocMutex   lock;
+    intptr_t      trackedObjects; // to skip search in tracked when it's empty
+    StackRecord   stacks[stacksNum];
+    TrackedObject tracked[trackedNum];
+
+    static unsigned objectHash(intptr_t object) {
+        return (unsigned)((uintptr_t)object>>3) * 2654435761U % trackedNum;
+    }
+    StackRecord *findStack(void **frames, int depth);
+    void doRecordRelease(const void *object);
+public:
+    intptr_t samplingInterval; // 0 if profiling is off
+
+    // returns false if profiling is not supported
+    bool setSampling(intptr_t interval);
+    void recordAllocation(const void *object, size_t size);
+    void recordRelease(const void *object) {
+        if (FencedLoad(trackedObjects))
+            doRecordRelease(object);
+    }
+    // write profile in pprof heap text format
+    bool dump(const char *fileName);
+    void reset();
+};
+
+extern StatisticsMode statisticsMode;
+extern AdaptiveLOCMode adaptiveLOC;
+extern MemoryDecay memoryDecay;
+extern HeapProfiler heapProfiler;
+
 class AllLargeBlocksList {
     MallocMutex       largeObjLock;
     LargeMemoryBlock *loHead;
@@ -1074,6 +1307,7 @@ struct ExtMemoryPool {
     // TODO: implements fixedPool with calling rawFree on destruction
                       fixedPool;
     TLSKey            tlsPointerKey;  // per-pool TLS key
+    PoolStatistics    stat;
 
     bool init(intptr_t poolId, rawAllocType rawAlloc, rawFreeType rawFree,
               size_t granularity, bool keepAllMemory, bool fixedPool);
@@ -1086,10 +1320,12 @@ struct ExtMemoryPool {
     bool softCachesCleanup();
     bool releaseAllLocalCaches();
     bool hardCachesCleanup();
+    size_t decay(intptr_t epoch);
     void *remap(void *ptr, size_t oldSize, size_t newSize, size_t alignment);
     bool reset() {
         loc.reset();
         allLocalCaches.reset();
+        memset(&stat, 0, sizeof(PoolStatistics));
         orphanedBlocks.reset();
         bool ret = tlsPointerKey.destroy();
         backend.reset();
@@ -1123,6 +1359,13 @@ struct ExtMemoryPool {
 
 inline bool Backend::inUserPool() const { return extMemPool->userPool(); }
 
+extern NumaTopology numaTopology;
+
+// user pools get memory from a callback, it has no known node
+inline int Backend::currentNumaNode() const {
+    return inUserPool()? 0 : numaTopology.currentNode();
+}
+
 struct LargeObjectHdr {
     LargeMemoryBlock *memoryBlock;
     /* Backreference points to LargeObjectHdr.
@@ -52,6 +52,8 @@
 #include "../tbb/observer_proxy.cpp"
 #include "../tbb/task.cpp"
 #include "../tbb/task_group_context.cpp"
+#include "../tbb/tbb_trace.cpp"
+#include "../tbb/epoch_reclamation.cpp"
 
 // Other dependencies
 #include "../tbb/cache_aligned_allocator.cpp"
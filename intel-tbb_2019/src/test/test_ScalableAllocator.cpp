@@ -163,6 +163,74 @@ void TestSmallFixedSizePool()
 #endif
 }
 
+void TestMonotonicArena()
+{
+    typedef tbb::memory_pool_allocator<void, tbb::monotonic_arena> arena_alloc_t;
+    {
+        tbb::monotonic_arena arena(1024);
+        arena_alloc_t::rebind<Foo<int,17> >::other a(( arena_alloc_t(arena) ));
+        TestBasic<Foo<int,17> >(a);
+        ASSERT(!NumberOfFoo, NULL);
+
+        arena.recycle();
+        void *first = arena.malloc(10);
+        ASSERT(first && !((uintptr_t)first % tbb::monotonic_arena::default_alignment), NULL);
+        char *aligned = (char*)arena.malloc(3, 4096);
+        ASSERT(aligned && !((uintptr_t)aligned % 4096), NULL);
+        arena.recycle();
+        void *objs[1000];
+        for (int i=0; i<1000; i++) {
+            objs[i] = arena.malloc(i);
+            ASSERT(objs[i], NULL);
+            memset(objs[i], i, i);
+        }
+        // after recycle same memory is given in same order
+        arena.recycle();
+        ASSERT(arena.malloc(10) == first, "Memory must be reused after recycle.");
+        for (int i=1; i<1000; i++)
+            ASSERT(arena.malloc(i), NULL);
+        arena.release();
+        ASSERT(arena.malloc(10), NULL);
+    }{
+        // objects from the buffer first, then from scalable_malloc
+        char buf[4096];
+        tbb::monotonic_arena arena(buf, sizeof(buf));
+        char *p = (char*)arena.malloc(100);
+        ASSERT(p > buf && p+100 <= buf+sizeof(buf), "Buffer must be used first.");
+        char *big = (char*)arena.malloc(2*sizeof(buf));
+        ASSERT(big && (big+2*sizeof(buf) <= buf || big >= buf+sizeof(buf)), NULL);
+        memset(big, 0, 2*sizeof(buf));
+        arena.release();
+        ASSERT(arena.malloc(100) == p, "Buffer must survive release.");
+    }{
+        // chunks from fixed_pool, then from scalable_malloc when the pool is exhausted
+        static char buf[1024*1024];
+        tbb::fixed_pool pool(buf, sizeof(buf));
+        tbb::monotonic_arena arena(pool);
+        char *p = (char*)arena.malloc(100);
+        ASSERT(p >= buf && p < buf+sizeof(buf), "Upstream pool must be used first.");
+        for (int i=0; i<100; i++) {
+            p = (char*)arena.malloc(64*1024);
+            ASSERT(p, NULL);
+            memset(p, 0, 64*1024);
+        }
+        ASSERT(p < buf || p >= buf+sizeof(buf), "Expected fallback to scalable_malloc.");
+        arena.recycle();
+        for (int i=0; i<100; i++)
+            ASSERT(arena.malloc(64*1024), NULL);
+    }
+#if TBB_USE_EXCEPTIONS
+    try {
+        char buf[8];
+        tbb::monotonic_arena arena(buf, sizeof(buf));
+        ASSERT(0, "Arena must not be created in too small buffer");
+    } catch (std::invalid_argument&) {
+    } catch (...) {
+        ASSERT(0, "wrong exception type; expected invalid_argument");
+    }
+#endif
+}
+
 int TestMain () {
 #if _MSC_VER && !__TBBMALLOC_NO_IMPLICIT_LINKAGE && !__TBB_WIN8UI_SUPPORT
     #ifdef _DEBUG
@@ -206,6 +274,7 @@ int TestMain () {
     }
     TestSmallFixedSizePool();
     TestZeroSpaceMemoryPool();
+    TestMonotonicArena();
 
     ASSERT( !result, NULL );
     return Harness::Done;
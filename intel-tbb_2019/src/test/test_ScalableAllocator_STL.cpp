@@ -23,6 +23,7 @@
 #define HARNESS_NO_PARSE_COMMAND_LINE 1
 #define __TBB_EXTRA_DEBUG 1 // enables additional checks
 #define TBB_PREVIEW_MEMORY_POOL 1
+#define TBB_USE_SCALABLE_FREE_SIZED 1 // deallocate of scalable_allocator releases by size
 
 #include "harness_assert.h"
 #include "tbb/memory_pool.h"
@@ -39,6 +40,8 @@ int TestMain () {
     static char buf[1024*1024*4];
     tbb::fixed_pool fpool(buf, sizeof(buf));
     TestAllocatorWithSTL(tbb::memory_pool_allocator<void>(fpool) );
+    tbb::monotonic_arena arena;
+    TestAllocatorWithSTL(tbb::memory_pool_allocator<void, tbb::monotonic_arena>(arena) );
 
 #if __TBB_CPP17_MEMORY_RESOURCE_PRESENT
     ASSERT(!tbb::scalable_memory_resource()->is_equal(*std::pmr::get_default_resource()),
@@ -0,0 +1,234 @@
+/*
+    Copyright (c) 2005-2019 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+#include "tbb/concurrent_flat_hash_map.h"
+#include "tbb/atomic.h"
+#include "tbb/tick_count.h"
+#include "harness.h"
+#include "harness_barrier.h"
+
+//! Value whose halves are always written together, so that torn reads are detected.
+struct Pair {
+    long first;
+    long second;
+};
+
+static Pair MakePair( long x ) {
+    Pair p = { x, -x };
+    return p;
+}
+
+static bool IsWhole( const Pair& p ) { return p.first == -p.second; }
+
+typedef tbb::concurrent_flat_hash_map<int, Pair> MyTable;
+
+//! Hashing that puts all the keys into the same group and gives them the same tag.
+struct CollidingHashCompare {
+    size_t hash( int ) const { return 0; }
+    bool equal( int a, int b ) const { return a == b; }
+};
+
+struct SetSecond {
+    long my_value;
+    SetSecond( long value ) : my_value(value) {}
+    void operator()( Pair& p ) const { p = MakePair( my_value ); }
+};
+
+template<typename Table>
+void TestSerialOperations( Table& table, int n ) {
+    for( int i = 0; i < n; ++i ) {
+        ASSERT( table.insert( i, MakePair( i ) ), "insert of a new key failed" );
+        ASSERT( !table.insert( std::make_pair( i, MakePair( -1 ) ) ), "insert of an existing key succeeded" );
+    }
+    ASSERT( table.size() == size_t(n) && !table.empty(), NULL );
+    for( int i = 0; i < n; ++i ) {
+        Pair p;
+        ASSERT( table.find( i, p ) && p.first == i && IsWhole( p ), "key is lost or its value is changed" );
+    }
+    ASSERT( !table.count( n ) && !table.count( -1 ), NULL );
+    for( int i = 0; i < n; i += 2 )
+        ASSERT( table.erase( i ), NULL );
+    for( int i = 0; i < n; i += 2 )
+        ASSERT( !table.erase( i ) && !table.count( i ), "erased key is found" );
+    for( int i = 1; i < n; i += 2 ) {
+        ASSERT( !table.insert_or_assign( i, MakePair( 2*i ) ), NULL );
+        ASSERT( table.update( i, SetSecond( 3*i ) ), NULL );
+    }
+    ASSERT( !table.update( 0, SetSecond( 0 ) ), "update of an absent key succeeded" );
+    ASSERT( table.size() == size_t(n/2), NULL );
+    for( int i = 0; i < n; ++i ) {
+        Pair p;
+        const bool found = table.find( i, p );
+        ASSERT( found == (i % 2 == 1), NULL );
+        ASSERT( !found || p.first == 3*i, "update is lost" );
+    }
+}
+
+void TestSerial() {
+    REMARK( "testing serial operations\n" );
+    {
+        MyTable table;
+        ASSERT( table.empty() && table.bucket_count() == 16, NULL );
+        TestSerialOperations( table, 10000 );
+        const size_t buckets = table.bucket_count();
+        ASSERT( buckets >= 10000, "table has not grown" );
+
+        // The copy and the rehash keep only the items that are not erased
+        MyTable copy( table );
+        ASSERT( copy.size() == table.size() && copy.count( 1 ) && !copy.count( 2 ), NULL );
+        table.rehash();
+        ASSERT( table.bucket_count() <= buckets && table.size() == 5000, NULL );
+        table.reserve( 100000 );
+        ASSERT( table.bucket_count() >= 100000 && table.size() == 5000 && table.count( 9999 ), NULL );
+
+        MyTable other( 100 );
+        other.insert( -5, MakePair( -5 ) );
+        other.swap( table );
+        ASSERT( other.size() == 5000 && table.size() == 1 && table.count( -5 ), NULL );
+        table = copy;
+        ASSERT( table.size() == 5000 && !table.count( -5 ), NULL );
+        table.clear();
+        ASSERT( table.empty() && !table.count( 1 ), NULL );
+        TestSerialOperations( table, 100 );
+    }
+    {
+        // All the keys collide, so every lookup probes the whole table
+        tbb::concurrent_flat_hash_map<int, Pair, CollidingHashCompare> table;
+        TestSerialOperations( table, 300 );
+    }
+    {
+        // Reinserting the erased keys fills the table with the erased items, which the growth drops
+        MyTable table;
+        for( int rep = 0; rep < 1000; ++rep ) {
+            ASSERT( table.insert( rep, MakePair( rep ) ), NULL );
+            ASSERT( table.erase( rep ), NULL );
+        }
+        ASSERT( table.empty() && table.bucket_count() <= 64, "erased items are not dropped" );
+    }
+}
+
+//! Every thread inserts the same keys, and every key is inserted once.
+class InsertSameKeys : NoAssign {
+    MyTable& my_table;
+    tbb::atomic<int>& my_inserted;
+    int my_n;
+public:
+    InsertSameKeys( MyTable& table, tbb::atomic<int>& inserted, int n ) : my_table(table), my_inserted(inserted), my_n(n) {}
+    void operator()( int id ) const {
+        for( int i = 0; i < my_n; ++i ) {
+            const int key = (i * 7 + id * 13) % my_n;
+            if( my_table.insert( key, MakePair( key ) ) )
+                ++my_inserted;
+        }
+    }
+};
+
+//! Every thread erases the same keys, and every key is erased once.
+class EraseSameKeys : NoAssign {
+    MyTable& my_table;
+    tbb::atomic<int>& my_erased;
+    int my_n;
+public:
+    EraseSameKeys( MyTable& table, tbb::atomic<int>& erased, int n ) : my_table(table), my_erased(erased), my_n(n) {}
+    void operator()( int id ) const {
+        for( int i = 0; i < my_n; ++i ) {
+            const int key = (i * 11 + id * 17) % my_n;
+            if( my_table.erase( key ) )
+                ++my_erased;
+        }
+    }
+};
+
+void TestUniqueness( int nthread ) {
+    REMARK( "testing insertions and erasures of the same keys with %d threads\n", nthread );
+    MyTable table;
+    const int n = 50000;
+    tbb::atomic<int> inserted, erased;
+    inserted = 0; erased = 0;
+    NativeParallelFor( nthread, InsertSameKeys( table, inserted, n ) );
+    ASSERT( inserted == n && int(table.size()) == n, "key is inserted twice or lost" );
+    for( int i = 0; i < n; ++i ) {
+        Pair p;
+        ASSERT( table.find( i, p ) && p.first == i && IsWhole( p ), NULL );
+    }
+    NativeParallelFor( nthread, EraseSameKeys( table, erased, n ) );
+    ASSERT( erased == n && table.empty(), "key is erased twice or not erased" );
+}
+
+//! Thread 0 keeps on growing the table, the others look up and update the keys inserted before.
+class GrowAndRead : NoAssign {
+    MyTable& my_table;
+    Harness::SpinBarrier& my_barrier;
+    tbb::atomic<bool>& my_done;
+    int my_stable;
+    int my_grow;
+public:
+    GrowAndRead( MyTable& table, Harness::SpinBarrier& barrier, tbb::atomic<bool>& done, int stable, int grow )
+        : my_table(table), my_barrier(barrier), my_done(done), my_stable(stable), my_grow(grow) {}
+    void operator()( int id ) const {
+        my_barrier.wait();
+        if( id == 0 ) {
+            for( int i = 0; i < my_grow; ++i )
+                ASSERT( my_table.insert( my_stable + i, MakePair( i ) ), NULL );
+            my_done = true;
+            return;
+        }
+        for( long rep = 0; !my_done || rep < 2; ++rep ) {
+            for( int i = id; i < my_stable; i += 3 ) {
+                Pair p;
+                ASSERT( my_table.find( i, p ), "key is not found while the table grows" );
+                ASSERT( IsWhole( p ), "torn value is read" );
+                if( id % 2 )
+                    my_table.update( i, SetSecond( p.first + 1 ) );
+                else
+                    my_table.insert_or_assign( i, MakePair( p.first + 1 ) );
+            }
+        }
+    }
+};
+
+void TestGrowthWithReaders( int nthread ) {
+    REMARK( "testing lookups during growth with %d threads\n", nthread );
+    const int stable = 1000, grow = 200000;
+    MyTable table;
+    for( int i = 0; i < stable; ++i )
+        table.insert( i, MakePair( 0 ) );
+    Harness::SpinBarrier barrier( nthread );
+    tbb::atomic<bool> done;
+    done = false;
+    tbb::tick_count t0 = tbb::tick_count::now();
+    NativeParallelFor( nthread, GrowAndRead( table, barrier, done, stable, grow ) );
+    REMARK( "time = %g with %d threads\n", (tbb::tick_count::now() - t0).seconds(), nthread );
+    ASSERT( int(table.size()) == stable + grow, NULL );
+    for( int i = 0; i < stable + grow; ++i )
+        ASSERT( table.count( i ), "key is lost during growth" );
+}
+
+int TestMain () {
+    if( MinThread<1 ) MinThread=1;
+    if( MaxThread<2 ) MaxThread=2;
+    TestSerial();
+    for( int nthread=MinThread; nthread<=MaxThread; ++nthread ) {
+        TestUniqueness( nthread );
+        if( nthread > 1 )
+            TestGrowthWithReaders( nthread );
+    }
+    return Harness::Done;
+}
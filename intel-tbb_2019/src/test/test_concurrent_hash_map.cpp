@@ -1614,6 +1614,257 @@ void TestScopedAllocator() {
 //------------------------------------------------------------------------
 // Test driver
 //------------------------------------------------------------------------
+#include "tbb/internal/_epoch_reclamation.h"
+#include <string>
+
+static tbb::atomic<int> FreedCount;
+
+static void CountingDeleter( void* object, void* ) {
+    delete static_cast<int*>( object );
+    ++FreedCount;
+}
+
+//! Thread 0 reads in an epoch while thread 1 retires objects; none of them may be freed meanwhile.
+class EpochBody : NoAssign {
+    Harness::SpinBarrier& my_barrier;
+    void* my_context;
+public:
+    static const int n = 1000;
+    EpochBody( Harness::SpinBarrier& barrier, void* context ) : my_barrier(barrier), my_context(context) {}
+    void operator()( int id ) const {
+        if( id == 0 ) {
+            tbb::internal::epoch_enter();
+            tbb::internal::epoch_enter(); // nested
+            my_barrier.wait();
+            my_barrier.wait(); // objects are retired
+            tbb::internal::epoch_leave();
+            tbb::internal::epoch_leave();
+            my_barrier.wait();
+        } else {
+            my_barrier.wait();
+            for( int i = 0; i < n; ++i )
+                tbb::internal::epoch_retire( new int(i), &CountingDeleter, my_context );
+            ASSERT( FreedCount == 0, "object is freed while a reader may see it" );
+            my_barrier.wait();
+            my_barrier.wait(); // the reader has left
+            // The record may come from a finished thread with objects of its own, so retire until the reclamation happens
+            for( int i = 0; i < 16*n && FreedCount < n; ++i )
+                tbb::internal::epoch_retire( new int(i), &CountingDeleter, my_context );
+            ASSERT( FreedCount >= n, "objects are not freed after the readers left" );
+        }
+    }
+};
+
+void TestEpochReclamation() {
+    REMARK( "testing epoch-based reclamation\n" );
+    FreedCount = 0;
+    int context;
+    Harness::SpinBarrier barrier( 2 );
+    NativeParallelFor( 2, EpochBody( barrier, &context ) );
+    tbb::internal::epoch_purge( &context );
+    tbb::internal::epoch_retire( new int(0), &CountingDeleter, &context );
+    int retired = FreedCount;
+    tbb::internal::epoch_purge( &context );
+    ASSERT( FreedCount == retired + 1, "epoch_purge has not freed the retired objects" );
+}
+
+//! Value whose halves are written apart by the accessors, so that a torn copy is detected.
+struct SplitValue {
+    long first;
+    long second;
+};
+
+typedef tbb::concurrent_hash_map<int,SplitValue> SplitTable;
+
+struct SplitValueChecker {
+    int my_key;
+    SplitValueChecker( int key ) : my_key(key) {}
+    void operator()( const SplitTable::value_type& item ) const {
+        ASSERT( item.first == my_key, NULL );
+        ASSERT( item.second.first == -item.second.second, "lock-free read sees a torn item" );
+    }
+};
+
+//! Thread 0 churns the table, thread 1 modifies the stable items, the others read them without locks.
+class LockFreeReadBody : NoAssign {
+    SplitTable& my_table;
+    tbb::concurrent_hash_map<int,std::string>& my_strings;
+    tbb::atomic<bool>& my_done;
+    int my_stable;
+public:
+    LockFreeReadBody( SplitTable& table, tbb::concurrent_hash_map<int,std::string>& strings, tbb::atomic<bool>& done, int stable )
+        : my_table(table), my_strings(strings), my_done(done), my_stable(stable) {}
+    void operator()( int id ) const {
+        if( id == 0 ) {
+            for( int i = 0; i < 50000; ++i ) {
+                SplitValue v = { i, -i };
+                my_table.insert( std::make_pair( my_stable + i, v ) );
+                my_strings.insert( std::make_pair( my_stable + i, std::string( 40, char('a' + i % 26) ) ) );
+                if( i % 2 ) {
+                    ASSERT( my_table.erase( my_stable + i - 1 ), NULL );
+                    ASSERT( my_strings.erase( my_stable + i - 1 ), NULL );
+                }
+            }
+            my_done = true;
+        } else if( id == 1 ) {
+            for( long rep = 1; !my_done; ++rep )
+                for( int i = 0; i < my_stable; i += 7 ) {
+                    SplitTable::accessor a;
+                    ASSERT( my_table.find( a, i ), NULL );
+                    a->second.first = rep;
+                    __TBB_Yield();
+                    a->second.second = -rep;
+                }
+        } else {
+            while( !my_done )
+                for( int i = id; i < my_stable; i += 5 ) {
+                    SplitValue v;
+                    ASSERT( my_table.find_value( i, v ), "stable item is not found" );
+                    ASSERT( v.first == -v.second, "lock-free read sees a torn item" );
+                    ASSERT( my_table.visit( i, SplitValueChecker( i ) ), NULL );
+                    ASSERT( my_table.contains( i ), NULL );
+                    std::string str;
+                    if( my_strings.find_value( my_stable + i * 8, str ) )
+                        ASSERT( str.size() == 40, NULL );
+                    my_strings.contains( my_stable + i * 8 + 1 );
+                }
+        }
+    }
+};
+
+void TestLockFreeReads( int nthread ) {
+    REMARK( "testing lock-free reads with %d threads\n", nthread );
+    const int stable = 500;
+    SplitTable table;
+    tbb::concurrent_hash_map<int,std::string> strings;
+    for( int i = 0; i < stable; ++i ) {
+        SplitValue v = { 0, 0 };
+        table.insert( std::make_pair( i, v ) );
+    }
+    tbb::atomic<bool> done;
+    done = false;
+    NativeParallelFor( nthread, LockFreeReadBody( table, strings, done, stable ) );
+    ASSERT( table.size() == size_t( stable + 25000 ), NULL );
+    for( int i = 0; i < 50000; ++i ) {
+        SplitValue v;
+        ASSERT( table.find_value( stable + i, v ) == (i % 2 == 1), "lock-free read is wrong after erasures" );
+        ASSERT( !table.contains( stable + i ) || v.first == i, NULL );
+    }
+    ASSERT( !table.contains( -1 ), NULL );
+    table.clear();
+    ASSERT( !table.contains( 0 ), NULL );
+}
+
+
+//! Counts the items that the iteration visits
+template<typename Table>
+size_t CountByIteration( const Table& table ) {
+    size_t count = 0;
+    for( typename Table::const_iterator i = table.begin(); i != table.end(); ++i )
+        ++count;
+    return count;
+}
+
+void TestSerialShrink() {
+    REMARK( "testing serial shrinking\n" );
+    const int n = 100000, kept = 100;
+    tbb::concurrent_hash_map<int,int> table;
+    for( int i = 0; i < n; ++i )
+        table.insert( std::make_pair( i, i ) );
+    const size_t full = table.bucket_count();
+    ASSERT( full >= size_t(n), NULL );
+    for( int i = kept; i < n; ++i )
+        ASSERT( table.erase( i ), NULL );
+    // The erasures shrink the table as they go; the last steps are left for rehash()
+    ASSERT( table.bucket_count() <= full / 64, "the table does not shrink on erasure" );
+    ASSERT( CountByIteration( table ) == size_t(kept), NULL );
+    for( int i = 0; i < kept; ++i ) {
+        int value;
+        ASSERT( table.find_value( i, value ) && value == i, "an item is lost by the shrinking" );
+        tbb::concurrent_hash_map<int,int>::const_accessor a;
+        ASSERT( table.find( a, i ), NULL );
+    }
+    table.rehash();
+    ASSERT( table.bucket_count() <= size_t(4 * kept), NULL );
+    ASSERT( table.size() == size_t(kept) && CountByIteration( table ) == size_t(kept), NULL );
+    // The table grows again over the buckets that it released
+    for( int i = kept; i < n; ++i )
+        table.insert( std::make_pair( i, -i ) );
+    ASSERT( table.bucket_count() >= size_t(n), NULL );
+    for( int i = 0; i < n; ++i ) {
+        tbb::concurrent_hash_map<int,int>::const_accessor a;
+        ASSERT( table.find( a, i ) && a->second == (i < kept ? i : -i), "an item is lost by the regrowth" );
+    }
+    ASSERT( CountByIteration( table ) == size_t(n), NULL );
+
+    // The table does not shrink below the buckets requested by the constructor or rehash()
+    const size_t requested = 1 << 14;
+    tbb::concurrent_hash_map<int,int> reserved( requested );
+    for( int i = 0; i < n; ++i )
+        reserved.insert( std::make_pair( i, i ) );
+    for( int i = 0; i < n; ++i )
+        reserved.erase( i );
+    reserved.rehash();
+    ASSERT( reserved.bucket_count() >= requested && reserved.bucket_count() < size_t(n), NULL );
+    reserved.rehash( requested * 2 );
+    ASSERT( reserved.bucket_count() >= requested * 2, NULL );
+    for( int i = 0; i < n; ++i )
+        reserved.insert( std::make_pair( i, i ) );
+    for( int i = 0; i < n; i += 2 )
+        reserved.erase( i );
+    reserved.clear();
+    ASSERT( reserved.empty() && !reserved.count( 1 ), NULL );
+}
+
+//! Thread 0 fills and empties the table over and over, the others read the stable items with and without locks.
+class ShrinkBody : NoAssign {
+    tbb::concurrent_hash_map<int,int>& my_table;
+    tbb::atomic<bool>& my_done;
+    int my_stable;
+public:
+    ShrinkBody( tbb::concurrent_hash_map<int,int>& table, tbb::atomic<bool>& done, int stable )
+        : my_table(table), my_done(done), my_stable(stable) {}
+    void operator()( int id ) const {
+        if( id == 0 ) {
+            for( int rep = 0; rep < 4; ++rep ) {
+                const int n = 20000 << (rep % 2);
+                for( int i = 0; i < n; ++i )
+                    my_table.insert( std::make_pair( my_stable + i, i ) );
+                for( int i = 0; i < n; ++i )
+                    ASSERT( my_table.erase( my_stable + i ), NULL );
+            }
+            my_done = true;
+        } else {
+            while( !my_done )
+                for( int i = id; i < my_stable; i += 3 ) {
+                    if( id % 2 ) {
+                        int value;
+                        ASSERT( my_table.find_value( i, value ) && value == -i, "a stable item is missed while the table resizes" );
+                    } else {
+                        tbb::concurrent_hash_map<int,int>::accessor a;
+                        ASSERT( my_table.find( a, i ) && a->second == -i, "a stable item is missed while the table resizes" );
+                    }
+                }
+        }
+    }
+};
+
+void TestConcurrentShrink( int nthread ) {
+    REMARK( "testing concurrent shrinking with %d threads\n", nthread );
+    const int stable = 100;
+    tbb::concurrent_hash_map<int,int> table;
+    for( int i = 0; i < stable; ++i )
+        table.insert( std::make_pair( i, -i ) );
+    tbb::atomic<bool> done;
+    done = false;
+    NativeParallelFor( nthread, ShrinkBody( table, done, stable ) );
+    ASSERT( table.size() == size_t(stable) && CountByIteration( table ) == size_t(stable), NULL );
+    table.rehash();
+    ASSERT( table.bucket_count() <= size_t(4 * stable), "the emptied table keeps its buckets" );
+    for( int i = 0; i < stable; ++i )
+        ASSERT( table.count( i ), NULL );
+}
+
 int TestMain () {
     if( MinThread<0 ) {
         REPORT("ERROR: must use at least one thread\n");
@@ -1625,6 +1876,7 @@ int TestMain () {
     TestTypes();
     TestCopy();
     TestRehash();
+    TestSerialShrink();
     TestAssignment();
     TestIteratorsAndRanges();
 #if __TBB_INITIALIZER_LISTS_PRESENT
@@ -1662,7 +1914,10 @@ int TestMain () {
         tbb::task_scheduler_init init( nthread );
         TestInsertFindErase( nthread );
         TestConcurrency( nthread );
+        TestLockFreeReads( nthread < 3 ? 3 : nthread );
+        TestConcurrentShrink( nthread < 3 ? 3 : nthread );
     }
+    TestEpochReclamation();
     // check linking
     if(bad_hashing) { //should be false
         tbb::internal::runtime_warning("none\nERROR: it must not be executed");
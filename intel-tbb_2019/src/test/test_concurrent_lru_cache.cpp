@@ -464,3 +464,141 @@ namespace concurrency_tests{
         }
     }
 }
+
+#ifndef TEST_COARSE_GRAINED_LOCK_IMPLEMENTATION
+namespace sharded_tests{
+    using namespace helpers;
+    namespace helpers{
+        using namespace ::helpers;
+        using ::serial_tests::usability::helpers::map_searcher;
+        using ::concurrency_tests::helpers::array_searcher;
+
+        //! Weight of an item is its key
+        struct key_weight{
+            template<typename value_type>
+            std::size_t operator()(std::size_t key, value_type const&)const{ return key; }
+        };
+    }
+
+    struct sharded_fixture_with_external_map{
+        static const size_t capacity = 8;
+
+        typedef helpers::map_searcher<size_t,helpers::object_instances_counting_serial_type> map_searcher_type;
+        typedef map_searcher_type::map_type objects_map_type;
+        typedef tbb::concurrent_sharded_lru_cache<size_t,helpers::object_instances_counting_serial_type,map_searcher_type> cache_type;
+        map_searcher_type::map_type objects_map;
+        cache_type cache;
+        //one shard makes the order of eviction predictable
+        sharded_fixture_with_external_map():cache(map_searcher_type(objects_map),capacity,tbb::lru_unit_weight(),1){}
+        bool is_evicted(size_t k){
+            objects_map_type::iterator it =objects_map.find(k);
+            ASSERT(it!=objects_map.end(),"no value for key - error in test logic ?");
+            return it->second.instances_count()==1;
+        }
+        void fill_up_cache(size_t lower_bound, size_t upper_bound){
+            for (size_t i=lower_bound;i<upper_bound;++i){
+                cache[i];
+            }
+        }
+    };
+
+    TEST_CASE_WITH_FIXTURE(test_sharded_cache_stores_no_more_than_capacity,sharded_fixture_with_external_map){
+        fill_up_cache(0,capacity+1);
+        ASSERT(cache.size()==capacity,"cache should respect its capacity");
+        ASSERT(is_evicted(0) && !is_evicted(1),"cache should evict the oldest item first");
+    }
+
+    TEST_CASE_WITH_FIXTURE(test_sharded_cache_spares_referenced_objects,sharded_fixture_with_external_map){
+        fill_up_cache(0,capacity);
+        //heat up first element
+        cache[0];
+        //cause eviction
+        cache[capacity];
+        ASSERT(is_evicted(1) && !is_evicted(0),"cache should evict the items that are not referenced since the last pass");
+    }
+
+    TEST_CASE_WITH_FIXTURE(test_sharded_cache_live_handle_prevents_eviction,sharded_fixture_with_external_map){
+        cache_type::handle h = cache[0];
+        {
+            cache_type::handle h1 = cache[0];
+        }
+        fill_up_cache(1,2*capacity);
+        ASSERT(!is_evicted(0) && is_evicted(1),"cache should not evict items in use");
+        ASSERT(cache.size()==capacity,"the items in use should count in the capacity");
+    }
+
+    struct empty_fixture{};
+
+    TEST_CASE_WITH_FIXTURE(test_sharded_cache_respects_weight,empty_fixture){
+        struct identity{static size_t _(size_t key){return key;}};
+        typedef tbb::concurrent_sharded_lru_cache<size_t,size_t,size_t(*)(size_t),helpers::key_weight> cache_type;
+        cache_type cache(&identity::_,100,helpers::key_weight(),1);
+        for (size_t i=0;i<20;++i){
+            cache[100+i];
+            ASSERT(cache.weight()<=100+i,"the weight of the unused items should fit the capacity");
+        }
+        for (size_t i=1;i<=10;++i){
+            ASSERT(cache[i].value()==i,NULL);
+        }
+        ASSERT(cache.weight()<=100,"the weight of the unused items should fit the capacity");
+        cache_type::handle heavy = cache[1000];
+        ASSERT(heavy.value()==1000 && cache.weight()==1000,"an item in use should stay even if it exceeds the capacity");
+    }
+
+    TEST_CASE_WITH_FIXTURE(test_sharded_cache_time_to_live,empty_fixture){
+        typedef ::serial_tests::usability::behaviour::helpers::tag<__LINE__> tag;
+        typedef ::serial_tests::usability::behaviour::helpers::call_counting_function<tag,int> function;
+        typedef tbb::concurrent_sharded_lru_cache<int,int> cache_type;
+        cache_type cache(&function::_,8,tbb::lru_unit_weight(),0,tbb::tick_count::interval_t(0.05));
+        cache_type::handle h = cache[1];
+        cache[1];
+        ASSERT(function::calls_count==1,"value function should be called only on a cache miss");
+        Harness::Sleep(100);
+        ASSERT(cache[1].value()==1 && function::calls_count==2,"an expired item should be created anew");
+        ASSERT(h.value()==1,"an expired item should stay valid while it is in use");
+        ASSERT(cache.size()==1,NULL);
+    }
+
+    struct sharded_fixture_with_external_array{
+        static const size_t capacity = 64;
+        static const size_t array_size = 16*capacity;
+
+        typedef helpers::array_searcher<size_t,helpers::object_instances_counting_concurrent_type,array_size> array_searcher_type;
+        typedef tbb::concurrent_sharded_lru_cache<size_t,helpers::object_instances_counting_concurrent_type,array_searcher_type> cache_type;
+        array_searcher_type::array_type objects_array;
+        size_t number_of_non_evicted()const{
+            size_t result=0;
+            for (size_t i=0; i<array_size; ++i){
+                if (objects_array[i].instances_count()!=1){
+                    ++result;
+                }
+            }
+            return result;
+        }
+    };
+
+    TEST_CASE_WITH_FIXTURE(test_sharded_cache_concurrent_use,sharded_fixture_with_external_array){
+        struct _{static void use_cache(cache_type& cache){
+            for (size_t i=0;i<array_size;++i){
+                size_t const k = (i*7)%array_size;
+                cache_type::handle h=cache[k];
+                cache_type::handle h1=cache[(k+1)%array_size];
+                helpers::prevent_optimizing_out(h.value());
+                h = move(h1);
+            }
+        }};
+        static const size_t number_of_threads = 4 * tbb::task_scheduler_init::default_num_threads(); //have 4x over subscription
+        {
+            cache_type cache(array_searcher_type(objects_array),capacity);
+            NativeParallelFor(number_of_threads,helpers::native_for_concurrent_op_repeated<cache_type>(cache,&_::use_cache,4));
+            ASSERT(cache.size()==number_of_non_evicted(),"an item is lost or leaked by the cache");
+            ASSERT(cache.size()==cache.weight(),NULL);
+            for (size_t i=0;i<array_size;++i){
+                cache[i];
+            }
+            ASSERT(cache.size()<=capacity,"the shards should be trimmed to their capacity on misses");
+        }
+        ASSERT(number_of_non_evicted()==0,"the cache should free all the items");
+    }
+}
+#endif // TEST_COARSE_GRAINED_LOCK_IMPLEMENTATION
@@ -0,0 +1,188 @@
+/*
+    Copyright (c) 2005-2019 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+#include "harness_defs.h"
+#include "tbb/concurrent_relaxed_priority_queue.h"
+#include "tbb/atomic.h"
+#include "harness.h"
+#include <functional>
+#include <algorithm>
+#include <vector>
+
+typedef tbb::concurrent_relaxed_priority_queue<int> queue_type;
+
+//! Pushes n distinct values and checks that each of them is popped once
+void TestSerialMultiset(size_t number_of_queues) {
+    const int n = 10000;
+    queue_type q(number_of_queues);
+    ASSERT(q.empty() && q.size()==0, "new queue is not empty");
+    ASSERT(number_of_queues==0 || q.number_of_queues()==number_of_queues, "wrong number of heaps");
+    for (int i = 0; i < n; ++i)
+        q.push((i * 7919) % n);
+    ASSERT(!q.empty() && q.size()==size_t(n), "wrong size after pushes");
+    std::vector<bool> seen(n, false);
+    int value;
+    for (int i = 0; i < n; ++i) {
+        ASSERT(q.try_pop(value), "pop from a non-empty queue failed");
+        ASSERT(0 <= value && value < n && !seen[value], "wrong or repeated value");
+        seen[value] = true;
+    }
+    ASSERT(!q.try_pop(value), "pop from an empty queue succeeded");
+    ASSERT(q.empty() && q.size()==0, "queue is not empty after pops");
+
+    for (int i = 0; i < 100; ++i)
+        q.push(i);
+    q.clear();
+    ASSERT(q.empty() && !q.try_pop(value), "queue is not empty after clear");
+}
+
+//! With a single heap the order is exact
+void TestExactOrder() {
+    const int n = 1000;
+    tbb::concurrent_relaxed_priority_queue<int, std::greater<int> > q(1);
+    for (int i = 0; i < n; ++i)
+        q.push((i * 331) % n);
+    int value;
+    for (int i = 0; i < n; ++i) {
+        ASSERT(q.try_pop(value), NULL);
+        ASSERT(value == i, "a single heap does not give the exact order");
+    }
+}
+
+//! The average rank of a popped element grows with the number of heaps, not with the size
+void TestRelaxation() {
+    const int n = 20000;
+    const size_t number_of_queues = 8;
+    queue_type q(number_of_queues);
+    std::vector<int> present(n, 1);
+    for (int i = 0; i < n; ++i)
+        q.push(i);
+    // the rank is the number of larger elements still in the queue
+    double rank_sum = 0;
+    int value, top = n-1;
+    for (int i = 0; i < n; ++i) {
+        ASSERT(q.try_pop(value), NULL);
+        present[value] = 0;
+        int rank = 0;
+        for (int j = top; j > value; --j)
+            rank += present[j];
+        rank_sum += rank;
+        while (top >= 0 && !present[top])
+            --top;
+    }
+    const double mean_rank = rank_sum / n;
+    REMARK("mean rank error with %d heaps: %g\n", int(number_of_queues), mean_rank);
+    ASSERT(mean_rank < 4.0 * number_of_queues, "the order is relaxed too much");
+}
+
+const int items_per_producer = 20000;
+
+struct ProducerConsumerBody : NoAssign {
+    queue_type& my_queue;
+    int my_producers;
+    tbb::atomic<int>* my_counts;
+    tbb::atomic<int>& my_popped;
+    ProducerConsumerBody(queue_type& q, int producers, tbb::atomic<int>* counts, tbb::atomic<int>& popped) :
+        my_queue(q), my_producers(producers), my_counts(counts), my_popped(popped) {}
+    void operator()(int thread_id) const {
+        const int total = my_producers * items_per_producer;
+        if (thread_id < my_producers) {
+            for (int i = 0; i < items_per_producer; ++i)
+                my_queue.push(thread_id * items_per_producer + i);
+        }
+        // every thread consumes until all the items are popped
+        int value;
+        while (my_popped < total) {
+            if (my_queue.try_pop(value)) {
+                ASSERT(0 <= value && value < total, "wrong value");
+                ++my_counts[value];
+                ++my_popped;
+            } else
+                __TBB_Yield();
+        }
+    }
+};
+
+void TestConcurrentPushPop(int nthreads) {
+    const int producers = nthreads > 1 ? nthreads/2 : 1;
+    const int total = producers * items_per_producer;
+    queue_type q;
+    std::vector<tbb::atomic<int> > counts(total);
+    for (int i = 0; i < total; ++i)
+        counts[i] = 0;
+    tbb::atomic<int> popped;
+    popped = 0;
+    NativeParallelFor(nthreads, ProducerConsumerBody(q, producers, &counts[0], popped));
+    ASSERT(q.empty(), "queue is not empty after all the items are popped");
+    for (int i = 0; i < total; ++i)
+        ASSERT(counts[i] == 1, "an item is lost or popped twice");
+}
+
+#if __TBB_CPP11_RVALUE_REF_PRESENT
+struct move_only {
+    int value;
+    move_only(int v = 0) : value(v) {}
+    move_only(move_only&& other) : value(other.value) { other.value = -1; }
+    move_only& operator=(move_only&& other) { value = other.value; other.value = -1; return *this; }
+    bool operator<(const move_only& other) const { return value < other.value; }
+private:
+    move_only(const move_only&);
+    move_only& operator=(const move_only&);
+};
+
+void TestMoveSupport() {
+    tbb::concurrent_relaxed_priority_queue<move_only> q(1);
+    q.push(move_only(1));
+#if __TBB_CPP11_VARIADIC_TEMPLATES_PRESENT
+    q.emplace(3);
+#else
+    q.push(move_only(3));
+#endif
+    move_only elem(2);
+    q.push(std::move(elem));
+    ASSERT(elem.value == -1, "the element was not moved in");
+    for (int i = 3; i > 0; --i) {
+        ASSERT(q.try_pop(elem), NULL);
+        ASSERT(elem.value == i, "wrong order of moved elements");
+    }
+}
+#endif /* __TBB_CPP11_RVALUE_REF_PRESENT */
+
+int TestMain() {
+    if (MinThread < 1)
+        MinThread = 1;
+
+    TestSerialMultiset(0);
+    TestSerialMultiset(1);
+    TestSerialMultiset(16);
+    TestExactOrder();
+    TestRelaxation();
+#if __TBB_CPP11_RVALUE_REF_PRESENT
+    TestMoveSupport();
+#else
+    REPORT("Known issue: move support tests are skipped.\n");
+#endif
+
+    for (int p = MinThread; p <= MaxThread; ++p) {
+        REMARK("Testing on %d threads.\n", p);
+        TestConcurrentPushPop(p);
+    }
+    return Harness::Done;
+}
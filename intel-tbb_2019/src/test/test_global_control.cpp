@@ -613,6 +613,42 @@ void TestConcurrentArenas()
     ASSERT(counter == 2*ArenaUserRun::ENQUEUE_TASKS, "All tasks must be done.");
 }
 
+void TestSpinTimeControl()
+{
+    const size_t unlimited = ~size_t(0);
+    ASSERT(unlimited == tbb::global_control::active_value(tbb::global_control::max_spin_time),
+           "Spinning must be limited by the scheduler only by default.");
+    {
+        tbb::global_control s0(tbb::global_control::max_spin_time, 1000);
+        {
+            tbb::global_control s1(tbb::global_control::max_spin_time, 0);
+            tbb::global_control s2(tbb::global_control::max_spin_time, 500);
+            ASSERT(0 == tbb::global_control::active_value(tbb::global_control::max_spin_time),
+                   "The shortest spin time must be active.");
+        }
+        ASSERT(1000 == tbb::global_control::active_value(tbb::global_control::max_spin_time), NULL);
+    }
+    ASSERT(unlimited == tbb::global_control::active_value(tbb::global_control::max_spin_time), NULL);
+
+    // workers that leave the arena without spinning must be woken up by each burst of tasks
+    const int BURSTS = 10, TASKS = 5;
+    tbb::atomic<int> counter;
+    counter = 0;
+    {
+        tbb::global_control s(tbb::global_control::max_spin_time, 0);
+        blocking_task_scheduler_init tsi(1);
+        tbb::task_arena arena(2);
+        for (int i=0; i<BURSTS; i++) {
+            for (int j=0; j<TASKS; j++)
+                arena.enqueue(ArenaRun(&counter));
+            while (counter < (i+1)*TASKS)
+                __TBB_Yield();
+            Harness::Sleep(1);
+        }
+    }
+    ASSERT(counter == BURSTS*TASKS, "All tasks must be done.");
+}
+
 void TestParallelismRestored()
 {
     const int TASKS = 5;
@@ -756,6 +792,7 @@ int TestMain()
 {
     TestTaskEnqueue();
     TestConcurrentArenas();
+    TestSpinTimeControl();
     TestMultipleControls();
     TestNoUnwantedEnforced();
     const unsigned h_c = tbb::tbb_thread::hardware_concurrency();
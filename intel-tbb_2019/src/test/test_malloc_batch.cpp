@@ -0,0 +1,168 @@
+/*
+    Copyright (c) 2005-2019 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+// Tests for scalable_malloc_batch/scalable_free_batch
+
+#define HARNESS_TBBMALLOC_THREAD_SHUTDOWN 1
+#include "harness.h"
+#include "harness_barrier.h"
+#include "tbb/scalable_allocator.h"
+#include "tbb/tick_count.h"
+#include <algorithm>
+#include <vector>
+
+const size_t testSizes[] = {0, 1, 8, 24, 100, 1000, 4000, 8000, 8*1024+16, 70*1024};
+const size_t testSizesNum = sizeof(testSizes)/sizeof(testSizes[0]);
+
+static void CheckObjects(void **objs, size_t num, size_t size)
+{
+    std::vector<void*> sorted(objs, objs+num);
+    std::sort(sorted.begin(), sorted.end());
+    ASSERT(std::adjacent_find(sorted.begin(), sorted.end()) == sorted.end(),
+           "The same object returned twice.");
+    for (size_t i=0; i<num; i++) {
+        ASSERT(objs[i], NULL);
+        ASSERT(scalable_msize(objs[i]) >= size, NULL);
+        memset(objs[i], (int)i, size);
+    }
+    for (size_t i=0; i<num; i++)
+        for (size_t j=0; j<size; j++)
+            ASSERT(((unsigned char*)objs[i])[j] == (unsigned char)i, "Objects overlap.");
+}
+
+void TestSerial()
+{
+    const size_t NUM = 3000; // several blocks for every small size
+    void *objs[NUM];
+
+    for (size_t s=0; s<testSizesNum; s++) {
+        size_t got = scalable_malloc_batch(testSizes[s], NUM, objs);
+        ASSERT(got == NUM, NULL);
+        CheckObjects(objs, NUM, testSizes[s]);
+        // free half by batch out of order, the rest by scalable_free
+        std::random_shuffle(objs, objs+NUM);
+        scalable_free_batch(objs, NUM/2);
+        for (size_t i=NUM/2; i<NUM; i++)
+            scalable_free(objs[i]);
+    }
+    // objects of different sizes and NULLs in one batch
+    for (size_t s=0; s<testSizesNum; s++)
+        ASSERT(scalable_malloc_batch(testSizes[s], NUM/testSizesNum, objs+s*(NUM/testSizesNum))
+               == NUM/testSizesNum, NULL);
+    for (size_t i=0; i<NUM; i+=7)
+        scalable_free(objs[i]);
+    for (size_t i=0; i<NUM; i+=7)
+        objs[i] = NULL;
+    std::random_shuffle(objs, objs+NUM);
+    scalable_free_batch(objs, NUM);
+
+    ASSERT(scalable_malloc_batch(8, 0, objs) == 0, NULL);
+    ASSERT(scalable_malloc_batch(8, 1, NULL) == 0, NULL);
+    scalable_free_batch(NULL, 10);
+    scalable_free_batch(objs, 0);
+}
+
+// objects allocated by one thread are released by another one
+class CrossThreadBatch: NoAssign {
+    static Harness::SpinBarrier barrier;
+    static std::vector<void*> *batches;
+    static const size_t OBJ_NUM = 2000;
+    int threads;
+public:
+    static void init(int p) {
+        barrier.initialize(p);
+        batches = new std::vector<void*>[p];
+    }
+    static void destroy() { delete []batches; }
+    CrossThreadBatch(int p) : threads(p) {}
+    void operator()(int id) const {
+        for (int iter=0; iter<5; iter++) {
+            std::vector<void*> &mine = batches[id];
+            mine.resize(OBJ_NUM);
+            // two sizes interleaved, so objects of many blocks are mixed
+            size_t half = OBJ_NUM/2;
+            ASSERT(scalable_malloc_batch(16*(id+1), half, &mine[0]) == half, NULL);
+            ASSERT(scalable_malloc_batch(200, OBJ_NUM-half, &mine[half]) == OBJ_NUM-half, NULL);
+            std::random_shuffle(mine.begin(), mine.end());
+            barrier.wait();
+            std::vector<void*> &foreign = batches[(id+1)%threads];
+            scalable_free_batch(&foreign[0], foreign.size());
+            barrier.wait();
+        }
+    }
+};
+
+Harness::SpinBarrier CrossThreadBatch::barrier;
+std::vector<void*> *CrossThreadBatch::batches;
+
+void TestCrossThread()
+{
+    for (int p=MinThread; p<=MaxThread; p++) {
+        CrossThreadBatch::init(p);
+        NativeParallelFor(p, CrossThreadBatch(p));
+        CrossThreadBatch::destroy();
+    }
+}
+
+// Compare scalable_malloc/scalable_free with batched versions,
+// the result is only reported, as timing is not reliable in testing.
+class BatchThroughput: NoAssign {
+    static const size_t OBJ_NUM = 1000;
+    static const int ITERS = 200;
+    size_t size;
+    bool batched;
+public:
+    BatchThroughput(size_t sz, bool b) : size(sz), batched(b) {}
+    void operator()(int) const {
+        void *objs[OBJ_NUM];
+        for (int iter=0; iter<ITERS; iter++) {
+            if (batched) {
+                ASSERT(scalable_malloc_batch(size, OBJ_NUM, objs) == OBJ_NUM, NULL);
+                scalable_free_batch(objs, OBJ_NUM);
+            } else {
+                for (size_t i=0; i<OBJ_NUM; i++)
+                    ASSERT((objs[i] = scalable_malloc(size)), NULL);
+                for (size_t i=0; i<OBJ_NUM; i++)
+                    scalable_free(objs[i]);
+            }
+        }
+    }
+};
+
+void TestThroughput()
+{
+    const size_t sizes[] = {16, 64, 512};
+    for (size_t s=0; s<sizeof(sizes)/sizeof(sizes[0]); s++) {
+        double t[2];
+        for (int b=0; b<2; b++) {
+            tbb::tick_count t0 = tbb::tick_count::now();
+            NativeParallelFor(MaxThread, BatchThroughput(sizes[s], b));
+            t[b] = (tbb::tick_count::now()-t0).seconds();
+        }
+        REMARK("size %u: one by one %.3f s, batched %.3f s\n", (unsigned)sizes[s], t[0], t[1]);
+    }
+}
+
+int TestMain () {
+    TestSerial();
+    TestCrossThread();
+    TestThroughput();
+    return Harness::Done;
+}
@@ -149,6 +149,7 @@ class ExtMemoryPool;
 
 struct BlockI {
     intptr_t     blockState[2];
+    intptr_t     numaNode;
 };
 
 struct LargeMemoryBlock : public BlockI {
@@ -342,6 +343,20 @@ void CheckNewDeleteOverload() {
     s4 = new(std::nothrow) BigStruct[2];
     scalableMallocCheckSize(s4, 2*sizeof(BigStruct));
     delete []s4;
+
+#if __cpp_sized_deallocation
+    // sized delete must release the objects to tbbmalloc,
+    // so a small object is reused at once by the same thread
+    const size_t sizes[] = {24, 1000, minLargeObjectSize-1, 10*minLargeObjectSize};
+    for (unsigned i=0; i<sizeof(sizes)/sizeof(sizes[0]); i++) {
+        void *p = ::operator new(sizes[i]);
+        scalableMallocCheckSize(p, sizes[i]);
+        ::operator delete(p, sizes[i]);
+        void *q = ::operator new(sizes[i]);
+        ASSERT(sizes[i] >= minLargeObjectSize || p == q, "Object released by sized delete was not reused.");
+        ::operator delete(q, sizes[i]);
+    }
+#endif
 }
 
 #if MALLOC_WINDOWS_OVERLOAD_ENABLED
@@ -0,0 +1,232 @@
+/*
+    Copyright (c) 2005-2019 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+// Tests for TBBMALLOC_GET_STATISTICS and sampled heap profiling
+
+#define HARNESS_TBBMALLOC_THREAD_SHUTDOWN 1
+#include "harness.h"
+#include "tbb/scalable_allocator.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+static void GetStatistics(ScalableAllocationStatistics *stat)
+{
+    int res = scalable_allocation_command(TBBMALLOC_GET_STATISTICS, stat);
+    ASSERT(res == TBBMALLOC_OK, NULL);
+}
+
+static const ScalableBinStatistics *FindBin(const ScalableAllocationStatistics &stat, size_t size)
+{
+    for (size_t i=0; i<stat.binsNum; i++)
+        if (stat.bins[i].objectSize >= size) {
+            // bins are not sorted by size, so look for the best fit
+            const ScalableBinStatistics *best = stat.bins+i;
+            for (size_t j=i+1; j<stat.binsNum; j++)
+                if (stat.bins[j].objectSize >= size && stat.bins[j].objectSize < best->objectSize)
+                    best = stat.bins+j;
+            return best;
+        }
+    return NULL;
+}
+
+void TestModeSwitch()
+{
+    ScalableAllocationStatistics stat;
+    void *p = scalable_malloc(8); // get some memory from OS
+
+    ASSERT(scalable_allocation_mode(TBBMALLOC_COLLECT_STATISTICS, 2) == TBBMALLOC_INVALID_PARAM, NULL);
+    ASSERT(scalable_allocation_command(TBBMALLOC_GET_STATISTICS, NULL) == TBBMALLOC_INVALID_PARAM, NULL);
+    ASSERT(scalable_allocation_mode(TBBMALLOC_COLLECT_STATISTICS, 0) == TBBMALLOC_OK, NULL);
+    // backend counters are available even when the mode is off
+    ASSERT(scalable_allocation_command(TBBMALLOC_GET_STATISTICS, &stat) == TBBMALLOC_NO_EFFECT, NULL);
+    ASSERT(stat.regions && stat.regionsSize, NULL);
+    ASSERT(stat.hugePageRegions <= stat.regions && stat.hugePageRegionsSize <= stat.regionsSize, NULL);
+    ASSERT(scalable_allocation_mode(TBBMALLOC_COLLECT_STATISTICS, 1) == TBBMALLOC_OK, NULL);
+    scalable_free(p);
+}
+
+void TestSlabCounters()
+{
+    const size_t NUM = 5000, SIZE = 100;
+    ScalableAllocationStatistics before, after;
+    std::vector<void*> objs(NUM);
+
+    GetStatistics(&before);
+    const ScalableBinStatistics *bin = FindBin(before, SIZE);
+    ASSERT(bin && bin->objectSize < 2*SIZE, NULL);
+    size_t idx = bin - before.bins;
+
+    for (size_t i=0; i<NUM; i++)
+        objs[i] = scalable_malloc(SIZE);
+    GetStatistics(&after);
+    ASSERT(after.bins[idx].allocatedObjects == before.bins[idx].allocatedObjects + NUM, NULL);
+    ASSERT(after.bins[idx].slabs >= NUM*bin->objectSize/(16*1024), NULL);
+    ASSERT(after.bins[idx].slabs*16*1024 >=
+           (after.bins[idx].allocatedObjects+after.bins[idx].freeObjects)*bin->objectSize, NULL);
+
+    for (size_t i=0; i<NUM; i++)
+        scalable_free(objs[i]);
+    GetStatistics(&after);
+    ASSERT(after.bins[idx].allocatedObjects == before.bins[idx].allocatedObjects, NULL);
+
+    // batch interface is counted as well
+    size_t got = scalable_malloc_batch(SIZE, NUM, &objs[0]);
+    ASSERT(got == NUM, NULL);
+    GetStatistics(&after);
+    ASSERT(after.bins[idx].allocatedObjects == before.bins[idx].allocatedObjects + NUM, NULL);
+    scalable_free_batch(&objs[0], NUM);
+    GetStatistics(&after);
+    ASSERT(after.bins[idx].allocatedObjects == before.bins[idx].allocatedObjects, NULL);
+}
+
+// counters of exited threads must be kept
+class LeaveObjects: NoAssign {
+    std::vector<void*> *objs;
+public:
+    static const size_t OBJ_NUM = 1000;
+    LeaveObjects(std::vector<void*> *o) : objs(o) {}
+    void operator()(int id) const {
+        for (size_t i=0; i<OBJ_NUM; i++)
+            objs[id].push_back(scalable_malloc(40));
+    }
+};
+
+void TestThreadCounters()
+{
+    ScalableAllocationStatistics before, after;
+    std::vector<void*> *objs = new std::vector<void*>[MaxThread];
+
+    GetStatistics(&before);
+    size_t idx = FindBin(before, 40) - before.bins;
+    NativeParallelFor(MaxThread, LeaveObjects(objs));
+    GetStatistics(&after);
+    ASSERT(after.bins[idx].allocatedObjects ==
+           before.bins[idx].allocatedObjects + MaxThread*LeaveObjects::OBJ_NUM, NULL);
+    for (int t=0; t<MaxThread; t++)
+        for (size_t i=0; i<objs[t].size(); i++)
+            scalable_free(objs[t][i]);
+    delete []objs;
+}
+
+void TestLargeObjectCache()
+{
+    ScalableAllocationStatistics before, after;
+
+    GetStatistics(&before);
+    for (int i=0; i<10; i++) {
+        void *p = scalable_malloc(1024*1024);
+        ASSERT(p, NULL);
+        scalable_free(p);
+    }
+    GetStatistics(&after);
+    ASSERT(after.largeCacheHits + after.largeCacheMisses + after.largeLocalCacheHits ==
+           before.largeCacheHits + before.largeCacheMisses + before.largeLocalCacheHits + 10,
+           "Every large object must be either cache hit or miss.");
+    ASSERT(after.largeCacheHits + after.largeLocalCacheHits >
+           before.largeCacheHits + before.largeLocalCacheHits, "Released large object not reused.");
+
+    scalable_allocation_command(TBBMALLOC_CLEAN_ALL_BUFFERS, NULL);
+    GetStatistics(&after);
+    ASSERT(after.largeCacheEvictions > before.largeCacheEvictions, NULL);
+}
+
+static void ReadProfileHeader(const char *fileName, long long *inuseObjs, bool *hasMaps)
+{
+    FILE *f = fopen(fileName, "r");
+    ASSERT(f, NULL);
+    long long inuseBytes, allocObjs, allocBytes, interval;
+    int got = fscanf(f, "heap profile: %lld: %lld [%lld: %lld] @ heap_v2/%lld",
+                     inuseObjs, &inuseBytes, &allocObjs, &allocBytes, &interval);
+    ASSERT(got == 5, "Invalid heap profile header.");
+    ASSERT(interval == 1, NULL);
+    char line[1024];
+    *hasMaps = false;
+    while (fgets(line, sizeof(line), f))
+        if (!strcmp(line, "MAPPED_LIBRARIES:\n"))
+            *hasMaps = true;
+    fclose(f);
+}
+
+void TestHeapProfile()
+{
+    char fileName[] = "test_malloc_statistics.heap";
+    ASSERT(scalable_allocation_command(TBBMALLOC_DUMP_HEAP_PROFILE, fileName)
+           == TBBMALLOC_NO_EFFECT, "Sampling is off by default.");
+    ASSERT(scalable_allocation_mode(TBBMALLOC_HEAP_PROFILE_SAMPLING, -1) == TBBMALLOC_INVALID_PARAM, NULL);
+    int res = scalable_allocation_mode(TBBMALLOC_HEAP_PROFILE_SAMPLING, 1);
+    if (res == TBBMALLOC_NO_EFFECT) {
+        REPORT("Known issue: heap profiling is not supported on this platform.\n");
+        return;
+    }
+    ASSERT(res == TBBMALLOC_OK, NULL);
+
+    // every allocation is sampled with interval 1
+    const int NUM = 100;
+    void *objs[NUM];
+    for (int i=0; i<NUM; i++)
+        objs[i] = scalable_malloc(i%2? 24 : 100*1024);
+    long long inuse, inuseAfterFree;
+    bool hasMaps;
+    ASSERT(scalable_allocation_command(TBBMALLOC_DUMP_HEAP_PROFILE, fileName) == TBBMALLOC_OK, NULL);
+    ReadProfileHeader(fileName, &inuse, &hasMaps);
+    ASSERT(inuse >= NUM && hasMaps, NULL);
+
+    for (int i=0; i<NUM; i++)
+        scalable_free(objs[i]);
+    ASSERT(scalable_allocation_command(TBBMALLOC_DUMP_HEAP_PROFILE, fileName) == TBBMALLOC_OK, NULL);
+    ReadProfileHeader(fileName, &inuseAfterFree, &hasMaps);
+    ASSERT(inuseAfterFree <= inuse - NUM, "Released objects must not be reported as in use.");
+
+    // aligned, zeroed and moved objects are sampled as well
+    for (int i=0; i<NUM; i++)
+        objs[i] = scalable_malloc(24);
+    ASSERT(scalable_allocation_command(TBBMALLOC_DUMP_HEAP_PROFILE, fileName) == TBBMALLOC_OK, NULL);
+    ReadProfileHeader(fileName, &inuse, &hasMaps);
+    void *aligned[NUM], *zeroed[NUM];
+    for (int i=0; i<NUM; i++) {
+        aligned[i] = scalable_aligned_malloc(i%2? 24 : 100*1024, 128);
+        zeroed[i] = scalable_calloc(1, i%2? 24 : 100*1024);
+        // grows out of the small object, so the object is moved
+        objs[i] = scalable_realloc(objs[i], 200*1024);
+    }
+    ASSERT(scalable_allocation_command(TBBMALLOC_DUMP_HEAP_PROFILE, fileName) == TBBMALLOC_OK, NULL);
+    ReadProfileHeader(fileName, &inuseAfterFree, &hasMaps);
+    ASSERT(inuseAfterFree >= inuse + 2*NUM, "Aligned, zeroed and reallocated objects must be sampled.");
+    for (int i=0; i<NUM; i++) {
+        scalable_aligned_free(aligned[i]);
+        scalable_free(zeroed[i]);
+        scalable_free(objs[i]);
+    }
+
+    ASSERT(scalable_allocation_mode(TBBMALLOC_HEAP_PROFILE_SAMPLING, 0) == TBBMALLOC_OK, NULL);
+    ASSERT(scalable_allocation_command(TBBMALLOC_DUMP_HEAP_PROFILE, fileName)
+           == TBBMALLOC_NO_EFFECT, NULL);
+    remove(fileName);
+}
+
+int TestMain () {
+    TestModeSwitch();
+    TestSlabCounters();
+    TestThreadCounters();
+    TestLargeObjectCache();
+    TestHeapProfile();
+    return Harness::Done;
+}
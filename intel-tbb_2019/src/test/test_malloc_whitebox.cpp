@@ -55,6 +55,8 @@
 #if __INTEL_COMPILER && __TBB_MIC_OFFLOAD
     #pragma warning(pop)
 #endif
+// before backend.cpp, as MapMemory.h brings system headers into the namespace
+#include "../tbbmalloc/heap_profiler.cpp"
 #include "../tbbmalloc/backend.cpp"
 #include "../tbbmalloc/backref.cpp"
 
@@ -664,6 +666,186 @@ void TestBackend()
     pool_destroy(mPool);
 }
 
+#if __linux__
+// Emulate 2 NUMA nodes and check that every thread gets memory of its node.
+class TestNumaWork: public SimpleBarrier {
+    static const int ITERS = 20;
+    static const int NUM_OBJS = 1000;
+public:
+    void operator()(int) const {
+        int node = -1;
+        int res = scalable_allocation_command(TBBMALLOC_GET_NUMA_NODE, &node);
+        ASSERT(res == TBBMALLOC_OK && 0 <= node && node < 2, NULL);
+        Backend *backend = &defaultMemPool->extMemPool.backend;
+        void *objs[NUM_OBJS];
+
+        barrier.wait();
+        for (int i=0; i<ITERS; i++) {
+            BlockI *slabBlock = backend->getSlabBlock(1);
+            ASSERT(slabBlock && slabBlock->getNumaNode() == node,
+                   "Slab block from a foreign node");
+            LargeMemoryBlock *lmb = backend->getLargeBlock(64*1024);
+            ASSERT(lmb && lmb->getNumaNode() == node,
+                   "Large block from a foreign node");
+            // large objects are not checked, as the global cache of them is shared
+            for (int j=0; j<NUM_OBJS; j++) {
+                objs[j] = scalable_malloc(j%2? 100 : minLargeObjectSize+j);
+                ASSERT(objs[j], NULL);
+            }
+            for (int j=1; j<NUM_OBJS; j+=2) {
+                Block *objBlock = (Block*)alignDown(objs[j], slabSize);
+                ASSERT(objBlock->getNumaNode() == node, "Small object from a foreign node");
+            }
+            for (int j=0; j<NUM_OBJS; j++)
+                scalable_free(objs[j]);
+            backend->putSlabBlock(slabBlock);
+            backend->putLargeBlock(lmb);
+        }
+        barrier.wait();
+    }
+};
+
+// Leave partially used blocks of the thread's node orphaned at the thread exit.
+class TestNumaOrphans: NoAssign {
+    void **objs;
+public:
+    static const int NUM_OBJS = 10, OBJ_SIZE = 200;
+    TestNumaOrphans(void **o) : objs(o) {}
+    void operator()(int id) const {
+        for (int i=0; i<NUM_OBJS; i++) {
+            objs[id*NUM_OBJS+i] = scalable_malloc(OBJ_SIZE);
+            ASSERT(objs[id*NUM_OBJS+i], NULL);
+        }
+    }
+};
+
+// Switch NUMA mode off while other threads orphan their blocks.
+class TestNumaOrphansSwitchOff: NoAssign {
+    void **objs;
+public:
+    TestNumaOrphansSwitchOff(void **o) : objs(o) {}
+    void operator()(int id) const {
+        if (id == 2) {
+            scalable_allocation_mode(TBBMALLOC_USE_NUMA, 0);
+        } else {
+            TestNumaOrphans orphans(objs);
+            orphans(id);
+        }
+    }
+};
+
+void TestNumaMode()
+{
+    if(!isMallocInitialized()) doInitialization();
+    int node = -1;
+    int res = scalable_allocation_command(TBBMALLOC_GET_NUMA_NODE, &node);
+    ASSERT(!numaTopology.isEnabled, "NUMA mode must be off by default");
+    ASSERT(res == (numaTopology.nodesNum>1? TBBMALLOC_OK : TBBMALLOC_NO_EFFECT), NULL);
+    ASSERT(scalable_allocation_command(TBBMALLOC_GET_NUMA_NODE, NULL) == TBBMALLOC_INVALID_PARAM,
+           NULL);
+    ASSERT(scalable_allocation_mode(TBBMALLOC_USE_NUMA, 2) == TBBMALLOC_INVALID_PARAM, NULL);
+
+    // fake topology, as set via TBB_MALLOC_NUMA_FAKE_NODES
+    ASSERT(numaTopology.initFakeTopology(2), NULL);
+    ASSERT(!numaTopology.initFakeTopology(maxNumaNodes+1), NULL);
+    res = scalable_allocation_mode(TBBMALLOC_USE_NUMA, 1);
+    ASSERT(res == TBBMALLOC_OK && numaTopology.isEnabled, NULL);
+
+    TestNumaWork::initBarrier(2);
+    NativeParallelFor(2, TestNumaWork());
+
+    // blocks orphaned at all nodes are available when the mode is off
+    void *objs[2*TestNumaOrphans::NUM_OBJS];
+    NativeParallelFor(2, TestNumaOrphans(objs));
+    const unsigned index = getIndex(TestNumaOrphans::OBJ_SIZE);
+    OrphanedBlocks &orphans = defaultMemPool->extMemPool.orphanedBlocks;
+    ASSERT(orphans.bins[1][index].top, "Partially used blocks must be orphaned at their node.");
+    res = scalable_allocation_mode(TBBMALLOC_USE_NUMA, 0);
+    ASSERT(res == TBBMALLOC_OK && !numaTopology.isEnabled, NULL);
+    for (int n=1; n<maxNumaNodes; n++)
+        for (uint32_t i=0; i<numBlockBinLimit; i++)
+            ASSERT(!orphans.bins[n][i].top, "Orphaned blocks must be moved to node 0.");
+    ASSERT(orphans.bins[0][index].top, NULL);
+    for (int i=0; i<2*TestNumaOrphans::NUM_OBJS; i++)
+        scalable_free(objs[i]);
+
+    // no block is left at other nodes by a thread that has not seen the mode off
+    for (int rep=0; rep<50; rep++) {
+        res = scalable_allocation_mode(TBBMALLOC_USE_NUMA, 1);
+        ASSERT(res == TBBMALLOC_OK, NULL);
+        NativeParallelFor(3, TestNumaOrphansSwitchOff(objs));
+        ASSERT(!numaTopology.isEnabled, NULL);
+        for (int n=1; n<maxNumaNodes; n++)
+            for (uint32_t i=0; i<numBlockBinLimit; i++)
+                ASSERT(!orphans.bins[n][i].top, "Orphaned blocks must be moved to node 0.");
+        for (int i=0; i<2*TestNumaOrphans::NUM_OBJS; i++)
+            scalable_free(objs[i]);
+    }
+
+    // restore the real topology
+    numaTopology.reset();
+    numaTopology.init();
+    res = scalable_allocation_mode(TBBMALLOC_USE_NUMA, 1);
+    ASSERT(res == (numaTopology.nodesNum>1? TBBMALLOC_OK : TBBMALLOC_NO_EFFECT), NULL);
+    ASSERT(numaTopology.isEnabled == (numaTopology.nodesNum>1), NULL);
+    scalable_allocation_mode(TBBMALLOC_USE_NUMA, 0);
+    scalable_allocation_command(TBBMALLOC_CLEAN_ALL_BUFFERS, 0);
+}
+#endif
+
+// bin index computed the way it was done before the table was introduced
+static unsigned refSizeToIndex(unsigned size)
+{
+    if (size <= maxSmallObjectSize) {
+        unsigned index = (size-1)>>3;
+        return sizeof(size_t)>4 && index? index|1 : index;
+    }
+    if (size <= maxSegregatedObjectSize) {
+        unsigned order = 6;
+        while ((size-1)>>(order+1))
+            order++;
+        return minSegregatedObjectIndex - (4*6) - 4 + (4*order) + ((size-1)>>(order-2));
+    }
+    const uint32_t fittingSizes[] = {fittingSize1, fittingSize2, fittingSize3, fittingSize4, fittingSize5};
+    unsigned i = 0;
+    while (size > fittingSizes[i])
+        i++;
+    return minFittingIndex+i;
+}
+
+void TestSizeClasses()
+{
+    for (unsigned size=1; size<minLargeObjectSize; size++) {
+        unsigned index = getIndex(size), objSize = getObjectSize(size);
+        ASSERT(index == refSizeToIndex(size), "Wrong bin for the size.");
+        ASSERT(size <= objSize && getIndex(objSize) == index, "Wrong object size for the bin.");
+        ASSERT(objSize == getObjectSize(objSize), NULL);
+        if (size > 8 && sizeof(size_t) > 4)
+            ASSERT(!(objSize % 16), "Object size must keep 16 bytes alignment.");
+    }
+
+    // sized release of all kinds of objects
+    const size_t sizes[] = {0, 1, 24, 100, 1024, fittingSize3, minLargeObjectSize-1,
+                            minLargeObjectSize, 1024*1024, 10*1024*1024};
+    const int num = sizeof(sizes)/sizeof(sizes[0]);
+    void *objs[num];
+    for (int i=0; i<num; i++) {
+        objs[i] = scalable_malloc(sizes[i]);
+        ASSERT(objs[i], NULL);
+        scalable_free_sized(objs[i], sizes[i]);
+        objs[i] = scalable_calloc(2, sizes[i]);
+        ASSERT(objs[i], NULL);
+    }
+    // small object is reused at once
+    void *p = scalable_malloc(100);
+    scalable_free_sized(p, 100);
+    ASSERT(p == scalable_malloc(100), "Object released by size was not reused.");
+    scalable_free_sized(p, 100);
+    scalable_free_sized(NULL, 100);
+    for (int i=0; i<num; i++)
+        scalable_free_sized(objs[i], 2*sizes[i]);
+}
+
 void TestBitMask()
 {
     BitMaskMin<256> mask;
@@ -1181,7 +1363,9 @@ void TestTHP() {
         size_t allocSize = HUGE_PAGE_SIZE - (i * 1000);
 
         // Map memory
-        allocPtrs[i] = backend->allocRawMem(allocSize);
+        bool hugePagesUsed;
+        allocPtrs[i] = backend->allocRawMem(allocSize, &hugePagesUsed);
+        MALLOC_ASSERT(hugePagesUsed, "Huge pages must be used when available.");
 
         MALLOC_ASSERT(allocPtrs[i], "Allocation not succeded.");
         MALLOC_ASSERT(allocSize == HUGE_PAGE_SIZE,
@@ -1283,6 +1467,361 @@ void TestReallocDecreasing() {
     /* TODO: Decreasing reallocation of large objects that fit backend cache */
     /* TODO: Small objects decreasing reallocation test */
 }
+// do purging passes in the test thread, as if done by the purging thread
+static size_t doDecayPasses(int num)
+{
+    size_t released = 0;
+    for (int i=0; i<num; i++) {
+        intptr_t epoch = memoryDecay.epoch+1;
+        FencedStore(memoryDecay.epoch, epoch);
+        released += defaultMemPool->extMemPool.decay(epoch);
+    }
+    return released;
+}
+
+static size_t countFilledBytes(const char *p, size_t size, char pattern)
+{
+    size_t cnt = 0;
+    for (size_t i=0; i<size; i++)
+        if (p[i] == pattern)
+            cnt++;
+    return cnt;
+}
+
+class DecayWork: NoAssign {
+    static const int ITERS = 200;
+public:
+    void operator()(int id) const {
+        const size_t sizes[] = {40, 3*1024, 100*1024, 1024*1024};
+        const int num = sizeof(sizes)/sizeof(sizes[0]);
+        char *objs[num];
+        for (int i=0; i<ITERS; i++) {
+            const char pattern = (char)(id+i+1);
+            for (int j=0; j<num; j++) {
+                objs[j] = (char*)scalable_malloc(sizes[j]);
+                ASSERT(objs[j], NULL);
+                memset(objs[j], pattern, sizes[j]);
+            }
+            for (int j=0; j<num; j++) {
+                ASSERT(countFilledBytes(objs[j], sizes[j], pattern) == sizes[j],
+                       "Pages of an object in use were released.");
+                scalable_free(objs[j]);
+            }
+        }
+    }
+};
+
+void TestDecay()
+{
+    if(!isMallocInitialized()) doInitialization();
+    ExtMemoryPool *extMemPool = &defaultMemPool->extMemPool;
+    const size_t pageSize = extMemPool->granularity;
+    const intptr_t decayTime = memoryDecay.decayTime;
+    ASSERT(scalable_allocation_mode(TBBMALLOC_SET_DECAY_TIME, -1) == TBBMALLOC_INVALID_PARAM, NULL);
+    ASSERT(scalable_allocation_mode(TBBMALLOC_SET_DECAY_TIME, 0) == TBBMALLOC_OK, NULL);
+    scalable_allocation_command(TBBMALLOC_CLEAN_ALL_BUFFERS, 0);
+
+    // cached large object keeps its address space, but not its pages
+    const size_t size = 1024*1024;
+    LargeMemoryBlock *lmb = NULL;
+    for (int i=0; i<3 && !extMemPool->loc.getLOCSize(); i++) {
+        // 1st release of a size can be not cached
+        char *p = (char*)scalable_malloc(size);
+        lmb = ((LargeObjectHdr*)p - 1)->memoryBlock;
+        memset(p, 0xAB, size);
+        scalable_free(p);
+        TLSData *tls = defaultMemPool->getTLS(/*create=*/false);
+        tls->lloc.externalCleanup(extMemPool);
+    }
+    ASSERT(extMemPool->loc.getLOCSize(), "Large object was not cached.");
+    size_t released = doDecayPasses(4);
+    ASSERT(released >= size/2, "Pages of cached object were not released.");
+    ASSERT(!doDecayPasses(4), "Decayed blocks must not be processed again.");
+    char *q = (char*)scalable_malloc(size);
+    ASSERT(((LargeObjectHdr*)q - 1)->memoryBlock == lmb, "Decayed object must stay in the cache.");
+    ASSERT(countFilledBytes(q, size, (char)0xAB) <= 2*pageSize,
+           "Pages of cached object were not released.");
+    scalable_free(q);
+    scalable_allocation_command(TBBMALLOC_CLEAN_ALL_BUFFERS, 0);
+
+    // free backend block stays in bin with released pages;
+    // look for adjacent blocks, so the region is not released on free
+    Backend *backend = &extMemPool->backend;
+    LargeMemoryBlock *blocks[8];
+    int found = -1;
+    for (int i=0; i<8 && found<0; i++) {
+        blocks[i] = backend->getLargeBlock(size);
+        ASSERT(blocks[i], NULL);
+        memset(blocks[i]+1, 0xAB, size-sizeof(LargeMemoryBlock));
+        if (i && ((char*)blocks[i] + blocks[i]->unalignedSize == (char*)blocks[i-1]
+                  || (char*)blocks[i-1] + blocks[i-1]->unalignedSize == (char*)blocks[i]))
+            found = i;
+    }
+    if (found > 0) {
+        char *freed = (char*)blocks[found];
+        backend->putLargeBlock(blocks[found]);
+        released = doDecayPasses(4);
+        ASSERT(released >= size/2, "Pages of free backend block were not released.");
+        // the memory is not reused, as there are no other allocations
+        ASSERT(countFilledBytes(freed+pageSize, size-2*pageSize, (char)0xAB) == 0,
+               "Pages of free backend block were not released.");
+    } else
+        REMARK("Adjacent backend blocks not found, skipped.\n");
+    const int allocated = found > 0 ? found : 8;
+    for (int i=0; i<allocated; i++)
+        backend->putLargeBlock(blocks[i]);
+
+    // purging thread must not release memory in use
+    int res = scalable_allocation_mode(TBBMALLOC_SET_DECAY_TIME, 1);
+    if (res == TBBMALLOC_OK) {
+        intptr_t epoch = memoryDecay.epoch;
+        NativeParallelFor(MaxThread, DecayWork());
+        for (int i=0; i<1000 && epoch == FencedLoad(memoryDecay.epoch); i++)
+            Harness::Sleep(1);
+        ASSERT(epoch != memoryDecay.epoch, "Purging thread does not work.");
+    } else
+        ASSERT(res == TBBMALLOC_NO_EFFECT, NULL);
+    ASSERT(scalable_allocation_mode(TBBMALLOC_SET_DECAY_TIME, decayTime) == TBBMALLOC_OK, NULL);
+    scalable_allocation_command(TBBMALLOC_CLEAN_ALL_BUFFERS, 0);
+}
+
+// slabs of each group of bins must be in a single dedicated huge page
+class HugePageSlabsWork: NoAssign {
+public:
+    static const int OBJ_NUM = 4000;
+    void operator()(int) const {
+        const unsigned sizes[numSlabGroups] = {16, 512, 4000};
+        void *objs[numSlabGroups][OBJ_NUM];
+        void *pages[numSlabGroups];
+
+        for (unsigned g=0; g<numSlabGroups; g++) {
+            ASSERT(getSlabGroup(sizes[g]) == g, NULL);
+            // fill not more than a huge page
+            const int num = sizes[g]*OBJ_NUM > HUGE_PAGE_SIZE/2? HUGE_PAGE_SIZE/2/sizes[g] : OBJ_NUM;
+            for (int i=0; i<OBJ_NUM; i++)
+                objs[g][i] = i<num? scalable_malloc(sizes[g]) : NULL;
+            pages[g] = alignDown(objs[g][0], HUGE_PAGE_SIZE);
+            for (int i=0; i<num; i++)
+                ASSERT(alignDown(objs[g][i], HUGE_PAGE_SIZE) == pages[g],
+                       "Slabs of a group must be in the same huge page.");
+            for (unsigned p=0; p<g; p++)
+                ASSERT(pages[p] != pages[g], "Huge page must be dedicated to a group.");
+        }
+        for (unsigned g=0; g<numSlabGroups; g++)
+            scalable_free_batch(objs[g], OBJ_NUM);
+    }
+};
+
+void TestHugePageSlabs()
+{
+    if(!isMallocInitialized()) doInitialization();
+    ASSERT(!hugePageSlabs.get(), "Huge page slabs mode must be off by default");
+    ASSERT(scalable_allocation_mode(TBBMALLOC_USE_HUGE_PAGE_SLABS, 2) == TBBMALLOC_INVALID_PARAM, NULL);
+    int res = scalable_allocation_mode(TBBMALLOC_USE_HUGE_PAGE_SLABS, 1);
+    ASSERT(res == TBBMALLOC_OK || res == TBBMALLOC_NO_EFFECT, NULL);
+    ASSERT(hugePageSlabs.get(), NULL);
+    const bool statistics = statisticsMode.get();
+    scalable_allocation_mode(TBBMALLOC_COLLECT_STATISTICS, 1);
+
+    ScalableAllocationStatistics before, after;
+    scalable_allocation_command(TBBMALLOC_GET_STATISTICS, &before);
+    // new threads have empty caches of slabs, so dedicated huge pages are used
+    NativeParallelFor(MaxThread, HugePageSlabsWork());
+    scalable_allocation_command(TBBMALLOC_GET_STATISTICS, &after);
+    ASSERT(after.hugePageSlabGroups >= before.hugePageSlabGroups + MaxThread*numSlabGroups, NULL);
+    ASSERT(after.groupedSlabs > before.groupedSlabs + after.hugePageSlabGroups
+                                                    - before.hugePageSlabGroups, NULL);
+
+    // huge pages released by exited threads are reused
+    scalable_allocation_command(TBBMALLOC_CLEAN_ALL_BUFFERS, 0);
+    size_t memSize = defaultMemPool->extMemPool.backend.getTotalMemSize();
+    for (int i=0; i<10; i++)
+        NativeParallelFor(MaxThread, HugePageSlabsWork());
+    scalable_allocation_command(TBBMALLOC_CLEAN_ALL_BUFFERS, 0);
+    ASSERT(defaultMemPool->extMemPool.backend.getTotalMemSize() <= memSize + 4*HUGE_PAGE_SIZE*MaxThread,
+           "Memory of dedicated huge pages is not reused.");
+
+    // not used slabs of a live thread are released by the cleanup commands
+    const int cmds[] = {TBBMALLOC_CLEAN_THREAD_BUFFERS, TBBMALLOC_CLEAN_ALL_BUFFERS};
+    for (int c=0; c<2; c++) {
+        scalable_allocation_command(TBBMALLOC_CLEAN_THREAD_BUFFERS, 0);
+        const int num = 2*slabSize/16;
+        void *objs[num];
+        for (int i=0; i<num; i++)
+            objs[i] = scalable_malloc(16);
+        TLSData *tls = defaultMemPool->getTLS(/*create=*/false);
+        ASSERT(tls && tls->slabGroups[getSlabGroup(16)].next, "A huge page must be dedicated.");
+        ASSERT(scalable_allocation_command(cmds[c], 0) == TBBMALLOC_OK, NULL);
+        for (unsigned g=0; g<numSlabGroups; g++)
+            ASSERT(!tls->slabGroups[g].next, "Not used slabs must be released.");
+        scalable_free_batch(objs, num);
+    }
+
+    ASSERT(scalable_allocation_mode(TBBMALLOC_USE_HUGE_PAGE_SLABS, 0) == res, NULL);
+    scalable_allocation_mode(TBBMALLOC_COLLECT_STATISTICS, statistics);
+}
+
+// objects of other thread are buffered till the batch is full
+class RemoteFreeWork: NoAssign {
+    void **objs;
+public:
+    static const int OBJ_NUM = 100, BATCH = 16;
+    RemoteFreeWork(void **o) : objs(o) {}
+    void operator()(int) const {
+        TLSData *tls = defaultMemPool->getTLS(/*create=*/true);
+        ASSERT(!tls->remoteFrees.objects, NULL);
+        for (int i=0; i<BATCH-1; i++) {
+            scalable_free(objs[i]);
+            Block *block = (Block*)alignDown(objs[i], slabSize);
+            ASSERT(!isSolidPtr(block->publicFreeList), "Object must be buffered.");
+        }
+        ASSERT(tls->remoteFrees.objects == BATCH-1, NULL);
+        scalable_free(objs[BATCH-1]);
+        ASSERT(!tls->remoteFrees.objects, "Full batch must be released.");
+        for (int i=BATCH; i<OBJ_NUM; i++)
+            scalable_free(objs[i]);
+        ASSERT(tls->remoteFrees.objects == (OBJ_NUM-BATCH)%BATCH, NULL);
+        // rest of the objects are released on thread exit
+    }
+};
+
+bool isPublished(void *object)
+{
+    Block *block = (Block*)alignDown(object, slabSize);
+    for (FreeObject *o = block->publicFreeList; isSolidPtr(o); o = o->next)
+        if (o == object)
+            return true;
+    return false;
+}
+
+// buffered objects are released when the thread goes allocation slow path
+class RemoteFreeFlushWork: NoAssign {
+    void **objs;
+    int num;
+public:
+    RemoteFreeFlushWork(void **o, int n) : objs(o), num(n) {}
+    void operator()(int) const {
+        TLSData *tls = defaultMemPool->getTLS(/*create=*/true);
+        for (int i=0; i<num; i++)
+            scalable_free(objs[i]);
+        ASSERT(tls->remoteFrees.objects == num, NULL);
+        for (int i=0; i<num; i++)
+            ASSERT(!isPublished(objs[i]), "Object must be buffered.");
+        // the thread has no active blocks yet
+        void *p = scalable_malloc(16);
+        ASSERT(!tls->remoteFrees.objects, "Buffer must be flushed on allocation slow path.");
+        for (int i=0; i<num; i++)
+            ASSERT(isPublished(objs[i]), "Buffered object must be visible to the owner.");
+        scalable_free(p);
+    }
+};
+
+void TestRemoteFreeBatching()
+{
+    if(!isMallocInitialized()) doInitialization();
+    const intptr_t batchSize = remoteFreeBatching.get();
+    ASSERT(scalable_allocation_mode(TBBMALLOC_SET_REMOTE_FREE_BATCH, -1) == TBBMALLOC_INVALID_PARAM, NULL);
+    ASSERT(scalable_allocation_mode(TBBMALLOC_SET_REMOTE_FREE_BATCH, RemoteFreeWork::BATCH) == TBBMALLOC_OK, NULL);
+    // objects from fresh blocks, so public free lists are empty
+    scalable_allocation_command(TBBMALLOC_CLEAN_THREAD_BUFFERS, 0);
+    const size_t size = 700;
+    void *objs[RemoteFreeWork::OBJ_NUM];
+    Block *blocks[RemoteFreeWork::OBJ_NUM];
+    int blocksNum = 0;
+    for (int i=0; i<RemoteFreeWork::OBJ_NUM; i++) {
+        objs[i] = scalable_malloc(size);
+        Block *block = (Block*)alignDown(objs[i], slabSize);
+        if (!blocksNum || blocks[blocksNum-1] != block) {
+            ASSERT(!isSolidPtr(block->publicFreeList), NULL);
+            blocks[blocksNum++] = block;
+        }
+    }
+    NativeParallelFor(1, RemoteFreeWork(objs));
+
+    int published = 0;
+    for (int i=0; i<blocksNum; i++)
+        for (FreeObject *o = blocks[i]->publicFreeList; isSolidPtr(o); o = o->next)
+            published++;
+    ASSERT(published == RemoteFreeWork::OBJ_NUM, "All objects must be released after thread exit.");
+
+    const int flushNum = RemoteFreeWork::BATCH/2;
+    for (int i=0; i<flushNum; i++)
+        objs[i] = scalable_malloc(size);
+    NativeParallelFor(1, RemoteFreeFlushWork(objs, flushNum));
+    ASSERT(scalable_allocation_mode(TBBMALLOC_SET_REMOTE_FREE_BATCH, batchSize) == TBBMALLOC_OK, NULL);
+}
+
+// releases burst of large objects to LOC, returns size cached by the bin
+template<typename CacheBin>
+size_t releaseLOCBurst(CacheBin *bin, LargeMemoryBlock **lmbs, int num)
+{
+    for (int i=0; i<num; i++)
+        defaultMemPool->extMemPool.freeLargeObject(lmbs[i]);
+    return bin->cachedSize;
+}
+
+void TestAdaptiveLOC()
+{
+    if(!isMallocInitialized()) doInitialization();
+    const bool adaptive = adaptiveLOC.get();
+    LargeObjectCache *loc = &defaultMemPool->extMemPool.loc;
+    const size_t allocationSize = LargeObjectCache::alignToBin(64*1024);
+    const int binIdx = loc->largeCache.sizeToIdx(allocationSize);
+    const int BURST = 4;
+    LargeMemoryBlock *lmbs[BURST];
+    ASSERT(scalable_allocation_mode(TBBMALLOC_USE_ADAPTIVE_LOC, 2) == TBBMALLOC_INVALID_PARAM, NULL);
+
+    for (int mode=0; mode<2; mode++) {
+        ASSERT(scalable_allocation_mode(TBBMALLOC_USE_ADAPTIVE_LOC, mode) == TBBMALLOC_OK, NULL);
+        loc->cleanAll();
+        loc->reset();
+        // no regular cleanup during the test
+        loc->cacheCurrTime = 1;
+        LargeObjectCache::LargeCacheType::CacheBin *bin = &loc->largeCache.bin[binIdx];
+
+        for (int i=0; i<BURST; i++)
+            lmbs[i] = defaultMemPool->extMemPool.mallocLargeObject(defaultMemPool, allocationSize);
+        size_t cached = releaseLOCBurst(bin, lmbs, BURST);
+        // 1st object of fresh size is cached only if others are in use
+        ASSERT(cached == (mode? BURST : BURST-1)*allocationSize, NULL);
+
+        for (int i=0; i<BURST; i++)
+            lmbs[i] = defaultMemPool->extMemPool.mallocLargeObject(defaultMemPool, allocationSize);
+        ASSERT(mode? !bin->cachedSize : true, "All objects must be got from the cache.");
+        ASSERT(mode? bin->reuseDistance > 0 : !bin->reuseDistance, NULL);
+        // forget the history, as for long unused bin
+        bin->lastCleanedAge = 0;
+        bin->ageThreshold = 0;
+        cached = releaseLOCBurst(bin, lmbs, BURST);
+        ASSERT(cached == (mode? BURST : BURST-1)*allocationSize, NULL);
+        if (mode)
+            ASSERT(bin->ageThreshold, "Threshold must be restored from learned distance.");
+    }
+    loc->cleanAll();
+    ASSERT(scalable_allocation_mode(TBBMALLOC_USE_ADAPTIVE_LOC, adaptive) == TBBMALLOC_OK, NULL);
+}
+
+void TestLocalLOCSize()
+{
+    if(!isMallocInitialized()) doInitialization();
+    const size_t maxSize = localLOCSize.get();
+    const size_t size = 8*1024*1024;
+    ASSERT(scalable_allocation_mode(TBBMALLOC_SET_LOCAL_LOC_SIZE, -1) == TBBMALLOC_INVALID_PARAM, NULL);
+
+    for (int i=0; i<2; i++) {
+        ASSERT(scalable_allocation_mode(TBBMALLOC_SET_LOCAL_LOC_SIZE, i? 2*size : size/2) == TBBMALLOC_OK, NULL);
+        scalable_allocation_command(TBBMALLOC_CLEAN_THREAD_BUFFERS, NULL);
+        void *p = scalable_malloc(size);
+        ASSERT(p, NULL);
+        scalable_free(p);
+        TLSData *tls = defaultMemPool->getTLS(/*create=*/false);
+        ASSERT(i? tls->lloc.head != NULL : tls->lloc.head == NULL,
+               "Object must be cached by thread only if it fits the limit.");
+    }
+    scalable_allocation_command(TBBMALLOC_CLEAN_THREAD_BUFFERS, NULL);
+    ASSERT(scalable_allocation_mode(TBBMALLOC_SET_LOCAL_LOC_SIZE, maxSize) == TBBMALLOC_OK, NULL);
+}
+
 #if !__TBB_WIN8UI_SUPPORT && defined(_WIN32)
 
 #include "../src/tbbmalloc/tbb_function_replacement.cpp"
@@ -1398,10 +1937,19 @@ int TestMain () {
     TestLargeObjectCache();
     TestObjectRecognition();
     TestBitMask();
+    TestSizeClasses();
     TestHeapLimit();
     TestLOC();
     TestSlabAlignment();
     TestReallocDecreasing();
+    TestDecay();
+    TestHugePageSlabs();
+    TestRemoteFreeBatching();
+    TestAdaptiveLOC();
+    TestLocalLOCSize();
+#if __linux__
+    TestNumaMode();
+#endif
 
 #if __linux__
     if (isTHPEnabledOnMachine()) {
@@ -22,6 +22,7 @@
 
 // These features are pure additions and thus can be always "on" in the test
 #define TBB_PREVIEW_SERIAL_SUBSET 1
+#define TBB_PREVIEW_BLOCKED_RANGE_ND 1
 #include "harness_defs.h"
 
 #if _MSC_VER
@@ -684,6 +685,108 @@ void test() {
 
 } // namespace parallel_for_within_task_arena
 
+#include "tbb/blocked_range2d.h"
+#include "tbb/blocked_range3d.h"
+#include "tbb/blocked_rangeNd.h"
+
+namespace affinity_replay_by_fraction {
+
+// Loops of different sizes and over different ranges share one partitioner, and run with different
+// numbers of threads, so the recorded affinities are replayed for the ranges they were not recorded for.
+
+static const size_t max_size = 64;
+tbb::atomic<int> visits[max_size][max_size][max_size];
+
+void reset( size_t n ) {
+    for( size_t i = 0; i < n; ++i )
+        for( size_t j = 0; j < n; ++j )
+            for( size_t k = 0; k < n; ++k )
+                visits[i][j][k] = 0;
+}
+
+void check( size_t n0, size_t n1, size_t n2 ) {
+    for( size_t i = 0; i < max_size; ++i )
+        for( size_t j = 0; j < max_size; ++j )
+            for( size_t k = 0; k < max_size; ++k )
+                ASSERT( visits[i][j][k] == int(i < n0 && j < n1 && k < n2), "Iteration is lost or executed twice" );
+}
+
+struct Body1d {
+    void operator()( const tbb::blocked_range<size_t>& r ) const {
+        for( size_t i = r.begin(); i != r.end(); ++i )
+            ++visits[i][0][0];
+    }
+};
+
+struct Body2d {
+    void operator()( const tbb::blocked_range2d<size_t>& r ) const {
+        for( size_t i = r.rows().begin(); i != r.rows().end(); ++i )
+            for( size_t j = r.cols().begin(); j != r.cols().end(); ++j )
+                ++visits[i][j][0];
+    }
+};
+
+struct Body3d {
+    void operator()( const tbb::blocked_range3d<size_t>& r ) const {
+        for( size_t i = r.pages().begin(); i != r.pages().end(); ++i )
+            for( size_t j = r.rows().begin(); j != r.rows().end(); ++j )
+                for( size_t k = r.cols().begin(); k != r.cols().end(); ++k )
+                    ++visits[i][j][k];
+    }
+};
+
+#if __TBB_CPP11_PRESENT && __TBB_CPP11_ARRAY_PRESENT && __TBB_CPP11_TEMPLATE_ALIASES_PRESENT
+struct BodyNd {
+    void operator()( const tbb::blocked_rangeNd<size_t, 3>& r ) const {
+        for( size_t i = r.dim(0).begin(); i != r.dim(0).end(); ++i )
+            for( size_t j = r.dim(1).begin(); j != r.dim(1).end(); ++j )
+                for( size_t k = r.dim(2).begin(); k != r.dim(2).end(); ++k )
+                    ++visits[i][j][k];
+    }
+};
+#endif
+
+class ArenaBody : NoAssign {
+    tbb::affinity_partitioner& my_ap;
+    size_t my_size;
+public:
+    ArenaBody( tbb::affinity_partitioner& ap, size_t size ) : my_ap(ap), my_size(size) {}
+    void operator()() const {
+        const size_t n = my_size;
+        for( size_t d = 0; d < 3; ++d ) {
+            reset( max_size );
+            tbb::parallel_for( tbb::blocked_range<size_t>( 0, n - d ), Body1d(), my_ap );
+            check( n - d, 1, 1 );
+        }
+        reset( max_size );
+        tbb::parallel_for( tbb::blocked_range2d<size_t>( 0, n, 0, n - 1 ), Body2d(), my_ap );
+        check( n, n - 1, 1 );
+        reset( max_size );
+        tbb::parallel_for( tbb::blocked_range3d<size_t>( 0, n, 0, n - 1, 0, n ), Body3d(), my_ap );
+        check( n, n - 1, n );
+#if __TBB_CPP11_PRESENT && __TBB_CPP11_ARRAY_PRESENT && __TBB_CPP11_TEMPLATE_ALIASES_PRESENT
+        reset( max_size );
+        tbb::parallel_for( tbb::blocked_rangeNd<size_t, 3>( {0, n - 1}, {0, n}, {0, n} ), BodyNd(), my_ap );
+        check( n - 1, n, n );
+#endif
+    }
+};
+
+void test() {
+    tbb::affinity_partitioner ap( tbb::affinity_partitioner::replay_by_fraction );
+    const int max_threads = tbb::task_scheduler_init::default_num_threads() + 2;
+    // The number of threads goes up and then down, so the recorded slots may be out of the smaller arenas
+    const int threads[] = { 1, max_threads, 2, max_threads / 2 + 1, 1 };
+    for( size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); ++i ) {
+        tbb::task_arena arena( threads[i] );
+        for( size_t size = max_size / 2; size <= max_size; size += 7 )
+            arena.execute( ArenaBody( ap, size ) );
+        arena.execute( ArenaBody( ap, 5 ) );
+    }
+}
+
+} // namespace affinity_replay_by_fraction
+
 int TestMain () {
     if( MinThread<1 ) {
         REPORT("number of threads must be positive\n");
@@ -757,6 +860,7 @@ int TestMain () {
     various_range_implementations::test();
     interaction_with_range_and_partitioner::test();
     parallel_for_within_task_arena::test();
+    affinity_replay_by_fraction::test();
     return Harness::Done;
 }
 
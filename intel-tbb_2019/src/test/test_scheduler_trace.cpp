@@ -0,0 +1,168 @@
+/*
+    Copyright (c) 2005-2019 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+#include "harness.h"
+#include "tbb/scheduler_trace.h"
+#include "tbb/task_scheduler_init.h"
+#include "tbb/task_arena.h"
+#include "tbb/parallel_for.h"
+#include "tbb/blocked_range.h"
+#include "tbb/task.h"
+#include "tbb/atomic.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+
+static const char TraceFile[] = "test_scheduler_trace.json";
+static const char DumpFile[] = "test_scheduler_trace_dump.json";
+
+class TracedTask: public tbb::task {
+    tbb::task* execute() __TBB_override {
+        tbb::parallel_for( tbb::blocked_range<int>(0, 1000), Body() );
+        return NULL;
+    }
+public:
+    struct Body {
+        void operator()( const tbb::blocked_range<int>& r ) const {
+            volatile int sum = 0;
+            for( int i = r.begin(); i != r.end(); ++i )
+                sum += i;
+        }
+    };
+};
+
+class EnqueuedTask: public tbb::task {
+    tbb::atomic<int>& my_done;
+    tbb::task* execute() __TBB_override {
+        ++my_done;
+        return NULL;
+    }
+public:
+    EnqueuedTask( tbb::atomic<int>& done ) : my_done(done) {}
+};
+
+struct ArenaBody {
+    void operator()() const {
+        tbb::task& root = *new( tbb::task::allocate_root() ) TracedTask;
+        tbb::task::spawn_root_and_wait( root );
+    }
+};
+
+static const int num_concurrent_masters = 2;
+
+//! Runs a short-living master thread
+struct MasterBody {
+    void operator()( int ) const {
+        tbb::task_scheduler_init init( 1 );
+        ArenaBody()();
+    }
+};
+
+//! Statistics gathered from a trace file written one event per line
+struct TraceInfo {
+    int lines, begins, ends, tasks_named, spawns, arenas, threads, masters;
+    bool well_formed;
+};
+
+static TraceInfo ReadTrace( const char* file_name ) {
+    TraceInfo info;
+    std::memset( &info, 0, sizeof(info) );
+    FILE* f = fopen( file_name, "r" );
+    ASSERT( f, "Trace file is not written" );
+    std::map<int, int> depth;
+    char line[4096];
+    bool first = true, closed = false;
+    while( fgets( line, sizeof(line), f ) ) {
+        ++info.lines;
+        if( first ) {
+            ASSERT( !std::strcmp( line, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n" ), "Wrong trace header" );
+            first = false;
+            continue;
+        }
+        if( !std::strcmp( line, "]}\n" ) ) {
+            closed = true;
+            continue;
+        }
+        ASSERT( !closed, "Events after the end of the trace" );
+        ASSERT( line[0] == '{', "Event is not a JSON object" );
+        if( std::strstr( line, "\"name\":\"thread_name\"" ) ) {
+            ++info.threads;
+            if( std::strstr( line, "\"name\":\"master " ) )
+                ++info.masters;
+        }
+        const char* tid_str = std::strstr( line, "\"tid\":" );
+        int tid = tid_str ? std::atoi( tid_str + 6 ) : -1;
+        if( std::strstr( line, "\"ph\":\"B\"" ) ) {
+            ++info.begins;
+            ++depth[tid];
+            if( std::strstr( line, "\"cat\":\"task\"" ) && std::strstr( line, "TracedTask" ) )
+                ++info.tasks_named;
+            if( std::strstr( line, "\"name\":\"arena\"" ) )
+                ++info.arenas;
+        } else if( std::strstr( line, "\"ph\":\"E\"" ) ) {
+            ++info.ends;
+            ASSERT( --depth[tid] >= 0, "End of a span that has not begun" );
+        } else if( std::strstr( line, "\"name\":\"spawn\"" ) )
+            ++info.spawns;
+    }
+    fclose( f );
+    info.well_formed = closed;
+    return info;
+}
+
+int TestMain () {
+    // Tracing is set up when the first scheduler is created
+    Harness::SetEnv( "TBB_TRACE", TraceFile );
+    {
+        tbb::task_scheduler_init init( MaxThread );
+        tbb::task& root = *new( tbb::task::allocate_root() ) TracedTask;
+        tbb::task::spawn_root_and_wait( root );
+
+        tbb::atomic<int> done;
+        done = 0;
+        const int num_enqueued = 10;
+        for( int i = 0; i < num_enqueued; ++i )
+            tbb::task::enqueue( *new( tbb::task::allocate_root() ) EnqueuedTask( done ) );
+        tbb::task_arena arena( 2 );
+        arena.execute( ArenaBody() );
+        while( done < num_enqueued )
+            __TBB_Yield();
+
+        // The buffers of finished masters are reused by the next ones
+        for( int i = 0; i < 10; ++i )
+            NativeParallelFor( num_concurrent_masters, MasterBody() );
+
+        ASSERT( tbb::dump_scheduler_trace( DumpFile ), "Trace is not dumped" );
+    }
+    TraceInfo info = ReadTrace( DumpFile );
+    REMARK( "%d lines, %d spans, %d spawns, %d threads\n", info.lines, info.begins, info.spawns, info.threads );
+    ASSERT( info.well_formed, "Trace is not terminated" );
+    ASSERT( info.threads >= 1, "No thread names in the trace" );
+    ASSERT( info.tasks_named >= 2, "Tasks are not named by their types" );
+    ASSERT( info.spawns > 0, "Spawns are not traced" );
+    ASSERT( info.arenas > 0, "Entering task_arena is not traced" );
+    ASSERT( info.masters <= 1 + num_concurrent_masters, "Buffers of finished threads are not reused" );
+    ASSERT( info.ends <= info.begins, NULL );
+    std::remove( DumpFile );
+    // TraceFile is written at exit
+    return Harness::Done;
+}
@@ -0,0 +1,235 @@
+/*
+    Copyright (c) 2005-2019 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+#define HARNESS_DEFINE_PRIVATE_PUBLIC 1
+#include "harness_inject_scheduler.h"
+#include "harness.h"
+
+#if __linux__
+
+#include "tbb/task_scheduler_init.h"
+#include "tbb/parallel_reduce.h"
+#include "tbb/blocked_range.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+using namespace tbb::internal;
+using tbb::task;
+
+//! sysfs-like tree with 8 cores of 2 SMT threads; 2 cores share the last level cache, 2 caches form a node.
+/** As in Linux, CPU k and k+8 are siblings of core k. **/
+class FakeSysfs : NoAssign {
+    std::string my_root;
+    std::vector<std::string> my_paths;
+
+    void makeDir( const std::string& path ) {
+        ASSERT( !mkdir( (my_root + path).c_str(), 0755 ), "Can't create fake sysfs directory" );
+        my_paths.push_back( path );
+    }
+    void writeFile( const std::string& path, const char* format, int a, int b ) {
+        FILE* f = fopen( (my_root + path).c_str(), "w" );
+        ASSERT( f, "Can't create fake sysfs file" );
+        fprintf( f, format, a, b, a+8, b+8 );
+        fclose( f );
+        my_paths.push_back( path );
+    }
+public:
+    static const int num_cpus = 16;
+
+    FakeSysfs( const char* online ) {
+        char buf[64];
+        sprintf( buf, "/tmp/tbb_fake_sysfs.%d", (int)getpid() );
+        my_root = buf;
+        ASSERT( !mkdir( my_root.c_str(), 0755 ), "Can't create fake sysfs root" );
+        makeDir( "/cpu" );
+        makeDir( "/node" );
+        writeFile( "/cpu/online", online, 0, 0 );
+        writeFile( "/node/online", "0-1\n", 0, 0 );
+        for ( int n = 0; n < 2; ++n ) {
+            sprintf( buf, "/node/node%d", n );
+            makeDir( buf );
+            writeFile( std::string(buf) + "/cpulist", "%d-%d,%d-%d\n", 4*n, 4*n+3 );
+        }
+        for ( int c = 0; c < num_cpus; ++c ) {
+            const int core = c % 8, llc = core / 2;
+            sprintf( buf, "/cpu/cpu%d", c );
+            const std::string cpu = buf;
+            makeDir( cpu );
+            makeDir( cpu + "/topology" );
+            writeFile( cpu + "/topology/thread_siblings_list", "%d,%d\n", core, core+8 );
+            makeDir( cpu + "/cache" );
+            for ( int index = 0; index < 3; ++index ) {
+                sprintf( buf, "/cache/index%d", index );
+                makeDir( cpu + buf );
+                if ( index < 2 )
+                    writeFile( cpu + buf + "/shared_cpu_list", "%d,%d\n", core, core+8 );
+                else
+                    writeFile( cpu + buf + "/shared_cpu_list", "%d-%d,%d-%d\n", 2*llc, 2*llc+1 );
+            }
+        }
+    }
+    ~FakeSysfs() {
+        for ( size_t i = my_paths.size(); i > 0; --i ) {
+            const std::string path = my_root + my_paths[i-1];
+            if ( remove( path.c_str() ) )
+                rmdir( path.c_str() );
+        }
+        rmdir( my_root.c_str() );
+    }
+    const char* root() const { return my_root.c_str(); }
+};
+
+void TestTopology() {
+    FakeSysfs sysfs( "0-15\n" );
+    cpu_topology topology;
+    ASSERT( topology.read( sysfs.root() ), "Fake topology is not read" );
+    ASSERT( topology.num_cpus() == FakeSysfs::num_cpus, NULL );
+    ASSERT( topology.distance( 0, 0 ) == cpu_same_core, NULL );
+    ASSERT( topology.distance( 0, 8 ) == cpu_same_core, NULL );
+    ASSERT( topology.distance( 11, 3 ) == cpu_same_core, NULL );
+    ASSERT( topology.distance( 0, 1 ) == cpu_same_llc, NULL );
+    ASSERT( topology.distance( 0, 9 ) == cpu_same_llc, NULL );
+    ASSERT( topology.distance( 0, 2 ) == cpu_same_node, NULL );
+    ASSERT( topology.distance( 11, 0 ) == cpu_same_node, NULL );
+    ASSERT( topology.distance( 0, 4 ) == cpu_remote, NULL );
+    ASSERT( topology.distance( 15, 0 ) == cpu_remote, NULL );
+    ASSERT( topology.distance( -1, 0 ) == cpu_remote, "Unknown CPU must be remote" );
+    ASSERT( topology.distance( 0, FakeSysfs::num_cpus ) == cpu_remote, "Unknown CPU must be remote" );
+    // Siblings, then cores sharing cache, then the node
+    const int order[FakeSysfs::num_cpus] = {0, 8, 1, 9, 2, 10, 3, 11, 4, 12, 5, 13, 6, 14, 7, 15};
+    for ( int i = 0; i < FakeSysfs::num_cpus; ++i )
+        ASSERT( topology.ordered_cpu( i ) == order[i], "Wrong CPU order" );
+    ASSERT( topology.ordered_cpu( FakeSysfs::num_cpus ) == order[0], "Order must wrap around" );
+
+    ASSERT( !topology.read( "/nonexistent/sysfs/root" ), NULL );
+    ASSERT( !topology.num_cpus(), NULL );
+}
+
+void TestOfflineCpus() {
+    FakeSysfs sysfs( "0-3,8-11\n" );
+    cpu_topology topology;
+    ASSERT( topology.read( sysfs.root() ), NULL );
+    ASSERT( topology.num_cpus() == 12, NULL );
+    ASSERT( topology.distance( 0, 8 ) == cpu_same_core, NULL );
+    ASSERT( topology.distance( 0, 2 ) == cpu_same_node, NULL );
+    ASSERT( topology.distance( 0, 4 ) == cpu_remote, "Offline CPU must be remote" );
+    ASSERT( topology.distance( 4, 0 ) == cpu_remote, "Offline CPU must be remote" );
+    const int order[8] = {0, 8, 1, 9, 2, 10, 3, 11};
+    for ( int i = 0; i < 8; ++i )
+        ASSERT( topology.ordered_cpu( i ) == order[i], "Wrong CPU order" );
+}
+
+void TestVictimList() {
+    FakeSysfs sysfs( "0-15\n" );
+    cpu_topology topology;
+    ASSERT( topology.read( sysfs.root() ), NULL );
+
+    static arena_slot slots[FakeSysfs::num_cpus];
+    task** const NonEmptyTaskPool = (task**)&slots[0];
+    for ( int i = 0; i < FakeSysfs::num_cpus; ++i ) {
+        slots[i].my_cpu = i;
+        slots[i].task_pool = NonEmptyTaskPool;
+    }
+    victim_list victims;
+    memset( (void*)&victims, 0, sizeof(victims) );
+    ASSERT( victims.is_stale( slots, FakeSysfs::num_cpus, 0 ), "Empty list must be stale" );
+    victims.build( slots, FakeSysfs::num_cpus, /*self=*/0, topology, /*cpu=*/0 );
+    ASSERT( !victims.is_stale( slots, FakeSysfs::num_cpus, 0 ), NULL );
+    ASSERT( victims.is_stale( slots, FakeSysfs::num_cpus-1, 0 ), "Change of arena limit must be noticed" );
+    ASSERT( victims.is_stale( slots, FakeSysfs::num_cpus, 1 ), "Change of own slot must be noticed" );
+
+    FastRandom random( (unsigned)42 );
+    cpu_distance distance;
+    for ( int i = 0; i < 100; ++i ) {
+        ASSERT( victims.select( random, distance ) == &slots[8], "SMT sibling must be tried first" );
+        ASSERT( distance == cpu_same_core, NULL );
+    }
+    slots[8].task_pool = EmptyTaskPool;
+    for ( int i = 0; i < 100; ++i ) {
+        arena_slot* victim = victims.select( random, distance );
+        ASSERT( victim == &slots[1] || victim == &slots[9], "Core sharing cache must be tried next" );
+        ASSERT( distance == cpu_same_llc, NULL );
+    }
+    for ( int i = 1; i < FakeSysfs::num_cpus; ++i )
+        slots[i].task_pool = EmptyTaskPool;
+    slots[15].task_pool = NonEmptyTaskPool;
+    bool found = false;
+    for ( int i = 0; i < 1000 && !found; ++i )
+        if ( arena_slot* victim = victims.select( random, distance ) ) {
+            ASSERT( victim == &slots[15] && distance == cpu_remote, NULL );
+            found = true;
+        }
+    ASSERT( found, "Remote victim is not found" );
+    slots[15].task_pool = EmptyTaskPool;
+    for ( int i = 0; i < 1000; ++i )
+        ASSERT( !victims.select( random, distance ), "Self or victim without tasks is selected" );
+    victims.free_list();
+}
+
+struct SumBody {
+    long my_sum;
+    SumBody() : my_sum(0) {}
+    SumBody( SumBody&, tbb::split ) : my_sum(0) {}
+    void operator()( const tbb::blocked_range<long>& r ) {
+        for ( long i = r.begin(); i != r.end(); ++i )
+            my_sum += i;
+    }
+    void join( SumBody& rhs ) { my_sum += rhs.my_sum; }
+};
+
+//! Runs the scheduler with topology-aware stealing over a fake topology.
+void TestTopologyStealing() {
+    FakeSysfs sysfs( "0-15\n" );
+    ASSERT( governor::theTopology.read( sysfs.root() ), NULL );
+    governor::is_topology_stealing_enabled = true;
+
+    const long n = 100000;
+    // Whitebox builds of the scheduler do not survive re-initialization after
+    // a single-threaded run, so start with two threads.
+    for ( int p = max(MinThread, 2); p <= MaxThread; ++p ) {
+        tbb::task_scheduler_init init( p );
+        for ( int i = 0; i < 10; ++i ) {
+            SumBody body;
+            tbb::parallel_reduce( tbb::blocked_range<long>(0, n, 10), body, tbb::simple_partitioner() );
+            ASSERT( body.my_sum == n*(n-1)/2, "Wrong sum" );
+        }
+    }
+    governor::is_topology_stealing_enabled = false;
+}
+
+int TestMain () {
+    TestTopology();
+    TestOfflineCpus();
+    TestVictimList();
+    TestTopologyStealing();
+    return Harness::Done;
+}
+
+#else /* !__linux__ */
+
+int TestMain () {
+    return Harness::Skipped;
+}
+
+#endif /* !__linux__ */
@@ -23,6 +23,7 @@
 #include "tbb/tbb_thread.h"
 #include "tbb/task_scheduler_init.h"
 #include <cstdlib>
+#include <vector>
 
 //------------------------------------------------------------------------
 // Test for task::spawn_children and task_list
@@ -156,6 +157,40 @@ void TestSpawnRootList( int nthread ) {
         }
 }
 
+//! Records the order of execution of its instances.
+class OrderedTask: public tbb::task {
+    int my_index;
+    std::vector<int>& my_order;
+    tbb::task* execute() __TBB_override {
+        my_order.push_back(my_index);
+        return NULL;
+    }
+public:
+    OrderedTask( int index, std::vector<int>& order ) : my_index(index), my_order(order) {}
+};
+
+//! Test that a spawned task_list is executed locally in the list order, however long it is
+void TestSpawnListOrder() {
+    REMARK("testing local execution order of a spawned task_list\n");
+    tbb::task_scheduler_init init(1);
+    const int sizes[] = {1, 2, 63, 64, 65, 1000, 5000};
+    for( size_t k=0; k<sizeof(sizes)/sizeof(sizes[0]); ++k ) {
+        std::vector<int> order;
+        tbb::task& root = *new( tbb::task::allocate_root() ) tbb::empty_task;
+        root.set_ref_count(sizes[k]+1);
+        tbb::task_list list;
+        for( int i=0; i<sizes[k]; ++i )
+            list.push_back( *new( root.allocate_child() ) OrderedTask(i, order) );
+        tbb::task::spawn(list);
+        ASSERT( list.empty(), "spawn must clear the list" );
+        root.wait_for_all();
+        tbb::task::destroy(root);
+        ASSERT( int(order.size())==sizes[k], NULL );
+        for( int i=0; i<sizes[k]; ++i )
+            ASSERT( order[i]==i, "Tasks of the list are executed in a wrong order" );
+    }
+}
+
 //------------------------------------------------------------------------
 // Test for task::recycle_as_safe_continuation
 //------------------------------------------------------------------------
@@ -795,7 +830,6 @@ void TestWaitableTask() {
 
 #if __TBB_PREVIEW_CRITICAL_TASKS
 #include <stdexcept>
-#include <vector>
 #include <map>
 #include "tbb/parallel_for.h"
 
@@ -1329,6 +1363,7 @@ int TestMain () {
     TestDispatchLoopResponsiveness();
     TestWaitDiscriminativenessWithoutStealing();
     TestWaitDiscriminativenessWithStealing();
+    TestSpawnListOrder();
     for( int p=MinThread; p<=MaxThread; ++p ) {
         TestSpawnChildren( p );
         TestSpawnRootList( p );
@@ -25,6 +25,7 @@
 #include <cstdio>
 #include <vector>
 #include <set>
+#include <climits>
 
 #include "harness_fp.h"
 
@@ -43,6 +44,7 @@
 #include "tbb/parallel_for.h"
 #include "tbb/blocked_range.h"
 #include "tbb/enumerable_thread_specific.h"
+#include "tbb/tick_count.h"
 
 #include "harness_assert.h"
 #include "harness.h"
@@ -1591,6 +1593,186 @@ void TestArenaWorkersMigration() {
 }
 
 //--------------------------------------------------//
+namespace TestStatisticsNS {
+    struct Body {
+        void operator()( const tbb::blocked_range<int>& r ) const {
+            volatile int sum = 0;
+            for( int i = r.begin(); i != r.end(); ++i )
+                sum += i;
+        }
+    };
+
+    struct Work {
+        tbb::task_arena_statistics& my_inner;
+        Work( tbb::task_arena_statistics& inner ) : my_inner(inner) {}
+        void operator()() const {
+            tbb::parallel_for( tbb::blocked_range<int>(0, 1000, 1), Body(), tbb::simple_partitioner() );
+            my_inner = tbb::this_task_arena::statistics();
+        }
+    };
+
+    struct Enqueued {
+        tbb::atomic<int>& my_done;
+        Enqueued( tbb::atomic<int>& done ) : my_done(done) {}
+        void operator()() const { ++my_done; }
+    };
+
+    void CheckGrowing( const tbb::task_arena_statistics& before, const tbb::task_arena_statistics& after ) {
+        ASSERT( before.tasks_executed <= after.tasks_executed, NULL );
+        ASSERT( before.steals_attempted <= after.steals_attempted, NULL );
+        ASSERT( before.steals_succeeded <= after.steals_succeeded, NULL );
+        ASSERT( before.mailbox_tasks_taken <= after.mailbox_tasks_taken, NULL );
+        ASSERT( before.tasks_enqueued <= after.tasks_enqueued, NULL );
+        ASSERT( before.wait_time <= after.wait_time, NULL );
+        ASSERT( before.spin_time <= after.spin_time, NULL );
+        ASSERT( before.work_time <= after.work_time, NULL );
+        ASSERT( before.sleep_time <= after.sleep_time, NULL );
+        ASSERT( after.steals_succeeded <= after.steals_attempted, NULL );
+    }
+}
+
+void TestStatistics() {
+    using namespace TestStatisticsNS;
+    tbb::task_arena a( 2 );
+    tbb::task_arena_statistics s = a.statistics();
+    ASSERT( !s.tasks_executed && !s.tasks_enqueued && !s.steals_attempted && s.wait_time == 0,
+            "Uninitialized arena has statistics" );
+    a.initialize();
+    s = a.statistics();
+    ASSERT( !s.tasks_executed && !s.tasks_enqueued, "New arena has executed tasks" );
+
+    tbb::task_arena_statistics inner;
+    a.execute( Work(inner) );
+    tbb::task_arena_statistics after_work = a.statistics();
+    ASSERT( inner.tasks_executed >= 1000, "Tasks of the current arena are not counted" );
+    ASSERT( inner.wait_time > 0, "Waiting for the work is not timed" );
+    ASSERT( inner.workers_allotted <= 1 && inner.workers_active <= 1, "The arena has one slot for a worker" );
+    CheckGrowing( inner, after_work );
+
+    const int num_enqueued = 100;
+    tbb::atomic<int> done;
+    done = 0;
+    for( int i = 0; i < num_enqueued; ++i )
+        a.enqueue( Enqueued(done) );
+    while( done < num_enqueued )
+        __TBB_Yield();
+    tbb::task_arena_statistics after_enqueue = a.statistics();
+    ASSERT( after_enqueue.tasks_enqueued >= after_work.tasks_enqueued + num_enqueued, "Enqueued tasks are not counted" );
+    CheckGrowing( after_work, after_enqueue );
+
+    // Enqueued tasks are executed by the worker, which accounts its times when it leaves the arena
+    tbb::task_arena_statistics after_leave = a.statistics();
+    for( int i = 0; i < 100 && after_leave.work_time == 0; ++i ) {
+        Harness::Sleep( 10 );
+        after_leave = a.statistics();
+    }
+    ASSERT( after_leave.work_time > 0, "Work time of the worker is not counted" );
+    ASSERT( after_leave.spin_time > 0, "The worker left the arena without spinning" );
+    ASSERT( after_leave.sleep_time > 0, "Sleep time of the worker is not counted" );
+    CheckGrowing( after_enqueue, after_leave );
+}
+
+//--------------------------------------------------//
+
+//--------------------------------------------------//
+namespace TestNestedQuotaNS {
+    tbb::atomic<int> g_active;
+    tbb::atomic<int> g_peak;
+    tbb::enumerable_thread_specific<int> g_depth;
+
+    //! Counts the thread as active in the arena group while any body runs on it.
+    class ActivityScope : NoCopy {
+    public:
+        ActivityScope() {
+            if( !g_depth.local()++ ) {
+                int active = ++g_active;
+                for( int peak = g_peak; active > peak; peak = g_peak )
+                    g_peak.compare_and_swap( active, peak );
+            }
+        }
+        ~ActivityScope() {
+            if( !--g_depth.local() )
+                --g_active;
+        }
+    };
+
+    //! Keeps the thread busy until the group has reached the expected number of threads, or for the given time.
+    struct Body {
+        int my_expected;
+        double my_seconds;
+        Body( int expected, double seconds ) : my_expected(expected), my_seconds(seconds) {}
+        void operator()( const tbb::blocked_range<int>& ) const {
+            ActivityScope scope;
+            const tbb::tick_count start = tbb::tick_count::now();
+            while( g_peak < my_expected && (tbb::tick_count::now() - start).seconds() < my_seconds )
+                __TBB_Yield();
+        }
+    };
+
+    struct Inner {
+        int my_expected;
+        double my_seconds;
+        Inner( int expected, double seconds = 0.1 ) : my_expected(expected), my_seconds(seconds) {}
+        void operator()() const {
+            tbb::parallel_for( tbb::blocked_range<int>(0, 100), Body(my_expected, my_seconds), tbb::simple_partitioner() );
+        }
+    };
+
+    //! Runs a nested arena with its own parallel loop in every iteration of the outer loop.
+    struct OuterBody {
+        int my_concurrency;
+        OuterBody( int concurrency ) : my_concurrency(concurrency) {}
+        void operator()( const tbb::blocked_range<int>& ) const {
+            ActivityScope scope;
+            tbb::task_arena child( tbb::task_arena::nested(), my_concurrency );
+            child.execute( Inner(INT_MAX, 0.001) );
+        }
+    };
+
+    struct Outer {
+        int my_concurrency;
+        Outer( int concurrency ) : my_concurrency(concurrency) {}
+        void operator()() const {
+            tbb::parallel_for( tbb::blocked_range<int>(0, 8), OuterBody(my_concurrency), tbb::simple_partitioner() );
+        }
+    };
+
+    struct Borrow {
+        int my_expected;
+        Borrow( int expected ) : my_expected(expected) {}
+        void operator()() const {
+            tbb::task_arena child( tbb::task_arena::nested(), tbb::task_arena::automatic );
+            child.execute( Inner(my_expected) );
+        }
+    };
+
+    void ResetPeak() {
+        ASSERT( !g_active, NULL );
+        g_peak = 0;
+    }
+}
+
+void TestNestedQuota() {
+    using namespace TestNestedQuotaNS;
+    // The market has MaxThread workers, more than the parent arena may use
+    const int limit = 2;
+    tbb::task_arena parent( limit );
+    ResetPeak();
+    parent.execute( Outer(MaxThread + 1) );
+    REMARK( "Nested arenas: %d threads at most with the limit %d\n", int(g_peak), limit );
+    ASSERT( g_peak <= limit, "Nested arenas exceed the concurrency of their parent" );
+
+    // A nested arena borrows all the workers of an idle parent, and returns them when done
+    const int concurrency = max( 2, min( MaxThread, 4 ) );
+    tbb::task_arena idle_parent( concurrency );
+    ResetPeak();
+    idle_parent.execute( Borrow(concurrency) );
+    ASSERT( g_peak == concurrency, "Nested arena has not borrowed the workers of its parent" );
+    ASSERT( idle_parent.max_concurrency() == concurrency, NULL );
+    ResetPeak();
+    idle_parent.execute( Inner(concurrency) );
+    ASSERT( g_peak == concurrency, "Nested arena has not returned the workers to its parent" );
+}
 
 int TestMain() {
 #if __TBB_TASK_ISOLATION
@@ -1610,5 +1792,7 @@ int TestMain() {
     TestMoveSemantics();
     TestReturnValue();
     TestArenaWorkersMigration();
+    TestStatistics();
+    TestNestedQuota();
     return Harness::Done;
 }
@@ -313,6 +313,167 @@ void TestDequeueByMaster () {
     tbb::task::destroy(r);
 }
 
+////////////////////// Enqueuing task lists ///////
+#include <vector>
+
+class ListedTask : public tbb::task {
+    int my_index;
+    std::vector<int>& my_order;
+    tbb::atomic<int>& my_count;
+    tbb::task* execute() __TBB_override {
+        my_order[my_count++] = my_index;
+        return NULL;
+    }
+public:
+    ListedTask( int index, std::vector<int>& order, tbb::atomic<int>& count )
+        : my_index(index), my_order(order), my_count(count) {}
+};
+
+//! Enqueues the whole list at once, checks that every task is executed once, and in FIFO order if p==1.
+void TestEnqueueList( int p, int n, bool with_priority ) {
+    tbb::task_scheduler_init init(p);
+    std::vector<int> order(n, -1);
+    tbb::atomic<int> count;
+    count = 0;
+    tbb::task &r = *new ( tbb::task::allocate_root() ) tbb::empty_task;
+    r.set_ref_count(n+1);
+    tbb::task_list list;
+    for( int i=0; i<n; ++i )
+        list.push_back( *new(r.allocate_child()) ListedTask(i, order, count) );
+#if __TBB_TASK_PRIORITY
+    if( with_priority )
+        tbb::task::enqueue( list, tbb::priority_high );
+    else
+#endif
+        tbb::task::enqueue( list );
+    ASSERT( list.empty(), "enqueue must clear the list" );
+    r.wait_for_all();
+    tbb::task::destroy(r);
+    ASSERT( count==n, NULL );
+    std::vector<bool> seen(n, false);
+    for( int i=0; i<n; ++i ) {
+        ASSERT( 0<=order[i] && order[i]<n && !seen[order[i]], "A task is executed twice or not at all" );
+        seen[order[i]] = true;
+        if( p==1 )
+            ASSERT( order[i]==i, "Enqueued tasks are executed not in FIFO order" );
+    }
+}
+
+void TestEnqueueList( int p ) {
+    REMARK("Testing enqueuing of task lists with %d threads\n", p);
+    // Lists longer than 256 tasks do not fit the stack buffer of the bulk enqueue
+    const int sizes[] = {1, 10, 256, 257, 1000};
+    for( size_t i=0; i<sizeof(sizes)/sizeof(sizes[0]); ++i ) {
+        TestEnqueueList( p, sizes[i], false );
+        TestEnqueueList( p, sizes[i], true );
+    }
+}
+
+////////////////////// Enqueuing with deadlines ///////
+#include "tbb/global_control.h"
+
+//! Enqueues tasks without deadlines, then ones with deadlines in a shuffled order.
+/** Checks that every task is executed once, and if the thread is alone, that the tasks with deadlines
+    are executed first and in the order of their deadlines, even if the deadlines have passed. **/
+void TestEnqueueWithDeadline( int p, bool with_priority ) {
+    tbb::task_scheduler_init init(p);
+    const int n = 100, n_fifo = 10;
+    std::vector<int> order(n+n_fifo, -1);
+    tbb::atomic<int> count;
+    count = 0;
+    tbb::task &r = *new ( tbb::task::allocate_root() ) tbb::empty_task;
+    r.set_ref_count(n+n_fifo+1);
+    // Ones without deadlines are executed last, so their indices follow
+    for( int i=0; i<n_fifo; ++i )
+        tbb::task::enqueue( *new(r.allocate_child()) ListedTask(n+i, order, count) );
+    const tbb::tick_count now = tbb::tick_count::now();
+    for( int i=0; i<n; ++i ) {
+        // 37 and n are coprime, so every index is used once; half of the deadlines have passed
+        const int index = i*37 % n;
+        const tbb::tick_count deadline = now + tbb::tick_count::interval_t( (index - n/2) * 1e-3 );
+        tbb::task& t = *new(r.allocate_child()) ListedTask(index, order, count);
+#if __TBB_TASK_PRIORITY
+        if( with_priority )
+            tbb::task::enqueue_with_deadline( t, deadline, tbb::priority_normal );
+        else
+#endif
+            tbb::task::enqueue_with_deadline( t, deadline );
+    }
+    r.wait_for_all();
+    tbb::task::destroy(r);
+    ASSERT( count==n+n_fifo, NULL );
+    // A worker servicing enqueued tasks might start before all of them are enqueued
+    const bool in_order = p==1 && tbb::global_control::active_value(tbb::global_control::max_allowed_parallelism)==1;
+    std::vector<bool> seen(n+n_fifo, false);
+    for( int i=0; i<n+n_fifo; ++i ) {
+        ASSERT( 0<=order[i] && order[i]<n+n_fifo && !seen[order[i]], "A task is executed twice or not at all" );
+        seen[order[i]] = true;
+        // The tasks without deadlines are spread over the lanes, so their order is relaxed
+        if( in_order )
+            ASSERT( i<n ? order[i]==i : order[i]>=n, "Tasks are executed not in the order of deadlines" );
+    }
+}
+
+#if __TBB_TASK_PRIORITY
+//! Enqueues tasks on the priority levels in between priority_low and priority_high.
+void TestIntermediatePriorities( int p ) {
+    tbb::task_scheduler_init init(p);
+    const int num_levels = 7, n = 10;
+    std::vector<int> order(num_levels*n, -1);
+    tbb::atomic<int> count;
+    count = 0;
+    tbb::task &r = *new ( tbb::task::allocate_root() ) tbb::empty_task;
+    r.set_ref_count(num_levels*n+1);
+    for( int i=0; i<num_levels*n; ++i ) {
+        const tbb::priority_t prio = tbb::priority_level( i % num_levels, num_levels );
+        tbb::task& t = *new(r.allocate_child()) ListedTask(i, order, count);
+        if( i % 2 )
+            tbb::task::enqueue( t, prio );
+        else
+            tbb::task::enqueue_with_deadline( t, tbb::tick_count::now(), prio );
+    }
+    r.wait_for_all();
+    tbb::task::destroy(r);
+    ASSERT( count==num_levels*n, NULL );
+    std::vector<bool> seen(num_levels*n, false);
+    for( int i=0; i<num_levels*n; ++i ) {
+        ASSERT( 0<=order[i] && order[i]<num_levels*n && !seen[order[i]], "A task is executed twice or not at all" );
+        seen[order[i]] = true;
+    }
+}
+
+//! Checks that the priorities in between are mapped onto the levels of the scheduler in order.
+void TestPriorityLevels() {
+    ASSERT( tbb::priority_level(0, 3)==tbb::priority_low, NULL );
+    ASSERT( tbb::priority_level(1, 3)==tbb::priority_normal, NULL );
+    ASSERT( tbb::priority_level(2, 3)==tbb::priority_high, NULL );
+    ASSERT( tbb::priority_level(8, 9)==tbb::priority_high, NULL );
+    tbb::task_scheduler_init init;
+    tbb::task_group_context ctx;
+    const tbb::priority_t levels[] = { tbb::priority_low, tbb::priority_normal, tbb::priority_high };
+    for( int i=0; i<3; ++i ) {
+        ctx.set_priority( levels[i] );
+        ASSERT( ctx.priority()==levels[i], "priority_low, priority_normal and priority_high must be distinguished" );
+    }
+    tbb::priority_t prev = tbb::priority_low;
+    for( unsigned i=0; i<=100; ++i ) {
+        ctx.set_priority( tbb::priority_level(i, 101) );
+        const tbb::priority_t cur = ctx.priority();
+        ASSERT( prev<=cur && cur<=tbb::priority_high, "Priorities are mapped out of order" );
+        prev = cur;
+    }
+}
+#endif /* __TBB_TASK_PRIORITY */
+
+void TestEnqueueWithDeadline( int p ) {
+    REMARK("Testing enqueuing with deadlines with %d threads\n", p);
+    TestEnqueueWithDeadline( p, false );
+    TestEnqueueWithDeadline( p, true );
+#if __TBB_TASK_PRIORITY
+    TestIntermediatePriorities( p );
+#endif
+}
+
 ////////////////////// Missed wake-ups ///////
 #include "tbb/blocked_range.h"
 #include "tbb/parallel_for.h"
@@ -356,11 +517,12 @@ void TestWakeups()
         tbb::parallel_for(tbb::blocked_range<int>(0, NUM_TASKS), Functor(barrier)); // auto
 }
 
-#include "tbb/global_control.h"
-
 int TestMain () {
 
     TestWakeups();         // 1st because requests oversubscription
+#if __TBB_TASK_PRIORITY
+    TestPriorityLevels();
+#endif
     for (int i=0; i<2; i++) {
         tbb::global_control *c = i?
             new tbb::global_control(tbb::global_control::max_allowed_parallelism, 1) : NULL;
@@ -373,6 +535,8 @@ int TestMain () {
         for( int p=MinThread; p<=MaxThread; ++p ) {
             TestEnqueue(p);
             TestSharedRoot(p);
+            TestEnqueueList(p);
+            TestEnqueueWithDeadline(p);
         }
         delete c;
     }
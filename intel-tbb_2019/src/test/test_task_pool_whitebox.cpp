@@ -0,0 +1,308 @@
+/*
+    Copyright (c) 2005-2019 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+// The scheduler is built into the test with the Chase-Lev task pool
+#define __TBB_CHASE_LEV_TASK_POOL 1
+#define HARNESS_DEFINE_PRIVATE_PUBLIC 1
+#include "harness_inject_scheduler.h"
+#include "harness.h"
+
+#include "tbb/task_arena.h"
+#include "tbb/task_scheduler_init.h"
+#include "tbb/parallel_for.h"
+#include "tbb/blocked_range.h"
+#include "tbb/partitioner.h"
+#include "tbb/atomic.h"
+
+#include <vector>
+
+using namespace tbb::internal;
+using tbb::task;
+
+//! Marks its flag, so that tasks executed twice or lost are detected.
+class FlagTask : public task {
+    tbb::atomic<int>& my_flag;
+    task* execute() __TBB_override {
+        ASSERT( my_flag.fetch_and_increment() == 0, "Task is executed twice" );
+        return NULL;
+    }
+public:
+    FlagTask( tbb::atomic<int>& flag ) : my_flag(flag) {}
+};
+
+class Flags : NoCopy {
+    std::vector<tbb::atomic<int> > my_flags;
+public:
+    Flags( size_t n ) : my_flags(n) { reset(); }
+    void reset() {
+        for( size_t i = 0; i < my_flags.size(); ++i )
+            my_flags[i] = 0;
+    }
+    size_t size() const { return my_flags.size(); }
+    tbb::atomic<int>& operator[]( size_t i ) { return my_flags[i]; }
+    void check() const {
+        for( size_t i = 0; i < my_flags.size(); ++i )
+            ASSERT( my_flags[i] == 1, "Task is lost" );
+    }
+};
+
+//! Spawns the tasks one by one or as lists of various lengths, and waits for them.
+/** The owner pops the tasks while the workers steal them; the lists grow the task pool. **/
+void TestSpawnAndSteal( int p ) {
+    REMARK( "Testing spawn and steal with %d threads\n", p );
+    tbb::task_scheduler_init init( p );
+    Flags flags( 5000 );
+    for( int rep = 0; rep < 20; ++rep ) {
+        flags.reset();
+        task& root = *new( task::allocate_root() ) tbb::empty_task;
+        root.set_ref_count( int(flags.size()) + 1 );
+        size_t list_size = rep % 2 ? 1 : size_t(rep) * 37;
+        tbb::task_list list;
+        size_t in_list = 0;
+        for( size_t i = 0; i < flags.size(); ++i ) {
+            list.push_back( *new( root.allocate_child() ) FlagTask( flags[i] ) );
+            if( ++in_list >= list_size ) {
+                task::spawn( list );
+                in_list = 0;
+            }
+        }
+        if( in_list )
+            task::spawn( list );
+        root.wait_for_all();
+        task::destroy( root );
+        flags.check();
+    }
+    generic_scheduler* s = governor::local_scheduler_if_initialized();
+    ASSERT( s && s->my_arena_slot, NULL );
+    arena_slot& slot = *s->my_arena_slot;
+    ASSERT( slot.my_task_pool_size >= generic_scheduler::min_task_pool_size, NULL );
+    ASSERT( !(slot.my_task_pool_size & (slot.my_task_pool_size - 1)), "Task pool size is not a power of two" );
+    ASSERT( arena_slot::header_of( slot.task_pool_ptr ).mask == slot.my_task_pool_size - 1, NULL );
+    ASSERT( slot.head == slot.tail, "Task pool is not empty after the work is done" );
+    // The tasks are spawned before waiting for them, so the task pool has grown
+    ASSERT( slot.my_task_pool_size >= 1024, "Task pool has not grown" );
+    // The task pool becomes empty only when the head reaches the tail, and the indices are never reset
+    ASSERT( slot.head >= 20, "Task pool indices are reset" );
+}
+
+//! Recursively spawns two children, as Fibonacci does, and sums the leaves.
+class TreeTask : public task {
+    int my_depth;
+    long* my_sum;
+    task* execute() __TBB_override {
+        if( !my_depth ) {
+            *my_sum = 1;
+            return NULL;
+        }
+        long x = 0, y = 0;
+        set_ref_count( 3 );
+        spawn( *new( allocate_child() ) TreeTask( my_depth - 1, &x ) );
+        spawn_and_wait_for_all( *new( allocate_child() ) TreeTask( my_depth - 1, &y ) );
+        *my_sum = x + y;
+        return NULL;
+    }
+public:
+    TreeTask( int depth, long* sum ) : my_depth(depth), my_sum(sum) {}
+};
+
+void TestRecursion( int p ) {
+    REMARK( "Testing recursive spawning with %d threads\n", p );
+    tbb::task_scheduler_init init( p );
+    const int depth = 16;
+    for( int rep = 0; rep < 10; ++rep ) {
+        long sum = 0;
+        task::spawn_root_and_wait( *new( task::allocate_root() ) TreeTask( depth, &sum ) );
+        ASSERT( sum == 1L << depth, "Tasks are lost or executed twice" );
+    }
+}
+
+#if __TBB_TASK_ISOLATION
+//! Isolation of the task executed by the calling thread.
+inline isolation_tag CurrentIsolation() {
+    return governor::local_scheduler()->my_innermost_running_task->prefix().isolation;
+}
+
+//! Checks that the isolated inner loops do not execute the iterations of the outer one.
+class OuterBody : NoAssign {
+    Flags& my_flags;
+public:
+    class InnerBody : NoAssign {
+    public:
+        void operator()( const tbb::blocked_range<int>& ) const {
+            ASSERT( CurrentIsolation() != no_isolation, "Inner iteration is executed outside of the isolated region" );
+        }
+    };
+    class Isolated : NoAssign {
+    public:
+        void operator()() const {
+            tbb::parallel_for( tbb::blocked_range<int>( 0, 100 ), InnerBody(), tbb::simple_partitioner() );
+        }
+    };
+    OuterBody( Flags& flags ) : my_flags(flags) {}
+    void operator()( const tbb::blocked_range<size_t>& r ) const {
+        ASSERT( CurrentIsolation() == no_isolation, "Outer iteration is executed inside the isolated region" );
+        for( size_t i = r.begin(); i != r.end(); ++i ) {
+            ASSERT( my_flags[i].fetch_and_increment() == 0, "Outer iteration is executed twice" );
+            tbb::this_task_arena::isolate( Isolated() );
+        }
+    }
+};
+
+void TestIsolation( int p ) {
+    REMARK( "Testing isolation with %d threads\n", p );
+    tbb::task_scheduler_init init( p );
+    Flags flags( 200 );
+    for( int rep = 0; rep < 5; ++rep ) {
+        flags.reset();
+        tbb::parallel_for( tbb::blocked_range<size_t>( 0, flags.size() ), OuterBody( flags ), tbb::simple_partitioner() );
+        flags.check();
+    }
+}
+
+//! Tries to steal its child from its own task pool as a thief from another isolated region would.
+class IsolatedThiefTask : public task {
+    task* execute() __TBB_override {
+        generic_scheduler* s = governor::local_scheduler();
+        tbb::atomic<int> flag;
+        flag = 0;
+        set_ref_count( 2 );
+        spawn( *new( allocate_child() ) FlagTask( flag ) );
+        arena_slot& slot = *s->my_arena_slot;
+        const size_t head = slot.head;
+        const arena_slot::steal_hint& hint = arena_slot::hint( slot.task_pool_ptr, head );
+        ASSERT( hint.isolation == slot.task_at( head )->prefix().isolation && !hint.outbox,
+                "Task pool keeps a wrong hint for thieves" );
+        const isolation_tag other_isolation = reinterpret_cast<isolation_tag>( &flag );
+        ASSERT( !s->steal_task_from( slot, other_isolation ), "Task of another isolation is stolen" );
+        ASSERT( slot.head == head && slot.tail == head + 1, "Task of another isolation is taken from the pool" );
+        wait_for_all();
+        ASSERT( flag == 1, NULL );
+        return NULL;
+    }
+};
+
+void TestIsolatedSteal() {
+    REMARK( "Testing stealing from another isolation\n" );
+    // No other thread may take the task meanwhile
+    tbb::task_scheduler_init init( 1 );
+    task::spawn_root_and_wait( *new( task::allocate_root() ) IsolatedThiefTask );
+}
+#endif /* __TBB_TASK_ISOLATION */
+
+//! Affinitized tasks go to the task pools as proxies, which the owner and the thieves extract.
+class AffinityBody : NoAssign {
+    Flags& my_flags;
+public:
+    AffinityBody( Flags& flags ) : my_flags(flags) {}
+    void operator()( const tbb::blocked_range<size_t>& r ) const {
+        for( size_t i = r.begin(); i != r.end(); ++i )
+            ASSERT( my_flags[i].fetch_and_increment() == 0, "Iteration is executed twice" );
+    }
+};
+
+void TestAffinity( int p ) {
+    REMARK( "Testing affinity proxies with %d threads\n", p );
+    tbb::task_scheduler_init init( p );
+    tbb::affinity_partitioner ap;
+    Flags flags( 10000 );
+    for( int rep = 0; rep < 20; ++rep ) {
+        flags.reset();
+        tbb::parallel_for( tbb::blocked_range<size_t>( 0, flags.size(), 10 ), AffinityBody( flags ), ap );
+        flags.check();
+    }
+}
+
+#if __TBB_TASK_ISOLATION
+//! Isolated inner loops with affinity inside an outer loop with affinity.
+/** The thieves check the isolation and the mailed proxies at the heads of the task pools,
+    while the owners and other thieves execute and free the tasks. **/
+class IsolatedAffinityBody : NoAssign {
+    Flags& my_flags;
+    tbb::affinity_partitioner* my_inner_partitioners;
+    tbb::atomic<int>& my_inner_count;
+public:
+    static const int inner_size = 64;
+    class InnerBody : NoAssign {
+        tbb::atomic<int>& my_count;
+    public:
+        InnerBody( tbb::atomic<int>& count ) : my_count(count) {}
+        void operator()( const tbb::blocked_range<int>& r ) const {
+            ASSERT( CurrentIsolation() != no_isolation, "Inner iteration is executed outside of the isolated region" );
+            my_count += r.size();
+        }
+    };
+    class Isolated : NoAssign {
+        tbb::affinity_partitioner& my_partitioner;
+        tbb::atomic<int>& my_count;
+    public:
+        Isolated( tbb::affinity_partitioner& ap, tbb::atomic<int>& count ) : my_partitioner(ap), my_count(count) {}
+        void operator()() const {
+            tbb::parallel_for( tbb::blocked_range<int>( 0, inner_size ), InnerBody( my_count ), my_partitioner );
+        }
+    };
+    IsolatedAffinityBody( Flags& flags, tbb::affinity_partitioner* aps, tbb::atomic<int>& count )
+        : my_flags(flags), my_inner_partitioners(aps), my_inner_count(count) {}
+    void operator()( const tbb::blocked_range<size_t>& r ) const {
+        ASSERT( CurrentIsolation() == no_isolation, "Outer iteration is executed inside the isolated region" );
+        for( size_t i = r.begin(); i != r.end(); ++i ) {
+            ASSERT( my_flags[i].fetch_and_increment() == 0, "Outer iteration is executed twice" );
+            tbb::this_task_arena::isolate( Isolated( my_inner_partitioners[i], my_inner_count ) );
+        }
+    }
+};
+
+void TestIsolatedAffinity( int p ) {
+    REMARK( "Testing isolation with affinity proxies with %d threads\n", p );
+    tbb::task_scheduler_init init( p );
+    Flags flags( 500 );
+    tbb::affinity_partitioner outer_partitioner;
+    tbb::affinity_partitioner* inner_partitioners = new tbb::affinity_partitioner[flags.size()];
+    for( int rep = 0; rep < 20; ++rep ) {
+        flags.reset();
+        tbb::atomic<int> inner_count;
+        inner_count = 0;
+        tbb::parallel_for( tbb::blocked_range<size_t>( 0, flags.size() ),
+            IsolatedAffinityBody( flags, inner_partitioners, inner_count ), outer_partitioner );
+        flags.check();
+        ASSERT( inner_count == int(flags.size()) * IsolatedAffinityBody::inner_size, "Inner iteration is lost or executed twice" );
+    }
+    delete[] inner_partitioners;
+}
+#endif /* __TBB_TASK_ISOLATION */
+
+int TestMain () {
+    if( MinThread < 1 )
+        MinThread = 1;
+    for( int p = MinThread; p <= MaxThread; ++p ) {
+        TestSpawnAndSteal( p );
+        TestRecursion( p );
+#if __TBB_TASK_ISOLATION
+        TestIsolation( p );
+#endif
+        TestAffinity( p );
+#if __TBB_TASK_ISOLATION
+        TestIsolatedAffinity( p );
+#endif
+    }
+#if __TBB_TASK_ISOLATION
+    TestIsolatedSteal();
+#endif
+    return Harness::Done;
+}
@@ -0,0 +1,271 @@
+/*
+    Copyright (c) 2005-2019 Intel Corporation
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+
+
+
+*/
+
+// The scheduler is built into the test with lock-free task_stream lanes
+#define __TBB_LOCKFREE_TASK_STREAM 1
+#define HARNESS_DEFINE_PRIVATE_PUBLIC 1
+#include "harness_inject_scheduler.h"
+#include "harness.h"
+
+#include "tbb/task_arena.h"
+#include "tbb/task_scheduler_init.h"
+#include "tbb/tick_count.h"
+#include "tbb/atomic.h"
+
+#include <vector>
+
+using namespace tbb::internal;
+using tbb::task;
+
+const uintptr_t ItemsPerProducer = 20000;
+
+//! Lanes do not dereference the pointers, so items encode the producer and its sequence number.
+inline task* make_item( uintptr_t producer, uintptr_t k ) {
+    return reinterpret_cast<task*>( (producer*ItemsPerProducer + k) * 8 + 8 );
+}
+
+inline uintptr_t item_index( task* t ) {
+    return reinterpret_cast<uintptr_t>(t) / 8 - 1;
+}
+
+//! Checks that every item is popped once, and items of each producer come to a consumer in order.
+class ItemChecker : NoAssign {
+    const int my_num_producers;
+    std::vector<tbb::atomic<char> > my_popped;
+public:
+    tbb::atomic<uintptr_t> num_popped;
+
+    ItemChecker( int num_producers )
+        : my_num_producers(num_producers), my_popped(num_producers*ItemsPerProducer) {
+        for( size_t i = 0; i < my_popped.size(); ++i )
+            my_popped[i] = 0;
+        num_popped = 0;
+    }
+    uintptr_t total() const { return my_num_producers*ItemsPerProducer; }
+    //! last is the per-producer sequence numbers last seen by the calling consumer
+    void check( task* t, std::vector<uintptr_t>& last ) {
+        uintptr_t i = item_index( t );
+        ASSERT( i < total(), "Item that was not pushed is popped" );
+        ASSERT( my_popped[i].fetch_and_increment() == 0, "Item is popped twice" );
+        uintptr_t producer = i / ItemsPerProducer, k = i % ItemsPerProducer;
+        ASSERT( last[producer] == ~uintptr_t(0) || last[producer] < k, "Items of a producer are popped out of order" );
+        last[producer] = k;
+        ++num_popped;
+    }
+};
+
+//! Producers push their items into a single lane, sometimes several at once; consumers pop them.
+class LaneBody : NoAssign {
+    lockfree_lane& my_lane;
+    ItemChecker& my_checker;
+    const int my_num_producers;
+public:
+    LaneBody( lockfree_lane& lane, ItemChecker& checker, int num_producers )
+        : my_lane(lane), my_checker(checker), my_num_producers(num_producers) {}
+    void operator()( int id ) const {
+        if( id < my_num_producers ) {
+            task* items[7];
+            for( uintptr_t k = 0; k < ItemsPerProducer; ) {
+                size_t n = 1 + k % 7;
+                if( n > ItemsPerProducer - k )
+                    n = size_t(ItemsPerProducer - k);
+                for( size_t i = 0; i < n; ++i )
+                    items[i] = make_item( id, k + i );
+                my_lane.push( items, n );
+                k += n;
+            }
+        } else {
+            std::vector<uintptr_t> last( my_num_producers, ~uintptr_t(0) );
+            bool is_empty_after;
+            while( my_checker.num_popped < my_checker.total() ) {
+                if( task* t = my_lane.pop( is_empty_after ) )
+                    my_checker.check( t, last );
+                else
+                    __TBB_Yield();
+            }
+        }
+    }
+};
+
+void TestLane( int num_producers, int num_consumers ) {
+    REMARK( "Testing lock-free lane with %d producers and %d consumers\n", num_producers, num_consumers );
+    lockfree_lane lane;
+    ItemChecker checker( num_producers );
+    NativeParallelFor( num_producers + num_consumers, LaneBody( lane, checker, num_producers ) );
+    ASSERT( checker.num_popped == checker.total(), NULL );
+    bool is_empty_after = false;
+    ASSERT( !lane.pop( is_empty_after ) && is_empty_after && lane.empty(), "Lane is not empty" );
+}
+
+//! Number of segments left by consumers and not freed yet. Called by the only consumer.
+intptr_t RetiredSegments( lockfree_lane& lane ) {
+    intptr_t queued = 0;
+    for( lockfree_segment* s = lane.my_head; s; s = s->next )
+        ++queued;
+    return lane.my_segment_count - queued;
+}
+
+//! Producers push without a break, so the lane is never idle; the consumer checks the retired segments.
+class ReclamationBody : NoAssign {
+    lockfree_lane& my_lane;
+    tbb::atomic<uintptr_t>& my_pushed;
+    tbb::atomic<uintptr_t>& my_popped;
+    tbb::atomic<intptr_t>& my_max_retired;
+public:
+    static const uintptr_t num_segments = 2000;
+
+    ReclamationBody( lockfree_lane& lane, tbb::atomic<uintptr_t>& pushed, tbb::atomic<uintptr_t>& popped,
+                     tbb::atomic<intptr_t>& max_retired )
+        : my_lane(lane), my_pushed(pushed), my_popped(popped), my_max_retired(max_retired) {}
+    void operator()( int id ) const {
+        const uintptr_t total = num_segments * lockfree_segment::size;
+        if( id ) {
+            // Producers stay a few segments ahead of the consumer
+            const uintptr_t max_queued = 16 * lockfree_segment::size;
+            for( uintptr_t k = 0; my_popped < total; ++k ) {
+                task* t = make_item( 0, k % ItemsPerProducer );
+                my_lane.push( &t, 1 );
+                ++my_pushed;
+                while( my_pushed - my_popped > max_queued && my_popped < total )
+                    __TBB_Yield();
+            }
+        } else {
+            bool is_empty_after;
+            while( my_popped < total ) {
+                if( my_lane.pop( is_empty_after ) ) {
+                    if( ++my_popped % lockfree_segment::size == 0 ) {
+                        const intptr_t retired = RetiredSegments( my_lane );
+                        if( retired > my_max_retired )
+                            my_max_retired = retired;
+                    }
+                } else
+                    __TBB_Yield();
+            }
+        }
+    }
+};
+
+void TestLaneReclamation( int num_producers ) {
+    REMARK( "Testing reclamation of lock-free lane segments with %d producers\n", num_producers );
+    lockfree_lane lane;
+    tbb::atomic<uintptr_t> pushed, popped;
+    pushed = popped = 0;
+    tbb::atomic<intptr_t> max_retired;
+    max_retired = 0;
+    NativeParallelFor( num_producers + 1, ReclamationBody( lane, pushed, popped, max_retired ) );
+    REMARK( "At most %d retired segments\n", int(max_retired) );
+    // The epoch-based reclamation defers freeing, but does not let the retired segments pile up
+    ASSERT( max_retired < intptr_t(ReclamationBody::num_segments/2),
+            "Segments left by consumers are not freed while producers are active" );
+}
+
+//! Same as LaneBody but for the whole task_stream, which also tracks non-empty lanes.
+class StreamBody : NoAssign {
+    task_stream<1>& my_stream;
+    ItemChecker& my_checker;
+    const int my_num_producers;
+public:
+    StreamBody( task_stream<1>& stream, ItemChecker& checker, int num_producers )
+        : my_stream(stream), my_checker(checker), my_num_producers(num_producers) {}
+    void operator()( int id ) const {
+        FastRandom random( uint32_t(id+1) );
+        if( id < my_num_producers ) {
+            for( uintptr_t k = 0; k < ItemsPerProducer; ++k )
+                my_stream.push( make_item( id, k ), 0, random );
+        } else {
+            // Items of a producer go to different lanes, so only uniqueness is checked
+            std::vector<uintptr_t> last( my_num_producers, ~uintptr_t(0) );
+            unsigned lane = random.get();
+            while( my_checker.num_popped < my_checker.total() ) {
+                if( task* t = my_stream.pop( 0, lane ) ) {
+                    last[item_index( t ) / ItemsPerProducer] = ~uintptr_t(0);
+                    my_checker.check( t, last );
+                } else
+                    __TBB_Yield();
+            }
+        }
+    }
+};
+
+void TestStream( int num_producers, int num_consumers ) {
+    REMARK( "Testing task_stream with %d producers and %d consumers\n", num_producers, num_consumers );
+    task_stream<1> stream;
+    stream.initialize( num_consumers );
+    ItemChecker checker( num_producers );
+    // Consumers spin until they pop everything, so a non-empty lane with the population bit cleared hangs the test
+    NativeParallelFor( num_producers + num_consumers, StreamBody( stream, checker, num_producers ) );
+    ASSERT( checker.num_popped == checker.total(), NULL );
+    ASSERT( stream.empty( 0 ), "Population bits are set for empty lanes" );
+}
+
+class CountingFunctor : NoAssign {
+    tbb::atomic<uintptr_t>& my_counter;
+public:
+    CountingFunctor( tbb::atomic<uintptr_t>& counter ) : my_counter(counter) {}
+    void operator()() const { ++my_counter; }
+};
+
+//! External threads enqueue tasks into one arena, as e.g. I/O threads that hand over the work do.
+class ExternalProducer : NoAssign {
+    tbb::task_arena& my_arena;
+    tbb::atomic<uintptr_t>& my_counter;
+    const uintptr_t my_num_tasks;
+public:
+    ExternalProducer( tbb::task_arena& a, tbb::atomic<uintptr_t>& counter, uintptr_t num_tasks )
+        : my_arena(a), my_counter(counter), my_num_tasks(num_tasks) {}
+    void operator()( int ) const {
+        for( uintptr_t k = 0; k < my_num_tasks; ++k )
+            my_arena.enqueue( CountingFunctor( my_counter ) );
+    }
+};
+
+void TestExternalProducers( int num_producers, int concurrency ) {
+    const uintptr_t tasks_per_producer = 10000;
+    tbb::task_scheduler_init init( concurrency );
+    tbb::task_arena a( concurrency );
+    a.initialize();
+    tbb::atomic<uintptr_t> counter;
+    counter = 0;
+    tbb::tick_count t0 = tbb::tick_count::now();
+    NativeParallelFor( num_producers, ExternalProducer( a, counter, tasks_per_producer ) );
+    const uintptr_t total = num_producers * tasks_per_producer;
+    while( counter < total )
+        __TBB_Yield();
+    double time = (tbb::tick_count::now() - t0).seconds();
+    REMARK( "%d external producers, arena of %d threads: %.1f ns per task\n",
+            num_producers, concurrency, time / total * 1e9 );
+}
+
+int TestMain () {
+    if( MinThread < 1 )
+        MinThread = 1;
+    for( int p = MinThread; p <= MaxThread; ++p ) {
+        TestLane( p, 1 );
+        TestLane( p, p );
+        TestStream( p, 1 );
+        TestStream( p, p );
+        TestLaneReclamation( p );
+    }
+    // Workers execute the tasks, so at least one is needed
+    const int concurrency = MaxThread < 2 ? 2 : MaxThread;
+    TestExternalProducers( 1, concurrency );
+    TestExternalProducers( 4*concurrency, concurrency );
+    return Harness::Done;
+}